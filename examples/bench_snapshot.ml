@@ -0,0 +1,66 @@
+(* Measures the time to save and restore the state of 10k bodies
+   with dSnapshotSave / dSnapshotRestore.
+
+   make bench_snapshot
+*)
+
+open Ode.LowLevel
+
+let n_bodies = 10_000
+let n_joints = 2_000
+let n_iter = 100
+
+let time f =
+  let t0 = Unix.gettimeofday () in
+  for _ = 1 to n_iter do f () done;
+  (Unix.gettimeofday () -. t0) /. float n_iter
+
+let () =
+  dInitODE ();
+  let wrl = dWorldCreate () in
+  dWorldSetGravity wrl 0. 0. (-9.81);
+  dWorldSetAutoDisableFlag wrl ~do_auto_disable:true;
+
+  let m = dMassCreate () in
+  dMassSetBox m 1.0 0.5 0.5 0.5;
+  let bodies =
+    Array.init n_bodies (fun i ->
+      let b = dBodyCreate wrl in
+      dBodySetMass b m;
+      dBodySetPosition b (float (i mod 100)) (float (i / 100)) 1.0;
+      dBodySetLinearVel b 0. 0. (float (i mod 7));
+      b)
+  in
+  let joints =
+    Array.init n_joints (fun i ->
+      let j = dJointCreateHinge wrl None in
+      dJointAttach j (Some bodies.(2*i)) (Some bodies.(2*i+1));
+      dJointSetHingeAnchor j (float (2*i mod 100) +. 0.5) (float (2*i / 100)) 1.0;
+      dJointSetHingeAxis j 0. 1. 0.;
+      dJointSetHingeParam j DParamLoStop (-0.5);
+      dJointSetHingeParam j DParamHiStop 0.5;
+      j)
+  in
+
+  let set = dSnapshotSetCreate wrl ~bodies ~joints in
+  let size = dSnapshotSize set in
+  let buf = Bigarray.Array1.create Bigarray.int8_unsigned Bigarray.c_layout size in
+
+  dSnapshotSave set buf;
+  for _ = 1 to 10 do dWorldQuickStep wrl 0.01 done;
+  let p_stepped = dBodyGetPosition bodies.(123) in
+  dSnapshotRestore set buf;
+  let p_restored = dBodyGetPosition bodies.(123) in
+
+  let t_save = time (fun () -> dSnapshotSave set buf) in
+  let t_restore = time (fun () -> dSnapshotRestore set buf) in
+
+  Printf.printf "%d bodies, %d joints, snapshot of %d bytes\n" n_bodies n_joints size;
+  Printf.printf "save:    %8.3f ms\n" (t_save *. 1000.);
+  Printf.printf "restore: %8.3f ms\n" (t_restore *. 1000.);
+  Printf.printf "body 123: z = %g after 10 steps, z = %g restored\n%!" p_stepped.z p_restored.z;
+
+  dSnapshotSetDestroy set;
+  dWorldDestroy wrl;
+  dCloseODE ();
+;;
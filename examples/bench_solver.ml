@@ -0,0 +1,195 @@
+(* Runs a scene without display over a grid of quick step parameters
+   (iterations, over-relaxation, ERP, CFM, contact surface layer), and
+   prints for each configuration the mean step time, the drift, the
+   deepest contact penetration and the change of mechanical energy.
+
+   make bench_solver
+   ./bench_solver [boxstack|chain] [steps]
+
+   boxstack: a tower of boxes on a plane, the drift is the horizontal
+             distance travelled by the top box.
+   chain:    a chain of boxes linked by ball joints, released horizontally,
+             the drift is the largest distance between the two anchors of
+             a joint.
+   The energy is the kinetic and potential energy of the bodies, its change
+   is relative to the energy of the first step.
+*)
+
+open Ode.LowLevel
+
+let gravity = 9.81
+let dt = 1.0 /. 60.0
+let side = 0.5
+let box_mass = 1.0
+
+let iterations = [10; 20; 40]
+let overrelaxations = [1.0; 1.3]
+let erps = [0.2; 0.8]
+let cfms = [1e-5; 1e-3]
+let layers = [0.0; 0.001]
+
+type scene = {
+  world : dWorldID;
+  space : dSpaceID;
+  bodies : dBodyID array;
+  joints : dJointID array;
+  destroy : unit -> unit;
+}
+
+let box_body world space x y z =
+  let b = dBodyCreate world in
+  let m = dMassCreate () in
+  dMassSetBox m 1.0 side side side;
+  dMassAdjust m box_mass;
+  dBodySetMass b m;
+  dBodySetPosition b x y z;
+  let g = dCreateBox (Some space) side side side in
+  dGeomSetBody g (Some b);
+  (b, g)
+
+let make_boxstack world space =
+  let ground = dCreatePlane (Some space) 0. 0. 1. 0. in
+  let boxes = Array.init 12 (fun i ->
+      box_body world space 0. 0. (side *. (float i +. 0.5))) in
+  let bodies = Array.map fst boxes in
+  let destroy () =
+    Array.iter (fun (_, g) -> dGeomDestroy g) boxes;
+    dGeomDestroy ground;
+  in
+  (bodies, [| |], destroy)
+
+let make_chain world space =
+  let n = 20 in
+  let links = Array.init n (fun i ->
+      box_body world space (side *. float i) 0. 10.) in
+  let bodies = Array.map fst links in
+  let joints = Array.init n (fun i ->
+      let j = dJointCreateBall world None in
+      let x = side *. (float i -. 0.5) in
+      if i = 0
+      then dJointAttach j (Some bodies.(0)) None
+      else dJointAttach j (Some bodies.(i-1)) (Some bodies.(i));
+      dJointSetBallAnchor j x 0. 10.;
+      j)
+  in
+  let destroy () =
+    Array.iter dJointDestroy joints;
+    Array.iter (fun (_, g) -> dGeomDestroy g) links;
+  in
+  (bodies, joints, destroy)
+
+let create_scene name =
+  let world = dWorldCreate () in
+  dWorldSetGravity world 0. 0. (-. gravity);
+  let space = dHashSpaceCreate None in
+  let bodies, joints, destroy =
+    match name with
+    | "boxstack" -> make_boxstack world space
+    | "chain" -> make_chain world space
+    | _ -> invalid_arg "scene"
+  in
+  let destroy () =
+    destroy ();
+    dSpaceDestroy space;
+    dWorldDestroy world;
+  in
+  { world; space; bodies; joints; destroy }
+
+(* kinetic and potential energy, the inertia of a box is diagonal in its frame *)
+let energy bodies =
+  let i = box_mass *. side *. side /. 6.0 in
+  Array.fold_left (fun e b ->
+    let v = dBodyGetLinearVel b in
+    let w = dBodyGetAngularVel b in
+    let p = dBodyGetPosition b in
+    let v2 = v.x *. v.x +. v.y *. v.y +. v.z *. v.z in
+    let w2 = w.x *. w.x +. w.y *. w.y +. w.z *. w.z in
+    e +. 0.5 *. box_mass *. v2 +. 0.5 *. i *. w2 +. box_mass *. gravity *. p.z
+  ) 0.0 bodies
+
+let joint_drift joints =
+  Array.fold_left (fun d j ->
+    let a = dJointGetBallAnchor j
+    and b = dJointGetBallAnchor2 j in
+    let dx = a.x -. b.x and dy = a.y -. b.y and dz = a.z -. b.z in
+    max d (sqrt (dx *. dx +. dy *. dy +. dz *. dz))
+  ) 0.0 joints
+
+let run name steps ~iters ~w ~erp ~cfm ~layer =
+  let s = create_scene name in
+  dWorldSetQuickStepNumIterations s.world iters;
+  dWorldSetQuickStepW s.world w;
+  dWorldSetERP s.world erp;
+  dWorldSetCFM s.world cfm;
+  dWorldSetContactSurfaceLayer s.world layer;
+
+  let contact_group = dJointGroupCreate () in
+  let max_depth = ref 0.0 in
+  let surface = { surf_param_zero with sp_mu = 1.0 } in
+  let near o1 o2 =
+    let b1 = dGeomGetBody o1
+    and b2 = dGeomGetBody o2 in
+    match b1, b2 with
+    | Some b1, Some b2 when dAreConnected b1 b2 -> ()
+    | _ ->
+        Array.iter (fun cg ->
+          if cg.cg_depth > !max_depth then max_depth := cg.cg_depth;
+          let c = { c_surface = surface; c_geom = cg;
+                    c_fdir1 = { x=0.; y=0.; z=0.; w=0. } } in
+          let j = dJointCreateContact s.world (Some contact_group) c in
+          dJointAttach j b1 b2;
+        ) (dCollide o1 o2 4)
+  in
+  let top = s.bodies.(Array.length s.bodies - 1) in
+  let p0 = dBodyGetPosition top in
+  let e0 = ref 0.0 in
+  let drift = ref 0.0 in
+  let energy_change = ref 0.0 in
+  let time = ref 0.0 in
+  for i = 1 to steps do
+    let t0 = Unix.gettimeofday () in
+    dSpaceCollide s.space near;
+    dWorldQuickStep s.world dt;
+    dJointGroupEmpty contact_group;
+    time := !time +. (Unix.gettimeofday () -. t0);
+
+    let e = energy s.bodies in
+    if i = 1 then e0 := e
+    else energy_change := max !energy_change (abs_float (e -. !e0) /. max (abs_float !e0) 1e-9);
+    if Array.length s.joints > 0 then
+      drift := max !drift (joint_drift s.joints)
+    else begin
+      let p = dBodyGetPosition top in
+      drift := max !drift (sqrt ((p.x -. p0.x) ** 2.0 +. (p.y -. p0.y) ** 2.0))
+    end;
+  done;
+  dJointGroupDestroy contact_group;
+  s.destroy ();
+  (!time /. float steps, !drift, !max_depth, !energy_change)
+
+let () =
+  let name = if Array.length Sys.argv > 1 then Sys.argv.(1) else "boxstack" in
+  let steps = if Array.length Sys.argv > 2 then int_of_string Sys.argv.(2) else 600 in
+  if name <> "boxstack" && name <> "chain" then begin
+    prerr_endline "usage: bench_solver [boxstack|chain] [steps]";
+    exit 1
+  end;
+  dInitODE ();
+  Printf.printf "scene %s, %d steps of %g s\n" name steps dt;
+  Printf.printf "%5s %4s %4s %7s %7s %10s %10s %10s %10s\n"
+    "iters" "w" "erp" "cfm" "layer" "step (us)" "drift" "depth" "energy";
+  List.iter (fun iters ->
+    List.iter (fun w ->
+      List.iter (fun erp ->
+        List.iter (fun cfm ->
+          List.iter (fun layer ->
+            let t, drift, depth, de = run name steps ~iters ~w ~erp ~cfm ~layer in
+            Printf.printf "%5d %4g %4g %7g %7g %10.1f %10.2e %10.2e %9.1f%%\n%!"
+              iters w erp cfm layer (t *. 1e6) drift depth (de *. 100.0)
+          ) layers
+        ) cfms
+      ) erps
+    ) overrelaxations
+  ) iterations;
+  dCloseODE ();
+;;
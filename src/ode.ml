@@ -195,6 +195,11 @@ module LowLevel = struct
     | JointTypeLMotor
     | JointTypePlane2D
     | JointTypePR
+    | JointTypePU
+    | JointTypePiston
+    | JointTypeDBall
+    | JointTypeDHinge
+    | JointTypeTransmission
 
   type dJointParam =
     | DParamLoStop
@@ -249,6 +254,58 @@ module LowLevel = struct
   external dInitODE2: initFlags:dInitODEFlags list -> unit = "ocamlode_dInitODE2"
 
 
+  (** {3 Arenas} *)
+
+  type dArena
+  (** records the bodies, joints, joint groups, spaces, geoms, trimesh datas
+      and joint feedback buffers created while it is the current arena,
+      to destroy all of them at once *)
+
+  external dArenaCreate : unit -> dArena = "ocamlode_dArenaCreate"
+  external dArenaEnter : dArena -> unit = "ocamlode_dArenaEnter"
+  (** makes the arena current, until [dArenaLeave], arenas can be nested *)
+  external dArenaLeave : dArena -> unit = "ocamlode_dArenaLeave"
+  (** the enclosing arena becomes current again *)
+  external dArenaCount : dArena -> int = "ocamlode_dArenaCount"
+  (** number of objects recorded, and not destroyed yet *)
+  external dArenaDestroy : dArena -> unit = "ocamlode_dArenaDestroy"
+  (** destroys all the objects recorded (joints first, then feedback buffers,
+      joint groups, geoms, spaces, bodies and trimesh datas), their handles
+      are invalidated.  The joints created in a joint group are left to the
+      group.  The objects already destroyed by hand, or by their world or
+      their space, are forgotten by the arena.  A feedback buffer is detached
+      from its joint if the joint is still alive.  A feedback buffer is only
+      recorded if its joint is recorded by an arena or managed, or was created
+      in a joint group while an arena was current. *)
+
+  let dArenaScope arena f =
+    dArenaEnter arena;
+    match f () with
+    | r -> dArenaLeave arena; r
+    | exception e -> dArenaLeave arena; raise e
+  (** [dArenaScope arena f] calls [f] with [arena] as the current arena *)
+
+
+  (** {3 Managed handles} *)
+
+  external dManagedEnable : unit -> unit = "ocamlode_dManagedEnable"
+  (** the handles of the bodies, joints, joint groups, spaces and geoms
+      created from now on outside of any arena are managed: when such a handle
+      is garbage collected its object is queued, and destroyed at the beginning
+      of the next [dWorldStep] or [dWorldQuickStep], or by [dManagedCollect].
+      {b Important:} the handle returned at the creation must stay reachable
+      for the whole lifetime of its object.  The handles returned by functions
+      like [dSpaceGetGeom], [dGeomGetBody], [dBodyGetJoint] or the geoms of
+      the contacts are other unmanaged values, they don't keep the object
+      alive, and a geom still in a space or a body still attached to joints
+      is destroyed as well once its creation handle is collected. *)
+  external dManagedDisable : unit -> unit = "ocamlode_dManagedDisable"
+  external dManagedCollect : unit -> int = "ocamlode_dManagedCollect"
+  (** destroys the queued objects now, returns how many were destroyed *)
+  external dManagedGetStats : unit -> (* live *) int * (* queued *) int
+      = "ocamlode_dManagedGetStats"
+
+
   (** {3 World} *)
 
   external dWorldCreate : unit -> dWorldID = "ocamlode_dWorldCreate"
@@ -272,14 +329,12 @@ module LowLevel = struct
   external dWorldSetAutoDisableAngularThreshold : dWorldID -> angular_threshold:float -> unit
       = "ocamlode_dWorldSetAutoDisableAngularThreshold"
   external dWorldGetAutoDisableAngularThreshold : dWorldID -> float = "ocamlode_dWorldGetAutoDisableAngularThreshold"
-  (*
-  external dWorldSetAutoDisableLinearAverageThreshold : dWorldID -> linear_average_threshold:float -> unit
-      = "ocamlode_dWorldSetAutoDisableLinearAverageThreshold"
-  external dWorldGetAutoDisableLinearAverageThreshold : dWorldID -> float = "ocamlode_dWorldGetAutoDisableLinearAverageThreshold"
-  external dWorldSetAutoDisableAngularAverageThreshold : dWorldID -> angular_average_threshold:float -> unit
-      = "ocamlode_dWorldSetAutoDisableAngularAverageThreshold"
-  external dWorldGetAutoDisableAngularAverageThreshold : dWorldID -> float = "ocamlode_dWorldGetAutoDisableAngularAverageThreshold"
-  *)
+  let dWorldSetAutoDisableLinearAverageThreshold = dWorldSetAutoDisableLinearThreshold
+  let dWorldGetAutoDisableLinearAverageThreshold = dWorldGetAutoDisableLinearThreshold
+  let dWorldSetAutoDisableAngularAverageThreshold = dWorldSetAutoDisableAngularThreshold
+  let dWorldGetAutoDisableAngularAverageThreshold = dWorldGetAutoDisableAngularThreshold
+  (** the same settings as the linear and angular thresholds, ODE compares
+      them to the velocities averaged over [average_samples_count] samples *)
   external dWorldSetAutoDisableAverageSamplesCount : dWorldID -> average_samples_count:int -> unit
       = "ocamlode_dWorldSetAutoDisableAverageSamplesCount"
   external dWorldGetAutoDisableAverageSamplesCount : dWorldID -> int = "ocamlode_dWorldGetAutoDisableAverageSamplesCount"
@@ -294,6 +349,44 @@ module LowLevel = struct
   external dWorldSetContactMaxCorrectingVel : dWorldID -> vel:float -> unit = "ocamlode_dWorldSetContactMaxCorrectingVel"
   external dWorldGetContactMaxCorrectingVel : dWorldID -> float = "ocamlode_dWorldGetContactMaxCorrectingVel"
 
+  external dWorldSetLinearDamping : dWorldID -> scale:float -> unit = "ocamlode_dWorldSetLinearDamping"
+  external dWorldGetLinearDamping : dWorldID -> float = "ocamlode_dWorldGetLinearDamping"
+  external dWorldSetAngularDamping : dWorldID -> scale:float -> unit = "ocamlode_dWorldSetAngularDamping"
+  external dWorldGetAngularDamping : dWorldID -> float = "ocamlode_dWorldGetAngularDamping"
+  external dWorldSetDamping : dWorldID -> linear_scale:float -> angular_scale:float -> unit = "ocamlode_dWorldSetDamping"
+  (** default damping of the new bodies, the velocities are multiplied by
+      (1 - scale) at each step, 0.0 disables the damping *)
+  external dWorldSetLinearDampingThreshold : dWorldID -> threshold:float -> unit = "ocamlode_dWorldSetLinearDampingThreshold"
+  external dWorldGetLinearDampingThreshold : dWorldID -> float = "ocamlode_dWorldGetLinearDampingThreshold"
+  external dWorldSetAngularDampingThreshold : dWorldID -> threshold:float -> unit = "ocamlode_dWorldSetAngularDampingThreshold"
+  external dWorldGetAngularDampingThreshold : dWorldID -> float = "ocamlode_dWorldGetAngularDampingThreshold"
+  (** the velocities under these thresholds are not damped *)
+  external dWorldSetMaxAngularSpeed : dWorldID -> max_speed:float -> unit = "ocamlode_dWorldSetMaxAngularSpeed"
+  external dWorldGetMaxAngularSpeed : dWorldID -> float = "ocamlode_dWorldGetMaxAngularSpeed"
+  (** default maximum angular speed of the new bodies, [infinity] by default *)
+
+  external dWorldSetStepMemoryReservationPolicy : dWorldID -> reserve_factor:float -> reserve_minimum:int -> unit
+      = "ocamlode_dWorldSetStepMemoryReservationPolicy"
+  (** the working memory is reserved as [reserve_factor] times the size needed
+      (at least 1.0), and at least [reserve_minimum] bytes are reserved *)
+  external dWorldSetDefaultStepMemoryReservationPolicy : dWorldID -> unit
+      = "ocamlode_dWorldSetDefaultStepMemoryReservationPolicy"
+  (** restores the default policy (reserve factor 1.2, reserve minimum 65536) *)
+
+  type step_memory_manager =
+    | Step_memory_default  (** ODE's allocation handlers *)
+    | Step_memory_malloc   (** the C library malloc / realloc / free *)
+
+  external dWorldSetStepMemoryManager : dWorldID -> step_memory_manager -> unit
+      = "ocamlode_dWorldSetStepMemoryManager"
+  external dWorldUseSharedWorkingMemory : dWorldID -> from_world:dWorldID option -> bool
+      = "ocamlode_dWorldUseSharedWorkingMemory"
+  (** shares the working memory of [from_world], or stops sharing it with [None].
+      The worlds sharing their memory must not be stepped at the same time.
+      Returns false on failure. *)
+  external dWorldCleanupWorkingMemory : dWorldID -> unit = "ocamlode_dWorldCleanupWorkingMemory"
+  (** releases the working memory of an idle world, it is reallocated at the next step *)
+
 
   (** {3 Bodies} *)
 
@@ -369,6 +462,49 @@ module LowLevel = struct
       = "ocamlode_dBodySetAutoDisableAverageSamplesCount"
   external dBodyGetAutoDisableAverageSamplesCount: dBodyID -> int = "ocamlode_dBodyGetAutoDisableAverageSamplesCount"
 
+  external dBodySetKinematic : dBodyID -> unit = "ocamlode_dBodySetKinematic"
+  (** a kinematic body moves at its velocities, whatever the forces and the
+      joints, it pushes the dynamic bodies as if its mass was infinite *)
+  external dBodySetDynamic : dBodyID -> unit = "ocamlode_dBodySetDynamic"
+  (** a dynamic body again, with the mass it had *)
+  external dBodyIsKinematic : dBodyID -> bool = "ocamlode_dBodyIsKinematic"
+
+  external dBodySetLinearDamping : dBodyID -> scale:float -> unit = "ocamlode_dBodySetLinearDamping"
+  external dBodyGetLinearDamping : dBodyID -> float = "ocamlode_dBodyGetLinearDamping"
+  external dBodySetAngularDamping : dBodyID -> scale:float -> unit = "ocamlode_dBodySetAngularDamping"
+  external dBodyGetAngularDamping : dBodyID -> float = "ocamlode_dBodyGetAngularDamping"
+  external dBodySetDamping : dBodyID -> linear_scale:float -> angular_scale:float -> unit = "ocamlode_dBodySetDamping"
+  external dBodySetLinearDampingThreshold : dBodyID -> threshold:float -> unit = "ocamlode_dBodySetLinearDampingThreshold"
+  external dBodyGetLinearDampingThreshold : dBodyID -> float = "ocamlode_dBodyGetLinearDampingThreshold"
+  external dBodySetAngularDampingThreshold : dBodyID -> threshold:float -> unit = "ocamlode_dBodySetAngularDampingThreshold"
+  external dBodyGetAngularDampingThreshold : dBodyID -> float = "ocamlode_dBodyGetAngularDampingThreshold"
+  external dBodySetDampingDefaults : dBodyID -> unit = "ocamlode_dBodySetDampingDefaults"
+  (** restores the damping parameters of the world *)
+  external dBodySetMaxAngularSpeed : dBodyID -> max_speed:float -> unit = "ocamlode_dBodySetMaxAngularSpeed"
+  external dBodyGetMaxAngularSpeed : dBodyID -> float = "ocamlode_dBodyGetMaxAngularSpeed"
+  external dBodySetGyroscopicMode : dBodyID -> enabled:bool -> unit = "ocamlode_dBodySetGyroscopicMode"
+  external dBodyGetGyroscopicMode : dBodyID -> bool = "ocamlode_dBodyGetGyroscopicMode"
+  (** the gyroscopic term is enabled by default, disabling it can be more
+      stable for the long thin bodies *)
+
+  type body_dynamics = {
+    bd_kinematic : bool;
+    bd_linear_damping : float;
+    bd_angular_damping : float;
+    bd_linear_damping_threshold : float;
+    bd_angular_damping_threshold : float;
+    bd_max_angular_speed : float;
+    bd_gyroscopic : bool;
+  }
+
+  external dBodyGetDynamics : dBodyID -> body_dynamics = "ocamlode_dBodyGetDynamics"
+  external dBodySetDynamics : dBodyID -> body_dynamics -> unit = "ocamlode_dBodySetDynamics"
+  external dBodiesSetDynamics : dBodyID array -> body_dynamics -> unit = "ocamlode_dBodiesSetDynamics"
+  (** sets all these parameters of many bodies in one call *)
+  external dBodiesSetKinematic : dBodyID array -> kinematic:bool -> unit = "ocamlode_dBodiesSetKinematic"
+  external dBodiesSetDamping : dBodyID array -> linear_scale:float -> angular_scale:float -> unit
+      = "ocamlode_dBodiesSetDamping"
+
   external dBodySetData : dBodyID -> int -> unit = "ocamlode_dBodySetData"
   external dBodyGetData : dBodyID -> int = "ocamlode_dBodyGetData"
   (** you can use these functions for example to associate user data to a body: {[
@@ -397,6 +533,12 @@ module LowLevel = struct
   external dJointCreateAMotor : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreateAMotor"
   external dJointCreateLMotor : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreateLMotor"
   external dJointCreatePlane2D : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreatePlane2D"
+  external dJointCreatePR : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreatePR"
+  external dJointCreatePU : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreatePU"
+  external dJointCreatePiston : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreatePiston"
+  external dJointCreateDBall : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreateDBall"
+  external dJointCreateDHinge : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreateDHinge"
+  external dJointCreateTransmission : dWorldID -> dJointGroupID option -> dJointID = "ocamlode_dJointCreateTransmission"
 
   external dJointDestroy : dJointID -> unit = "ocamlode_dJointDestroy"
 
@@ -482,6 +624,97 @@ module LowLevel = struct
   external dJointGetUniversalAxis1 : dJointID -> dVector3 = "ocamlode_dJointGetUniversalAxis1"
   external dJointGetUniversalAxis2 : dJointID -> dVector3 = "ocamlode_dJointGetUniversalAxis2"
 
+  external dJointSetPUAnchor : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetPUAnchor"
+  external dJointSetPUAxis1 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetPUAxis1"
+  external dJointSetPUAxis2 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetPUAxis2"
+  external dJointSetPUAxis3 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetPUAxis3"
+  external dJointGetPUAnchor : dJointID -> dVector3 = "ocamlode_dJointGetPUAnchor"
+  external dJointGetPUAxis1 : dJointID -> dVector3 = "ocamlode_dJointGetPUAxis1"
+  external dJointGetPUAxis2 : dJointID -> dVector3 = "ocamlode_dJointGetPUAxis2"
+  external dJointGetPUAxis3 : dJointID -> dVector3 = "ocamlode_dJointGetPUAxis3"
+  external dJointGetPUPosition : dJointID -> float = "ocamlode_dJointGetPUPosition"
+  external dJointGetPUPositionRate : dJointID -> float = "ocamlode_dJointGetPUPositionRate"
+  external dJointGetPUAngle1 : dJointID -> float = "ocamlode_dJointGetPUAngle1"
+  external dJointGetPUAngle1Rate : dJointID -> float = "ocamlode_dJointGetPUAngle1Rate"
+  external dJointGetPUAngle2 : dJointID -> float = "ocamlode_dJointGetPUAngle2"
+  external dJointGetPUAngle2Rate : dJointID -> float = "ocamlode_dJointGetPUAngle2Rate"
+  external dJointSetPUParam : dJointID -> dJointParam -> float -> unit = "ocamlode_dJointSetPUParam"
+  external dJointGetPUParam : dJointID -> dJointParam -> float = "ocamlode_dJointGetPUParam"
+  (** the [DParam*] and [DParam*2] parameters are for the rotations around the axes
+      1 and 2, the [DParam*3] ones for the translation along the axis 3 *)
+
+  external dJointSetPistonAnchor : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetPistonAnchor"
+  external dJointSetPistonAxis : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetPistonAxis"
+  external dJointGetPistonAnchor : dJointID -> dVector3 = "ocamlode_dJointGetPistonAnchor"
+  external dJointGetPistonAnchor2 : dJointID -> dVector3 = "ocamlode_dJointGetPistonAnchor2"
+  external dJointGetPistonAxis : dJointID -> dVector3 = "ocamlode_dJointGetPistonAxis"
+  external dJointGetPistonPosition : dJointID -> float = "ocamlode_dJointGetPistonPosition"
+  external dJointGetPistonPositionRate : dJointID -> float = "ocamlode_dJointGetPistonPositionRate"
+  external dJointGetPistonAngle : dJointID -> float = "ocamlode_dJointGetPistonAngle"
+  external dJointGetPistonAngleRate : dJointID -> float = "ocamlode_dJointGetPistonAngleRate"
+  external dJointSetPistonParam : dJointID -> dJointParam -> float -> unit = "ocamlode_dJointSetPistonParam"
+  external dJointGetPistonParam : dJointID -> dJointParam -> float = "ocamlode_dJointGetPistonParam"
+  (** the [DParam*] parameters are for the translation, the [DParam*2] ones for the rotation *)
+  external dJointAddPistonForce : dJointID -> force:float -> unit = "ocamlode_dJointAddPistonForce"
+
+  external dJointSetDBallAnchor1 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetDBallAnchor1"
+  external dJointSetDBallAnchor2 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetDBallAnchor2"
+  external dJointGetDBallAnchor1 : dJointID -> dVector3 = "ocamlode_dJointGetDBallAnchor1"
+  external dJointGetDBallAnchor2 : dJointID -> dVector3 = "ocamlode_dJointGetDBallAnchor2"
+  external dJointGetDBallDistance : dJointID -> float = "ocamlode_dJointGetDBallDistance"
+  external dJointSetDBallDistance : dJointID -> distance:float -> unit = "ocamlode_dJointSetDBallDistance"
+  external dJointSetDBallParam : dJointID -> dJointParam -> float -> unit = "ocamlode_dJointSetDBallParam"
+  external dJointGetDBallParam : dJointID -> dJointParam -> float = "ocamlode_dJointGetDBallParam"
+  (** keeps the anchors at the distance they have when they are set *)
+
+  external dJointSetDHingeAxis : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetDHingeAxis"
+  external dJointSetDHingeAnchor1 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetDHingeAnchor1"
+  external dJointSetDHingeAnchor2 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetDHingeAnchor2"
+  external dJointGetDHingeAxis : dJointID -> dVector3 = "ocamlode_dJointGetDHingeAxis"
+  external dJointGetDHingeAnchor1 : dJointID -> dVector3 = "ocamlode_dJointGetDHingeAnchor1"
+  external dJointGetDHingeAnchor2 : dJointID -> dVector3 = "ocamlode_dJointGetDHingeAnchor2"
+  external dJointGetDHingeDistance : dJointID -> float = "ocamlode_dJointGetDHingeDistance"
+  external dJointSetDHingeParam : dJointID -> dJointParam -> float -> unit = "ocamlode_dJointSetDHingeParam"
+  external dJointGetDHingeParam : dJointID -> dJointParam -> float = "ocamlode_dJointGetDHingeParam"
+  (** a double ball joint whose two bodies also keep their rotation around the axis *)
+
+  type transmission_mode =
+    | Transmission_parallel_axes
+    | Transmission_intersecting_axes
+    | Transmission_chain_drive
+
+  external dJointSetTransmissionMode : dJointID -> transmission_mode -> unit = "ocamlode_dJointSetTransmissionMode"
+  external dJointGetTransmissionMode : dJointID -> transmission_mode = "ocamlode_dJointGetTransmissionMode"
+  external dJointSetTransmissionAxis : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetTransmissionAxis"
+  external dJointGetTransmissionAxis : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionAxis"
+  (** the axis of both wheels, for the parallel axes and chain drive modes *)
+  external dJointSetTransmissionAxis1 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetTransmissionAxis1"
+  external dJointGetTransmissionAxis1 : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionAxis1"
+  external dJointSetTransmissionAxis2 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetTransmissionAxis2"
+  external dJointGetTransmissionAxis2 : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionAxis2"
+  external dJointSetTransmissionAnchor1 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetTransmissionAnchor1"
+  external dJointGetTransmissionAnchor1 : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionAnchor1"
+  external dJointSetTransmissionAnchor2 : dJointID -> x:float -> y:float -> z:float -> unit = "ocamlode_dJointSetTransmissionAnchor2"
+  external dJointGetTransmissionAnchor2 : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionAnchor2"
+  external dJointGetTransmissionContactPoint1 : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionContactPoint1"
+  external dJointGetTransmissionContactPoint2 : dJointID -> dVector3 = "ocamlode_dJointGetTransmissionContactPoint2"
+  external dJointSetTransmissionRatio : dJointID -> ratio:float -> unit = "ocamlode_dJointSetTransmissionRatio"
+  external dJointGetTransmissionRatio : dJointID -> float = "ocamlode_dJointGetTransmissionRatio"
+  (** ratio of the angular speeds, the radiuses are computed from the anchors
+      and the contact points for the gear modes *)
+  external dJointSetTransmissionRadius1 : dJointID -> radius:float -> unit = "ocamlode_dJointSetTransmissionRadius1"
+  external dJointGetTransmissionRadius1 : dJointID -> float = "ocamlode_dJointGetTransmissionRadius1"
+  external dJointSetTransmissionRadius2 : dJointID -> radius:float -> unit = "ocamlode_dJointSetTransmissionRadius2"
+  external dJointGetTransmissionRadius2 : dJointID -> float = "ocamlode_dJointGetTransmissionRadius2"
+  (** the radiuses of the sprockets of a chain drive *)
+  external dJointSetTransmissionBacklash : dJointID -> backlash:float -> unit = "ocamlode_dJointSetTransmissionBacklash"
+  external dJointGetTransmissionBacklash : dJointID -> float = "ocamlode_dJointGetTransmissionBacklash"
+  external dJointGetTransmissionAngle1 : dJointID -> float = "ocamlode_dJointGetTransmissionAngle1"
+  external dJointGetTransmissionAngle2 : dJointID -> float = "ocamlode_dJointGetTransmissionAngle2"
+  external dJointSetTransmissionParam : dJointID -> dJointParam -> float -> unit = "ocamlode_dJointSetTransmissionParam"
+  external dJointGetTransmissionParam : dJointID -> dJointParam -> float = "ocamlode_dJointGetTransmissionParam"
+  (** only [DParamERP] and [DParamCFM] *)
+
   external dBodyGetNumJoints : dBodyID -> int = "ocamlode_dBodyGetNumJoints"
   external dBodyGetJoint : dBodyID -> index:int -> dJointID = "ocamlode_dBodyGetJoint"
   external dConnectingJoint : dBodyID -> dBodyID -> dJointID = "ocamlode_dConnectingJoint"
@@ -510,6 +743,208 @@ module LowLevel = struct
   external dJointGetFeedback : dJointID -> dJointFeedback = "ocamlode_dJointGetFeedback"
   external dJointFeedback_of_buffer : dJointFeedbackBuffer -> dJointFeedback = "ocamlode_dJointFeedback_of_buffer"
 
+  type dJointFeedbackArena
+  external dJointFeedbackArenaCreate : dJointID array -> dJointFeedbackArena = "ocamlode_dJointFeedbackArenaCreate"
+  (** sets the feedback of all these joints into a single contiguous buffer *)
+  external dJointFeedbackArenaSize : dJointFeedbackArena -> int = "ocamlode_dJointFeedbackArenaSize"
+  external dJointFeedbackArenaRead : dJointFeedbackArena ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t -> unit
+      = "ocamlode_dJointFeedbackArenaRead"
+  (** reads the feedbacks into a bigarray of dimensions [[n; 12]], the line [i]
+      contains f1, t1, f2, t2 (x, y, z) of the joint [i] of the arena *)
+  external dJointFeedbackArenaDestroy : dJointFeedbackArena -> unit
+      = "ocamlode_dJointFeedbackArenaDestroy"
+  (** frees the arena, the feedback of the joints still alive is reset.
+      A joint is known to be dead when it was destroyed with [dJointDestroy],
+      by an arena, with its world while attached to a body, or with its
+      group when created while an arena was current.  A joint of a group
+      created outside of any arena should not be in the arena when its group
+      is emptied. *)
+
+
+  (** {3 Snapshots} *)
+
+  type dSnapshotSet
+  type snapshot_buffer = (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+  external dSnapshotSetCreate : dWorldID -> bodies:dBodyID array -> joints:dJointID array -> dSnapshotSet
+      = "ocamlode_dSnapshotSetCreate"
+  (** the bodies and joints whose state is saved by [dSnapshotSave]: the world
+      parameters (with its damping), position, orientation, velocities, accumulated forces, enabled
+      and auto-disable state, kinematic and gyroscopic modes, damping and max
+      angular speed of the bodies, attached bodies, enabled state and
+      limit/motor parameters of the joints.
+      The contact joints don't need to be in the set, they are created again
+      by the collision of the next step. *)
+  external dSnapshotSetDestroy : dSnapshotSet -> unit = "ocamlode_dSnapshotSetDestroy"
+  external dSnapshotSize : dSnapshotSet -> int = "ocamlode_dSnapshotSize"
+  (** size in bytes of the buffers for this set *)
+  external dSnapshotBodyCount : dSnapshotSet -> int = "ocamlode_dSnapshotBodyCount"
+  external dSnapshotSave : dSnapshotSet -> snapshot_buffer -> unit = "ocamlode_dSnapshotSave"
+  external dSnapshotRestore : dSnapshotSet -> snapshot_buffer -> unit = "ocamlode_dSnapshotRestore"
+  (** restores a state saved by [dSnapshotSave] with the same set, in the same
+      process (the buffer contains the addresses of the bodies).
+      The auto-disable counters of ODE are not accessible, they are restarted. *)
+
+  external dSnapshotHash : dSnapshotSet -> int64 = "ocamlode_dSnapshotHash"
+  (** hash of the positions, rotations and velocities of the bodies, and of
+      the angles and rates of the joints of the set, to call after each step.
+      Runs in lockstep have the same hashes as long as they are bit exact. *)
+
+  type body_hashes = (int64, Bigarray.int64_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+  external dSnapshotHashBodies : dSnapshotSet -> body_hashes -> int64 = "ocamlode_dSnapshotHashBodies"
+  (** same as [dSnapshotHash], and writes the hash of each body of the set *)
+
+  (** {4 Replays} *)
+
+  type 'a replay_log = {
+    rl_inputs : 'a array;
+    rl_hashes : int64 array;
+    rl_body_hashes : (int64, Bigarray.int64_elt, Bigarray.c_layout) Bigarray.Array2.t;
+  }
+  (** the inputs of each step, and the hashes after it *)
+
+  type replay_divergence = {
+    rd_step : int;
+    rd_body : int;  (** index of the first body which differs in the set, -1 if only the joints differ *)
+  }
+
+  let dReplayRecord set ~steps ~input ~apply ~step =
+    let n = dSnapshotBodyCount set in
+    let body_hashes =
+      Bigarray.Array2.create Bigarray.int64 Bigarray.c_layout steps n in
+    let hashes = Array.make steps 0L in
+    let inputs =
+      Array.init steps (fun i ->
+        let x = input i in
+        apply x;
+        step ();
+        hashes.(i) <- dSnapshotHashBodies set (Bigarray.Array2.slice_left body_hashes i);
+        x)
+    in
+    { rl_inputs = inputs; rl_hashes = hashes; rl_body_hashes = body_hashes }
+  (** runs [steps] steps, calling [apply (input i)] then [step ()] for each one,
+      and records the inputs and the hashes of the set *)
+
+  let dReplayCheck set log ~apply ~step =
+    let n = dSnapshotBodyCount set in
+    let body_hashes = Bigarray.Array1.create Bigarray.int64 Bigarray.c_layout n in
+    let rec run i =
+      if i >= Array.length log.rl_inputs then None else begin
+        apply log.rl_inputs.(i);
+        step ();
+        if dSnapshotHashBodies set body_hashes = log.rl_hashes.(i)
+        then run (i + 1)
+        else begin
+          let rec first_body k =
+            if k >= n then -1 else
+            if body_hashes.{k} <> log.rl_body_hashes.{i, k} then k
+            else first_body (k + 1)
+          in
+          Some { rd_step = i; rd_body = first_body 0 }
+        end
+      end
+    in
+    run 0
+  (** replays the inputs of the log from the same initial state (restored for
+      example with [dSnapshotRestore]), and returns the first step whose hash
+      differs from the recorded one *)
+
+
+  (** {3 Sleep trackers} *)
+
+  type dSleepTracker
+  type body_indexes = (int32, Bigarray.int32_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+  external dSleepTrackerCreate : bodies:dBodyID array -> dSleepTracker = "ocamlode_dSleepTrackerCreate"
+  (** remembers the enabled state of the bodies.
+      The tracker keeps the bodies, it should be destroyed before them. *)
+  external dSleepTrackerDestroy : dSleepTracker -> unit = "ocamlode_dSleepTrackerDestroy"
+  external dSleepTrackerBodyCount : dSleepTracker -> int = "ocamlode_dSleepTrackerBodyCount"
+  external dSleepTrackerChanged : dSleepTracker -> body_indexes -> int = "ocamlode_dSleepTrackerChanged"
+  (** writes the indexes in the [bodies] array of the bodies which were
+      disabled or enabled since the last call, and returns their number.
+      The bigarray needs one element per body. *)
+  external dSleepTrackerIsEnabled : dSleepTracker -> int -> bool = "ocamlode_dSleepTrackerIsEnabled"
+  (** enabled state of the body of this index at the last [dSleepTrackerChanged] *)
+
+  (** {3 Render interpolation} *)
+
+  type dInterpolator
+
+  external dInterpolatorCreate : dWorldID -> bodies:dBodyID array -> dInterpolator = "ocamlode_dInterpolatorCreate"
+  (** after each [dWorldStep] or [dWorldQuickStep] of the world, and once at
+      the end of each [dWorldSubstep] or [dWorldAdaptiveStep] (not after each
+      substep), the position and quaternion of the bodies are copied, keeping
+      those of the previous frame.  Destroying one of its bodies, or its world,
+      stops the interpolator, [dInterpolatorWrite] then keeps returning the
+      last transforms. *)
+  external dInterpolatorDestroy : dInterpolator -> unit = "ocamlode_dInterpolatorDestroy"
+  external dInterpolatorCapture : dInterpolator -> unit = "ocamlode_dInterpolatorCapture"
+  (** captures the transforms now, for the worlds not stepped with
+      [dWorldStep] or [dWorldQuickStep], raises [Invalid_argument] if the
+      interpolator was stopped *)
+  external dInterpolatorReset : dInterpolator -> unit = "ocamlode_dInterpolatorReset"
+  (** captures the transforms as both the previous and the last ones,
+      after moving the bodies without a step *)
+  external dInterpolatorWrite : dInterpolator -> alpha:float ->
+      ('a, 'b, Bigarray.c_layout) Bigarray.Array2.t -> unit = "ocamlode_dInterpolatorWrite"
+  (** writes for each body the position linearly interpolated and the
+      quaternion spherically interpolated between the previous and the last
+      step, at [alpha] between 0.0 and 1.0, as (x, y, z, qw, qx, qy, qz) rows
+      of a float32 or float64 bigarray of dimensions [n; 7] *)
+
+  (** {3 Trajectory recorder} *)
+
+  type dRecorder
+
+  type recorder_stats = {
+    rec_frames_captured : int;
+    rec_frames_written : int;
+    rec_bytes_written : int;
+    rec_stalls : int;  (** captures which waited for the writer, the ring was full *)
+  }
+
+  external dRecorderCreate : dWorldID -> filename:string -> bodies:dBodyID array -> joints:dJointID array ->
+      ring_size:int -> keyframe_interval:int -> dRecorder
+      = "ocamlode_dRecorderCreate_bytecode"
+        "ocamlode_dRecorderCreate_native"
+  (** after each [dWorldStep] or [dWorldQuickStep] of the world, the position
+      and quaternion of the bodies and the angles (or positions) and rates of
+      the joints are copied in a ring of [ring_size] frames, and a thread
+      writes them to the file.  Between two keyframes the frames only contain
+      the values changed since the previous frame, a [keyframe_interval] of 1
+      writes only keyframes.
+      Destroying one of its bodies or joints, or its world, stops the recorder,
+      the frames already captured are still written.  The joints should not be
+      in a joint group. *)
+  external dRecorderCapture : dRecorder -> unit = "ocamlode_dRecorderCapture"
+  (** captures a frame now, for the worlds not stepped with [dWorldStep]
+      or [dWorldQuickStep], raises [Invalid_argument] if the recorder
+      was stopped *)
+  external dRecorderGetStats : dRecorder -> recorder_stats = "ocamlode_dRecorderGetStats"
+  external dRecorderClose : dRecorder -> unit = "ocamlode_dRecorderClose"
+  (** waits for all the frames to be written, and closes the file *)
+
+  type dRecording
+  external dRecordingOpen : filename:string -> dRecording = "ocamlode_dRecordingOpen"
+  (** maps a file written by a recorder in memory, fails on a corrupted
+      file, an incomplete last frame is ignored *)
+  external dRecordingInfo : dRecording -> (* bodies *) int * (* joints *) int * (* frames *) int *
+      (* keyframe interval *) int = "ocamlode_dRecordingInfo"
+  external dRecordingRead : dRecording -> int ->
+      (float, Bigarray.float32_elt, Bigarray.c_layout) Bigarray.Array1.t -> int
+      = "ocamlode_dRecordingRead"
+  (** [dRecordingRead rec i ba] decodes the frame [i] into [ba], 7 values
+      (x, y, z, qw, qx, qy, qz) for each body then 4 values for each joint
+      (hinge: angle, 0, rate, 0; slider, PR and PU: position, 0, rate, 0;
+      piston: position, angle, position rate, angle rate;
+      hinge2: angle1, 0, rate1, rate2; universal: angle1, angle2, rate1, rate2),
+      and returns the step number of the frame.
+      Reading the frames in sequence decodes each frame only once. *)
+  external dRecordingClose : dRecording -> unit = "ocamlode_dRecordingClose"
+
 
   (** {3 Space} *)
 
@@ -665,6 +1100,16 @@ module LowLevel = struct
   external dGeomRaySetClosestHit : ray_geom dGeomID -> closest_hit:bool -> unit = "ocamlode_dGeomRaySetClosestHit"
   external dGeomRayGetClosestHit : ray_geom dGeomID -> bool = "ocamlode_dGeomRayGetClosestHit"
 
+  external dCreateGeomTransform : dSpaceID option -> geomTransform_geom dGeomID = "ocamlode_dCreateGeomTransform"
+  external dGeomTransformSetGeom : geomTransform_geom dGeomID -> 'a dGeomID option -> unit = "ocamlode_dGeomTransformSetGeom"
+  (** the encapsulated geom should not be inserted into any space, with the
+      cleanup mode set the previous geom is destroyed *)
+  external dGeomTransformGetGeom : geomTransform_geom dGeomID -> 'a dGeomID option = "ocamlode_dGeomTransformGetGeom"
+  external dGeomTransformSetCleanup : geomTransform_geom dGeomID -> mode:bool -> unit = "ocamlode_dGeomTransformSetCleanup"
+  external dGeomTransformGetCleanup : geomTransform_geom dGeomID -> bool = "ocamlode_dGeomTransformGetCleanup"
+  external dGeomTransformSetInfo : geomTransform_geom dGeomID -> mode:bool -> unit = "ocamlode_dGeomTransformSetInfo"
+  external dGeomTransformGetInfo : geomTransform_geom dGeomID -> bool = "ocamlode_dGeomTransformGetInfo"
+
   type dTriMeshDataID
   external dGeomTriMeshDataCreate : unit -> dTriMeshDataID = "ocamlode_dGeomTriMeshDataCreate"
   external dGeomTriMeshDataDestroy : dTriMeshDataID -> unit = "ocamlode_dGeomTriMeshDataDestroy"
@@ -703,7 +1148,21 @@ module LowLevel = struct
   external dConvexDataBuild : planes:float array ->
                               points:float array ->
                               polygones:int array -> dConvexDataID = "ocamlode_get_dConvexDataID"
-  (** {b Important:} the [dConvexDataID] needs to be freed with [dConvexDataDestroy] at the end. *)
+  (** the planes are given as [(nx, ny, nz, d)], and the polygones as
+      [(n, i1, ..., in)] for each plane, with [n >= 3] and the vertices
+      indices in counter-clockwise order.
+      {b Important:} the [dConvexDataID] needs to be freed with [dConvexDataDestroy] at the end. *)
+
+  external dConvexDataBuildHull : (float, 'a, Bigarray.c_layout) Bigarray.Array2.t -> dConvexDataID
+                              = "ocamlode_dConvexDataBuildHull"
+  (** computes the convex hull of a point cloud of dimensions [n * 3],
+      the coplanar faces are merged into polygons.
+      Needs to be freed with [dConvexDataDestroy] as [dConvexDataBuild]. *)
+
+  external dConvexDataGet : dConvexDataID ->
+                              (* planes *) float array *
+                              (* points *) float array *
+                              (* polygones *) int array = "ocamlode_dConvexDataGet"
 
   external dCreateConvex : dSpaceID option -> dConvexDataID -> convex_geom dGeomID = "ocamlode_dCreateConvex"
   external dGeomSetConvex : convex_geom dGeomID -> dConvexDataID -> unit = "ocamlode_dGeomSetConvex"
@@ -723,6 +1182,131 @@ module LowLevel = struct
                 scale:float -> offset:float -> thickness:float -> wrap:bool -> unit
                 = "ocamlode_dGeomHeightfieldDataBuild_bytecode"
                   "ocamlode_dGeomHeightfieldDataBuild"
+  external dGeomHeightfieldDataSetBounds:
+                id:dHeightfieldDataID -> min_height:float -> max_height:float -> unit
+                = "ocamlode_dGeomHeightfieldDataSetBounds"
+
+  type dHeightfieldSampler
+  (** a height sampler for [dGeomHeightfieldDataBuildCallback], the heights
+      are computed on demand by ODE instead of being stored *)
+
+  external dHeightfieldSamplerTiled:
+                (float, 'a, Bigarray.c_layout) Bigarray.Array2.t -> dHeightfieldSampler
+                = "ocamlode_dHeightfieldSamplerTiled"
+  (** samples from a float32 or float64 bigarray of dimensions [depth * width],
+      repeated infinitely in both directions.
+      The bigarray is kept alive until [dHeightfieldSamplerDestroy]. *)
+
+  external dHeightfieldSamplerNoise:
+                seed:int -> frequency:float -> amplitude:float ->
+                persistence:float -> octaves:int -> dHeightfieldSampler
+                = "ocamlode_dHeightfieldSamplerNoise"
+  (** native value noise, summed over [octaves] (the frequency doubles
+      and the amplitude is multiplied by [persistence] at each octave) *)
+
+  external dHeightfieldSamplerClosure:
+                cache_size:int -> (int -> int -> float) -> dHeightfieldSampler
+                = "ocamlode_dHeightfieldSamplerClosure"
+  (** [dHeightfieldSamplerClosure ~cache_size (fun x z -> height)]
+      the results are kept in a cache of [cache_size] entries, so that the
+      neighbour queries of a same collision do not call back the closure *)
+
+  external dHeightfieldSamplerClearCache: dHeightfieldSampler -> unit
+                = "ocamlode_dHeightfieldSamplerClearCache"
+  (** to call when the heights returned by the closure have changed *)
+
+  external dHeightfieldSamplerDestroy: dHeightfieldSampler -> unit
+                = "ocamlode_dHeightfieldSamplerDestroy"
+  (** {b Important:} do not destroy the sampler as long as the associated heightfield data is used. *)
+
+  external dGeomHeightfieldDataBuildCallback:
+                id:dHeightfieldDataID ->
+                sampler:dHeightfieldSampler ->
+                width:float -> depth:float -> width_samples:int -> depth_samples:int ->
+                scale:float -> offset:float -> thickness:float -> wrap:bool -> unit
+                = "ocamlode_dGeomHeightfieldDataBuildCallback_bytecode"
+                  "ocamlode_dGeomHeightfieldDataBuildCallback"
+  (** the bounds of the heights are unknown with a sampler,
+      use [dGeomHeightfieldDataSetBounds] to provide them *)
+
+  type dTerrainPager
+  (** pages heightfield tiles in and out of a space around some focus points *)
+
+  type terrain_pager_stats = {
+    tiles_loaded : int;     (** tiles currently in the space *)
+    tiles_pending : int;    (** tiles requested but not swapped in yet *)
+    tiles_paged_in : int;
+    tiles_paged_out : int;
+    latency_last : float;   (** time between the request of a tile and its swap in, in seconds *)
+    latency_avg : float;
+    latency_max : float;
+  }
+
+  external dTerrainPagerCreate: dSpaceID -> filename:string ->
+                samples_x:int -> samples_z:int -> tile_cells:int -> cell_size:float ->
+                height_scale:float -> thickness:float -> radius:int -> dTerrainPager
+                = "ocamlode_dTerrainPagerCreate_bytecode"
+                  "ocamlode_dTerrainPagerCreate_native"
+  (** the terrain file is a raw grid of [samples_x * samples_z] native endian
+      float32 heights, row by row along the z axis, it is memory mapped and the
+      tiles of [tile_cells * tile_cells] cells are read by a background thread.
+      The tile [(tx, tz)] covers the x range [tx * tile_cells * cell_size] to
+      [(tx+1) * tile_cells * cell_size] (the same for z), with the heights along
+      the y axis. The tiles within [radius] tiles of a focus point are kept.
+      Raises [Invalid_argument] if [cell_size] is not positive or [radius] is negative.
+      The pager owns the heightfield geoms of its tiles, it destroys them when
+      they leave the ring and in [dTerrainPagerDestroy].  If the space is
+      destroyed first (its cleanup mode destroying the tiles), the pager only
+      frees its buffers and [dTerrainPagerUpdate] raises [Invalid_argument]. *)
+
+  external dTerrainPagerSetFocus: dTerrainPager -> float array -> unit
+                = "ocamlode_dTerrainPagerSetFocus"
+  (** the focus points as the pairs [[| x1; z1; x2; z2; ... |]] *)
+
+  external dTerrainPagerUpdate: dTerrainPager -> unit = "ocamlode_dTerrainPagerUpdate"
+  (** swaps the ready tiles into the space, destroys the tiles out of the ring,
+      and requests the missing ones; call it between two steps, not during
+      the collision detection *)
+
+  external dTerrainPagerGetStats: dTerrainPager -> terrain_pager_stats
+                = "ocamlode_dTerrainPagerGetStats"
+
+  external dTerrainPagerDestroy: dTerrainPager -> unit = "ocamlode_dTerrainPagerDestroy"
+  (** stops the loader thread and destroys all the tiles geoms *)
+
+  type 'a dSharedData
+  (** collision datas shared by several geoms, the datas are reference counted
+      and freed when the handle has been released and the last geom using them
+      has been destroyed (with [dGeomDestroy], or with [dSpaceDestroy] if the
+      cleanup mode of the space is set) *)
+
+  external dSharedTriMeshCreate : vertices:float array -> indices:int array -> trimesh_geom dSharedData
+      = "ocamlode_dSharedTriMeshCreate"
+  (** the vertices and the indices are copied *)
+
+  external dSharedConvexCreate : dConvexDataID -> convex_geom dSharedData = "ocamlode_dSharedConvexCreate"
+  (** the convex data is copied, so it can be destroyed after this call *)
+
+  external dSharedHeightfieldCreate :
+                height_data:float array ->
+                width:float -> depth:float -> width_samples:int -> depth_samples:int ->
+                scale:float -> offset:float -> thickness:float -> wrap:bool -> heightfield_geom dSharedData
+                = "ocamlode_dSharedHeightfieldCreate_bytecode"
+                  "ocamlode_dSharedHeightfieldCreate_native"
+
+  external dCreateSharedGeom : dSpaceID option -> 'a dSharedData -> 'a dGeomID = "ocamlode_dCreateSharedGeom"
+  (** creates a new geom instance of the shared data (heightfields are created placeable) *)
+
+  external dSharedDataRelease : 'a dSharedData -> unit = "ocamlode_dSharedDataRelease"
+  (** releases the handle, the geoms already created stay valid *)
+
+  external dSharedDataGetInfo : 'a dSharedData -> (* instances *) int * (* bytes *) int
+      = "ocamlode_dSharedDataGetInfo"
+  (** returns the number of geoms using the shared data, and the memory allocated for it by the bindings *)
+
+  external dSharedDataGetTotal : unit -> (* shared datas *) int * (* bytes *) int
+      = "ocamlode_dSharedDataGetTotal"
+  (** the number of shared datas still alive, and the memory allocated for them *)
 
 
   external dGeomSetData : 'a dGeomID -> int -> unit = "ocamlode_dGeomSetData"
@@ -751,6 +1335,10 @@ module LowLevel = struct
 if ( ((g1.category_bits & g2.collide_bits) ||
       (g2.category_bits & g1.collide_bits)) == 0) ]} *)
 
+  external dGeomSetMaterial : 'a dGeomID -> int -> unit = "ocamlode_dGeomSetMaterial"
+  external dGeomGetMaterial : 'a dGeomID -> int = "ocamlode_dGeomGetMaterial"
+  (** the material of the geom in the contact tables of [dWorldSubstep], 0 by default *)
+
   external dGeomEnable : 'a dGeomID -> unit = "ocamlode_dGeomEnable"
   external dGeomDisable : 'a dGeomID -> unit = "ocamlode_dGeomDisable"
   external dGeomIsEnabled : 'a dGeomID -> bool = "ocamlode_dGeomIsEnabled"
@@ -774,10 +1362,160 @@ if ( ((g1.category_bits & g2.collide_bits) ||
   external dGeomGetOffsetPosition : 'a dGeomID -> dVector3 = "ocamlode_dGeomGetOffsetPosition"
   external dGeomGetOffsetRotation : 'a dGeomID -> dMatrix3 = "ocamlode_dGeomGetOffsetRotation"
 
+  type compound_shape =
+    | Part_sphere of float                   (** radius *)
+    | Part_box of float * float * float      (** lx, ly, lz *)
+    | Part_capsule of float * float          (** radius, length along z *)
+    | Part_cylinder of float * float         (** radius, length along z *)
+
+  type compound_part = {
+    part_shape : compound_shape;
+    part_pos : dVector3;
+    part_rot : dMatrix3 option;
+    part_density : float;
+  }
+
+  external dCreateCompoundBody : dWorldID -> dSpaceID option -> compound_part array -> dBodyID * 'a dGeomID array
+      = "ocamlode_dCreateCompoundBody"
+  (** creates a body with one geom for each part, attached with an offset,
+      the masses of the parts are added and the body is placed on the resulting
+      center of mass, so that the parts keep the positions given in [part_pos] *)
+
+
+  (** {3 Scenes} *)
+
+  external dSceneSave : filename:string -> dWorldID -> spaces:dSpaceID array -> bodies:dBodyID array -> unit
+      = "ocamlode_dSceneSave"
+  (** writes a binary scene file with the world parameters, the spaces (and
+      the spaces they contain), the geoms of these spaces, the bodies with their
+      masses and the state saved by [dSnapshotSave], and the joints connected to these bodies (the bodies at the other
+      end of the joints are saved too).  The contact joints are not saved.
+      The convexes and the heightfields can only be saved if they were created
+      with [dCreateSharedGeom], the trimeshes which are not shared are saved
+      with their triangles.  Geom transforms are not supported. *)
+
+  external dSceneLoad : filename:string ->
+      dWorldID * dSpaceID array * dBodyID array * unit dGeomID array * dJointID array
+      = "ocamlode_dSceneLoad"
+
+  type scene = {
+    sc_world : dWorldID;
+    sc_spaces : dSpaceID array;
+    sc_bodies : dBodyID array;
+    sc_geoms : geom_type array;
+    sc_joints : dJointID array;
+  }
+
+  let dSceneLoad ~filename =
+    let world, spaces, bodies, geoms, joints = dSceneLoad ~filename in
+    { sc_world = world;
+      sc_spaces = spaces;
+      sc_bodies = bodies;
+      sc_geoms = Array.map geom_kind geoms;
+      sc_joints = joints; }
+  (** creates again a scene saved with [dSceneSave], in the order of the arrays
+      given to [dSceneSave] (the spaces are followed by the spaces they contain).
+      The trimesh, convex and heightfield datas are loaded as shared datas,
+      freed with the last geom using them. *)
+
+
+  (** {3 Moved bodies} *)
+
+  type dMovedTracker
+
+  external dMovedTrackerCreate : dWorldID -> bodies:dBodyID array -> dMovedTracker = "ocamlode_dMovedTrackerCreate"
+  (** sets the moved callback of the bodies, the steps of the world collect
+      the indexes in [bodies] of the bodies they move.  A destroyed body is
+      dropped from the tracker, its index is not reported anymore, and
+      destroying the world leaves the tracker empty. *)
+  external dMovedTrackerDestroy : dMovedTracker -> unit = "ocamlode_dMovedTrackerDestroy"
+  external dMovedTrackerRead : dMovedTracker -> body_indexes -> int = "ocamlode_dMovedTrackerRead"
+  (** writes the indexes of the bodies moved since the last read, each once,
+      and returns their number.  The bigarray needs one element per body. *)
+  external dMovedTrackerCount : dMovedTracker -> int = "ocamlode_dMovedTrackerCount"
+  (** number of the bodies moved since the last read *)
+
+  (** {3 Substeps} *)
+
+  type dContactTable
+
+  external dContactTableCreate : materials:int -> max_contacts:int -> dSurfaceParameters -> dContactTable
+      = "ocamlode_dContactTableCreate"
+  (** a table of the surface parameters of the contacts between each pair of
+      materials, all initialised with the given surface; at most [max_contacts]
+      contacts are created for each pair of geoms.  [materials] is at most
+      4096 and [max_contacts] at most 65535. *)
+  external dContactTableDestroy : dContactTable -> unit = "ocamlode_dContactTableDestroy"
+  external dContactTableSetSurface : dContactTable -> int -> int -> dSurfaceParameters -> unit
+      = "ocamlode_dContactTableSetSurface"
+  (** sets the surface between two materials, in both directions *)
+
+  type substep_stats = {
+    sub_steps : int;
+    sub_pairs : int;         (** pairs of geoms tested by the native near callback *)
+    sub_contacts : int;      (** contact joints created by the native near callback *)
+    sub_max_contacts : int;  (** the most contact joints created in one substep *)
+  }
+
+  external dWorldSubstep : dWorldID -> dSpaceID -> dJointGroupID -> dContactTable ->
+      near:('a dGeomID -> 'b dGeomID -> unit) option ->
+      substeps:int -> stepsize:float -> quick:bool -> substep_stats
+      = "ocamlode_dWorldSubstep_bytecode"
+        "ocamlode_dWorldSubstep_native"
+  (** runs [substeps] times [dSpaceCollide], [dWorldStep] (or [dWorldQuickStep]
+      if [quick]) and [dJointGroupEmpty] on the contact group.
+      With [~near:None] the contacts are created natively: the geoms in the
+      space and in the spaces it contains are collided, except the pairs of
+      static geoms and of bodies already connected by a joint, and the surface
+      of the contacts comes from the table and the materials of the geoms.
+      With [~near:(Some f)] the near callback [f] of [dSpaceCollide] is called
+      instead, it has to put its contacts in the contact group. *)
+
+  type dAdaptive
+
+  external dAdaptiveCreate : dt_min:float -> dt_max:float ->
+      max_depth:float -> max_travel:float -> max_error:float -> dAdaptive
+      = "ocamlode_dAdaptiveCreate"
+  (** an adaptive step controller: after each step it measures the deepest
+      contact, the largest travel of a body relative to the size of its geoms
+      (the distance covered divided by the smallest half extent of the geom,
+      plus the angle covered), and the largest separation between the two
+      anchors of the ball, hinge, universal and hinge2 joints.  The next step
+      size is scaled so that the largest ratio of these metrics to their limit
+      comes close to 1, changing by a factor 2 at most and staying within
+      [\[dt_min, dt_max\]] *)
+  external dAdaptiveDestroy : dAdaptive -> unit = "ocamlode_dAdaptiveDestroy"
+  external dAdaptiveGetStep : dAdaptive -> float = "ocamlode_dAdaptiveGetStep"
+  (** the size of the next step *)
+
+  type adaptive_stats = {
+    ad_steps : int;
+    ad_dt_min : float;     (** the smallest step of the frame *)
+    ad_dt_next : float;    (** the step size chosen for the next step *)
+    ad_max_depth : float;
+    ad_max_travel : float;
+    ad_max_error : float;
+  }
+
+  external dWorldAdaptiveStep : dWorldID -> dSpaceID -> dJointGroupID -> dContactTable -> dAdaptive ->
+      frame:float -> quick:bool -> adaptive_stats
+      = "ocamlode_dWorldAdaptiveStep_bytecode"
+        "ocamlode_dWorldAdaptiveStep_native"
+  (** advances the world by [frame] seconds with steps of the size chosen by
+      the controller, the last step being shortened to end on the frame.
+      Each step is a cycle of [dWorldSubstep] with the native near callback.
+      Raises [Invalid_argument] if [frame] is negative or not finite. *)
+
 
   (** {3 Mass functions} *)
   (**  Note that dMass objects are garbage collected. *)
 
+  external register_custom_ops : unit -> unit = "ocamlode_register_custom_ops"
+  let () = register_custom_ops ()
+  (** dMass and dConvexDataID values can be sent through [Marshal], to another
+      process or machine, the data is converted if its precision or byte order
+      differs *)
+
   external dMassCreate : unit -> dMass = "ocamlode_dMassCreate"
   external dMass_set_mass : dMass -> float -> unit = "ocamlode_dMass_set_mass"
   external dMass_mass : dMass -> float = "ocamlode_dMass_mass"
@@ -826,6 +1564,10 @@ if ( ((g1.category_bits & g2.collide_bits) ||
   external dRGetIdentity : unit -> dMatrix3 = "ocamlode_dRSetIdentity"
   external dRFromAxisAndAngle : ax:float -> ay:float -> az:float -> angle:float -> dMatrix3 = "ocamlode_dRFromAxisAndAngle"
   external dRFromEulerAngles : phi:float -> theta:float -> psi:float -> dMatrix3 = "ocamlode_dRFromEulerAngles"
+  external dRFrom2Axes : ax:float -> ay:float -> az:float -> bx:float -> by:float -> bz:float -> dMatrix3
+      = "ocamlode_dRFrom2Axes_bytecode"
+        "ocamlode_dRFrom2Axes_native"
+  external dRFromZAxis : ax:float -> ay:float -> az:float -> dMatrix3 = "ocamlode_dRFromZAxis"
 
 
   (** {3 Quaternion} *)
@@ -833,18 +1575,78 @@ if ( ((g1.category_bits & g2.collide_bits) ||
   external dQGetIdentity : unit -> dQuaternion = "ocamlode_dQSetIdentity"
   external dQFromAxisAndAngle : ax:float -> ay:float -> az:float -> angle:float -> dQuaternion = "ocamlode_dQFromAxisAndAngle"
 
+  type qmultiply =
+    | QMultiply0  (** qb * qc *)
+    | QMultiply1  (** inverse(qb) * qc *)
+    | QMultiply2  (** qb * inverse(qc) *)
+    | QMultiply3  (** inverse(qb) * inverse(qc) *)
+
+  external dQMultiply : qmultiply -> dQuaternion -> dQuaternion -> dQuaternion = "ocamlode_dQMultiply"
+  let dQMultiply0 = dQMultiply QMultiply0
+  let dQMultiply1 = dQMultiply QMultiply1
+  let dQMultiply2 = dQMultiply QMultiply2
+  let dQMultiply3 = dQMultiply QMultiply3
+
+  external dRfromQ : dQuaternion -> dMatrix3 = "ocamlode_dRfromQ"
+  external dQfromR : dMatrix3 -> dQuaternion = "ocamlode_dQfromR"
+  external dDQfromW : w:dVector3 -> dQuaternion -> dQuaternion = "ocamlode_dDQfromW"
+  (** derivative of the quaternion for the angular velocity [w] *)
+
+  (** {4 Batched rotations}
+      The quaternions are stored in bigarrays of dimensions [[n; 4]], the
+      matrices in [[n; 12]] with the layout of [dMatrix3], and the angular
+      velocities in [[n; 3]]; all the arrays of a call have the same [n].
+      Nothing is allocated. *)
+
+  type rotation_batch = (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t
+
+  external dQMultiplyBatch : qmultiply -> dst:rotation_batch -> rotation_batch -> rotation_batch -> unit
+      = "ocamlode_dQMultiplyBatch"
+  (** [dst] can be one of the operands *)
+  external dRfromQBatch : dst:rotation_batch -> rotation_batch -> unit = "ocamlode_dRfromQBatch"
+  external dQfromRBatch : dst:rotation_batch -> rotation_batch -> unit = "ocamlode_dQfromRBatch"
+  external dQNormalizeBatch : rotation_batch -> unit = "ocamlode_dQNormalizeBatch"
+  (** in place, the null quaternions are replaced by the identity *)
+  external dDQfromWBatch : dst:rotation_batch -> w:rotation_batch -> rotation_batch -> unit
+      = "ocamlode_dDQfromWBatch"
+  external dQIntegrateBatch : rotation_batch -> w:rotation_batch -> dt:float -> unit
+      = "ocamlode_dQIntegrateBatch"
+  (** rotates in place the quaternions by the angular velocities during [dt],
+      and normalizes them *)
+
 
   (** {3 Misc} *)
 
   external dWorldImpulseToForce : dWorldID -> stepsize:float -> ix:float -> iy:float -> iz:float -> dVector3
       = "ocamlode_dWorldImpulseToForce"
-  (*
   external dWorldExportDIF : dWorldID -> filename:string -> world_name:string -> unit = "ocamlode_dWorldExportDIF"
-  *)
+  (** exports the world in the DIF text format, [filename] can be ["stdout"] or ["stderr"] *)
 
   external dQtoR : dQuaternion -> dMatrix3 = "ocamlode_dQtoR"
   external dPlaneSpace : n:dVector3 -> dVector3 * dVector3 = "ocamlode_dPlaneSpace"
 
+  type memory_category =
+    | Mem_ode          (** allocations of ODE itself *)
+    | Mem_trimesh      (** trimesh indices and shared vertices *)
+    | Mem_convex       (** convex planes, points and polygons *)
+    | Mem_heightfield  (** heightfield samples, sampler caches and terrain tiles *)
+    | Mem_feedback     (** joint feedback buffers and arenas *)
+
+  type memory_stats = {
+    live_bytes : int;
+    peak_bytes : int;
+    live_count : int;   (** number of blocks currently allocated *)
+    total_count : int;  (** number of blocks allocated since the start *)
+  }
+
+  external dMemoryTrackingEnable : unit -> unit = "ocamlode_dMemoryTrackingEnable"
+  (** installs ODE allocation handlers which account its allocations in [Mem_ode],
+      call it before [dInitODE] (the blocks allocated before are not accounted).
+      The buffers allocated by the bindings are always accounted. *)
+  external dMemoryTrackingDisable : unit -> unit = "ocamlode_dMemoryTrackingDisable"
+  external dMemoryGetStats : memory_category -> memory_stats = "ocamlode_dMemoryGetStats"
+  external dMemoryResetPeaks : unit -> unit = "ocamlode_dMemoryResetPeaks"
+
   (**/**)
 
   let is_nan f = (Stdlib.compare nan f) = 0 ;;
@@ -950,24 +1752,46 @@ if ( ((g1.category_bits & g2.collide_bits) ||
   external dQMaxDifference : a:dQuaternion -> b:dQuaternion -> n:int -> m:int -> float = "ocamlode_dMaxDifference"
 
   external dMultiply0 : 'a -> 'b -> p:int -> q:int -> r:int -> float array = "ocamlode_dMultiply0"
+  (** the rows of more than one element are padded to a multiple of 4, as in
+      ODE, so the result has [p * r] elements only if [r = 1] *)
+
+  type multiply =
+    | Multiply0  (** a(p*r) = b(p*q) . c(q*r) *)
+    | Multiply1  (** a(p*r) = b'(q*p) . c(q*r) *)
+    | Multiply2  (** a(p*r) = b(p*q) . c'(r*q) *)
+
+  external dMultiplyInto : multiply -> dst:'a -> 'b -> 'c -> p:int -> q:int -> r:int -> unit
+      = "ocamlode_dMultiplyInto_bytecode"
+        "ocamlode_dMultiplyInto_native"
+  (** writes the product into [dst], which must be a float array or a record
+      of floats (like [dVector3] or [dMatrix3]) distinct from the operands *)
 
   (*
       a(p*q)  b(q*r)  v(p*r)
   *)
   let dMultiply0_331 (a : dMatrix3) (b : 'a) =
-    let _b = (Obj.magic b : float array) in
-    assert(Array.length _b = 3);
-    let v = dMultiply0 a _b ~p:3 ~q:3 ~r:1 in
-    (Obj.magic v : dVector3)
+    assert(Array.length (Obj.magic b : float array) >= 3);
+    let v = { x = 0.0; y = 0.0; z = 0.0; w = 0.0 } in
+    dMultiplyInto Multiply0 ~dst:v a b ~p:3 ~q:3 ~r:1;
+    (v : dVector3)
   ;;
 
   let dMultiply0_333 (a : dMatrix3) (b : 'a) =
-    let _b = (Obj.magic b : float array) in
-    assert(Array.length _b = 12);
-    let v = dMultiply0 a _b ~p:3 ~q:3 ~r:3 in
-    (Obj.magic v : dMatrix3)
+    assert(Array.length (Obj.magic b : float array) = 12);
+    let v = dRGetIdentity () in
+    dMultiplyInto Multiply0 ~dst:v a b ~p:3 ~q:3 ~r:3;
+    (v : dMatrix3)
   ;;
 
+  external dTransformBatch : dst:('a, 'b, Bigarray.c_layout) Bigarray.Array2.t -> dMatrix3 -> dVector3 option ->
+      ('a, 'b, Bigarray.c_layout) Bigarray.Array2.t -> unit = "ocamlode_dTransformBatch"
+  (** [dst.(i) = r . src.(i) + pos] for the vectors of a float32 or float64
+      bigarray of dimensions [[n; 3]], [dst] can be [src] *)
+
+  external dBodyTransformBatch : dBodyID -> dst:('a, 'b, Bigarray.c_layout) Bigarray.Array2.t ->
+      ('a, 'b, Bigarray.c_layout) Bigarray.Array2.t -> unit = "ocamlode_dBodyTransformBatch"
+  (** transforms the points from the body frame to the world frame *)
+
   external memory_share : unit -> bool = "ocamlode_memory_share"
   (** tells whether the bindings were compiled to share structures memory *)
 
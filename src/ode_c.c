@@ -24,6 +24,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define CAML_NAME_SPACE 1
 
@@ -34,6 +42,8 @@
 #include <caml/fail.h>
 #include <caml/memory.h>
 #include <caml/printexc.h>
+#include <caml/bigarray.h>
+#include <caml/intext.h>
 
 /* usable generated macro for versioning */
 //#include "ode_version.h"
@@ -43,6 +53,7 @@
 #define uint32 _uint32
 
 #include <ode/ode.h>
+#include <ode/export-dif.h>
 
 #undef int32
 #undef uint32
@@ -63,6 +74,108 @@
   #define MEM_CPY
 #endif
 
+/* {{{ Memory tracking */
+
+/* The buffers allocated by the bindings are prefixed by a small header
+   recording their size and category, so that they are always accounted.
+   The allocations of ODE itself are only accounted once the tracking
+   handlers are installed with ocamlode_dMemoryTrackingEnable(). */
+
+enum mem_category {
+  MEM_ODE,
+  MEM_TRIMESH,
+  MEM_CONVEX,
+  MEM_HEIGHTFIELD,
+  MEM_FEEDBACK,
+  MEM_CATEGORIES
+};
+
+struct mem_stats {
+  long long live_bytes;
+  long long peak_bytes;
+  long live_count;
+  long total_count;
+};
+
+static struct mem_stats mem_stats[MEM_CATEGORIES];
+
+union mem_header {
+  struct {
+    size_t size;
+    enum mem_category category;
+  } h;
+  double align;
+  void *align_ptr;
+  long long align_ll[2];
+};
+
+static inline void
+mem_account (enum mem_category cat, long long bytes, int count)
+{
+  struct mem_stats *s = &mem_stats[cat];
+  s->live_bytes += bytes;
+  s->live_count += count;
+  if (count > 0) s->total_count += count;
+  if (s->live_bytes > s->peak_bytes) s->peak_bytes = s->live_bytes;
+}
+
+static void *
+ocamlode_malloc (enum mem_category cat, size_t size)
+{
+  union mem_header *p = malloc (sizeof(union mem_header) + size);
+  if (p == NULL) return NULL;
+  p->h.size = size;
+  p->h.category = cat;
+  mem_account (cat, size, 1);
+  return (p + 1);
+}
+
+static void *
+ocamlode_calloc (enum mem_category cat, size_t n, size_t size)
+{
+  void *p = ocamlode_malloc (cat, n * size);
+  if (p != NULL) memset (p, 0, n * size);
+  return p;
+}
+
+static void
+ocamlode_free (void *ptr)
+{
+  union mem_header *p;
+  if (ptr == NULL) return;
+  p = ((union mem_header *) ptr) - 1;
+  mem_account (p->h.category, -(long long) p->h.size, -1);
+  free (p);
+}
+
+/* ODE allocation handlers */
+
+static void *
+mem_ode_alloc (size_t size)
+{
+  void *p = malloc (size);
+  if (p != NULL) mem_account (MEM_ODE, size, 1);
+  return p;
+}
+
+static void *
+mem_ode_realloc (void *ptr, size_t oldsize, size_t newsize)
+{
+  void *p = realloc (ptr, newsize);
+  if (p != NULL) mem_account (MEM_ODE, (long long) newsize - (long long) oldsize, (ptr == NULL));
+  return p;
+}
+
+static void
+mem_ode_free (void *ptr, size_t size)
+{
+  if (ptr == NULL) return;
+  mem_account (MEM_ODE, -(long long) size, -1);
+  free (ptr);
+}
+
+/* }}} */
+
 /* {{{ Types convertions */
 
 struct voidptr {
@@ -145,14 +258,112 @@ destroy_voidptr (value rv)
 #define dTriMeshDataID_val(idv) (Voidptr_val (dTriMeshDataID, (idv)))
 
 
+/* Serialization of the custom blocks holding dReals.
+   Every value starts with a tag: the version of the format, the size of the
+   dReals and the byte order of the machine which wrote it.  The dReals are
+   written as they are in memory, so a value sent between processes of the
+   same kind is only copied; they are converted when the precision or the
+   byte order of the reader differs. */
+
+#define SERIAL_VERSION 1
+#ifdef ARCH_BIG_ENDIAN
+#define SERIAL_NATIVE_ORDER 1
+#else
+#define SERIAL_NATIVE_ORDER 0
+#endif
+
+struct serial_tag {
+  int precision;
+  int big_endian;
+};
+
+static void
+serialize_tag (void)
+{
+  caml_serialize_int_1 (SERIAL_VERSION);
+  caml_serialize_int_1 (sizeof(dReal));
+  caml_serialize_int_1 (SERIAL_NATIVE_ORDER);
+}
+
+static struct serial_tag
+deserialize_tag (void)
+{
+  struct serial_tag t;
+  if (caml_deserialize_uint_1 () != SERIAL_VERSION)
+    caml_deserialize_error ("ocamlode: unknown serialization format");
+  t.precision = caml_deserialize_uint_1 ();
+  t.big_endian = caml_deserialize_uint_1 ();
+  if (t.precision != sizeof(float) && t.precision != sizeof(double))
+    caml_deserialize_error ("ocamlode: wrong precision tag");
+  return t;
+}
+
+static void
+serialize_reals (const dReal *a, uintnat n)
+{
+  caml_serialize_block_1 ((void *) a, n * sizeof(dReal));
+}
+
+static void
+deserialize_reals (struct serial_tag t, dReal *a, uintnat n)
+{
+  unsigned char buf[sizeof(double)];
+  uintnat i;
+  int k;
+  if (t.precision == sizeof(dReal) && t.big_endian == SERIAL_NATIVE_ORDER) {
+    caml_deserialize_block_1 (a, n * sizeof(dReal));
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    caml_deserialize_block_1 (buf, t.precision);
+    if (t.big_endian != SERIAL_NATIVE_ORDER)
+      for (k = 0; k < t.precision / 2; k++) {
+        unsigned char c = buf[k];
+        buf[k] = buf[t.precision - 1 - k];
+        buf[t.precision - 1 - k] = c;
+      }
+    if (t.precision == sizeof(float)) {
+      float x;
+      memcpy (&x, buf, sizeof x);
+      a[i] = x;
+    } else {
+      double x;
+      memcpy (&x, buf, sizeof x);
+      a[i] = x;
+    }
+  }
+}
+
+static void
+serialize_dMass (value v, uintnat *bsize_32, uintnat *bsize_64)
+{
+  dMass *m = (dMass *) Data_custom_val (v);
+  serialize_tag ();
+  serialize_reals (&m->mass, 1);
+  serialize_reals (m->c, 4);
+  serialize_reals (m->I, 12);
+  *bsize_32 = *bsize_64 = sizeof(dMass);
+}
+
+static uintnat
+deserialize_dMass (void *dst)
+{
+  dMass *m = (dMass *) dst;
+  struct serial_tag t = deserialize_tag ();
+  deserialize_reals (t, &m->mass, 1);
+  deserialize_reals (t, m->c, 4);
+  deserialize_reals (t, m->I, 12);
+  return sizeof(dMass);
+}
+
 /* dMass objects are stored in specialised custom blocks. */
 static struct custom_operations dMass_custom_ops = {
   identifier: "ocamlode_dMass",
   finalize: NULL,
   compare: custom_compare_default,
   hash: custom_hash_default,
-  serialize: custom_serialize_default,
-  deserialize: custom_deserialize_default
+  serialize: serialize_dMass,
+  deserialize: deserialize_dMass
 };
 
 static inline value
@@ -270,15 +481,12 @@ dContactGeom_val (value geomv, dContactGeom *geom)
   CAMLreturn0;
 }
 
+/* Create a dSurfaceParameters C struct from an OCaml record. */
 static void
-dContact_val (value contactv, dContact *contact)
+dSurfaceParameters_val (value surfacev, dSurfaceParameters *surface)
 {
-  CAMLparam1 (contactv);
-  CAMLlocal4 (surfacev, modev, geomv, fdir1v);
-
-#if TYPE_CHECKING
-  assert (Wosize_val (contactv) == 3);
-#endif
+  CAMLparam1 (surfacev);
+  CAMLlocal1 (modev);
 
   static int initialized = 0;
   static int hashdContactMu2, hashdContactFDir1, hashdContactBounce,
@@ -303,71 +511,85 @@ dContact_val (value contactv, dContact *contact)
     initialized = 1;
   }
 
-  surfacev = Field (contactv, 0);
 #if TYPE_CHECKING
   assert (Wosize_val (surfacev) == 11);
 #endif
   modev = Field (surfacev, 0);
-  contact->surface.mode = 0;
+  surface->mode = 0;
   while (modev != Val_int (0))
     {
       int m = Field (modev, 0);
       /*
       switch (m)
         {
-        case hashdContactMu2:       contact->surface.mode |= dContactMu2; break;
-        case hashdContactFDir1:     contact->surface.mode |= dContactFDir1; break;
-        case hashdContactBounce:    contact->surface.mode |= dContactBounce; break;
-        case hashdContactSoftERP:   contact->surface.mode |= dContactSoftERP; break;
-        case hashdContactSoftCFM:   contact->surface.mode |= dContactSoftCFM; break;
-        case hashdContactMotion1:   contact->surface.mode |= dContactMotion1; break;
-        case hashdContactMotion2:   contact->surface.mode |= dContactMotion2; break;
-        case hashdContactSlip1:     contact->surface.mode |= dContactSlip1; break;
-        case hashdContactSlip2:     contact->surface.mode |= dContactSlip2; break;
-        //case hashdContactApprox0:   contact->surface.mode |= dContactApprox0; break;
-        case hashdContactApprox1_1: contact->surface.mode |= dContactApprox1_1; break;
-        case hashdContactApprox1_2: contact->surface.mode |= dContactApprox1_2; break;
-        case hashdContactApprox1:   contact->surface.mode |= dContactApprox1; break;
+        case hashdContactMu2:       surface->mode |= dContactMu2; break;
+        case hashdContactFDir1:     surface->mode |= dContactFDir1; break;
+        case hashdContactBounce:    surface->mode |= dContactBounce; break;
+        case hashdContactSoftERP:   surface->mode |= dContactSoftERP; break;
+        case hashdContactSoftCFM:   surface->mode |= dContactSoftCFM; break;
+        case hashdContactMotion1:   surface->mode |= dContactMotion1; break;
+        case hashdContactMotion2:   surface->mode |= dContactMotion2; break;
+        case hashdContactSlip1:     surface->mode |= dContactSlip1; break;
+        case hashdContactSlip2:     surface->mode |= dContactSlip2; break;
+        //case hashdContactApprox0:   surface->mode |= dContactApprox0; break;
+        case hashdContactApprox1_1: surface->mode |= dContactApprox1_1; break;
+        case hashdContactApprox1_2: surface->mode |= dContactApprox1_2; break;
+        case hashdContactApprox1:   surface->mode |= dContactApprox1; break;
         default: abort ();
         }
       */
       if (m == hashdContactMu2)
-        contact->surface.mode |= dContactMu2;
+        surface->mode |= dContactMu2;
       else if (m == hashdContactFDir1)
-        contact->surface.mode |= dContactFDir1;
+        surface->mode |= dContactFDir1;
       else if (m == hashdContactBounce)
-        contact->surface.mode |= dContactBounce;
+        surface->mode |= dContactBounce;
       else if (m == hashdContactSoftERP)
-        contact->surface.mode |= dContactSoftERP;
+        surface->mode |= dContactSoftERP;
       else if (m == hashdContactSoftCFM)
-        contact->surface.mode |= dContactSoftCFM;
+        surface->mode |= dContactSoftCFM;
       else if (m == hashdContactMotion1)
-        contact->surface.mode |= dContactMotion1;
+        surface->mode |= dContactMotion1;
       else if (m == hashdContactMotion2)
-        contact->surface.mode |= dContactMotion2;
+        surface->mode |= dContactMotion2;
       else if (m == hashdContactSlip1)
-        contact->surface.mode |= dContactSlip1;
+        surface->mode |= dContactSlip1;
       else if (m == hashdContactSlip2)
-        contact->surface.mode |= dContactSlip2;
+        surface->mode |= dContactSlip2;
       else if (m == hashdContactApprox1_1)
-        contact->surface.mode |= dContactApprox1_1;
+        surface->mode |= dContactApprox1_1;
       else if (m == hashdContactApprox1_2)
-        contact->surface.mode |= dContactApprox1_2;
+        surface->mode |= dContactApprox1_2;
       else if (m == hashdContactApprox1)
-        contact->surface.mode |= dContactApprox1;
+        surface->mode |= dContactApprox1;
       else abort ();
       modev = Field (modev, 1);
     }
-  contact->surface.mu = Double_val (Field (surfacev, 1));
-  contact->surface.mu2 = Double_val (Field (surfacev, 2));
-  contact->surface.bounce = Double_val (Field (surfacev, 3));
-  contact->surface.bounce_vel = Double_val (Field (surfacev, 4));
-  contact->surface.soft_erp = Double_val (Field (surfacev, 5));
-  contact->surface.soft_cfm = Double_val (Field (surfacev, 6));
-  contact->surface.motion1 = Double_val (Field (surfacev, 7));
-  contact->surface.motion2 = Double_val (Field (surfacev, 8));
-  contact->surface.slip1 = Double_val (Field (surfacev, 9));
-  contact->surface.slip2 = Double_val (Field (surfacev, 10));
+  surface->mu = Double_val (Field (surfacev, 1));
+  surface->mu2 = Double_val (Field (surfacev, 2));
+  surface->bounce = Double_val (Field (surfacev, 3));
+  surface->bounce_vel = Double_val (Field (surfacev, 4));
+  surface->soft_erp = Double_val (Field (surfacev, 5));
+  surface->soft_cfm = Double_val (Field (surfacev, 6));
+  surface->motion1 = Double_val (Field (surfacev, 7));
+  surface->motion2 = Double_val (Field (surfacev, 8));
+  surface->slip1 = Double_val (Field (surfacev, 9));
+  surface->slip2 = Double_val (Field (surfacev, 10));
+  CAMLreturn0;
+}
+
+static void
+dContact_val (value contactv, dContact *contact)
+{
+  CAMLparam1 (contactv);
+  CAMLlocal3 (surfacev, geomv, fdir1v);
+
+#if TYPE_CHECKING
+  assert (Wosize_val (contactv) == 3);
+#endif
+
+  surfacev = Field (contactv, 0);
+  dSurfaceParameters_val (surfacev, &contact->surface);
 
   geomv = Field (contactv, 1);
   dContactGeom_val (geomv, &contact->geom);
@@ -493,6 +715,11 @@ static const int joint_type_table[] = {
   dJointTypeLMotor,
   dJointTypePlane2D,
   dJointTypePR,
+  dJointTypePU,
+  dJointTypePiston,
+  dJointTypeDBall,
+  dJointTypeDHinge,
+  dJointTypeTransmission,
 };
 
 #define joint_type_val(joint_type_i)   (joint_type_table[Long_val(joint_type_i)])
@@ -519,6 +746,11 @@ value inline __Val_joint_type (int joint_type)
     case dJointTypeLMotor:    return Val_long(10); break;
     case dJointTypePlane2D:   return Val_long(11); break;
     case dJointTypePR:        return Val_long(12); break;
+    case dJointTypePU:        return Val_long(13); break;
+    case dJointTypePiston:    return Val_long(14); break;
+    case dJointTypeDBall:     return Val_long(15); break;
+    case dJointTypeDHinge:    return Val_long(16); break;
+    case dJointTypeTransmission: return Val_long(17); break;
     default: caml_failwith ("unhandled joint type");
   }
 }
@@ -540,7 +772,7 @@ void finalize_voidptrs2 (value v)
   data2 = ((struct voidptr2 *) Data_custom_val (v))->data2;
 
   if (data2 != NULL) {
-    free (data2);
+    ocamlode_free (data2);
     data2 = NULL;
   }
 
@@ -582,7 +814,7 @@ set_data2 (value rv, void * data2)
   void *_data2 = (((struct voidptr2 *) Data_custom_val (rv))->data2);
   if ( _data2 != NULL )
   {
-    free (_data2);
+    ocamlode_free (_data2);
   }
   ((struct voidptr2 *) Data_custom_val (rv))->data2 = data2;
 }
@@ -591,3217 +823,10020 @@ set_data2 (value rv, void * data2)
 
 /* }}} */
 
-/* {{{ Global */
+/* {{{ Geom materials */
 
-CAMLprim value
-ocamlode_dGetInfinity (value unit)
+/* The material of a geom is a small integer indexing the contact tables
+   of the substep driver, 0 by default.  The map only holds the geoms with
+   a non zero material, and forgets the geoms when they are destroyed. */
+
+struct geom_material {
+  dGeomID geom;
+  int material;
+  struct geom_material *next;
+};
+
+static struct geom_material **geom_materials = NULL;
+static unsigned int geom_materials_size = 0;
+static unsigned int geom_materials_count = 0;
+
+static inline unsigned int
+geom_material_hash (dGeomID g, unsigned int size)
 {
-  CAMLparam1 (unit);
-  CAMLreturn (caml_copy_double (dInfinity));
+  uintptr_t h = (uintptr_t) g;
+  h ^= h >> 17;
+  h *= 0x9e3779b1u;
+  return (unsigned int) (h ^ (h >> 13)) & (size - 1);
 }
 
-CAMLprim value
-ocamlode_dInitODE (value u)
+static int
+geom_material_get (dGeomID g)
 {
-  CAMLparam1 (u);
-  dInitODE();
-  CAMLreturn (Val_unit);
+  struct geom_material *m;
+  if (geom_materials_count == 0) return 0;
+  for (m = geom_materials[geom_material_hash(g, geom_materials_size)]; m != NULL; m = m->next)
+    if (m->geom == g) return m->material;
+  return 0;
 }
 
-static const unsigned int dInitODEFlags_table[] = {
-#if ( (ODE_VERSION_MAJOR == 0) && (ODE_VERSION_MINOR >= 10) ) || (ODE_VERSION_MAJOR > 0)
-  dInitFlagManualThreadCleanup,
-#else
-  0,
-#endif
-};
+static void
+geom_material_forget (dGeomID g)
+{
+  struct geom_material *m, **mp;
+  if (geom_materials_count == 0) return;
+  mp = &geom_materials[geom_material_hash(g, geom_materials_size)];
+  for (m = *mp; m != NULL; mp = &m->next, m = m->next) {
+    if (m->geom == g) {
+      *mp = m->next;
+      geom_materials_count--;
+      free(m);
+      return;
+    }
+  }
+}
+
+static int
+geom_material_set (dGeomID g, int material)
+{
+  struct geom_material *m;
+  unsigned int h;
+
+  geom_material_forget(g);
+  if (material == 0) return 1;
+  if (geom_materials_count >= geom_materials_size) {
+    unsigned int i, size = geom_materials_size ? 2 * geom_materials_size : 256;
+    struct geom_material **ms = calloc(size, sizeof(struct geom_material *));
+    if (ms == NULL) return 0;
+    for (i = 0; i < geom_materials_size; i++) {
+      struct geom_material *next;
+      for (m = geom_materials[i]; m != NULL; m = next) {
+        next = m->next;
+        h = geom_material_hash(m->geom, size);
+        m->next = ms[h];
+        ms[h] = m;
+      }
+    }
+    free(geom_materials);
+    geom_materials = ms;
+    geom_materials_size = size;
+  }
+  m = malloc(sizeof(struct geom_material));
+  if (m == NULL) return 0;
+  h = geom_material_hash(g, geom_materials_size);
+  m->geom = g;
+  m->material = material;
+  m->next = geom_materials[h];
+  geom_materials[h] = m;
+  geom_materials_count++;
+  return 1;
+}
 
 CAMLprim value
-ocamlode_dInitODE2 (value uiInitFlagsv)
+ocamlode_dGeomSetMaterial (value geomv, value materialv)
 {
-  CAMLparam1 (uiInitFlagsv);
-#if ( (ODE_VERSION_MAJOR == 0) && (ODE_VERSION_MINOR >= 10) ) || (ODE_VERSION_MAJOR > 0)
-  unsigned int uiInitFlags = dInitODEFlags_table[Long_val(uiInitFlagsv)];
-  int success = dInitODE2 (uiInitFlags);
-  if (!success)
-    caml_failwith("dInitODE2");
-#else
-  caml_failwith("dInitODE2: function available since ODE version 0.10.0");
-#endif
-  CAMLreturn (Val_unit);
+  if (Int_val (materialv) < 0)
+    caml_invalid_argument ("dGeomSetMaterial: negative material");
+  if (!geom_material_set (dGeomID_val (geomv), Int_val (materialv)))
+    caml_failwith ("Out of memory");
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dCloseODE (value unit)
+ocamlode_dGeomGetMaterial (value geomv)
 {
-  CAMLparam1 (unit);
-  dCloseODE ();
-  CAMLreturn (Val_unit);
+  return Val_int (geom_material_get (dGeomID_val (geomv)));
 }
 
 /* }}} */
-/* {{{ World */
 
-CAMLprim value
-ocamlode_dWorldCreate (value unit)
+/* {{{ Shared collision datas */
+
+/* A shared data owns a trimesh, convex or heightfield data, and is reference
+   counted: one reference for the handle returned to OCaml, and one for each
+   geom instancing it.  The data is freed once, when the handle has been
+   released and the last geom using it has been destroyed. */
+
+enum shared_kind {
+  SHARED_TRIMESH,
+  SHARED_CONVEX,
+  SHARED_HEIGHTFIELD,
+};
+
+struct shared_data {
+  enum shared_kind kind;
+  int refcount;
+  int instances;
+  size_t bytes;
+  dTriMeshDataID trimesh;
+  dHeightfieldDataID heightfield;
+  dReal *vertices;      /* trimesh vertices, or heightfield samples */
+  int *indices;
+  unsigned int vertexcount, indexcount;
+  dReal *planes;
+  dReal *points;
+  unsigned int *polygons;
+  unsigned int planecount, pointcount, polyscount;
+  /* heightfield parameters */
+  dReal width, depth, scale, offset, thickness;
+  int width_samples, depth_samples, wrap;
+};
+
+#define shared_data_val(v) Voidptr_val(struct shared_data *, (v))
+
+/* geom -> shared data, to release the reference when a geom is destroyed */
+struct shared_ref {
+  dGeomID geom;
+  struct shared_data *data;
+  struct shared_ref *next;
+};
+
+static struct shared_ref **shared_refs = NULL;
+static unsigned int shared_refs_size = 0;
+static unsigned int shared_refs_count = 0;
+
+static long shared_datas_count = 0;
+static size_t shared_datas_bytes = 0;
+
+static inline unsigned int
+shared_ref_hash (dGeomID g, unsigned int size)
 {
-  CAMLparam1 (unit);
-  dWorldID id = dWorldCreate ();
-  CAMLreturn (Val_dWorldID (id));
+  uintptr_t h = (uintptr_t) g;
+  h ^= h >> 17;
+  h *= 0x9e3779b1u;
+  return (unsigned int) (h ^ (h >> 13)) & (size - 1);
 }
 
-CAMLprim value
-ocamlode_dWorldDestroy (value idv)
-{
-  CAMLparam1 (idv);
-  dWorldID id = dWorldID_val (idv);
-  dWorldDestroy (id);
-  destroy_voidptr (idv);
-  CAMLreturn (Val_unit);
+static int
+shared_ref_add (dGeomID g, struct shared_data *d)
+{
+  struct shared_ref *r;
+  unsigned int h;
+
+  if (shared_refs_count >= shared_refs_size) {
+    unsigned int i, size = shared_refs_size ? 2 * shared_refs_size : 256;
+    struct shared_ref **refs = calloc(size, sizeof(struct shared_ref *));
+    if (refs == NULL) return 0;
+    for (i = 0; i < shared_refs_size; i++) {
+      struct shared_ref *next;
+      for (r = shared_refs[i]; r != NULL; r = next) {
+        next = r->next;
+        h = shared_ref_hash(r->geom, size);
+        r->next = refs[h];
+        refs[h] = r;
+      }
+    }
+    free(shared_refs);
+    shared_refs = refs;
+    shared_refs_size = size;
+  }
+  r = malloc(sizeof(struct shared_ref));
+  if (r == NULL) return 0;
+  h = shared_ref_hash(g, shared_refs_size);
+  r->geom = g;
+  r->data = d;
+  r->next = shared_refs[h];
+  shared_refs[h] = r;
+  shared_refs_count++;
+  return 1;
 }
 
-CAMLprim value
-ocamlode_dWorldSetGravity (value idv, value xv, value yv, value zv)
+static void
+shared_data_unref (struct shared_data *d)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dWorldID id = dWorldID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dWorldSetGravity (id, x, y, z);
-  CAMLreturn (Val_unit);
+  if (--d->refcount > 0) return;
+  switch (d->kind)
+  {
+    case SHARED_TRIMESH:
+      dGeomTriMeshDataDestroy(d->trimesh);
+      break;
+    case SHARED_HEIGHTFIELD:
+      dGeomHeightfieldDataDestroy(d->heightfield);
+      break;
+    case SHARED_CONVEX:
+      break;
+  }
+  ocamlode_free(d->vertices);
+  ocamlode_free(d->indices);
+  ocamlode_free(d->planes);
+  ocamlode_free(d->points);
+  ocamlode_free(d->polygons);
+  shared_datas_count--;
+  shared_datas_bytes -= d->bytes;
+  free(d);
 }
 
-CAMLprim value
-ocamlode_dWorldGetGravity (value idv)
+static struct shared_data *
+shared_ref_find (dGeomID g)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dWorldID id = dWorldID_val (idv);
-  dVector3 gravity;
-  dWorldGetGravity (id, gravity);
-  rv = copy_dReal_array (gravity, 4);
-  CAMLreturn (rv);
+  struct shared_ref *r;
+  if (shared_refs_count == 0) return NULL;
+  for (r = shared_refs[shared_ref_hash(g, shared_refs_size)]; r != NULL; r = r->next)
+    if (r->geom == g) return r->data;
+  return NULL;
 }
 
-CAMLprim value
-ocamlode_dWorldSetERP (value idv, value erp)
-{
-  dWorldID id = dWorldID_val (idv);
-  dWorldSetERP (id, Double_val(erp));
-  return Val_unit;
+/* to call before a geom is destroyed, also forgets its material,
+   and the geom of a transform which destroys it */
+static void
+shared_geom_destroyed (dGeomID g)
+{
+  struct shared_ref *r, **rp;
+  geom_material_forget(g);
+  if (shared_refs_count != 0) {
+    rp = &shared_refs[shared_ref_hash(g, shared_refs_size)];
+    for (r = *rp; r != NULL; rp = &r->next, r = r->next) {
+      if (r->geom == g) {
+        *rp = r->next;
+        shared_refs_count--;
+        r->data->instances--;
+        shared_data_unref(r->data);
+        free(r);
+        break;
+      }
+    }
+  }
+  if (dGeomGetClass(g) == dGeomTransformClass && dGeomTransformGetCleanup(g)) {
+    dGeomID inner = dGeomTransformGetGeom(g);
+    if (inner != NULL) shared_geom_destroyed(inner);
+  }
 }
 
-CAMLprim value
-ocamlode_dWorldGetERP (value idv)
-{
-  dWorldID id = dWorldID_val (idv);
-  dReal r = dWorldGetERP (id);
-  return caml_copy_double (r);
+/* to call before a space is destroyed, the geoms it contains
+   are also destroyed if its cleanup mode is set */
+static void
+shared_space_destroyed (dSpaceID s)
+{
+  int i, n;
+  if ((shared_refs_count == 0 && geom_materials_count == 0) || !dSpaceGetCleanup(s)) return;
+  n = dSpaceGetNumGeoms(s);
+  for (i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom(s, i);
+    if (dGeomIsSpace(g))
+      shared_space_destroyed((dSpaceID) g);
+    else
+      shared_geom_destroyed(g);
+  }
 }
 
-CAMLprim value
-ocamlode_dWorldSetCFM (value idv, value cfmv)
+static struct shared_data *
+shared_data_alloc (enum shared_kind kind)
 {
-  CAMLparam2 (idv, cfmv);
-  dWorldID id = dWorldID_val (idv);
-  dReal cfm = Double_val (cfmv);
-  dWorldSetCFM (id, cfm);
-  CAMLreturn (Val_unit);
+  struct shared_data *d = calloc(1, sizeof(struct shared_data));
+  if (d == NULL) caml_failwith("Out of memory");
+  d->kind = kind;
+  d->refcount = 1;
+  return d;
 }
 
-CAMLprim value
-ocamlode_dWorldGetCFM (value idv)
+static void
+shared_data_register (struct shared_data *d)
 {
-  dWorldID id = dWorldID_val (idv);
-  dReal r = dWorldGetCFM( id );
-  return caml_copy_double (r);
+  shared_datas_count++;
+  shared_datas_bytes += d->bytes;
 }
 
-CAMLprim value
-ocamlode_dWorldStep (value idv, value stepsizev)
+static value
+Val_shared_data (struct shared_data *d)
 {
-  CAMLparam2 (idv, stepsizev);
-  dWorldID id = dWorldID_val (idv);
-  dReal stepsize = Double_val (stepsizev);
-  dWorldStep (id, stepsize);
-  CAMLreturn (Val_unit);
+  shared_data_register (d);
+  return Val_voidptr (d);
 }
 
-CAMLprim value
-ocamlode_dWorldQuickStep (value idv, value stepsizev)
+/* builds the ODE data from the vertices and indices */
+static void
+shared_trimesh_build (struct shared_data *d)
 {
-  CAMLparam2 (idv, stepsizev);
-  dWorldID id = dWorldID_val (idv);
-  dReal stepsize = Double_val (stepsizev);
-  dWorldQuickStep (id, stepsize);
-  CAMLreturn (Val_unit);
+  d->trimesh = dGeomTriMeshDataCreate();
+#if defined(dSINGLE)
+  dGeomTriMeshDataBuildSingle (d->trimesh, d->vertices, 3 * sizeof(dReal), d->vertexcount,
+                               d->indices, d->indexcount, 3 * sizeof(int));
+#else
+  dGeomTriMeshDataBuildDouble (d->trimesh, d->vertices, 3 * sizeof(dReal), d->vertexcount,
+                               d->indices, d->indexcount, 3 * sizeof(int));
+#endif
 }
 
-CAMLprim value
-ocamlode_dWorldSetQuickStepNumIterations( value worldv, value num )
+/* builds the ODE data from the samples and the heightfield parameters */
+static void
+shared_heightfield_build (struct shared_data *d)
 {
-  CAMLparam2 (worldv, num);
-  dWorldID world = dWorldID_val (worldv);
-  dWorldSetQuickStepNumIterations( world, Int_val(num) );
-  CAMLreturn (Val_unit);
+  d->heightfield = dGeomHeightfieldDataCreate();
+#if defined(dSINGLE)
+  dGeomHeightfieldDataBuildSingle(
+#else
+  dGeomHeightfieldDataBuildDouble(
+#endif
+                  d->heightfield,
+                  d->vertices,
+                  0, // bCopyHeightData, the shared data keeps the samples
+                  d->width, d->depth,
+                  d->width_samples, d->depth_samples,
+                  d->scale, d->offset, d->thickness,
+                  d->wrap );
 }
 
-CAMLprim value
-ocamlode_dWorldGetQuickStepNumIterations( value worldv )
-{
-  CAMLparam1 (worldv);
-  int _ret;
-  dWorldID world = dWorldID_val (worldv);
-  _ret = dWorldGetQuickStepNumIterations (world);
-  CAMLreturn (Val_int (_ret));
-}
+/* }}} */
 
-CAMLprim value
-ocamlode_dWorldSetContactSurfaceLayer (value world, value depth)
+/* {{{ Arenas */
+
+/* An arena records the objects created while it is the current arena,
+   and destroys all of them at once with dArenaDestroy.  Every record
+   keeps the OCaml handle of its object, so that it can be invalidated
+   when the object is destroyed. */
+
+enum arena_kind {
+  ARENA_JOINT,
+  ARENA_FEEDBACK,
+  ARENA_JOINT_GROUP,
+  ARENA_GEOM,
+  ARENA_SPACE,
+  ARENA_BODY,
+  ARENA_TRIMESH_DATA,
+  ARENA_KINDS
+};  /* in teardown order */
+
+struct arena;
+
+struct arena_entry {
+  enum arena_kind kind;
+  void *ptr;
+  void *owner;  /* the world of bodies and joints, the joint of feedbacks */
+  unsigned long serial;
+  value handle;
+  struct arena *arena;
+  struct arena_entry *prev, *next;  /* in the list of its kind */
+  struct arena_entry *hnext;        /* in the table by pointer */
+};
+
+struct arena {
+  struct arena_entry *heads[ARENA_KINDS];
+  struct arena *outer;  /* current arena when this one was entered */
+  int entered;
+  long count;
+};
+
+static struct arena *current_arena = NULL;
+
+/* all the entries of all the arenas by object pointer,
+   to forget the objects destroyed by the user */
+static struct arena_entry **arena_table = NULL;
+static unsigned int arena_table_size = 0;
+static unsigned int arena_entries_count = 0;
+static unsigned long arena_serial = 0;
+
+static inline unsigned int
+arena_hash (void *p, unsigned int size)
 {
-  dWorldSetContactSurfaceLayer (dWorldID_val (world), Double_val (depth));
-  return Val_unit;
+  return (unsigned int) (((uintptr_t) p >> 4) * 2654435761u) & (size - 1);
 }
 
-CAMLprim value
-ocamlode_dWorldGetContactSurfaceLayer (value world)
-{
-  return caml_copy_double (dWorldGetContactSurfaceLayer (dWorldID_val (world)));
+static int
+arena_table_grow (void)
+{
+  unsigned int i, h, size = arena_table_size ? 2 * arena_table_size : 1024;
+  struct arena_entry *e, *next, **table;
+  table = calloc(size, sizeof(struct arena_entry *));
+  if (table == NULL) return 0;
+  for (i = 0; i < arena_table_size; i++) {
+    for (e = arena_table[i]; e != NULL; e = next) {
+      next = e->hnext;
+      h = arena_hash(e->ptr, size);
+      e->hnext = table[h];
+      table[h] = e;
+    }
+  }
+  free(arena_table);
+  arena_table = table;
+  arena_table_size = size;
+  return 1;
 }
 
-CAMLprim value
-ocamlode_dWorldSetAutoDisableLinearThreshold (value world, value linear_threshold)
+static struct arena_entry *
+arena_lookup (void *p)
 {
-  dWorldSetAutoDisableLinearThreshold (dWorldID_val (world), Double_val (linear_threshold));
-  return Val_unit;
+  struct arena_entry *e;
+  if (arena_entries_count == 0) return NULL;
+  for (e = arena_table[arena_hash(p, arena_table_size)]; e != NULL; e = e->hnext)
+    if (e->ptr == p) return e;
+  return NULL;
 }
 
-CAMLprim value
-ocamlode_dWorldGetAutoDisableLinearThreshold (value world)
+static struct arena_entry *
+arena_add (struct arena *a, enum arena_kind kind, void *p, void *owner, value handle)
 {
-  return caml_copy_double (dWorldGetAutoDisableLinearThreshold (dWorldID_val (world)));
+  struct arena_entry *e;
+  unsigned int h;
+
+  if (arena_entries_count >= arena_table_size && !arena_table_grow())
+    caml_failwith("Out of memory");
+  e = malloc(sizeof(struct arena_entry));
+  if (e == NULL) caml_failwith("Out of memory");
+  e->kind = kind;
+  e->ptr = p;
+  e->owner = owner;
+  e->serial = ++arena_serial;
+  e->handle = handle;
+  e->arena = a;
+  e->prev = NULL;
+  e->next = a->heads[kind];
+  if (e->next != NULL) e->next->prev = e;
+  a->heads[kind] = e;
+  a->count++;
+  h = arena_hash(p, arena_table_size);
+  e->hnext = arena_table[h];
+  arena_table[h] = e;
+  arena_entries_count++;
+  if (Is_block(handle))
+    caml_register_generational_global_root(&e->handle);
+  return e;
+}
+
+/* record a newly created object in the current arena,
+   returns its handle unchanged */
+static value
+arena_track (enum arena_kind kind, void *p, void *owner, value handle)
+{
+  if (current_arena != NULL && p != NULL)
+    arena_add(current_arena, kind, p, owner, handle);
+  return handle;
 }
 
-CAMLprim value
-ocamlode_dWorldSetAutoDisableAngularThreshold (value world, value angular_threshold)
+static void
+arena_remove (struct arena_entry *e)
 {
-  dWorldSetAutoDisableAngularThreshold (dWorldID_val (world), Double_val (angular_threshold));
-  return Val_unit;
+  struct arena_entry **ep;
+  struct arena *a = e->arena;
+
+  for (ep = &arena_table[arena_hash(e->ptr, arena_table_size)];
+       *ep != e; ep = &(*ep)->hnext);
+  *ep = e->hnext;
+  arena_entries_count--;
+
+  if (e->prev != NULL) e->prev->next = e->next;
+  else a->heads[e->kind] = e->next;
+  if (e->next != NULL) e->next->prev = e->prev;
+  a->count--;
+
+  if (Is_block(e->handle)) {
+    destroy_voidptr(e->handle);
+    caml_remove_generational_global_root(&e->handle);
+  }
+  free(e);
 }
 
-CAMLprim value
-ocamlode_dWorldGetAutoDisableAngularThreshold (value world)
+/* to call before an object is destroyed by any other way than its arena */
+static void
+arena_forget (void *p)
 {
-  return caml_copy_double (dWorldGetAutoDisableAngularThreshold (dWorldID_val (world)));
+  struct arena_entry *e = arena_lookup(p);
+  if (e != NULL) arena_remove(e);
 }
 
-/*
-CAMLprim value
-ocamlode_dWorldSetAutoDisableLinearAverageThreshold (value world, value linear_average_threshold)
+static void feedback_arenas_forget (dJointID j, dJointFeedback *f);
+
+/* the feedback buffer recorded for a joint forgets it,
+   to call before the joint is destroyed or gets another buffer */
+static void
+arena_feedback_forget (dJointID j)
+{
+  struct arena_entry *e;
+  dJointFeedback *f = dJointGetFeedback(j);
+  feedback_arenas_forget(j, f);
+  if (arena_entries_count == 0) return;
+  if (f != NULL && (e = arena_lookup(f)) != NULL &&
+      e->kind == ARENA_FEEDBACK && e->owner == j)
+    e->owner = NULL;
+}
+
+/* ODE has no accessor for the group of a joint, the joints created in a
+   group while an arena is current are recorded by group, so that their
+   feedback buffers can be recorded in the arena and forgotten when the
+   group is emptied.  The other joints are known by their arena entry. */
+
+struct group_joint {
+  dJointID joint;
+  struct group_joint *hnext;  /* in the table by joint */
+  struct group_joint *next;   /* in the list of its group */
+};
+
+struct joint_group {
+  dJointGroupID id;
+  struct group_joint *joints;
+  struct joint_group *next;
+};
+
+static struct joint_group *joint_groups = NULL;
+static struct group_joint **group_joints = NULL;
+static unsigned int group_joints_size = 0;
+static unsigned int group_joints_count = 0;
+
+static int
+group_joint_add (dJointGroupID group, dJointID j)
+{
+  struct joint_group *g;
+  struct group_joint *r, *next, **table;
+  unsigned int h;
+
+  for (g = joint_groups; g != NULL && g->id != group; g = g->next);
+  if (g == NULL) {
+    g = malloc(sizeof(struct joint_group));
+    if (g == NULL) return 0;
+    g->id = group;
+    g->joints = NULL;
+    g->next = joint_groups;
+    joint_groups = g;
+  }
+  if (group_joints_count >= group_joints_size) {
+    unsigned int i, size = group_joints_size ? 2 * group_joints_size : 256;
+    table = calloc(size, sizeof(struct group_joint *));
+    if (table == NULL) return 0;
+    for (i = 0; i < group_joints_size; i++) {
+      for (r = group_joints[i]; r != NULL; r = next) {
+        next = r->hnext;
+        h = arena_hash(r->joint, size);
+        r->hnext = table[h];
+        table[h] = r;
+      }
+    }
+    free(group_joints);
+    group_joints = table;
+    group_joints_size = size;
+  }
+  r = malloc(sizeof(struct group_joint));
+  if (r == NULL) return 0;
+  r->joint = j;
+  r->next = g->joints;
+  g->joints = r;
+  h = arena_hash(j, group_joints_size);
+  r->hnext = group_joints[h];
+  group_joints[h] = r;
+  group_joints_count++;
+  return 1;
+}
+
+static int
+group_joint_known (dJointID j)
 {
-  dWorldSetAutoDisableLinearAverageThreshold (dWorldID_val(world), Double_val (linear_average_threshold));
-  return Val_unit;
+  struct group_joint *r;
+  if (group_joints_count == 0) return 0;
+  for (r = group_joints[arena_hash(j, group_joints_size)]; r != NULL; r = r->hnext)
+    if (r->joint == j) return 1;
+  return 0;
 }
 
-CAMLprim value
-ocamlode_dWorldGetAutoDisableLinearAverageThreshold (value world)
+/* a joint whose destruction is known: recorded in an arena or in a group */
+static int
+joint_known (dJointID j)
 {
-  return caml_copy_double (dWorldGetAutoDisableLinearAverageThreshold (dWorldID_val(world)));
+  struct arena_entry *e = arena_lookup(j);
+  return ((e != NULL && e->kind == ARENA_JOINT) || group_joint_known(j));
 }
 
-CAMLprim value
-ocamlode_dWorldSetAutoDisableAngularAverageThreshold (value world, value angular_average_threshold)
+/* to call before a group is emptied, or destroyed */
+static void
+joint_group_emptied (dJointGroupID group, int destroyed)
+{
+  struct joint_group *g, **gp;
+  struct group_joint *r, *next, **rp;
+
+  for (gp = &joint_groups; (g = *gp) != NULL && g->id != group; gp = &g->next);
+  if (g == NULL) return;
+  for (r = g->joints; r != NULL; r = next) {
+    next = r->next;
+    arena_feedback_forget(r->joint);
+    for (rp = &group_joints[arena_hash(r->joint, group_joints_size)]; *rp != r; rp = &(*rp)->hnext);
+    *rp = r->hnext;
+    group_joints_count--;
+    free(r);
+  }
+  g->joints = NULL;
+  if (destroyed) {
+    *gp = g->next;
+    free(g);
+  }
+}
+
+static void
+arena_geom_destroyed (dGeomID g)
 {
-  dWorldSetAutoDisableAngularAverageThreshold (dWorldID_val(world), Double_val (angular_average_threshold));
-  return Val_unit;
+  if (arena_entries_count == 0) return;
+  arena_forget(g);
+  if (dGeomGetClass(g) == dGeomTransformClass && dGeomTransformGetCleanup(g)) {
+    dGeomID inner = dGeomTransformGetGeom(g);
+    if (inner != NULL) arena_geom_destroyed(inner);
+  }
 }
 
-CAMLprim value
-ocamlode_dWorldGetAutoDisableAngularAverageThreshold (value world)
+static void
+arena_space_destroyed (dSpaceID s)
+{
+  int i, n;
+  if (arena_entries_count == 0) return;
+  arena_forget(s);
+  if (!dSpaceGetCleanup(s)) return;
+  n = dSpaceGetNumGeoms(s);
+  for (i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom(s, i);
+    if (dGeomIsSpace(g))
+      arena_space_destroyed((dSpaceID) g);
+    else
+      arena_geom_destroyed(g);
+  }
+}
+
+/* a world destroys its bodies and its joints */
+static void
+arena_world_destroyed (dWorldID w)
+{
+  unsigned int i;
+  struct arena_entry *e, *next;
+  for (i = 0; i < arena_table_size && arena_entries_count > 0; i++) {
+    for (e = arena_table[i]; e != NULL; e = next) {
+      next = e->hnext;
+      if ((e->kind == ARENA_BODY || e->kind == ARENA_JOINT) && e->owner == w) {
+        if (e->kind == ARENA_JOINT) arena_feedback_forget((dJointID) e->ptr);
+        arena_remove(e);
+      }
+    }
+  }
+}
+
+/* the recorders, trackers and terrain pagers holding raw bodies, joints
+   and spaces are told of their destruction, these are defined after them */
+static void trackers_body_destroyed (dBodyID b);
+static void trackers_joint_destroyed (dJointID j);
+static void trackers_world_destroyed (dWorldID w);
+static void trackers_space_destroyed (dSpaceID s);
+
+static void
+arena_destroy_entry (struct arena_entry *e)
 {
-  return caml_copy_double (dWorldGetAutoDisableAngularAverageThreshold (dWorldID_val (world)));
+  void *p = e->ptr;
+  switch (e->kind)
+  {
+    case ARENA_JOINT:
+      arena_remove(e);
+      arena_feedback_forget((dJointID) p);
+      trackers_joint_destroyed((dJointID) p);
+      dJointDestroy((dJointID) p);
+      break;
+    case ARENA_FEEDBACK:
+      {
+        /* the feedback of a joint that outlives the arena is detached,
+           the owner is cleared when the joint is destroyed */
+        dJointID j = (dJointID) e->owner;
+        arena_remove(e);
+        if (j != NULL && dJointGetFeedback(j) == p)
+          dJointSetFeedback(j, NULL);
+        ocamlode_free(p);
+      }
+      break;
+    case ARENA_JOINT_GROUP:
+      arena_remove(e);
+      joint_group_emptied((dJointGroupID) p, 1);
+      dJointGroupDestroy((dJointGroupID) p);
+      break;
+    case ARENA_GEOM:
+      shared_geom_destroyed((dGeomID) p);
+      arena_geom_destroyed((dGeomID) p);
+      dGeomDestroy((dGeomID) p);
+      break;
+    case ARENA_SPACE:
+      shared_space_destroyed((dSpaceID) p);
+      arena_space_destroyed((dSpaceID) p);
+      trackers_space_destroyed((dSpaceID) p);
+      dSpaceDestroy((dSpaceID) p);
+      break;
+    case ARENA_BODY:
+      arena_remove(e);
+      trackers_body_destroyed((dBodyID) p);
+      dBodyDestroy((dBodyID) p);
+      break;
+    case ARENA_TRIMESH_DATA:
+      arena_remove(e);
+      dGeomTriMeshDataDestroy((dTriMeshDataID) p);
+      break;
+    case ARENA_KINDS:
+      break;
+  }
 }
-*/
+
+#define arena_val(v) Voidptr_val(struct arena *, (v))
 
 CAMLprim value
-ocamlode_dWorldSetAutoDisableAverageSamplesCount (value world, value average_samples_count)
+ocamlode_dArenaCreate (value unit)
 {
-  dWorldSetAutoDisableAverageSamplesCount (dWorldID_val (world), Int_val (average_samples_count));
-  return Val_unit;
+  struct arena *a = calloc(1, sizeof(struct arena));
+  if (a == NULL) caml_failwith("Out of memory");
+  return Val_voidptr (a);
 }
 
 CAMLprim value
-ocamlode_dWorldGetAutoDisableAverageSamplesCount (value world)
+ocamlode_dArenaEnter (value av)
 {
-  return Val_int (dWorldGetAutoDisableAverageSamplesCount (dWorldID_val (world)));
+  struct arena *a = arena_val (av);
+  if (a->entered)
+    caml_invalid_argument ("dArenaEnter: arena already entered");
+  a->outer = current_arena;
+  a->entered = 1;
+  current_arena = a;
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dWorldSetAutoDisableSteps (value world, value steps)
+ocamlode_dArenaLeave (value av)
 {
-  dWorldSetAutoDisableSteps (dWorldID_val (world), Int_val (steps));
+  struct arena *a = arena_val (av);
+  if (a != current_arena)
+    caml_invalid_argument ("dArenaLeave: not the current arena");
+  current_arena = a->outer;
+  a->outer = NULL;
+  a->entered = 0;
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dWorldGetAutoDisableSteps (value world)
+ocamlode_dArenaCount (value av)
 {
-  return Val_int (dWorldGetAutoDisableSteps (dWorldID_val (world)));
+  return Val_long (arena_val (av)->count);
 }
 
 CAMLprim value
-ocamlode_dWorldSetAutoDisableTime (value world, value time)
+ocamlode_dArenaDestroy (value av)
 {
-  dWorldSetAutoDisableTime (dWorldID_val (world), Double_val (time));
+  struct arena *a = arena_val (av);
+  int k;
+  if (a == NULL) return Val_unit;
+  if (a->entered) {
+    if (a != current_arena)
+      caml_invalid_argument ("dArenaDestroy: an inner arena is still entered");
+    current_arena = a->outer;
+  }
+  /* the spaces are destroyed after the geoms,
+     so only the untracked geoms are left to their cleanup mode */
+  for (k = 0; k < ARENA_KINDS; k++)
+    while (a->heads[k] != NULL)
+      arena_destroy_entry (a->heads[k]);
+  free (a);
+  destroy_voidptr (av);
   return Val_unit;
 }
 
-CAMLprim value
-ocamlode_dWorldGetAutoDisableTime (value world)
+/* }}} */
+/* {{{ Managed handles */
+
+/* Once enabled, the handles of the objects created outside of any arena
+   carry a finaliser.  The finaliser only pushes the object on a lock-free
+   list, and the objects are destroyed at the next world step (or by
+   dManagedCollect), never from the GC nor in the middle of a step.
+   The objects are recorded in an internal arena which doesn't hold their
+   handles, so the objects destroyed by other means are forgotten. */
+
+struct managed_ptr {
+  void *data;            /* as in struct voidptr */
+  unsigned long serial;  /* of its record, the address can be reused */
+};
+
+struct managed_node {
+  void *ptr;
+  unsigned long serial;
+  struct managed_node *next;
+};
+
+static struct arena managed_arena;
+static int managed_enabled = 0;
+static struct managed_node *managed_pending = NULL;
+static unsigned int managed_pending_count = 0;
+
+static void
+finalize_managed (value v)
+{
+  struct managed_ptr *m = (struct managed_ptr *) Data_custom_val (v);
+  struct managed_node *n;
+  if (m->data == NULL) return;  /* destroyed with this handle */
+  n = malloc (sizeof (struct managed_node));
+  if (n == NULL) return;
+  n->ptr = m->data;
+  n->serial = m->serial;
+  n->next = __atomic_load_n (&managed_pending, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n (&managed_pending, &n->next, n, 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  __atomic_add_fetch (&managed_pending_count, 1, __ATOMIC_RELAXED);
+}
+
+static struct custom_operations managed_custom_ops = {
+  identifier: "ocamlode_managed",
+  finalize: finalize_managed,
+  compare: compare_voidptrs,
+  hash: hash_voidptr,
+  serialize: custom_serialize_default,
+  deserialize: custom_deserialize_default
+};
+
+/* handle of a newly created object, recorded in the current arena,
+   or managed */
+static value
+Val_owned (enum arena_kind kind, void *p, void *owner)
 {
-  return caml_copy_double (dWorldGetAutoDisableTime (dWorldID_val (world)));
+  CAMLparam0 ();
+  CAMLlocal1 (rv);
+  struct arena_entry *e;
+  if (current_arena != NULL || !managed_enabled || p == NULL)
+    CAMLreturn (arena_track (kind, p, owner, Val_voidptr (p)));
+  e = arena_add (&managed_arena, kind, p, owner, Val_unit);
+  rv = caml_alloc_custom (&managed_custom_ops, sizeof (struct managed_ptr), 0, 1);
+  ((struct managed_ptr *) Data_custom_val (rv))->data = p;
+  ((struct managed_ptr *) Data_custom_val (rv))->serial = e->serial;
+  CAMLreturn (rv);
 }
 
-CAMLprim value
-ocamlode_dWorldSetAutoDisableFlag (value world, value do_auto_disable)
+/* handle of a newly created joint, recorded in its group while an arena
+   is current, or owned */
+static value
+Val_joint (dJointID id, dWorldID world, dJointGroupID group)
 {
-  dWorldSetAutoDisableFlag (dWorldID_val (world), Int_val (do_auto_disable));
-  return Val_unit;
+  if (group == 0) return Val_owned (ARENA_JOINT, id, world);
+  if (current_arena != NULL && !group_joint_add(group, id))
+    caml_failwith("Out of memory");
+  return Val_dJointID (id);
 }
 
-CAMLprim value
-ocamlode_dWorldGetAutoDisableFlag (value world)
-{
-  return Val_bool (dWorldGetAutoDisableFlag (dWorldID_val (world)));
+/* destroys the objects whose handles were finalised */
+static int
+managed_collect (void)
+{
+  struct managed_node *n, *next;
+  int count = 0;
+  if (__atomic_load_n (&managed_pending, __ATOMIC_RELAXED) == NULL) return 0;
+  n = __atomic_exchange_n (&managed_pending, NULL, __ATOMIC_ACQUIRE);
+  for (; n != NULL; n = next) {
+    struct arena_entry *e = arena_lookup (n->ptr);
+    next = n->next;
+    if (e != NULL && e->arena == &managed_arena && e->serial == n->serial) {
+      arena_destroy_entry (e);
+      count++;
+    }
+    __atomic_sub_fetch (&managed_pending_count, 1, __ATOMIC_RELAXED);
+    free (n);
+  }
+  return count;
 }
 
 CAMLprim value
-ocamlode_dWorldSetQuickStepW (value world, value over_relaxation)
+ocamlode_dManagedEnable (value unit)
 {
-  dWorldSetQuickStepW (dWorldID_val (world), Double_val (over_relaxation));
+  managed_enabled = 1;
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dWorldGetQuickStepW (value world)
+ocamlode_dManagedDisable (value unit)
 {
-  return caml_copy_double (dWorldGetQuickStepW (dWorldID_val (world)));
+  managed_enabled = 0;
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dWorldSetContactMaxCorrectingVel (value world, value vel)
+ocamlode_dManagedCollect (value unit)
 {
-  dWorldSetContactMaxCorrectingVel (dWorldID_val (world), Double_val (vel));
-  return Val_unit;
+  return Val_int (managed_collect ());
 }
 
 CAMLprim value
-ocamlode_dWorldGetContactMaxCorrectingVel (value world)
+ocamlode_dManagedGetStats (value unit)
 {
-  return caml_copy_double (dWorldGetContactMaxCorrectingVel (dWorldID_val (world)));
+  CAMLparam0 ();
+  CAMLlocal1 (rv);
+  rv = caml_alloc (2, 0);
+  Store_field (rv, 0, Val_long (managed_arena.count));
+  Store_field (rv, 1, Val_long (__atomic_load_n (&managed_pending_count, __ATOMIC_RELAXED)));
+  CAMLreturn (rv);
 }
 
 /* }}} */
-/* {{{ Bodies */
+/* {{{ Render interpolation */
 
-CAMLprim value
-ocamlode_dBodyCreate (value worldv)
+/* An interpolator keeps the transforms of some bodies before and after the
+   last step of their world, a renderer running at its own rate reads the
+   transforms interpolated between these two steps. */
+
+#define INTERPOLATION_BODY_WORDS 7  /* position, quaternion */
+
+struct interpolator {
+  dWorldID world;  /* NULL once a body or the world is destroyed */
+  int body_count;
+  dBodyID *bodies;
+  double *prev, *cur;
+  struct interpolator *next;  /* interpolators attached to a world */
+};
+
+static struct interpolator *interpolators = NULL;
+
+#define interpolator_val(v) Voidptr_val(struct interpolator *, (v))
+
+static struct interpolator *
+interpolator_get (value pv, const char *msg)
 {
-  CAMLparam1 (worldv);
-  dWorldID world = dWorldID_val (worldv);
-  dBodyID id = dBodyCreate (world);
-  CAMLreturn (Val_dBodyID (id));
+  struct interpolator *p = interpolator_val(pv);
+  if (p == NULL) caml_invalid_argument(msg);
+  return p;
 }
 
-CAMLprim value
-ocamlode_dBodyDestroy (value idv)
-{
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dBodyDestroy (id);
-  destroy_voidptr (idv);
-  CAMLreturn (Val_unit);
+static void
+interpolator_capture (struct interpolator *p)
+{
+  double *w, *tmp;
+  int i, k;
+  tmp = p->prev; p->prev = p->cur; p->cur = tmp;
+  for (i = 0, w = p->cur; i < p->body_count; i++, w += INTERPOLATION_BODY_WORDS) {
+    const dReal *pos = dBodyGetPosition(p->bodies[i]);
+    const dReal *q = dBodyGetQuaternion(p->bodies[i]);
+    for (k = 0; k < 3; k++) w[k] = pos[k];
+    for (k = 0; k < 4; k++) w[3 + k] = q[k];
+  }
 }
 
-CAMLprim value
-ocamlode_dBodyGetWorld( value idv )
-{
-  dWorldID wid;
-  dBodyID id = dBodyID_val (idv);
-  wid = dBodyGetWorld( id );
-  return Val_dWorldID (wid);
+/* slerp along the shortest arc, lerp and normalize when the quaternions are
+   too close for the sine */
+static void
+interpolate_body (double *d, const double *a, const double *b, double alpha)
+{
+  double cosom = a[3]*b[3] + a[4]*b[4] + a[5]*b[5] + a[6]*b[6];
+  double sb = 1.0, s0, s1, l;
+  int k;
+  for (k = 0; k < 3; k++) d[k] = a[k] + (b[k] - a[k]) * alpha;
+  if (cosom < 0.0) { cosom = -cosom; sb = -1.0; }
+  if (cosom < 0.9995) {
+    double omega = acos (cosom);
+    double sinom = sin (omega);
+    s0 = sin ((1.0 - alpha) * omega) / sinom;
+    s1 = sin (alpha * omega) / sinom;
+  } else {
+    s0 = 1.0 - alpha;
+    s1 = alpha;
+  }
+  s1 *= sb;
+  for (k = 3; k < 7; k++) d[k] = s0 * a[k] + s1 * b[k];
+  l = sqrt (d[3]*d[3] + d[4]*d[4] + d[5]*d[5] + d[6]*d[6]);
+  if (l > 0.0) for (k = 3; k < 7; k++) d[k] /= l;
 }
 
-CAMLprim value
-ocamlode_dBodySetPosition (value idv, value xv, value yv, value zv)
+/* to call at the end of a frame: after a step of the world, or after all
+   the substeps of a dWorldSubstep or dWorldAdaptiveStep */
+static void
+interpolators_step (dWorldID w)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dBodyID id = dBodyID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dBodySetPosition (id, x, y, z);
-  CAMLreturn (Val_unit);
+  struct interpolator *p;
+  for (p = interpolators; p != NULL; p = p->next)
+    if (p->world == w) interpolator_capture(p);
 }
 
-CAMLprim value
-ocamlode_dBodySetRotation( value idv, value mv )
+/* an interpolator stops when one of its bodies is destroyed */
+static void
+interpolators_body_destroyed (dBodyID b)
 {
-  dBodyID id = dBodyID_val (idv);
-#if defined(MEM_CPY) // dSINGLE
-  dMatrix3 m;
+  struct interpolator *p;
   int i;
-  for (i=0; i<12; ++i)
-    m[i] = Double_field(mv,i);
-  dBodySetRotation( id, m );
-#else // dDOUBLE
-  dBodySetRotation (id, (double *) mv);
-#endif
-  return Val_unit;
+  for (p = interpolators; p != NULL; p = p->next) {
+    if (p->world == NULL) continue;
+    for (i = 0; i < p->body_count; i++)
+      if (p->bodies[i] == b) { p->world = NULL; break; }
+  }
 }
 
-CAMLprim value
-ocamlode_dBodySetQuaternion( value idv, value qv )
+static void
+interpolators_world_destroyed (dWorldID w)
 {
-  dBodyID id = dBodyID_val (idv);
-#if defined(MEM_CPY) // dSINGLE
-  dQuaternion q;
-  int i;
-  for (i=0; i<4; ++i)
-    q[i] = Double_field(qv,i);
-  dBodySetQuaternion (id, q);
-#else // dDOUBLE
-  dBodySetQuaternion (id, (double *) qv);
-#endif
-  return Val_unit;
+  struct interpolator *p;
+  for (p = interpolators; p != NULL; p = p->next)
+    if (p->world == w) p->world = NULL;
 }
 
+#define INTERPOLATE_LOOP(type) \
+  { \
+    type *o = data; \
+    for (i = 0; i < p->body_count; i++, o += INTERPOLATION_BODY_WORDS) { \
+      double t[INTERPOLATION_BODY_WORDS]; \
+      interpolate_body (t, p->prev + i * INTERPOLATION_BODY_WORDS, \
+                        p->cur + i * INTERPOLATION_BODY_WORDS, alpha); \
+      for (k = 0; k < INTERPOLATION_BODY_WORDS; k++) o[k] = t[k]; \
+    } \
+  }
+
 CAMLprim value
-ocamlode_dBodySetLinearVel( value idv, value x, value y, value z )
+ocamlode_dInterpolatorCreate (value worldv, value bodiesv)
 {
-  dBodyID id = dBodyID_val (idv);
-  dBodySetLinearVel( id, Double_val(x), Double_val(y), Double_val(z) );
-  return Val_unit;
+  CAMLparam2 (worldv, bodiesv);
+  struct interpolator *p;
+  int i, n;
+
+  p = malloc(sizeof(struct interpolator));
+  if (p == NULL) caml_failwith("Out of memory");
+  p->world = dWorldID_val(worldv);
+  p->body_count = Wosize_val(bodiesv);
+  n = (p->body_count + 1) * INTERPOLATION_BODY_WORDS;
+  p->bodies = malloc((p->body_count + 1) * sizeof(dBodyID));
+  p->prev = malloc(n * sizeof(double));
+  p->cur = malloc(n * sizeof(double));
+  if (!p->bodies || !p->prev || !p->cur) {
+    free(p->bodies); free(p->prev); free(p->cur); free(p);
+    caml_failwith("Out of memory");
+  }
+  for (i = 0; i < p->body_count; i++)
+    p->bodies[i] = dBodyID_val(Field(bodiesv, i));
+  interpolator_capture(p);
+  memcpy(p->prev, p->cur, n * sizeof(double));
+  p->next = interpolators;
+  interpolators = p;
+  CAMLreturn (Val_voidptr (p));
 }
 
 CAMLprim value
-ocamlode_dBodySetAngularVel( value idv, value x, value y, value z )
+ocamlode_dInterpolatorDestroy (value pv)
 {
-  dBodyID id = dBodyID_val (idv);
-  dBodySetAngularVel( id, Double_val(x), Double_val(y), Double_val(z) );
+  struct interpolator *p = interpolator_val(pv);
+  struct interpolator **pp;
+  if (p == NULL) return Val_unit;
+  for (pp = &interpolators; *pp != p; pp = &(*pp)->next);
+  *pp = p->next;
+  free(p->bodies); free(p->prev); free(p->cur); free(p);
+  destroy_voidptr(pv);
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetPosition (value idv)
+ocamlode_dInterpolatorCapture (value pv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  const dReal *r = dBodyGetPosition (id);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  struct interpolator *p = interpolator_get(pv, "dInterpolatorCapture: the interpolator is destroyed");
+  if (p->world == NULL)
+    caml_invalid_argument("dInterpolatorCapture: a body or the world of the interpolator was destroyed");
+  interpolator_capture(p);
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetRotation (value idv)
+ocamlode_dInterpolatorReset (value pv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  const dReal *r = dBodyGetRotation (id);
-  rv = copy_dReal_array (r, 12);
-  CAMLreturn (rv);
+  struct interpolator *p = interpolator_get(pv, "dInterpolatorReset: the interpolator is destroyed");
+  if (p->world == NULL)
+    caml_invalid_argument("dInterpolatorReset: a body or the world of the interpolator was destroyed");
+  interpolator_capture(p);
+  memcpy(p->prev, p->cur, p->body_count * INTERPOLATION_BODY_WORDS * sizeof(double));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetQuaternion (value idv)
+ocamlode_dInterpolatorWrite (value pv, value alphav, value ba)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  const dReal *r = dBodyGetQuaternion (id);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
-}
+  struct interpolator *p = interpolator_get(pv, "dInterpolatorWrite: the interpolator is destroyed");
+  struct caml_ba_array *b = Caml_ba_array_val(ba);
+  int kind = b->flags & CAML_BA_KIND_MASK;
+  double alpha = Double_val(alphav);
+  void *data = b->data;
+  int i, k;
 
-CAMLprim value
-ocamlode_dBodyGetLinearVel (value idv)
+  if ((kind != CAML_BA_FLOAT32 && kind != CAML_BA_FLOAT64) ||
+      (b->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT ||
+      b->num_dims != 2 || b->dim[1] != INTERPOLATION_BODY_WORDS ||
+      b->dim[0] < p->body_count)
+    caml_invalid_argument("dInterpolatorWrite: a float32 or float64 c_layout bigarray of dimensions [n; 7] is expected");
+  if (kind == CAML_BA_FLOAT64)
+    INTERPOLATE_LOOP(double)
+  else
+    INTERPOLATE_LOOP(float)
+  return Val_unit;
+}
+
+/* }}} */
+/* {{{ Trajectory recorder */
+
+/* A recorder copies the transforms of some bodies and the state of some
+   joints after each step of its world into a ring of frames, a writer
+   thread encodes the frames and writes them to a file.
+   With a keyframe interval greater than 1, the frames between two
+   keyframes only contain the words changed since the previous frame
+   (a bitmask followed by these words). */
+
+#define RECORDING_MAGIC 0x5245444f  /* "ODER" */
+#define RECORDING_VERSION 1
+#define RECORDING_BODY_WORDS 7   /* position, quaternion */
+#define RECORDING_JOINT_WORDS 4  /* angles or positions, and their rates */
+
+struct recording_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t body_count;
+  uint32_t joint_count;
+  uint32_t frame_words;  /* without the step number */
+  uint32_t keyframe_interval;
+};
+
+struct recording_frame {
+  uint32_t step;
+  uint32_t keyframe;
+  uint32_t size;  /* of the data following */
+};
+
+struct recorder {
+  dWorldID world;  /* NULL once a body, a joint or the world is destroyed */
+  int body_count, joint_count;
+  dBodyID *bodies;
+  dJointID *joints;
+  int frame_words;  /* the step number, then the datas */
+  int keyframe_interval;
+  uint32_t step;
+  int fd;
+
+  uint32_t *ring;
+  long ring_size;
+  long head, tail;  /* frames captured, frames written */
+
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;   /* a frame was captured */
+  pthread_cond_t space;  /* a frame was written */
+  int quit;
+
+  /* writer side */
+  uint32_t *prev;
+  unsigned char *out;
+  size_t out_len, out_size;
+  int error;
+
+  long long bytes_written;
+  long stalls;
+
+  struct recorder *next;  /* recorders attached to a world */
+};
+
+static struct recorder *recorders = NULL;
+
+#define recorder_val(v) Voidptr_val(struct recorder *, (v))
+
+static void
+recorder_flush (struct recorder *r)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  const dReal *r = dBodyGetLinearVel (id);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  size_t done = 0;
+  while (done < r->out_len && !r->error) {
+    ssize_t n = write(r->fd, r->out + done, r->out_len - done);
+    if (n <= 0) r->error = 1;
+    else done += n;
+  }
+  r->bytes_written += done;
+  r->out_len = 0;
 }
 
-CAMLprim value
-ocamlode_dBodyGetAngularVel (value idv)
+static void
+recorder_encode (struct recorder *r, const uint32_t *frame, long index)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  const dReal *r = dBodyGetAngularVel (id);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  int n = r->frame_words - 1;
+  const uint32_t *data = frame + 1;
+  struct recording_frame h;
+  unsigned char *p;
+  int i;
+
+  if (r->out_size - r->out_len < sizeof h + (n + 7) / 8 + n * 4)
+    recorder_flush(r);
+  p = r->out + r->out_len + sizeof h;
+  h.step = frame[0];
+  h.keyframe = (index % r->keyframe_interval) == 0;
+  if (h.keyframe) {
+    memcpy(p, data, n * 4);
+    p += n * 4;
+  } else {
+    unsigned char *mask = p;
+    memset(mask, 0, (n + 7) / 8);
+    p += (n + 7) / 8;
+    for (i = 0; i < n; i++) {
+      if (data[i] != r->prev[i]) {
+        mask[i >> 3] |= 1 << (i & 7);
+        memcpy(p, &data[i], 4);
+        p += 4;
+      }
+    }
+  }
+  h.size = p - (r->out + r->out_len + sizeof h);
+  memcpy(r->out + r->out_len, &h, sizeof h);
+  r->out_len += sizeof h + h.size;
+  memcpy(r->prev, data, n * 4);
 }
 
-CAMLprim value
-ocamlode_dBodySetMass (value idv, value massv)
+static void *
+recorder_writer (void *arg)
 {
-  CAMLparam2 (idv, massv);
-  dBodyID id = dBodyID_val (idv);
-  dBodySetMass (id, dMass_data_custom_val (massv));
-  CAMLreturn (Val_unit);
+  struct recorder *r = arg;
+  long index;
+
+  pthread_mutex_lock(&r->lock);
+  for (;;)
+  {
+    while (r->tail == r->head && !r->quit)
+      pthread_cond_wait(&r->cond, &r->lock);
+    if (r->tail == r->head) break;  /* quit, everything is written */
+    index = r->tail;
+    pthread_mutex_unlock(&r->lock);
+
+    recorder_encode(r, r->ring + (index % r->ring_size) * r->frame_words, index);
+
+    pthread_mutex_lock(&r->lock);
+    r->tail++;
+    pthread_cond_signal(&r->space);
+  }
+  pthread_mutex_unlock(&r->lock);
+  recorder_flush(r);
+  return NULL;
 }
 
-CAMLprim value
-ocamlode_dBodyGetMass (value idv)
+static inline void
+recorder_store (uint32_t *w, dReal v)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dMass mass;
-  dBodyGetMass (id, &mass);
-  CAMLreturn (copy_dMass (&mass));
+  float f = v;
+  memcpy(w, &f, 4);
 }
 
-CAMLprim value
-ocamlode_dBodyAddForce (value idv, value fxv, value fyv, value fzv)
+static void
+recorder_capture (struct recorder *r)
 {
-  CAMLparam4 (idv, fxv, fyv, fzv);
-  dBodyID id = dBodyID_val (idv);
-  dReal fx = Double_val (fxv);
-  dReal fy = Double_val (fyv);
-  dReal fz = Double_val (fzv);
-  dBodyAddForce (id, fx, fy, fz);
-  CAMLreturn (Val_unit);
+  uint32_t *frame, *w;
+  int i, k;
+
+  pthread_mutex_lock(&r->lock);
+  if (r->head - r->tail >= r->ring_size) {
+    r->stalls++;
+    while (r->head - r->tail >= r->ring_size)
+      pthread_cond_wait(&r->space, &r->lock);
+  }
+  pthread_mutex_unlock(&r->lock);
+
+  frame = r->ring + (r->head % r->ring_size) * r->frame_words;
+  frame[0] = r->step++;
+  w = frame + 1;
+  for (i = 0; i < r->body_count; i++, w += RECORDING_BODY_WORDS) {
+    const dReal *pos = dBodyGetPosition(r->bodies[i]);
+    const dReal *q = dBodyGetQuaternion(r->bodies[i]);
+    for (k = 0; k < 3; k++) recorder_store(w + k, pos[k]);
+    for (k = 0; k < 4; k++) recorder_store(w + 3 + k, q[k]);
+  }
+  for (i = 0; i < r->joint_count; i++, w += RECORDING_JOINT_WORDS) {
+    dJointID j = r->joints[i];
+    dReal s[RECORDING_JOINT_WORDS] = { 0.0, 0.0, 0.0, 0.0 };
+    switch (dJointGetType(j))
+    {
+      case dJointTypeHinge:
+        s[0] = dJointGetHingeAngle(j);
+        s[2] = dJointGetHingeAngleRate(j);
+        break;
+      case dJointTypeSlider:
+        s[0] = dJointGetSliderPosition(j);
+        s[2] = dJointGetSliderPositionRate(j);
+        break;
+      case dJointTypeHinge2:
+        s[0] = dJointGetHinge2Angle1(j);
+        s[2] = dJointGetHinge2Angle1Rate(j);
+        s[3] = dJointGetHinge2Angle2Rate(j);
+        break;
+      case dJointTypeUniversal:
+        s[0] = dJointGetUniversalAngle1(j);
+        s[1] = dJointGetUniversalAngle2(j);
+        s[2] = dJointGetUniversalAngle1Rate(j);
+        s[3] = dJointGetUniversalAngle2Rate(j);
+        break;
+      case dJointTypePR:
+        s[0] = dJointGetPRPosition(j);
+        s[2] = dJointGetPRPositionRate(j);
+        break;
+      case dJointTypePiston:
+        s[0] = dJointGetPistonPosition(j);
+        s[1] = dJointGetPistonAngle(j);
+        s[2] = dJointGetPistonPositionRate(j);
+        s[3] = dJointGetPistonAngleRate(j);
+        break;
+      case dJointTypePU:
+        s[0] = dJointGetPUPosition(j);
+        s[2] = dJointGetPUPositionRate(j);
+        break;
+      default:
+        break;
+    }
+    for (k = 0; k < RECORDING_JOINT_WORDS; k++) recorder_store(w + k, s[k]);
+  }
+
+  pthread_mutex_lock(&r->lock);
+  r->head++;
+  pthread_cond_signal(&r->cond);
+  pthread_mutex_unlock(&r->lock);
 }
 
+/* to call after each step of a world */
+static void
+recorders_step (dWorldID w)
+{
+  struct recorder *r;
+  for (r = recorders; r != NULL; r = r->next)
+    if (r->world == w) recorder_capture(r);
+}
+
+CAMLprim value
+ocamlode_dRecorderCreate_native (value worldv, value filename,
+                                 value bodiesv, value jointsv,
+                                 value ring_size, value keyframe_interval)
+{
+  CAMLparam5 (worldv, filename, bodiesv, jointsv, ring_size);
+  CAMLxparam1 (keyframe_interval);
+  struct recording_header h;
+  struct recorder *r;
+  int i, n;
+
+  if (Int_val(ring_size) < 1 || Int_val(keyframe_interval) < 1)
+    caml_invalid_argument("dRecorderCreate: ring_size and keyframe_interval should be positive");
+
+  r = calloc(1, sizeof(struct recorder));
+  if (r == NULL) caml_failwith("Out of memory");
+  r->world = dWorldID_val(worldv);
+  r->body_count = Wosize_val(bodiesv);
+  r->joint_count = Wosize_val(jointsv);
+  r->frame_words = 1 + r->body_count * RECORDING_BODY_WORDS
+                     + r->joint_count * RECORDING_JOINT_WORDS;
+  r->keyframe_interval = Int_val(keyframe_interval);
+  r->ring_size = Int_val(ring_size);
+  n = r->frame_words - 1;
+  r->out_size = 65536 + sizeof(struct recording_frame) + (n + 7) / 8 + n * 4;
+  r->bodies = malloc((r->body_count + 1) * sizeof(dBodyID));
+  r->joints = malloc((r->joint_count + 1) * sizeof(dJointID));
+  r->ring = malloc(r->ring_size * r->frame_words * sizeof(uint32_t));
+  r->prev = calloc(n + 1, sizeof(uint32_t));
+  r->out = malloc(r->out_size);
+  if (!r->bodies || !r->joints || !r->ring || !r->prev || !r->out) {
+    free(r->bodies); free(r->joints); free(r->ring); free(r->prev); free(r->out); free(r);
+    caml_failwith("Out of memory");
+  }
+  for (i = 0; i < r->body_count; i++)
+    r->bodies[i] = dBodyID_val(Field(bodiesv, i));
+  for (i = 0; i < r->joint_count; i++)
+    r->joints[i] = dJointID_val(Field(jointsv, i));
+
+  r->fd = open(String_val(filename), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (r->fd == -1) {
+    free(r->bodies); free(r->joints); free(r->ring); free(r->prev); free(r->out); free(r);
+    caml_failwith("dRecorderCreate: can not open the file");
+  }
+  h.magic = RECORDING_MAGIC;
+  h.version = RECORDING_VERSION;
+  h.body_count = r->body_count;
+  h.joint_count = r->joint_count;
+  h.frame_words = n;
+  h.keyframe_interval = r->keyframe_interval;
+  memcpy(r->out, &h, sizeof h);
+  r->out_len = sizeof h;
+
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->cond, NULL);
+  pthread_cond_init(&r->space, NULL);
+  if (pthread_create(&r->writer, NULL, recorder_writer, r) != 0) {
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    pthread_cond_destroy(&r->space);
+    close(r->fd);
+    free(r->bodies); free(r->joints); free(r->ring); free(r->prev); free(r->out); free(r);
+    caml_failwith("dRecorderCreate: can not create the writer thread");
+  }
+  r->next = recorders;
+  recorders = r;
+  CAMLreturn (Val_voidptr (r));
+}
 CAMLprim value
-ocamlode_dBodyAddTorque (value idv, value fxv, value fyv, value fzv)
+ocamlode_dRecorderCreate_bytecode (value * argv, int argn)
 {
-  CAMLparam4 (idv, fxv, fyv, fzv);
-  dBodyID id = dBodyID_val (idv);
-  dReal fx = Double_val (fxv);
-  dReal fy = Double_val (fyv);
-  dReal fz = Double_val (fzv);
-  dBodyAddTorque (id, fx, fy, fz);
-  CAMLreturn (Val_unit);
+  return ocamlode_dRecorderCreate_native (argv[0], argv[1], argv[2],
+                                          argv[3], argv[4], argv[5]);
 }
 
-CAMLprim value
-ocamlode_dBodyAddRelForce (value idv, value fxv, value fyv, value fzv)
+static struct recorder *
+recorder_get (value rv, const char *msg)
 {
-  CAMLparam4 (idv, fxv, fyv, fzv);
-  dBodyID id = dBodyID_val (idv);
-  dReal fx = Double_val (fxv);
-  dReal fy = Double_val (fyv);
-  dReal fz = Double_val (fzv);
-  dBodyAddRelForce (id, fx, fy, fz);
-  CAMLreturn (Val_unit);
+  struct recorder *r = recorder_val(rv);
+  if (r == NULL) caml_invalid_argument(msg);
+  return r;
 }
 
-CAMLprim value
-ocamlode_dBodyAddRelTorque (value idv, value fxv, value fyv, value fzv)
+/* a recorder stops when one of its bodies or joints is destroyed */
+static void
+recorders_body_destroyed (dBodyID b)
 {
-  CAMLparam4 (idv, fxv, fyv, fzv);
-  dBodyID id = dBodyID_val (idv);
-  dReal fx = Double_val (fxv);
-  dReal fy = Double_val (fyv);
-  dReal fz = Double_val (fzv);
-  dBodyAddRelTorque (id, fx, fy, fz);
-  CAMLreturn (Val_unit);
+  struct recorder *r;
+  int i;
+  for (r = recorders; r != NULL; r = r->next) {
+    if (r->world == NULL) continue;
+    for (i = 0; i < r->body_count; i++)
+      if (r->bodies[i] == b) { r->world = NULL; break; }
+  }
 }
 
-CAMLprim value
-ocamlode_dBodyAddForceAtPos (value body, value fx, value fy, value fz,
-                                         value px, value py, value pz)
+static void
+recorders_joint_destroyed (dJointID j)
 {
-  dBodyAddForceAtPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
-                                          Double_val(px), Double_val(py), Double_val(pz));
-  return Val_unit;
+  struct recorder *r;
+  int i;
+  for (r = recorders; r != NULL; r = r->next) {
+    if (r->world == NULL) continue;
+    for (i = 0; i < r->joint_count; i++)
+      if (r->joints[i] == j) { r->world = NULL; break; }
+  }
 }
-CAMLprim value
-ocamlode_dBodyAddForceAtPos_bc (value * argv, int argn)
+
+static void
+recorders_world_destroyed (dWorldID w)
 {
-  return ocamlode_dBodyAddForceAtPos(
-    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
+  struct recorder *r;
+  for (r = recorders; r != NULL; r = r->next)
+    if (r->world == w) r->world = NULL;
 }
 
 CAMLprim value
-ocamlode_dBodyAddForceAtRelPos (value body, value fx, value fy, value fz,
-                                            value px, value py, value pz)
+ocamlode_dRecorderCapture (value rv)
 {
-  dBodyAddForceAtRelPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
-                                             Double_val(px), Double_val(py), Double_val(pz));
+  struct recorder *r = recorder_get(rv, "dRecorderCapture: the recorder is closed");
+  if (r->world == NULL)
+    caml_invalid_argument("dRecorderCapture: a body, a joint or the world of the recorder was destroyed");
+  recorder_capture(r);
   return Val_unit;
 }
+
 CAMLprim value
-ocamlode_dBodyAddForceAtRelPos_bc (value * argv, int argn)
+ocamlode_dRecorderGetStats (value rv)
 {
-  return ocamlode_dBodyAddForceAtRelPos(
-    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
+  CAMLparam1 (rv);
+  CAMLlocal1 (sv);
+  struct recorder *r = recorder_get(rv, "dRecorderGetStats: the recorder is closed");
+  pthread_mutex_lock(&r->lock);
+  sv = caml_alloc(4, 0);
+  Store_field(sv, 0, Val_long(r->head));
+  Store_field(sv, 1, Val_long(r->tail));
+  Store_field(sv, 2, Val_long(r->bytes_written));
+  Store_field(sv, 3, Val_long(r->stalls));
+  pthread_mutex_unlock(&r->lock);
+  CAMLreturn (sv);
 }
 
 CAMLprim value
-ocamlode_dBodyAddRelForceAtPos (value body, value fx, value fy, value fz,
-                                            value px, value py, value pz)
+ocamlode_dRecorderClose (value rv)
 {
-  dBodyAddRelForceAtPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
-                                             Double_val(px), Double_val(py), Double_val(pz));
+  struct recorder *r = recorder_val(rv);
+  struct recorder **rp;
+  int error;
+  if (r == NULL) return Val_unit;
+
+  for (rp = &recorders; *rp != r; rp = &(*rp)->next);
+  *rp = r->next;
+
+  pthread_mutex_lock(&r->lock);
+  r->quit = 1;
+  pthread_cond_signal(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+  pthread_join(r->writer, NULL);
+
+  error = r->error;
+  if (close(r->fd) == -1) error = 1;
+  pthread_mutex_destroy(&r->lock);
+  pthread_cond_destroy(&r->cond);
+  pthread_cond_destroy(&r->space);
+  free(r->bodies); free(r->joints); free(r->ring); free(r->prev); free(r->out); free(r);
+  destroy_voidptr(rv);
+  if (error) caml_failwith("dRecorderClose: write error");
   return Val_unit;
 }
-CAMLprim value
-ocamlode_dBodyAddRelForceAtPos_bc (value * argv, int argn)
+
+/* Recordings, the file is mapped in memory, a frame is decoded from its
+   previous keyframe, or from the frame decoded before for a playback. */
+
+struct recording {
+  const unsigned char *map;
+  size_t map_size;
+  struct recording_header header;
+  long frame_count;
+  const unsigned char **frames;
+  uint32_t *current;
+  long current_index;
+};
+
+#define recording_val(v) Voidptr_val(struct recording *, (v))
+
+static struct recording *
+recording_get (value gv, const char *msg)
 {
-  return ocamlode_dBodyAddRelForceAtPos(
-    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
+  struct recording *g = recording_val(gv);
+  if (g == NULL) caml_invalid_argument(msg);
+  return g;
+}
+
+/* the payload of a frame matches its keyframe, or its mask of changes */
+static int
+recording_frame_valid (const struct recording_header *header,
+                       const struct recording_frame *h, const unsigned char *p)
+{
+  uint32_t n = header->frame_words, i, words = 0;
+  if (h->keyframe) return h->size == n * 4;
+  if (h->size < (n + 7) / 8) return 0;
+  for (i = 0; i < n; i++)
+    if (p[i >> 3] & (1 << (i & 7))) words++;
+  return h->size == (n + 7) / 8 + words * 4;
 }
 
 CAMLprim value
-ocamlode_dBodyAddRelForceAtRelPos (value body, value fx, value fy, value fz,
-                                               value px, value py, value pz)
+ocamlode_dRecordingOpen (value filename)
 {
-  dBodyAddRelForceAtRelPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
-                                                Double_val(px), Double_val(py), Double_val(pz));
-  return Val_unit;
+  CAMLparam1 (filename);
+  struct recording *g;
+  struct stat st;
+  const unsigned char *p, *end;
+  void *map;
+  long count, size;
+  int fd;
+
+  fd = open(String_val(filename), O_RDONLY);
+  if (fd == -1) caml_failwith("dRecordingOpen: can not open the file");
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct recording_header)) {
+    close(fd);
+    caml_failwith("dRecordingOpen: not a recording");
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) caml_failwith("dRecordingOpen: mmap failed");
+
+  g = calloc(1, sizeof(struct recording));
+  if (g == NULL) {
+    munmap(map, st.st_size);
+    caml_failwith("Out of memory");
+  }
+  g->map = map;
+  g->map_size = st.st_size;
+  memcpy(&g->header, map, sizeof(struct recording_header));
+  if (g->header.magic != RECORDING_MAGIC || g->header.version != RECORDING_VERSION) {
+    munmap(map, st.st_size);
+    free(g);
+    caml_failwith("dRecordingOpen: not a recording");
+  }
+  if (g->header.keyframe_interval < 1 || g->header.frame_words >= (1 << 28) ||
+      g->header.frame_words != (uint64_t) g->header.body_count * RECORDING_BODY_WORDS
+                               + (uint64_t) g->header.joint_count * RECORDING_JOINT_WORDS) {
+    munmap(map, st.st_size);
+    free(g);
+    caml_failwith("dRecordingOpen: corrupted recording");
+  }
+
+  /* index the frames, an incomplete last frame is ignored */
+  end = g->map + g->map_size;
+  size = 1024;
+  count = 0;
+  g->frames = malloc(size * sizeof(unsigned char *));
+  g->current = calloc(g->header.frame_words + 1, sizeof(uint32_t));
+  p = g->map + sizeof(struct recording_header);
+  while (g->frames != NULL && p + sizeof(struct recording_frame) <= end) {
+    struct recording_frame h;
+    memcpy(&h, p, sizeof h);
+    if (h.size > (size_t) (end - p) - sizeof h) break;
+    if (!recording_frame_valid(&g->header, &h, p + sizeof h)) {
+      free(g->frames); free(g->current);
+      munmap(map, st.st_size);
+      free(g);
+      caml_failwith("dRecordingOpen: corrupted recording");
+    }
+    if (count == size) {
+      const unsigned char **frames;
+      size *= 2;
+      frames = realloc(g->frames, size * sizeof(unsigned char *));
+      if (frames == NULL) { free(g->frames); g->frames = NULL; break; }
+      g->frames = frames;
+    }
+    g->frames[count++] = p;
+    p += sizeof h + h.size;
+  }
+  if (g->frames == NULL || g->current == NULL) {
+    free(g->frames); free(g->current);
+    munmap(map, st.st_size);
+    free(g);
+    caml_failwith("Out of memory");
+  }
+  g->frame_count = count;
+  g->current_index = -1;
+  CAMLreturn (Val_voidptr (g));
 }
+
 CAMLprim value
-ocamlode_dBodyAddRelForceAtRelPos_bc (value * argv, int argn)
+ocamlode_dRecordingInfo (value gv)
 {
-  return ocamlode_dBodyAddRelForceAtRelPos(
-    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
+  CAMLparam1 (gv);
+  CAMLlocal1 (rv);
+  struct recording *g = recording_get(gv, "dRecordingInfo: the recording is closed");
+  rv = caml_alloc(4, 0);
+  Store_field(rv, 0, Val_int(g->header.body_count));
+  Store_field(rv, 1, Val_int(g->header.joint_count));
+  Store_field(rv, 2, Val_long(g->frame_count));
+  Store_field(rv, 3, Val_int(g->header.keyframe_interval));
+  CAMLreturn (rv);
+}
+
+static void
+recording_apply (struct recording *g, long index)
+{
+  struct recording_frame h;
+  const unsigned char *p = g->frames[index];
+  int n = g->header.frame_words;
+  uint32_t *data = g->current + 1;
+  int i;
+
+  memcpy(&h, p, sizeof h);
+  p += sizeof h;
+  g->current[0] = h.step;
+  if (h.keyframe) {
+    memcpy(data, p, n * 4);
+  } else {
+    const unsigned char *mask = p;
+    p += (n + 7) / 8;
+    for (i = 0; i < n; i++) {
+      if (mask[i >> 3] & (1 << (i & 7))) {
+        memcpy(&data[i], p, 4);
+        p += 4;
+      }
+    }
+  }
+  g->current_index = index;
 }
 
 CAMLprim value
-ocamlode_dBodySetForce (value body, value x, value y, value z)
+ocamlode_dRecordingRead (value gv, value indexv, value ba)
 {
-  dBodySetForce (dBodyID_val (body), Double_val(x), Double_val(y), Double_val(z));
-  return Val_unit;
+  struct recording *g = recording_get(gv, "dRecordingRead: the recording is closed");
+  struct caml_ba_array *b = Caml_ba_array_val(ba);
+  long index = Long_val(indexv);
+  long k;
+
+  if (index < 0 || index >= g->frame_count)
+    caml_invalid_argument("dRecordingRead: frame index out of bounds");
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT32 ||
+      b->num_dims != 1 || b->dim[0] < (intnat) g->header.frame_words)
+    caml_invalid_argument("dRecordingRead: a float32 bigarray of (7 * bodies + 4 * joints) elements is expected");
+
+  if (index != g->current_index) {
+    /* from the previous keyframe, or from the current frame if it is after */
+    long first = (g->current_index < index) ? g->current_index + 1 : 0;
+    struct recording_frame h;
+    for (k = index; k > first; k--) {
+      memcpy(&h, g->frames[k], sizeof h);
+      if (h.keyframe) break;
+    }
+    for (; k <= index; k++)
+      recording_apply(g, k);
+  }
+  memcpy(b->data, g->current + 1, g->header.frame_words * 4);
+  return Val_long(g->current[0]);
 }
 
 CAMLprim value
-ocamlode_dBodySetTorque (value body, value x, value y, value z)
+ocamlode_dRecordingClose (value gv)
 {
-  dBodySetTorque (dBodyID_val (body) , Double_val(x), Double_val(y), Double_val(z));
+  struct recording *g = recording_val(gv);
+  if (g == NULL) return Val_unit;
+  munmap((void *) g->map, g->map_size);
+  free(g->frames);
+  free(g->current);
+  free(g);
+  destroy_voidptr(gv);
   return Val_unit;
 }
 
+/* }}} */
+/* {{{ Global */
+
 CAMLprim value
-ocamlode_dBodyGetForce (value body)
+ocamlode_dGetInfinity (value unit)
 {
-  const dReal * f = dBodyGetForce (dBodyID_val (body));
-  return copy_dReal_array (f, 4);
+  CAMLparam1 (unit);
+  CAMLreturn (caml_copy_double (dInfinity));
 }
 
 CAMLprim value
-ocamlode_dBodyGetTorque (value body)
+ocamlode_dInitODE (value u)
 {
-  const dReal * t = dBodyGetTorque (dBodyID_val (body));
-  return copy_dReal_array (t, 4);
+  CAMLparam1 (u);
+  dInitODE();
+  CAMLreturn (Val_unit);
 }
 
+static const unsigned int dInitODEFlags_table[] = {
+#if ( (ODE_VERSION_MAJOR == 0) && (ODE_VERSION_MINOR >= 10) ) || (ODE_VERSION_MAJOR > 0)
+  dInitFlagManualThreadCleanup,
+#else
+  0,
+#endif
+};
+
 CAMLprim value
-ocamlode_dBodyGetRelPointPos (value idv, value pxv, value pyv, value pzv)
+ocamlode_dInitODE2 (value uiInitFlagsv)
 {
-  CAMLparam4 (idv, pxv, pyv, pzv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  dReal px = Double_val (pxv);
-  dReal py = Double_val (pyv);
-  dReal pz = Double_val (pzv);
-  dVector3 r;
-  dBodyGetRelPointPos (id, px, py, pz, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam1 (uiInitFlagsv);
+#if ( (ODE_VERSION_MAJOR == 0) && (ODE_VERSION_MINOR >= 10) ) || (ODE_VERSION_MAJOR > 0)
+  unsigned int uiInitFlags = dInitODEFlags_table[Long_val(uiInitFlagsv)];
+  int success = dInitODE2 (uiInitFlags);
+  if (!success)
+    caml_failwith("dInitODE2");
+#else
+  caml_failwith("dInitODE2: function available since ODE version 0.10.0");
+#endif
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodyGetPosRelPoint (value idv, value pxv, value pyv, value pzv)
+ocamlode_dCloseODE (value unit)
 {
-  CAMLparam4 (idv, pxv, pyv, pzv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  dReal px = Double_val (pxv);
-  dReal py = Double_val (pyv);
-  dReal pz = Double_val (pzv);
-  dVector3 r;
-  dBodyGetPosRelPoint (id, px, py, pz, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam1 (unit);
+  dCloseODE ();
+  CAMLreturn (Val_unit);
 }
 
+/* }}} */
+/* {{{ World */
+
 CAMLprim value
-ocamlode_dBodyGetRelPointVel (value idv, value pxv, value pyv, value pzv)
+ocamlode_dWorldCreate (value unit)
 {
-  CAMLparam4 (idv, pxv, pyv, pzv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  dReal px = Double_val (pxv);
-  dReal py = Double_val (pyv);
-  dReal pz = Double_val (pzv);
-  dVector3 r;
-  dBodyGetRelPointVel (id, px, py, pz, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam1 (unit);
+  dWorldID id = dWorldCreate ();
+  CAMLreturn (Val_dWorldID (id));
 }
 
 CAMLprim value
-ocamlode_dBodyGetPointVel (value idv, value pxv, value pyv, value pzv)
+ocamlode_dWorldDestroy (value idv)
 {
-  CAMLparam4 (idv, pxv, pyv, pzv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  dReal px = Double_val (pxv);
-  dReal py = Double_val (pyv);
-  dReal pz = Double_val (pzv);
-  dVector3 r;
-  dBodyGetPointVel (id, px, py, pz, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam1 (idv);
+  dWorldID id = dWorldID_val (idv);
+  arena_world_destroyed (id);
+  trackers_world_destroyed (id);
+  dWorldDestroy (id);
+  destroy_voidptr (idv);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodyVectorToWorld (value idv, value pxv, value pyv, value pzv)
+ocamlode_dWorldSetGravity (value idv, value xv, value yv, value zv)
 {
-  CAMLparam4 (idv, pxv, pyv, pzv);
-  CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  dReal px = Double_val (pxv);
-  dReal py = Double_val (pyv);
-  dReal pz = Double_val (pzv);
-  dVector3 r;
-  dBodyVectorToWorld (id, px, py, pz, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam4 (idv, xv, yv, zv);
+  dWorldID id = dWorldID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dWorldSetGravity (id, x, y, z);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodyVectorFromWorld (value idv, value pxv, value pyv, value pzv)
+ocamlode_dWorldGetGravity (value idv)
 {
-  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLparam1 (idv);
   CAMLlocal1 (rv);
-  dBodyID id = dBodyID_val (idv);
-  dReal px = Double_val (pxv);
-  dReal py = Double_val (pyv);
-  dReal pz = Double_val (pzv);
-  dVector3 r;
-  dBodyVectorFromWorld (id, px, py, pz, r);
-  rv = copy_dReal_array (r, 4);
+  dWorldID id = dWorldID_val (idv);
+  dVector3 gravity;
+  dWorldGetGravity (id, gravity);
+  rv = copy_dReal_array (gravity, 4);
   CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dBodyEnable (value idv)
+ocamlode_dWorldSetERP (value idv, value erp)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dBodyEnable (id);
-  CAMLreturn (Val_unit);
+  dWorldID id = dWorldID_val (idv);
+  dWorldSetERP (id, Double_val(erp));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyDisable (value idv)
+ocamlode_dWorldGetERP (value idv)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dBodyDisable (id);
+  dWorldID id = dWorldID_val (idv);
+  dReal r = dWorldGetERP (id);
+  return caml_copy_double (r);
+}
+
+CAMLprim value
+ocamlode_dWorldSetCFM (value idv, value cfmv)
+{
+  CAMLparam2 (idv, cfmv);
+  dWorldID id = dWorldID_val (idv);
+  dReal cfm = Double_val (cfmv);
+  dWorldSetCFM (id, cfm);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodyIsEnabled (value idv)
+ocamlode_dWorldGetCFM (value idv)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  int enabled = dBodyIsEnabled (id);
-  CAMLreturn (Val_bool (enabled));
+  dWorldID id = dWorldID_val (idv);
+  dReal r = dWorldGetCFM( id );
+  return caml_copy_double (r);
 }
 
 CAMLprim value
-ocamlode_dBodySetAutoDisableFlag (value idv, value flagv)
+ocamlode_dWorldStep (value idv, value stepsizev)
 {
-  CAMLparam2 (idv, flagv);
-  dBodyID id = dBodyID_val (idv);
-  int flag = Bool_val (flagv);
-  dBodySetAutoDisableFlag (id, flag);
+  CAMLparam2 (idv, stepsizev);
+  dWorldID id = dWorldID_val (idv);
+  dReal stepsize = Double_val (stepsizev);
+  managed_collect ();
+  dWorldStep (id, stepsize);
+  recorders_step (id);
+  interpolators_step (id);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodyGetAutoDisableFlag (value idv)
+ocamlode_dWorldQuickStep (value idv, value stepsizev)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  int flag = dBodyGetAutoDisableFlag (id);
-  CAMLreturn (Val_bool (flag));
+  CAMLparam2 (idv, stepsizev);
+  dWorldID id = dWorldID_val (idv);
+  dReal stepsize = Double_val (stepsizev);
+  managed_collect ();
+  dWorldQuickStep (id, stepsize);
+  recorders_step (id);
+  interpolators_step (id);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodySetAutoDisableSteps (value idv, value steps)
+ocamlode_dWorldSetQuickStepNumIterations( value worldv, value num )
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dBodySetAutoDisableSteps (id, Int_val(steps));
+  CAMLparam2 (worldv, num);
+  dWorldID world = dWorldID_val (worldv);
+  dWorldSetQuickStepNumIterations( world, Int_val(num) );
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dBodyGetAutoDisableSteps (value idv)
+ocamlode_dWorldGetQuickStepNumIterations( value worldv )
 {
-  dBodyID id = dBodyID_val (idv);
-  return Val_int (dBodyGetAutoDisableSteps (id));
+  CAMLparam1 (worldv);
+  int _ret;
+  dWorldID world = dWorldID_val (worldv);
+  _ret = dWorldGetQuickStepNumIterations (world);
+  CAMLreturn (Val_int (_ret));
 }
 
 CAMLprim value
-ocamlode_dBodySetAutoDisableTime (value idv, value timev)
+ocamlode_dWorldSetContactSurfaceLayer (value world, value depth)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dReal time = Double_val (timev);
-  dBodySetAutoDisableTime (id, time);
-  CAMLreturn (Val_unit);
+  dWorldSetContactSurfaceLayer (dWorldID_val (world), Double_val (depth));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetAutoDisableTime (value idv)
+ocamlode_dWorldGetContactSurfaceLayer (value world)
 {
-  CAMLparam1 (idv);
-  dBodyID id = dBodyID_val (idv);
-  dReal r = dBodyGetAutoDisableTime (id);
-  CAMLreturn (caml_copy_double (r));
+  return caml_copy_double (dWorldGetContactSurfaceLayer (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dAreConnected (value idav, value idbv)
+ocamlode_dWorldSetAutoDisableLinearThreshold (value world, value linear_threshold)
 {
-  CAMLparam2 (idav, idbv);
-  dBodyID ida = dBodyID_val (idav);
-  dBodyID idb = dBodyID_val (idbv);
-  int conn = dAreConnected (ida, idb);
-  CAMLreturn (Val_bool (conn));
+  dWorldSetAutoDisableLinearThreshold (dWorldID_val (world), Double_val (linear_threshold));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dAreConnectedExcluding (value body1, value body2, value joint_type_v)
+ocamlode_dWorldGetAutoDisableLinearThreshold (value world)
 {
-  int joint_type = joint_type_val (joint_type_v);
-  int ret = dAreConnectedExcluding (dBodyID_val (body1), dBodyID_val (body2), joint_type);
-  return Val_bool (ret);
+  return caml_copy_double (dWorldGetAutoDisableLinearThreshold (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dBodySetGravityMode (value b, value mode)
+ocamlode_dWorldSetAutoDisableAngularThreshold (value world, value angular_threshold)
 {
-  dBodySetGravityMode (dBodyID_val (b), Bool_val (mode));
+  dWorldSetAutoDisableAngularThreshold (dWorldID_val (world), Double_val (angular_threshold));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetGravityMode (value b)
+ocamlode_dWorldGetAutoDisableAngularThreshold (value world)
 {
-  return Val_bool (dBodyGetGravityMode (dBodyID_val (b)));
+  return caml_copy_double (dWorldGetAutoDisableAngularThreshold (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dBodySetFiniteRotationMode (value body, value mode)
+ocamlode_dWorldSetAutoDisableAverageSamplesCount (value world, value average_samples_count)
 {
-  dBodySetFiniteRotationMode (dBodyID_val (body), Bool_val(mode));
+  dWorldSetAutoDisableAverageSamplesCount (dWorldID_val (world), Int_val (average_samples_count));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetFiniteRotationMode (value body)
+ocamlode_dWorldGetAutoDisableAverageSamplesCount (value world)
 {
-  int ret = dBodyGetFiniteRotationMode (dBodyID_val (body));
-  return Val_bool (ret);
+  return Val_int (dWorldGetAutoDisableAverageSamplesCount (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dBodySetFiniteRotationAxis (value body, value x, value y, value z)
+ocamlode_dWorldSetAutoDisableSteps (value world, value steps)
 {
-  dBodySetFiniteRotationAxis (dBodyID_val (body), Double_val(x), Double_val(y), Double_val(z));
+  dWorldSetAutoDisableSteps (dWorldID_val (world), Int_val (steps));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetFiniteRotationAxis (value body)
+ocamlode_dWorldGetAutoDisableSteps (value world)
 {
-  dVector3 result;
-  dBodyGetFiniteRotationAxis (dBodyID_val (body), result);
-  return copy_dVector3 (result);
+  return Val_int (dWorldGetAutoDisableSteps (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dBodySetAutoDisableLinearThreshold (value body, value linear_average_threshold)
+ocamlode_dWorldSetAutoDisableTime (value world, value time)
 {
-  dBodySetAutoDisableLinearThreshold (dBodyID_val (body), Double_val (linear_average_threshold));
+  dWorldSetAutoDisableTime (dWorldID_val (world), Double_val (time));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetAutoDisableLinearThreshold (value body)
+ocamlode_dWorldGetAutoDisableTime (value world)
 {
-  return caml_copy_double (dBodyGetAutoDisableLinearThreshold (dBodyID_val (body)));
+  return caml_copy_double (dWorldGetAutoDisableTime (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dBodySetAutoDisableAngularThreshold (value body, value angular_average_threshold)
+ocamlode_dWorldSetAutoDisableFlag (value world, value do_auto_disable)
 {
-  dBodySetAutoDisableAngularThreshold (dBodyID_val (body), Double_val (angular_average_threshold));
+  dWorldSetAutoDisableFlag (dWorldID_val (world), Int_val (do_auto_disable));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetAutoDisableAngularThreshold (value body)
+ocamlode_dWorldGetAutoDisableFlag (value world)
 {
-  return caml_copy_double (dBodyGetAutoDisableAngularThreshold (dBodyID_val (body)));
+  return Val_bool (dWorldGetAutoDisableFlag (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dBodySetAutoDisableAverageSamplesCount (value body, value average_samples_count)
+ocamlode_dWorldSetQuickStepW (value world, value over_relaxation)
 {
-  dBodySetAutoDisableAverageSamplesCount (dBodyID_val (body), Int_val (average_samples_count));
+  dWorldSetQuickStepW (dWorldID_val (world), Double_val (over_relaxation));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetAutoDisableAverageSamplesCount (value body)
+ocamlode_dWorldGetQuickStepW (value world)
 {
-  int ret = dBodyGetAutoDisableAverageSamplesCount (dBodyID_val (body));
-  if (ret > Max_long)
-    caml_failwith("dBodyGetAutoDisableAverageSamplesCount: integer overflow");
-  return Val_int(ret);
+  return caml_copy_double (dWorldGetQuickStepW (dWorldID_val (world)));
 }
 
-/* OCaml integers are unboxed,
- * here it is set, and get back without convertions
- */
 CAMLprim value
-ocamlode_dBodySetData (value body, value data)
+ocamlode_dWorldSetContactMaxCorrectingVel (value world, value vel)
 {
-  dBodySetData (dBodyID_val (body), (void*) data);
+  dWorldSetContactMaxCorrectingVel (dWorldID_val (world), Double_val (vel));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dBodyGetData (value body)
+ocamlode_dWorldGetContactMaxCorrectingVel (value world)
 {
-  return ((value) dBodyGetData (dBodyID_val (body)));
+  return caml_copy_double (dWorldGetContactMaxCorrectingVel (dWorldID_val (world)));
 }
 
-/*
- void dBodySetAutoDisableDefaults (dBodyID);
-*/
-
-/* }}} */
-/* {{{ Joints */
+CAMLprim value
+ocamlode_dWorldSetLinearDamping (value world, value scale)
+{
+  dWorldSetLinearDamping (dWorldID_val (world), Double_val (scale));
+  return Val_unit;
+}
 
 CAMLprim value
-ocamlode_dJointCreateBall (value worldv, value jointgroupv)
+ocamlode_dWorldGetLinearDamping (value world)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateBall (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  return caml_copy_double (dWorldGetLinearDamping (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dJointCreateHinge (value worldv, value jointgroupv)
+ocamlode_dWorldSetAngularDamping (value world, value scale)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateHinge (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  dWorldSetAngularDamping (dWorldID_val (world), Double_val (scale));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointCreateSlider (value worldv, value jointgroupv)
+ocamlode_dWorldGetAngularDamping (value world)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateSlider (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  return caml_copy_double (dWorldGetAngularDamping (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dJointCreateContact (value worldv, value jointgroupv, value contactv)
+ocamlode_dWorldSetLinearDampingThreshold (value world, value threshold)
 {
-  CAMLparam3 (worldv, jointgroupv, contactv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dContact contact;
-  dContact_val (contactv, &contact);
-  dJointID id = dJointCreateContact (world, jointgroup, &contact);
-  CAMLreturn (Val_dJointID (id));
+  dWorldSetLinearDampingThreshold (dWorldID_val (world), Double_val (threshold));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointCreateUniversal (value worldv, value jointgroupv)
+ocamlode_dWorldGetLinearDampingThreshold (value world)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateUniversal (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  return caml_copy_double (dWorldGetLinearDampingThreshold (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dJointCreateHinge2 (value worldv, value jointgroupv)
+ocamlode_dWorldSetAngularDampingThreshold (value world, value threshold)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateHinge2 (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  dWorldSetAngularDampingThreshold (dWorldID_val (world), Double_val (threshold));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointCreateFixed (value worldv, value jointgroupv)
+ocamlode_dWorldGetAngularDampingThreshold (value world)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateFixed (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  return caml_copy_double (dWorldGetAngularDampingThreshold (dWorldID_val (world)));
 }
 
 CAMLprim value
-ocamlode_dJointCreateAMotor (value worldv, value jointgroupv)
+ocamlode_dWorldSetMaxAngularSpeed (value world, value max_speed)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateAMotor (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  dWorldSetMaxAngularSpeed (dWorldID_val (world), Double_val (max_speed));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointCreateLMotor (value worldv, value jointgroupv)
+ocamlode_dWorldGetMaxAngularSpeed (value world)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreateLMotor (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  return caml_copy_double (dWorldGetMaxAngularSpeed (dWorldID_val (world)));
 }
 
-/*
- dJointID dJointCreatePR (dWorldID, dJointGroupID);
- dJointID dJointCreateNull (dWorldID, dJointGroupID);
-*/
-
 CAMLprim value
-ocamlode_dJointCreatePlane2D (value worldv, value jointgroupv)
+ocamlode_dWorldSetDamping (value world, value linear_scale, value angular_scale)
 {
-  CAMLparam2 (worldv, jointgroupv);
-  dWorldID world = dWorldID_val (worldv);
-  dJointGroupID jointgroup;
-  if (jointgroupv == Val_int (0)) /* None */
-    jointgroup = 0;
-  else				/* Some jointgroup */
-    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
-  dJointID id = dJointCreatePlane2D (world, jointgroup);
-  CAMLreturn (Val_dJointID (id));
+  dWorldSetDamping (dWorldID_val (world), Double_val (linear_scale), Double_val (angular_scale));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointDestroy (value idv)
+ocamlode_dWorldSetStepMemoryReservationPolicy (value world, value reserve_factor, value reserve_minimum)
 {
-  CAMLparam1 (idv);
-  dJointID id = dJointID_val (idv);
-  dJointDestroy (id);
-  destroy_voidptr (idv);
-  CAMLreturn (Val_unit);
+  dWorldStepReserveInfo info;
+  info.struct_size = sizeof(dWorldStepReserveInfo);
+  info.reserve_factor = Double_val (reserve_factor);
+  info.reserve_minimum = Int_val (reserve_minimum);
+  if (!dWorldSetStepMemoryReservationPolicy (dWorldID_val (world), &info))
+    caml_failwith ("dWorldSetStepMemoryReservationPolicy");
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGroupCreate (value unit)
+ocamlode_dWorldSetDefaultStepMemoryReservationPolicy (value world)
 {
-  CAMLparam1 (unit);
-  dJointGroupID id = dJointGroupCreate (0);
-  CAMLreturn (Val_dJointGroupID (id));
+  if (!dWorldSetStepMemoryReservationPolicy (dWorldID_val (world), NULL))
+    caml_failwith ("dWorldSetStepMemoryReservationPolicy");
+  return Val_unit;
 }
 
-CAMLprim value
-ocamlode_dJointGroupDestroy (value idv)
+static void *
+step_memory_alloc (size_t block_size)
 {
-  CAMLparam1 (idv);
-  dJointGroupID id = dJointGroupID_val (idv);
-  dJointGroupDestroy (id);
-  destroy_voidptr (idv);
-  CAMLreturn (Val_unit);
+  return malloc (block_size);
 }
 
-CAMLprim value
-ocamlode_dJointGroupEmpty (value idv)
+static void *
+step_memory_shrink (void *block_pointer, size_t block_current_size, size_t block_smaller_size)
 {
-  CAMLparam1 (idv);
-  dJointGroupID id = dJointGroupID_val (idv);
-  dJointGroupEmpty (id);
-  CAMLreturn (Val_unit);
+  return realloc (block_pointer, block_smaller_size);
 }
 
-CAMLprim value
-ocamlode_dJointAttach (value idv, value body1v, value body2v)
+static void
+step_memory_free (void *block_pointer, size_t block_current_size)
 {
-  CAMLparam3 (idv, body1v, body2v);
-  dJointID id = dJointID_val (idv);
-  dBodyID body1, body2;
-  if (body1v == Val_int (0))	/* Get body1 option. */
-    body1 = 0;
-  else
-    body1 = dBodyID_val (Field (body1v, 0));
-  if (body2v == Val_int (0))	/* Get body2 option. */
-    body2 = 0;
-  else
-    body2 = dBodyID_val (Field (body2v, 0));
-  dJointAttach (id, body1, body2);
-  CAMLreturn (Val_unit);
+  free (block_pointer);
 }
 
 CAMLprim value
-ocamlode_dJointSetSliderAxis (value idv, value xv, value yv, value zv)
+ocamlode_dWorldSetStepMemoryManager (value world, value manager)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dJointID id = dJointID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dJointSetSliderAxis (id, x, y, z);
-  CAMLreturn (Val_unit);
+  dWorldStepMemoryFunctionsInfo info;
+  int ok;
+  switch (Int_val (manager))
+  {
+    case 0: /* Step_memory_default */
+      ok = dWorldSetStepMemoryManager (dWorldID_val (world), NULL);
+      break;
+    case 1: /* Step_memory_malloc */
+      info.struct_size = sizeof(dWorldStepMemoryFunctionsInfo);
+      info.alloc_block = step_memory_alloc;
+      info.shrink_block = step_memory_shrink;
+      info.free_block = step_memory_free;
+      ok = dWorldSetStepMemoryManager (dWorldID_val (world), &info);
+      break;
+    default: caml_failwith ("dWorldSetStepMemoryManager");
+  }
+  if (!ok) caml_failwith ("dWorldSetStepMemoryManager");
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetSliderAxis (value idv)
+ocamlode_dWorldUseSharedWorkingMemory (value world, value from_worldv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dJointID id = dJointID_val (idv);
-  dVector3 r;
-  dJointGetSliderAxis (id, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  dWorldID from_world;
+  if (from_worldv == Val_int (0))	/* None */
+    from_world = 0;
+  else				/* Some from_world */
+    from_world = dWorldID_val (Field (from_worldv, 0));
+  return Val_bool (dWorldUseSharedWorkingMemory (dWorldID_val (world), from_world));
 }
 
 CAMLprim value
-ocamlode_dJointGetSliderPosition (value idv)
+ocamlode_dWorldCleanupWorkingMemory (value world)
 {
-  CAMLparam1 (idv);
-  dJointID id = dJointID_val (idv);
-  dReal r = dJointGetSliderPosition (id);
-  CAMLreturn (caml_copy_double (r));
+  dWorldCleanupWorkingMemory (dWorldID_val (world));
+  return Val_unit;
 }
 
+/* }}} */
+/* {{{ Bodies */
+
 CAMLprim value
-ocamlode_dJointGetSliderPositionRate (value idv)
+ocamlode_dBodyCreate (value worldv)
 {
-  CAMLparam1 (idv);
-  dJointID id = dJointID_val (idv);
-  dReal r = dJointGetSliderPositionRate (id);
-  CAMLreturn (caml_copy_double (r));
+  CAMLparam1 (worldv);
+  dWorldID world = dWorldID_val (worldv);
+  dBodyID id = dBodyCreate (world);
+  CAMLreturn (Val_owned (ARENA_BODY, id, world));
 }
 
 CAMLprim value
-ocamlode_dJointSetHingeParam (value idv, value paramv, value vv)
+ocamlode_dBodyDestroy (value idv)
 {
-  CAMLparam3 (idv, paramv, vv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal v = Double_val (vv);
-  dJointSetHingeParam (id, parameter, v);
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  arena_forget (id);
+  trackers_body_destroyed (id);
+  dBodyDestroy (id);
+  destroy_voidptr (idv);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetSliderParam (value idv, value paramv, value vv)
+ocamlode_dBodyGetWorld( value idv )
 {
-  CAMLparam3 (idv, paramv, vv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal v = Double_val (vv);
-  dJointSetSliderParam (id, parameter, v);
-  CAMLreturn (Val_unit);
+  dWorldID wid;
+  dBodyID id = dBodyID_val (idv);
+  wid = dBodyGetWorld( id );
+  return Val_dWorldID (wid);
 }
 
 CAMLprim value
-ocamlode_dJointSetHinge2Param (value idv, value paramv, value vv)
+ocamlode_dBodySetPosition (value idv, value xv, value yv, value zv)
 {
-  CAMLparam3 (idv, paramv, vv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal v = Double_val (vv);
-  dJointSetHinge2Param (id, parameter, v);
+  CAMLparam4 (idv, xv, yv, zv);
+  dBodyID id = dBodyID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dBodySetPosition (id, x, y, z);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetUniversalParam (value idv, value paramv, value vv)
+ocamlode_dBodySetRotation( value idv, value mv )
 {
-  CAMLparam3 (idv, paramv, vv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal v = Double_val (vv);
-  dJointSetUniversalParam (id, parameter, v);
-  CAMLreturn (Val_unit);
+  dBodyID id = dBodyID_val (idv);
+#if defined(MEM_CPY) // dSINGLE
+  dMatrix3 m;
+  int i;
+  for (i=0; i<12; ++i)
+    m[i] = Double_field(mv,i);
+  dBodySetRotation( id, m );
+#else // dDOUBLE
+  dBodySetRotation (id, (double *) mv);
+#endif
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointSetAMotorParam (value idv, value paramv, value vv)
+ocamlode_dBodySetQuaternion( value idv, value qv )
 {
-  CAMLparam3 (idv, paramv, vv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal v = Double_val (vv);
-  dJointSetAMotorParam (id, parameter, v);
-  CAMLreturn (Val_unit);
+  dBodyID id = dBodyID_val (idv);
+#if defined(MEM_CPY) // dSINGLE
+  dQuaternion q;
+  int i;
+  for (i=0; i<4; ++i)
+    q[i] = Double_field(qv,i);
+  dBodySetQuaternion (id, q);
+#else // dDOUBLE
+  dBodySetQuaternion (id, (double *) qv);
+#endif
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointSetLMotorParam (value idv, value paramv, value vv)
+ocamlode_dBodySetLinearVel( value idv, value x, value y, value z )
 {
-  CAMLparam3 (idv, paramv, vv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal v = Double_val (vv);
-  dJointSetLMotorParam (id, parameter, v);
-  CAMLreturn (Val_unit);
+  dBodyID id = dBodyID_val (idv);
+  dBodySetLinearVel( id, Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetHingeParam (value idv, value paramv)
+ocamlode_dBodySetAngularVel( value idv, value x, value y, value z )
 {
-  CAMLparam2 (idv, paramv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal r = dJointGetHingeParam (id, parameter);
-  CAMLreturn (caml_copy_double (r));
+  dBodyID id = dBodyID_val (idv);
+  dBodySetAngularVel( id, Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetSliderParam (value idv, value paramv)
+ocamlode_dBodyGetPosition (value idv)
 {
-  CAMLparam2 (idv, paramv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal r = dJointGetSliderParam (id, parameter);
-  CAMLreturn (caml_copy_double (r));
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  const dReal *r = dBodyGetPosition (id);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Param (value idv, value paramv)
+ocamlode_dBodyGetRotation (value idv)
 {
-  CAMLparam2 (idv, paramv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal r = dJointGetHinge2Param (id, parameter);
-  CAMLreturn (caml_copy_double (r));
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  const dReal *r = dBodyGetRotation (id);
+  rv = copy_dReal_array (r, 12);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointGetUniversalParam (value idv, value paramv)
+ocamlode_dBodyGetQuaternion (value idv)
 {
-  CAMLparam2 (idv, paramv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal r = dJointGetUniversalParam (id, parameter);
-  CAMLreturn (caml_copy_double (r));
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  const dReal *r = dBodyGetQuaternion (id);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointGetAMotorParam (value idv, value paramv)
+ocamlode_dBodyGetLinearVel (value idv)
 {
-  CAMLparam2 (idv, paramv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal r = dJointGetAMotorParam (id, parameter);
-  CAMLreturn (caml_copy_double (r));
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  const dReal *r = dBodyGetLinearVel (id);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointGetLMotorParam (value idv, value paramv)
+ocamlode_dBodyGetAngularVel (value idv)
 {
-  CAMLparam2 (idv, paramv);
-  dJointID id = dJointID_val (idv);
-  int parameter = dJointParam_val (paramv);
-  dReal r = dJointGetLMotorParam (id, parameter);
-  CAMLreturn (caml_copy_double (r));
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  const dReal *r = dBodyGetAngularVel (id);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointSetBallAnchor (value idv, value xv, value yv, value zv)
+ocamlode_dBodySetMass (value idv, value massv)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dJointID id = dJointID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dJointSetBallAnchor (id, x, y, z);
+  CAMLparam2 (idv, massv);
+  dBodyID id = dBodyID_val (idv);
+  dBodySetMass (id, dMass_data_custom_val (massv));
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetBallAnchor2 (value idv, value xv, value yv, value zv)
+ocamlode_dBodyGetMass (value idv)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dJointID id = dJointID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dJointSetBallAnchor2 (id, x, y, z);
-  CAMLreturn (Val_unit);
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  dMass mass;
+  dBodyGetMass (id, &mass);
+  CAMLreturn (copy_dMass (&mass));
 }
 
 CAMLprim value
-ocamlode_dJointSetHingeAnchor (value joint, value x, value y, value z)
+ocamlode_dBodyAddForce (value idv, value fxv, value fyv, value fzv)
 {
-  dJointSetHingeAnchor (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
-  return Val_unit;
+  CAMLparam4 (idv, fxv, fyv, fzv);
+  dBodyID id = dBodyID_val (idv);
+  dReal fx = Double_val (fxv);
+  dReal fy = Double_val (fyv);
+  dReal fz = Double_val (fzv);
+  dBodyAddForce (id, fx, fy, fz);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetHingeAnchorDelta (value joint, value x, value y, value z, value ax, value ay, value az)
-{
-  dJointSetHingeAnchorDelta (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z),
-                             Double_val (ax), Double_val (ay), Double_val (az));
-  return Val_unit;
-}
-CAMLprim value
-ocamlode_dJointSetHingeAnchorDelta_bytecode (value * argv, int argn)
+ocamlode_dBodyAddTorque (value idv, value fxv, value fyv, value fzv)
 {
-  return ocamlode_dJointSetHingeAnchorDelta (argv[0], argv[1], argv[2],
-                                             argv[3], argv[4], argv[5], argv[6]);
+  CAMLparam4 (idv, fxv, fyv, fzv);
+  dBodyID id = dBodyID_val (idv);
+  dReal fx = Double_val (fxv);
+  dReal fy = Double_val (fyv);
+  dReal fz = Double_val (fzv);
+  dBodyAddTorque (id, fx, fy, fz);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetHingeAxis (value joint, value x, value y, value z)
+ocamlode_dBodyAddRelForce (value idv, value fxv, value fyv, value fzv)
 {
-  dJointSetHingeAxis (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
-  return Val_unit;
+  CAMLparam4 (idv, fxv, fyv, fzv);
+  dBodyID id = dBodyID_val (idv);
+  dReal fx = Double_val (fxv);
+  dReal fy = Double_val (fyv);
+  dReal fz = Double_val (fzv);
+  dBodyAddRelForce (id, fx, fy, fz);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointAddHingeTorque (value joint, value torque)
+ocamlode_dBodyAddRelTorque (value idv, value fxv, value fyv, value fzv)
 {
-  dJointAddHingeTorque (dJointID_val (joint), Double_val (torque));
-  return Val_unit;
+  CAMLparam4 (idv, fxv, fyv, fzv);
+  dBodyID id = dBodyID_val (idv);
+  dReal fx = Double_val (fxv);
+  dReal fy = Double_val (fyv);
+  dReal fz = Double_val (fzv);
+  dBodyAddRelTorque (id, fx, fy, fz);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetSliderAxisDelta (value joint, value x, value y, value z, value ax, value ay, value az)
+ocamlode_dBodyAddForceAtPos (value body, value fx, value fy, value fz,
+                                         value px, value py, value pz)
 {
-  dJointSetSliderAxisDelta (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z),
-                            Double_val (ax), Double_val (ay), Double_val (az));
+  dBodyAddForceAtPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
+                                          Double_val(px), Double_val(py), Double_val(pz));
   return Val_unit;
 }
 CAMLprim value
-ocamlode_dJointSetSliderAxisDelta_bytecode (value * argv, int argn)
-{
-  return ocamlode_dJointSetSliderAxisDelta (argv[0], argv[1], argv[2],
-                                            argv[3], argv[4], argv[5], argv[6]);
-}
-
-CAMLprim value
-ocamlode_dJointAddSliderForce (value joint, value force)
+ocamlode_dBodyAddForceAtPos_bc (value * argv, int argn)
 {
-  dJointAddSliderForce (dJointID_val (joint), Double_val (force));
-  return Val_unit;
+  return ocamlode_dBodyAddForceAtPos(
+    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
 }
 
 CAMLprim value
-ocamlode_dJointSetHinge2Anchor (value joint, value x, value y, value z)
+ocamlode_dBodyAddForceAtRelPos (value body, value fx, value fy, value fz,
+                                            value px, value py, value pz)
 {
-  dJointSetHinge2Anchor (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  dBodyAddForceAtRelPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
+                                             Double_val(px), Double_val(py), Double_val(pz));
   return Val_unit;
 }
-
 CAMLprim value
-ocamlode_dJointAddHinge2Torques (value joint, value torque1, value torque2)
+ocamlode_dBodyAddForceAtRelPos_bc (value * argv, int argn)
 {
-  dJointAddHinge2Torques (dJointID_val (joint), Double_val (torque1), Double_val (torque2));
-  return Val_unit;
+  return ocamlode_dBodyAddForceAtRelPos(
+    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
 }
 
-/* {{{ generated code needing to be tested */
-
 CAMLprim value
-ocamlode_dJointSetUniversalAnchor( value pv, value x, value y, value z )
+ocamlode_dBodyAddRelForceAtPos (value body, value fx, value fy, value fz,
+                                            value px, value py, value pz)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetUniversalAnchor( p, Double_val(x), Double_val(y), Double_val(z) );
+  dBodyAddRelForceAtPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
+                                             Double_val(px), Double_val(py), Double_val(pz));
   return Val_unit;
 }
-
 CAMLprim value
-ocamlode_dJointSetUniversalAxis1( value pv, value x, value y, value z )
+ocamlode_dBodyAddRelForceAtPos_bc (value * argv, int argn)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetUniversalAxis1( p, Double_val(x), Double_val(y), Double_val(z) );
-  return Val_unit;
+  return ocamlode_dBodyAddRelForceAtPos(
+    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
 }
 
 CAMLprim value
-ocamlode_dJointSetUniversalAxis2( value pv, value x, value y, value z )
+ocamlode_dBodyAddRelForceAtRelPos (value body, value fx, value fy, value fz,
+                                               value px, value py, value pz)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetUniversalAxis2( p, Double_val(x), Double_val(y), Double_val(z) );
+  dBodyAddRelForceAtRelPos (dBodyID_val (body), Double_val(fx), Double_val(fy), Double_val(fz),
+                                                Double_val(px), Double_val(py), Double_val(pz));
   return Val_unit;
 }
-
 CAMLprim value
-ocamlode_dJointAddUniversalTorques( value jointv, value torque1, value torque2 )
+ocamlode_dBodyAddRelForceAtRelPos_bc (value * argv, int argn)
 {
-  dJointID joint = dJointID_val (jointv);
-  dJointAddUniversalTorques( joint, Double_val(torque1), Double_val(torque2) );
-  return Val_unit;
+  return ocamlode_dBodyAddRelForceAtRelPos(
+    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6] );
 }
 
 CAMLprim value
-ocamlode_dJointSetPRAnchor( value pv, value x, value y, value z )
+ocamlode_dBodySetForce (value body, value x, value y, value z)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetPRAnchor( p, Double_val(x), Double_val(y), Double_val(z) );
+  dBodySetForce (dBodyID_val (body), Double_val(x), Double_val(y), Double_val(z));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointSetPRAxis1( value pv, value x, value y, value z )
+ocamlode_dBodySetTorque (value body, value x, value y, value z)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetPRAxis1( p, Double_val(x), Double_val(y), Double_val(z) );
+  dBodySetTorque (dBodyID_val (body) , Double_val(x), Double_val(y), Double_val(z));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointSetPRAxis2( value pv, value x, value y, value z )
+ocamlode_dBodyGetForce (value body)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetPRAxis2( p, Double_val(x), Double_val(y), Double_val(z) );
-  return Val_unit;
+  const dReal * f = dBodyGetForce (dBodyID_val (body));
+  return copy_dReal_array (f, 4);
 }
 
 CAMLprim value
-ocamlode_dJointSetPRParam( value pv, value parameter, value value )
+ocamlode_dBodyGetTorque (value body)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetPRParam( p, Int_val(parameter), Double_val(value) );
-  return Val_unit;
+  const dReal * t = dBodyGetTorque (dBodyID_val (body));
+  return copy_dReal_array (t, 4);
 }
 
 CAMLprim value
-ocamlode_dJointAddPRTorque( value jv, value torque )
+ocamlode_dBodyGetRelPointPos (value idv, value pxv, value pyv, value pzv)
 {
-  dJointID j = dJointID_val (jv);
-  dJointAddPRTorque( j, Double_val(torque) );
-  return Val_unit;
+  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  dReal px = Double_val (pxv);
+  dReal py = Double_val (pyv);
+  dReal pz = Double_val (pzv);
+  dVector3 r;
+  dBodyGetRelPointPos (id, px, py, pz, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointSetFixed( value pv )
+ocamlode_dBodyGetPosRelPoint (value idv, value pxv, value pyv, value pzv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetFixed( p );
-  return Val_unit;
+  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  dReal px = Double_val (pxv);
+  dReal py = Double_val (pyv);
+  dReal pz = Double_val (pzv);
+  dVector3 r;
+  dBodyGetPosRelPoint (id, px, py, pz, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointSetAMotorNumAxes( value pv, value num )
+ocamlode_dBodyGetRelPointVel (value idv, value pxv, value pyv, value pzv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetAMotorNumAxes( p, Int_val(num) );
-  return Val_unit;
+  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  dReal px = Double_val (pxv);
+  dReal py = Double_val (pyv);
+  dReal pz = Double_val (pzv);
+  dVector3 r;
+  dBodyGetRelPointVel (id, px, py, pz, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointSetAMotorAxis( value pv, value anum, value rel, value x, value y, value z )
+ocamlode_dBodyGetPointVel (value idv, value pxv, value pyv, value pzv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetAMotorAxis( p, Int_val(anum), Int_val(rel), Double_val(x), Double_val(y), Double_val(z) );
-  return Val_unit;
+  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  dReal px = Double_val (pxv);
+  dReal py = Double_val (pyv);
+  dReal pz = Double_val (pzv);
+  dVector3 r;
+  dBodyGetPointVel (id, px, py, pz, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
+
 CAMLprim value
-ocamlode_dJointSetAMotorAxis_bc(value * argv, int argn)
+ocamlode_dBodyVectorToWorld (value idv, value pxv, value pyv, value pzv)
 {
-  return ocamlode_dJointSetAMotorAxis(
-    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5] );
+  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  dReal px = Double_val (pxv);
+  dReal py = Double_val (pyv);
+  dReal pz = Double_val (pzv);
+  dVector3 r;
+  dBodyVectorToWorld (id, px, py, pz, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointSetAMotorAngle( value pv, value anum, value angle )
+ocamlode_dBodyVectorFromWorld (value idv, value pxv, value pyv, value pzv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetAMotorAngle( p, Int_val(anum), Double_val(angle) );
-  return Val_unit;
+  CAMLparam4 (idv, pxv, pyv, pzv);
+  CAMLlocal1 (rv);
+  dBodyID id = dBodyID_val (idv);
+  dReal px = Double_val (pxv);
+  dReal py = Double_val (pyv);
+  dReal pz = Double_val (pzv);
+  dVector3 r;
+  dBodyVectorFromWorld (id, px, py, pz, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dJointSetAMotorMode( value pv, value mode )
+ocamlode_dBodyEnable (value idv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetAMotorMode( p, Int_val(mode) );
-  return Val_unit;
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  dBodyEnable (id);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointAddAMotorTorques( value pv, value torque1, value torque2, value torque3 )
+ocamlode_dBodyDisable (value idv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointAddAMotorTorques( p, Double_val(torque1), Double_val(torque2), Double_val(torque3) );
-  return Val_unit;
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  dBodyDisable (id);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetLMotorNumAxes( value pv, value num )
+ocamlode_dBodyIsEnabled (value idv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetLMotorNumAxes( p, Int_val(num) );
-  return Val_unit;
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  int enabled = dBodyIsEnabled (id);
+  CAMLreturn (Val_bool (enabled));
 }
 
 CAMLprim value
-ocamlode_dJointSetLMotorAxis( value pv, value anum, value rel, value x, value y, value z )
+ocamlode_dBodySetAutoDisableFlag (value idv, value flagv)
 {
-  dJointID p = dJointID_val (pv);
-  dJointSetLMotorAxis( p, Int_val(anum), Int_val(rel), Double_val(x), Double_val(y), Double_val(z) );
-  return Val_unit;
+  CAMLparam2 (idv, flagv);
+  dBodyID id = dBodyID_val (idv);
+  int flag = Bool_val (flagv);
+  dBodySetAutoDisableFlag (id, flag);
+  CAMLreturn (Val_unit);
 }
+
 CAMLprim value
-ocamlode_dJointSetLMotorAxis_bc(value * argv, int argn)
+ocamlode_dBodyGetAutoDisableFlag (value idv)
 {
-  return ocamlode_dJointSetLMotorAxis(
-    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5] );
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  int flag = dBodyGetAutoDisableFlag (id);
+  CAMLreturn (Val_bool (flag));
 }
 
-/* }}} */
-
 CAMLprim value
-ocamlode_dJointSetPlane2DXParam (value joint, value paramv, value val)
+ocamlode_dBodySetAutoDisableSteps (value idv, value steps)
 {
-  int param = dJointParam_val (paramv);
-  dJointSetPlane2DXParam (dJointID_val (joint), param, Double_val (val));
-  return Val_unit;
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  dBodySetAutoDisableSteps (id, Int_val(steps));
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointSetPlane2DYParam (value joint, value paramv, value val)
+ocamlode_dBodyGetAutoDisableSteps (value idv)
 {
-  int param = dJointParam_val (paramv);
-  dJointSetPlane2DYParam (dJointID_val (joint), param, Double_val (val));
-  return Val_unit;
+  dBodyID id = dBodyID_val (idv);
+  return Val_int (dBodyGetAutoDisableSteps (id));
 }
 
 CAMLprim value
-ocamlode_dJointSetPlane2DAngleParam (value joint, value paramv, value val)
+ocamlode_dBodySetAutoDisableTime (value idv, value timev)
 {
-  int param = dJointParam_val (paramv);
-  dJointSetPlane2DAngleParam (dJointID_val (joint), param, Double_val (val));
-  return Val_unit;
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  dReal time = Double_val (timev);
+  dBodySetAutoDisableTime (id, time);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dJointGetBallAnchor (value joint)
+ocamlode_dBodyGetAutoDisableTime (value idv)
 {
-  dVector3 result;
-  dJointGetBallAnchor (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  CAMLparam1 (idv);
+  dBodyID id = dBodyID_val (idv);
+  dReal r = dBodyGetAutoDisableTime (id);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dJointGetBallAnchor2 (value joint)
+ocamlode_dAreConnected (value idav, value idbv)
 {
-  dVector3 result;
-  dJointGetBallAnchor2 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  CAMLparam2 (idav, idbv);
+  dBodyID ida = dBodyID_val (idav);
+  dBodyID idb = dBodyID_val (idbv);
+  int conn = dAreConnected (ida, idb);
+  CAMLreturn (Val_bool (conn));
 }
 
 CAMLprim value
-ocamlode_dJointGetHingeAnchor (value joint)
+ocamlode_dAreConnectedExcluding (value body1, value body2, value joint_type_v)
 {
-  dVector3 result;
-  dJointGetHingeAnchor (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  int joint_type = joint_type_val (joint_type_v);
+  int ret = dAreConnectedExcluding (dBodyID_val (body1), dBodyID_val (body2), joint_type);
+  return Val_bool (ret);
 }
 
 CAMLprim value
-ocamlode_dJointGetHingeAnchor2 (value joint)
+ocamlode_dBodySetGravityMode (value b, value mode)
 {
-  dVector3 result;
-  dJointGetHingeAnchor2 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  dBodySetGravityMode (dBodyID_val (b), Bool_val (mode));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetHingeAxis (value joint)
+ocamlode_dBodyGetGravityMode (value b)
 {
-  dVector3 result;
-  dJointGetHingeAxis (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  return Val_bool (dBodyGetGravityMode (dBodyID_val (b)));
 }
 
 CAMLprim value
-ocamlode_dJointGetHingeAngle (value joint)
+ocamlode_dBodySetFiniteRotationMode (value body, value mode)
 {
-  return caml_copy_double (dJointGetHingeAngle (dJointID_val (joint)));
+  dBodySetFiniteRotationMode (dBodyID_val (body), Bool_val(mode));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetHingeAngleRate (value joint)
+ocamlode_dBodyGetFiniteRotationMode (value body)
 {
-  return caml_copy_double (dJointGetHingeAngleRate (dJointID_val (joint)));
+  int ret = dBodyGetFiniteRotationMode (dBodyID_val (body));
+  return Val_bool (ret);
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Anchor (value joint)
+ocamlode_dBodySetFiniteRotationAxis (value body, value x, value y, value z)
 {
-  dVector3 result;
-  dJointGetHinge2Anchor (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  dBodySetFiniteRotationAxis (dBodyID_val (body), Double_val(x), Double_val(y), Double_val(z));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Anchor2 (value joint)
+ocamlode_dBodyGetFiniteRotationAxis (value body)
 {
   dVector3 result;
-  dJointGetHinge2Anchor2 (dJointID_val (joint), result);
+  dBodyGetFiniteRotationAxis (dBodyID_val (body), result);
   return copy_dVector3 (result);
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Axis1 (value joint)
+ocamlode_dBodySetAutoDisableLinearThreshold (value body, value linear_average_threshold)
 {
-  dVector3 result;
-  dJointGetHinge2Axis1 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  dBodySetAutoDisableLinearThreshold (dBodyID_val (body), Double_val (linear_average_threshold));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Axis2 (value joint)
+ocamlode_dBodyGetAutoDisableLinearThreshold (value body)
 {
-  dVector3 result;
-  dJointGetHinge2Axis2 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  return caml_copy_double (dBodyGetAutoDisableLinearThreshold (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Angle1 (value joint)
+ocamlode_dBodySetAutoDisableAngularThreshold (value body, value angular_average_threshold)
 {
-  return caml_copy_double (dJointGetHinge2Angle1 (dJointID_val (joint)));
+  dBodySetAutoDisableAngularThreshold (dBodyID_val (body), Double_val (angular_average_threshold));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Angle1Rate (value joint)
+ocamlode_dBodyGetAutoDisableAngularThreshold (value body)
 {
-  return caml_copy_double (dJointGetHinge2Angle1Rate (dJointID_val (joint)));
+  return caml_copy_double (dBodyGetAutoDisableAngularThreshold (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dJointGetHinge2Angle2Rate (value joint)
+ocamlode_dBodySetAutoDisableAverageSamplesCount (value body, value average_samples_count)
 {
-  return caml_copy_double (dJointGetHinge2Angle2Rate (dJointID_val (joint)));
+  dBodySetAutoDisableAverageSamplesCount (dBodyID_val (body), Int_val (average_samples_count));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetUniversalAnchor (value joint)
+ocamlode_dBodyGetAutoDisableAverageSamplesCount (value body)
 {
-  dVector3 result;
-  dJointGetUniversalAnchor (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  int ret = dBodyGetAutoDisableAverageSamplesCount (dBodyID_val (body));
+  if (ret > Max_long)
+    caml_failwith("dBodyGetAutoDisableAverageSamplesCount: integer overflow");
+  return Val_int(ret);
 }
 
 CAMLprim value
-ocamlode_dJointGetUniversalAnchor2 (value joint)
+ocamlode_dBodySetLinearDamping (value body, value scale)
 {
-  dVector3 result;
-  dJointGetUniversalAnchor2 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  dBodySetLinearDamping (dBodyID_val (body), Double_val (scale));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetUniversalAxis1 (value joint)
+ocamlode_dBodyGetLinearDamping (value body)
 {
-  dVector3 result;
-  dJointGetUniversalAxis1 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  return caml_copy_double (dBodyGetLinearDamping (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dJointGetUniversalAxis2 (value joint)
+ocamlode_dBodySetAngularDamping (value body, value scale)
 {
-  dVector3 result;
-  dJointGetUniversalAxis2 (dJointID_val (joint), result);
-  return copy_dVector3 (result);
+  dBodySetAngularDamping (dBodyID_val (body), Double_val (scale));
+  return Val_unit;
 }
 
-/*
- void dJointGetUniversalAngles (dJointID, dReal *angle1, dReal *angle2);
- dReal dJointGetUniversalAngle1 (dJointID);
- dReal dJointGetUniversalAngle2 (dJointID);
- dReal dJointGetUniversalAngle1Rate (dJointID);
- dReal dJointGetUniversalAngle2Rate (dJointID);
-
- void dJointGetPRAnchor (dJointID, dVector3 result);
-
- dReal dJointGetPRPosition (dJointID);
- dReal dJointGetPRPositionRate (dJointID);
- void dJointGetPRAxis1 (dJointID, dVector3 result);
- void dJointGetPRAxis2 (dJointID, dVector3 result);
- dReal dJointGetPRParam (dJointID, int parameter);
-
- int dJointGetAMotorNumAxes (dJointID);
- void dJointGetAMotorAxis (dJointID, int anum, dVector3 result);
- int dJointGetAMotorAxisRel (dJointID, int anum);
- dReal dJointGetAMotorAngle (dJointID, int anum);
- dReal dJointGetAMotorAngleRate (dJointID, int anum);
- int dJointGetAMotorMode (dJointID);
-
- int dJointGetLMotorNumAxes (dJointID);
- void dJointGetLMotorAxis (dJointID, int anum, dVector3 result);
-*/
-
 CAMLprim value
-ocamlode_dBodyGetNumJoints (value body)
+ocamlode_dBodyGetAngularDamping (value body)
 {
-  return Val_int (dBodyGetNumJoints (dBodyID_val (body)));
+  return caml_copy_double (dBodyGetAngularDamping (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dBodyGetJoint (value body, value index)
+ocamlode_dBodySetLinearDampingThreshold (value body, value threshold)
 {
-  dJointID joint = dBodyGetJoint (dBodyID_val (body), Int_val (index));
-  return Val_dJointID (joint);
+  dBodySetLinearDampingThreshold (dBodyID_val (body), Double_val (threshold));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dConnectingJoint (value b1, value b2)
+ocamlode_dBodyGetLinearDampingThreshold (value body)
 {
-  dJointID joint = dConnectingJoint (dBodyID_val (b1), dBodyID_val (b2));
-  return Val_dJointID (joint);
+  return caml_copy_double (dBodyGetLinearDampingThreshold (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dConnectingJointList (value b1, value b2)
+ocamlode_dBodySetAngularDampingThreshold (value body, value threshold)
 {
-  CAMLparam2 (b1, b2);
-  CAMLlocal1 (rv);
-
-  dJointID* jlist = NULL;
-  int i;
-  int n = dConnectingJointList (dBodyID_val (b1), dBodyID_val (b2), jlist);
-
-  rv = caml_alloc(n, 0);
-  for (i=0; i<n; ++i) {
-    Store_field (rv, i, Val_dJointID (jlist[i]) );
-  }
-  CAMLreturn (rv);
+  dBodySetAngularDampingThreshold (dBodyID_val (body), Double_val (threshold));
+  return Val_unit;
 }
 
-/* OCaml integers are unboxed,
- * here it is set, and get back without convertions
- */
 CAMLprim value
-ocamlode_dJointSetData (value joint, value data)
+ocamlode_dBodyGetAngularDampingThreshold (value body)
 {
-  dJointSetData (dJointID_val (joint), (void *) data);
-  return Val_unit;
+  return caml_copy_double (dBodyGetAngularDampingThreshold (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dJointGetData (value joint)
+ocamlode_dBodySetMaxAngularSpeed (value body, value max_speed)
 {
-  return ((value) dJointGetData (dJointID_val (joint)));
+  dBodySetMaxAngularSpeed (dBodyID_val (body), Double_val (max_speed));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetType (value joint)
+ocamlode_dBodyGetMaxAngularSpeed (value body)
 {
-  return Val_joint_type (dJointGetType (dJointID_val (joint)));
+  return caml_copy_double (dBodyGetMaxAngularSpeed (dBodyID_val (body)));
 }
 
 CAMLprim value
-ocamlode_dJointGetBody (value joint, value index)
+ocamlode_dBodySetDamping (value body, value linear_scale, value angular_scale)
 {
-  dBodyID b = dJointGetBody (dJointID_val (joint), Int_val (index));
-  if (!b) caml_failwith("dJointGetBody: connection with the static environment");
-  return Val_dBodyID (b);
+  dBodySetDamping (dBodyID_val (body), Double_val (linear_scale), Double_val (angular_scale));
+  return Val_unit;
 }
 
-static struct custom_operations dJointFeedback_custom_ops = {
-  identifier: "ocamlode_dJointFeedback",
-  finalize:    custom_finalize_default,
-  compare:     custom_compare_default,
-  hash:        custom_hash_default,
-  serialize:   custom_serialize_default,
-  deserialize: custom_deserialize_default
-};
-
-static inline value copy_dJointFeedback (dJointFeedback *some_obj)
-{
-  CAMLparam0 ();
-  CAMLlocal1 (v);
-  v = caml_alloc_custom (&dJointFeedback_custom_ops, sizeof(dJointFeedback), 0, 1);
-  memcpy (Data_custom_val(v), some_obj, sizeof(dJointFeedback));
-  CAMLreturn (v);
-}
-/*
-define value alloc_dJointFeedback \
-  caml_alloc_custom (&dJointFeedback_custom_ops, sizeof(dJointFeedback), 0, 1)
-*/
 CAMLprim value
-_ocamlode_dJointSetFeedback ( value joint )
+ocamlode_dBodySetDampingDefaults (value body)
 {
-  CAMLparam1 (joint);
-  CAMLlocal1 (ml_jfb);
-  ml_jfb = caml_alloc_custom (&dJointFeedback_custom_ops, sizeof(dJointFeedback), 0, 1);
-  dJointSetFeedback (dJointID_val (joint), (dJointFeedback *) Data_custom_val(ml_jfb));
-  CAMLreturn (ml_jfb);
+  dBodySetDampingDefaults (dBodyID_val (body));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointSetFeedback ( value joint )
+ocamlode_dBodySetKinematic (value body)
 {
-  CAMLparam1 (joint);
-  dJointFeedback * jfb;
-  jfb = malloc (sizeof(dJointFeedback));
-  if (jfb==NULL) caml_failwith("Out of memory");
-  dJointSetFeedback (dJointID_val (joint), jfb);
-  CAMLreturn ( (value) jfb );
+  dBodySetKinematic (dBodyID_val (body));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointFeedbackBufferDestroy (value b)
+ocamlode_dBodySetDynamic (value body)
 {
-  dJointFeedback * f = (dJointFeedback *) b;
-  free (f);
+  dBodySetDynamic (dBodyID_val (body));
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointGetFeedback (value joint)
+ocamlode_dBodyIsKinematic (value body)
 {
-  CAMLparam1 (joint);
-  CAMLlocal1 (rv);
-  dJointFeedback *f = dJointGetFeedback (dJointID_val (joint));
-  rv = caml_alloc (4, 0);
-  caml_modify (&Field (rv, 0), copy_dVector3 (f->f1));
-  caml_modify (&Field (rv, 1), copy_dVector3 (f->t1));
-  caml_modify (&Field (rv, 2), copy_dVector3 (f->f2));
-  caml_modify (&Field (rv, 3), copy_dVector3 (f->t2));
-  CAMLreturn (rv);
+  return Val_bool (dBodyIsKinematic (dBodyID_val (body)));
 }
 
 CAMLprim value
-_ocamlode_dJointFeedback_of_buffer (value b)
+ocamlode_dBodySetGyroscopicMode (value body, value enabled)
 {
-  CAMLparam1 (b);
-  CAMLlocal1 (rv);
-  dJointFeedback * f = (dJointFeedback *) Data_custom_val(b);
-  rv = caml_alloc (4, 0);
-  caml_modify (&Field (rv, 0), copy_dVector3 (f->f1));
-  caml_modify (&Field (rv, 1), copy_dVector3 (f->t1));
-  caml_modify (&Field (rv, 2), copy_dVector3 (f->f2));
-  caml_modify (&Field (rv, 3), copy_dVector3 (f->t2));
-  CAMLreturn (rv);
+  dBodySetGyroscopicMode (dBodyID_val (body), Bool_val (enabled));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dJointFeedback_of_buffer (value b)
+ocamlode_dBodyGetGyroscopicMode (value body)
 {
-  CAMLparam1 (b);
-  CAMLlocal1 (rv);
-  dJointFeedback * f = (dJointFeedback *) b;
-  rv = caml_alloc (4, 0);
-  caml_modify (&Field (rv, 0), copy_dVector3 (f->f1));
-  caml_modify (&Field (rv, 1), copy_dVector3 (f->t1));
-  caml_modify (&Field (rv, 2), copy_dVector3 (f->f2));
-  caml_modify (&Field (rv, 3), copy_dVector3 (f->t2));
-  CAMLreturn (rv);
+  return Val_bool (dBodyGetGyroscopicMode (dBodyID_val (body)));
 }
 
-/* }}} */
-/* {{{ Space */
-
-CAMLprim value
-ocamlode_dSimpleSpaceCreate (value parentv)
+/* the fields of the record body_dynamics */
+static void
+body_set_dynamics (dBodyID b, value d)
 {
-  CAMLparam1 (parentv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dSpaceID id = dSimpleSpaceCreate (parent);
-  CAMLreturn (Val_dSpaceID (id));
+  if (Bool_val (Field (d, 0))) dBodySetKinematic (b);
+  else dBodySetDynamic (b);
+  dBodySetLinearDamping (b, Double_val (Field (d, 1)));
+  dBodySetAngularDamping (b, Double_val (Field (d, 2)));
+  dBodySetLinearDampingThreshold (b, Double_val (Field (d, 3)));
+  dBodySetAngularDampingThreshold (b, Double_val (Field (d, 4)));
+  dBodySetMaxAngularSpeed (b, Double_val (Field (d, 5)));
+  dBodySetGyroscopicMode (b, Bool_val (Field (d, 6)));
 }
 
 CAMLprim value
-ocamlode_dHashSpaceCreate (value parentv)
+ocamlode_dBodyGetDynamics (value body)
 {
-  CAMLparam1 (parentv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dSpaceID id = dHashSpaceCreate (parent);
-  CAMLreturn (Val_dSpaceID (id));
+  CAMLparam1 (body);
+  CAMLlocal1 (d);
+  dBodyID b = dBodyID_val (body);
+  d = caml_alloc (7, 0);
+  Store_field (d, 0, Val_bool (dBodyIsKinematic (b)));
+  Store_field (d, 1, caml_copy_double (dBodyGetLinearDamping (b)));
+  Store_field (d, 2, caml_copy_double (dBodyGetAngularDamping (b)));
+  Store_field (d, 3, caml_copy_double (dBodyGetLinearDampingThreshold (b)));
+  Store_field (d, 4, caml_copy_double (dBodyGetAngularDampingThreshold (b)));
+  Store_field (d, 5, caml_copy_double (dBodyGetMaxAngularSpeed (b)));
+  Store_field (d, 6, Val_bool (dBodyGetGyroscopicMode (b)));
+  CAMLreturn (d);
 }
 
 CAMLprim value
-ocamlode_dQuadTreeSpaceCreate (value parentv,
-                               value centerv, value extentsv, value depthv)
+ocamlode_dBodySetDynamics (value body, value d)
 {
-  CAMLparam4 (parentv, centerv, extentsv, depthv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dVector3 center, extents;
-  dVector3_val (centerv, center);
-  dVector3_val (extentsv, extents);
-  int depth = Int_val (depthv);
-  dSpaceID id = dQuadTreeSpaceCreate (parent, center, extents, depth);
-  CAMLreturn (Val_dSpaceID (id));
+  body_set_dynamics (dBodyID_val (body), d);
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dSpaceDestroy (value idv)
+ocamlode_dBodiesSetDynamics (value bodies, value d)
 {
-  CAMLparam1 (idv);
-  dSpaceID id = dSpaceID_val (idv);
-  dSpaceDestroy (id);
-  destroy_voidptr (idv);
-  CAMLreturn (Val_unit);
+  mlsize_t i, n = Wosize_val (bodies);
+  for (i = 0; i < n; i++)
+    body_set_dynamics (dBodyID_val (Field (bodies, i)), d);
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dHashSpaceSetLevels (value idv, value minlevelv, value maxlevelv)
+ocamlode_dBodiesSetKinematic (value bodies, value kinematic)
 {
-  CAMLparam3 (idv, minlevelv, maxlevelv);
-  dSpaceID id = dSpaceID_val (idv);
-  int minlevel = Int_val (minlevelv);
-  int maxlevel = Int_val (maxlevelv);
-  dHashSpaceSetLevels (id, minlevel, maxlevel);
-  CAMLreturn (Val_unit);
+  mlsize_t i, n = Wosize_val (bodies);
+  int k = Bool_val (kinematic);
+  for (i = 0; i < n; i++) {
+    dBodyID b = dBodyID_val (Field (bodies, i));
+    if (k) dBodySetKinematic (b);
+    else dBodySetDynamic (b);
+  }
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dHashSpaceGetLevels (value idv)
+ocamlode_dBodiesSetDamping (value bodies, value linear_scale, value angular_scale)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dSpaceID id = dSpaceID_val (idv);
-  int minlevel, maxlevel;
-  dHashSpaceGetLevels (id, &minlevel, &maxlevel);
-  rv = caml_alloc (2, 0);
-  caml_modify (&Field (rv, 0), Val_int (minlevel));
-  caml_modify (&Field (rv, 1), Val_int (maxlevel));
-  CAMLreturn (rv);
+  mlsize_t i, n = Wosize_val (bodies);
+  dReal l = Double_val (linear_scale), a = Double_val (angular_scale);
+  for (i = 0; i < n; i++)
+    dBodySetDamping (dBodyID_val (Field (bodies, i)), l, a);
+  return Val_unit;
 }
 
+/* OCaml integers are unboxed,
+ * here it is set, and get back without convertions
+ */
 CAMLprim value
-ocamlode_dSpaceAdd (value idv, value geomv)
+ocamlode_dBodySetData (value body, value data)
 {
-  CAMLparam2 (idv, geomv);
-  dSpaceID id = dSpaceID_val (idv);
-  dGeomID geom = dGeomID_val (geomv);
-  dSpaceAdd (id, geom);
-  CAMLreturn (Val_unit);
+  dBodySetData (dBodyID_val (body), (void*) data);
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dSpaceRemove (value idv, value geomv)
+ocamlode_dBodyGetData (value body)
 {
-  CAMLparam2 (idv, geomv);
-  dSpaceID id = dSpaceID_val (idv);
-  dGeomID geom = dGeomID_val (geomv);
-  dSpaceRemove (id, geom);
-  CAMLreturn (Val_unit);
+  return ((value) dBodyGetData (dBodyID_val (body)));
 }
 
-static void
-dSpaceCollide_callback (void *fvpv, dGeomID geom1, dGeomID geom2)
-{
-  CAMLparam0 ();
-  CAMLlocal4 (fv, geom1v, geom2v, rv);
-  value *fvp = (value *) fvpv;
-  assert (geom1 != geom2);
-  geom1v = Val_dGeomID (geom1);
-  geom2v = Val_dGeomID (geom2);
-  rv = caml_callback2_exn (*fvp, geom1v, geom2v);
-  if (Is_exception_result (rv)) {
-    // XXX Can we do better than this?
-    fprintf (stderr, "dSpaceCollide: callback raised exception: %s\n",
-             caml_format_exception (Extract_exception (rv)));
-    fflush (stderr);
-  }
-  CAMLreturn0;
-}
+/*
+ void dBodySetAutoDisableDefaults (dBodyID);
+*/
+
+/* }}} */
+/* {{{ Joints */
 
 CAMLprim value
-ocamlode_dSpaceCollide (value idv, value fv)
+ocamlode_dJointCreateBall (value worldv, value jointgroupv)
 {
-  CAMLparam2 (idv, fv);
-  value *fvp = &fv;
-  dSpaceID id = dSpaceID_val (idv);
-  dSpaceCollide (id, fvp, dSpaceCollide_callback);
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateBall (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceCollide2 (value o1, value o2, value fv)
+ocamlode_dJointCreateHinge (value worldv, value jointgroupv)
 {
-  CAMLparam3 (o1, o2, fv);
-  value *fvp = &fv;
-  dSpaceCollide2 (dGeomID_val (o1), dGeomID_val (o2), fvp, dSpaceCollide_callback);
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateHinge (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceSetCleanup (value space, value mode)
+ocamlode_dJointCreateSlider (value worldv, value jointgroupv)
 {
-  dSpaceSetCleanup (dSpaceID_val (space), Bool_val (mode));
-  return Val_unit;
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateSlider (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceGetCleanup (value space)
+ocamlode_dJointCreateContact (value worldv, value jointgroupv, value contactv)
 {
-  return Val_bool (dSpaceGetCleanup (dSpaceID_val (space)));
+  CAMLparam3 (worldv, jointgroupv, contactv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dContact contact;
+  dContact_val (contactv, &contact);
+  dJointID id = dJointCreateContact (world, jointgroup, &contact);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceClean (value space)
+ocamlode_dJointCreateUniversal (value worldv, value jointgroupv)
 {
-  dSpaceClean (dSpaceID_val (space));
-  return Val_unit;
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateUniversal (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceQuery (value space, value geom)
+ocamlode_dJointCreateHinge2 (value worldv, value jointgroupv)
 {
-  return Val_bool (dSpaceQuery (dSpaceID_val (space), dGeomID_val (geom)));
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateHinge2 (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceGetNumGeoms (value space)
+ocamlode_dJointCreateFixed (value worldv, value jointgroupv)
 {
-  int num = dSpaceGetNumGeoms (dSpaceID_val (space));
-  return Val_int (num);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateFixed (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceGetGeom (value space, value i)
+ocamlode_dJointCreateAMotor (value worldv, value jointgroupv)
 {
-  CAMLparam2 (space, i);
-  dGeomID id = dSpaceGetGeom (dSpaceID_val (space), Int_val (i));
-  CAMLreturn (Val_dGeomID (id));
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateAMotor (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dSpaceGetGeomsArray (value spacev)
+ocamlode_dJointCreateLMotor (value worldv, value jointgroupv)
 {
-  CAMLparam1 (spacev);
-  CAMLlocal1 (ar);
-
-  dSpaceID space = dSpaceID_val (spacev);
-  int i;
-  int num = dSpaceGetNumGeoms (space);
-
-  ar = caml_alloc(num, 0);
-
-  for (i=0; i<num; ++i)
-  {
-    dGeomID id = dSpaceGetGeom (space, i);
-    Store_field (ar, i, Val_dGeomID (id));
-  }
-
-  CAMLreturn (ar);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateLMotor (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
-/* }}} */
-/* {{{ Geometry */
+/*
+ dJointID dJointCreateNull (dWorldID, dJointGroupID);
+*/
 
 CAMLprim value
-ocamlode_dCollide (value geom1v, value geom2v, value maxv)
+ocamlode_dJointCreatePlane2D (value worldv, value jointgroupv)
 {
-  CAMLparam3 (geom1v, geom2v, maxv);
-  CAMLlocal1 (contactsv);
-  dGeomID geom1 = dGeomID_val (geom1v);
-  dGeomID geom2 = dGeomID_val (geom2v);
-  int max = Int_val (maxv);
-  unsigned flags = ((unsigned) max) & 0xffff;
-  dContactGeom contacts[max];
-  int n = dCollide (geom1, geom2, flags, contacts, sizeof (dContactGeom));
-#if 0
-  if (n == 0)
-    caml_failwith("dCollide: no contacts");
-#endif
-  contactsv = caml_alloc (n, 0);
-  int i;
-  for (i = 0; i < n; ++i)
-    caml_modify (&Field (contactsv, i), copy_dContactGeom (&contacts[i]));
-  CAMLreturn (contactsv);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreatePlane2D (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomDestroy (value idv)
+ocamlode_dJointCreatePR (value worldv, value jointgroupv)
 {
-  CAMLparam1 (idv);
-  dGeomID id = dGeomID_val (idv);
-  dGeomDestroy (id);
-  destroy_voidptr (idv);
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreatePR (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomSetBody (value idv, value bodyv)
+ocamlode_dJointCreatePU (value worldv, value jointgroupv)
 {
-  CAMLparam2 (idv, bodyv);
-  dGeomID id = dGeomID_val (idv);
-  dBodyID body;
-  if (bodyv == Val_int (0))	/* None */
-    body = 0;
-  else
-    body = dBodyID_val (Field (bodyv, 0));
-  dGeomSetBody (id, body);
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreatePU (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomGetBody (value idv)
+ocamlode_dJointCreatePiston (value worldv, value jointgroupv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (bodyv);
-  dGeomID id = dGeomID_val (idv);
-  dBodyID body = dGeomGetBody (id);
-  if (body) {			/* Some body */
-    bodyv = caml_alloc (1, 0);
-    caml_modify (&Field (bodyv, 0), Val_dBodyID (body));
-  } else
-    caml_modify (&bodyv, Val_int (0));	/* None */
-  CAMLreturn (bodyv);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreatePiston (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomSetPosition (value idv, value xv, value yv, value zv)
+ocamlode_dJointCreateDBall (value worldv, value jointgroupv)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dGeomID id = dGeomID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dGeomSetPosition (id, x, y, z);
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateDBall (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomSetRotation (value idv, value matrixv)
+ocamlode_dJointCreateDHinge (value worldv, value jointgroupv)
 {
-  CAMLparam2 (idv, matrixv);
-  dGeomID id = dGeomID_val (idv);
-#if defined(MEM_CPY) // dSINGLE
-  dMatrix3 m;
-  int i;
-  for (i=0; i<12; ++i)
-    m[i] = Double_field(matrixv,i);
-  dGeomSetRotation (id, m);
-#else // dDOUBLE
-  dGeomSetRotation (id, (double *) matrixv);
-#endif
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateDHinge (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomSetQuaternion (value idv, value quaternionv)
+ocamlode_dJointCreateTransmission (value worldv, value jointgroupv)
 {
-  CAMLparam2 (idv, quaternionv);
-  dGeomID id = dGeomID_val (idv);
-#if defined(MEM_CPY) // dSINGLE
-  dQuaternion q;
-  int i;
-  for (i=0; i<4; ++i)
-    q[i] = Double_field(quaternionv,i);
-  dGeomSetQuaternion (id, q);
-#else // dDOUBLE
-  dGeomSetQuaternion (id, (double *) quaternionv);
-#endif
-  CAMLreturn (Val_unit);
+  CAMLparam2 (worldv, jointgroupv);
+  dWorldID world = dWorldID_val (worldv);
+  dJointGroupID jointgroup;
+  if (jointgroupv == Val_int (0)) /* None */
+    jointgroup = 0;
+  else				/* Some jointgroup */
+    jointgroup = dJointGroupID_val (Field (jointgroupv, 0));
+  dJointID id = dJointCreateTransmission (world, jointgroup);
+  CAMLreturn (Val_joint (id, world, jointgroup));
 }
 
 CAMLprim value
-ocamlode_dGeomGetPosition (value idv)
+ocamlode_dJointDestroy (value idv)
 {
   CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  const dReal *r = dGeomGetPosition (id);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  dJointID id = dJointID_val (idv);
+  /* dJointDestroy ignores the joints of a group */
+  if (!group_joint_known (id)) arena_feedback_forget (id);
+  arena_forget (id);
+  trackers_joint_destroyed (id);
+  dJointDestroy (id);
+  destroy_voidptr (idv);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomGetRotation (value idv)
+ocamlode_dJointGroupCreate (value unit)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  const dReal *r = dGeomGetRotation (id);
-  rv = copy_dReal_array (r, 12);
-  CAMLreturn (rv);
+  CAMLparam1 (unit);
+  dJointGroupID id = dJointGroupCreate (0);
+  CAMLreturn (Val_owned (ARENA_JOINT_GROUP, id, NULL));
 }
 
 CAMLprim value
-ocamlode_dGeomGetQuaternion (value idv)
+ocamlode_dJointGroupDestroy (value idv)
 {
   CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  dQuaternion r;
-  dGeomGetQuaternion (id, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  dJointGroupID id = dJointGroupID_val (idv);
+  arena_forget (id);
+  joint_group_emptied (id, 1);
+  dJointGroupDestroy (id);
+  destroy_voidptr (idv);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomGetAABB (value idv)
+ocamlode_dJointGroupEmpty (value idv)
 {
   CAMLparam1 (idv);
-  CAMLlocal1 (aabbv);
-  dGeomID id = dGeomID_val (idv);
-  dReal aabb[6];
-  dGeomGetAABB (id, aabb);
-  aabbv = copy_dReal_array (aabb, 6);
-  CAMLreturn (aabbv);
+  dJointGroupID id = dJointGroupID_val (idv);
+  joint_group_emptied (id, 0);
+  dJointGroupEmpty (id);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dInfiniteAABB (value idv)
+ocamlode_dJointAttach (value idv, value body1v, value body2v)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (aabbv);
-  dGeomID id = dGeomID_val (idv);
-  dReal aabb[6];
-  dInfiniteAABB (id, aabb);
-  aabbv = copy_dReal_array (aabb, 6);
-  CAMLreturn (aabbv);
+  CAMLparam3 (idv, body1v, body2v);
+  dJointID id = dJointID_val (idv);
+  dBodyID body1, body2;
+  if (body1v == Val_int (0))	/* Get body1 option. */
+    body1 = 0;
+  else
+    body1 = dBodyID_val (Field (body1v, 0));
+  if (body2v == Val_int (0))	/* Get body2 option. */
+    body2 = 0;
+  else
+    body2 = dBodyID_val (Field (body2v, 0));
+  dJointAttach (id, body1, body2);
+  CAMLreturn (Val_unit);
 }
 
-/* Geometry Shapes */
+CAMLprim value
+ocamlode_dJointSetSliderAxis (value idv, value xv, value yv, value zv)
+{
+  CAMLparam4 (idv, xv, yv, zv);
+  dJointID id = dJointID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dJointSetSliderAxis (id, x, y, z);
+  CAMLreturn (Val_unit);
+}
 
 CAMLprim value
-ocamlode_dGeomGetClass (value geom)
+ocamlode_dJointGetSliderAxis (value idv)
 {
-  int geom_class = dGeomGetClass (dGeomID_val (geom));
-  value ret;
-  Val_dGeomClass(ret, geom_class);
-  return ret;
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dJointID id = dJointID_val (idv);
+  dVector3 r;
+  dJointGetSliderAxis (id, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
 }
 
 CAMLprim value
-ocamlode_dCreateSphere (value parentv, value radiusv)
+ocamlode_dJointGetSliderPosition (value idv)
 {
-  CAMLparam2 (parentv, radiusv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dReal radius = Double_val (radiusv);
-  dGeomID id = dCreateSphere (parent, radius);
-  CAMLreturn (Val_dGeomID (id));
+  CAMLparam1 (idv);
+  dJointID id = dJointID_val (idv);
+  dReal r = dJointGetSliderPosition (id);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomSphereGetRadius (value idv)
+ocamlode_dJointGetSliderPositionRate (value idv)
 {
   CAMLparam1 (idv);
-  dGeomID id = dGeomID_val (idv);
-  dReal radius = dGeomSphereGetRadius (id);
-  CAMLreturn (caml_copy_double (radius));
+  dJointID id = dJointID_val (idv);
+  dReal r = dJointGetSliderPositionRate (id);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomSphereSetRadius (value idv, value radiusv)
+ocamlode_dJointSetHingeParam (value idv, value paramv, value vv)
 {
-  CAMLparam2 (idv, radiusv);
-  dGeomID id = dGeomID_val (idv);
-  dReal radius = Double_val (radiusv);
-  dGeomSphereSetRadius (id, radius);
+  CAMLparam3 (idv, paramv, vv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal v = Double_val (vv);
+  dJointSetHingeParam (id, parameter, v);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomSpherePointDepth (value idv, value xv, value yv, value zv)
+ocamlode_dJointSetSliderParam (value idv, value paramv, value vv)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dGeomID id = dGeomID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dReal d =  dGeomSpherePointDepth (id, x, y, z);
-  CAMLreturn (caml_copy_double (d));
+  CAMLparam3 (idv, paramv, vv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal v = Double_val (vv);
+  dJointSetSliderParam (id, parameter, v);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dCreateBox (value parentv, value lxv, value lyv, value lzv)
+ocamlode_dJointSetHinge2Param (value idv, value paramv, value vv)
 {
-  CAMLparam4 (parentv, lxv, lyv, lzv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dReal lx = Double_val (lxv);
-  dReal ly = Double_val (lyv);
-  dReal lz = Double_val (lzv);
-  dGeomID id = dCreateBox (parent, lx, ly, lz);
-  CAMLreturn (Val_dGeomID (id));
+  CAMLparam3 (idv, paramv, vv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal v = Double_val (vv);
+  dJointSetHinge2Param (id, parameter, v);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomBoxGetLengths (value idv)
+ocamlode_dJointSetUniversalParam (value idv, value paramv, value vv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  dVector3 r;
-  dGeomBoxGetLengths (id, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam3 (idv, paramv, vv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal v = Double_val (vv);
+  dJointSetUniversalParam (id, parameter, v);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomBoxSetLengths (value idv, value lxv, value lyv, value lzv)
+ocamlode_dJointSetAMotorParam (value idv, value paramv, value vv)
 {
-  CAMLparam4 (idv, lxv, lyv, lzv);
-  dGeomID id = dGeomID_val (idv);
-  dReal lx = Double_val (lxv);
-  dReal ly = Double_val (lyv);
-  dReal lz = Double_val (lzv);
-  dGeomBoxSetLengths (id, lx, ly, lz);
+  CAMLparam3 (idv, paramv, vv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal v = Double_val (vv);
+  dJointSetAMotorParam (id, parameter, v);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomBoxPointDepth (value idv, value xv, value yv, value zv)
+ocamlode_dJointSetLMotorParam (value idv, value paramv, value vv)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dGeomID id = dGeomID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dReal d = dGeomBoxPointDepth (id, x, y, z);
-  CAMLreturn (caml_copy_double (d));
+  CAMLparam3 (idv, paramv, vv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal v = Double_val (vv);
+  dJointSetLMotorParam (id, parameter, v);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dCreatePlane (value parentv, value av, value bv, value cv, value dv)
+ocamlode_dJointGetHingeParam (value idv, value paramv)
 {
-  CAMLparam5 (parentv, av, bv, cv, dv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dReal a = Double_val (av);
-  dReal b = Double_val (bv);
-  dReal c = Double_val (cv);
-  dReal d = Double_val (dv);
-  dGeomID id = dCreatePlane (parent, a, b, c, d);
-  CAMLreturn (Val_dGeomID (id));
+  CAMLparam2 (idv, paramv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal r = dJointGetHingeParam (id, parameter);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomPlaneGetParams (value idv)
+ocamlode_dJointGetSliderParam (value idv, value paramv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  dVector4 r;
-  dGeomPlaneGetParams (id, r);
-  rv = copy_dReal_array (r, 4);
-  CAMLreturn (rv);
+  CAMLparam2 (idv, paramv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal r = dJointGetSliderParam (id, parameter);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomPlaneSetParams (value idv, value av, value bv, value cv, value dv)
+ocamlode_dJointGetHinge2Param (value idv, value paramv)
 {
-  CAMLparam5 (idv, av, bv, cv, dv);
-  dGeomID id = dGeomID_val (idv);
-  dReal a = Double_val (av);
-  dReal b = Double_val (bv);
-  dReal c = Double_val (cv);
-  dReal d = Double_val (dv);
-  dGeomPlaneSetParams (id, a, b, c, d);
-  CAMLreturn (Val_unit);
+  CAMLparam2 (idv, paramv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal r = dJointGetHinge2Param (id, parameter);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomPlanePointDepth (value idv, value xv, value yv, value zv)
+ocamlode_dJointGetUniversalParam (value idv, value paramv)
 {
-  CAMLparam4 (idv, xv, yv, zv);
-  dGeomID id = dGeomID_val (idv);
-  dReal x = Double_val (xv);
-  dReal y = Double_val (yv);
-  dReal z = Double_val (zv);
-  dReal d = dGeomPlanePointDepth (id, x, y, z);
-  CAMLreturn (caml_copy_double (d));
+  CAMLparam2 (idv, paramv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal r = dJointGetUniversalParam (id, parameter);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dCreateCapsule (value parentv, value radiusv, value lengthv)
+ocamlode_dJointGetAMotorParam (value idv, value paramv)
 {
-  CAMLparam3 (parentv, radiusv, lengthv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dReal radius = Double_val (radiusv);
-  dReal length = Double_val (lengthv);
-  dGeomID id = dCreateCapsule (parent, radius, length);
-  CAMLreturn (Val_dGeomID (id));
+  CAMLparam2 (idv, paramv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal r = dJointGetAMotorParam (id, parameter);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomCapsuleGetParams (value idv)
+ocamlode_dJointGetLMotorParam (value idv, value paramv)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  dReal radius, length;
-  dGeomCapsuleGetParams (id, &radius, &length);
-  rv = caml_alloc(2, 0);
-  Store_field (rv, 0, caml_copy_double (radius) );
-  Store_field (rv, 1, caml_copy_double (length) );
-  CAMLreturn (rv);
+  CAMLparam2 (idv, paramv);
+  dJointID id = dJointID_val (idv);
+  int parameter = dJointParam_val (paramv);
+  dReal r = dJointGetLMotorParam (id, parameter);
+  CAMLreturn (caml_copy_double (r));
 }
 
 CAMLprim value
-ocamlode_dGeomCapsuleSetParams (value idv, value radiusv, value lengthv)
+ocamlode_dJointSetBallAnchor (value idv, value xv, value yv, value zv)
 {
-  CAMLparam3 (idv, radiusv, lengthv);
-  dGeomID id = dGeomID_val (idv);
-  dReal radius = Double_val (radiusv);
-  dReal length = Double_val (lengthv);
-  dGeomCapsuleSetParams (id, radius, length);
+  CAMLparam4 (idv, xv, yv, zv);
+  dJointID id = dJointID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dJointSetBallAnchor (id, x, y, z);
   CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dGeomCapsulePointDepth (value idv, value xv, value yv, value zv)
+ocamlode_dJointSetBallAnchor2 (value idv, value xv, value yv, value zv)
 {
   CAMLparam4 (idv, xv, yv, zv);
-  dGeomID id = dGeomID_val (idv);
+  dJointID id = dJointID_val (idv);
   dReal x = Double_val (xv);
   dReal y = Double_val (yv);
   dReal z = Double_val (zv);
-  dReal d = dGeomCapsulePointDepth (id, x, y, z);
-  CAMLreturn (caml_copy_double (d));
+  dJointSetBallAnchor2 (id, x, y, z);
+  CAMLreturn (Val_unit);
 }
 
 CAMLprim value
-ocamlode_dCreateCylinder (value parentv, value radiusv, value lengthv)
+ocamlode_dJointSetHingeAnchor (value joint, value x, value y, value z)
 {
-  CAMLparam3 (parentv, radiusv, lengthv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dReal radius = Double_val (radiusv);
-  dReal length = Double_val (lengthv);
-  dGeomID id = dCreateCylinder (parent, radius, length);
-  CAMLreturn (Val_dGeomID (id));
+  dJointSetHingeAnchor (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomCylinderGetParams (value idv)
+ocamlode_dJointSetHingeAnchorDelta (value joint, value x, value y, value z, value ax, value ay, value az)
 {
-  CAMLparam1 (idv);
-  CAMLlocal1 (rv);
-  dGeomID id = dGeomID_val (idv);
-  dReal radius, length;
-  dGeomCylinderGetParams (id, &radius, &length);
-  rv = caml_alloc(2, 0);
-  Store_field (rv, 0, caml_copy_double (radius) );
-  Store_field (rv, 1, caml_copy_double (length) );
-  CAMLreturn (rv);
+  dJointSetHingeAnchorDelta (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z),
+                             Double_val (ax), Double_val (ay), Double_val (az));
+  return Val_unit;
 }
-
 CAMLprim value
-ocamlode_dGeomCylinderSetParams (value idv, value radiusv, value lengthv)
+ocamlode_dJointSetHingeAnchorDelta_bytecode (value * argv, int argn)
 {
-  CAMLparam3 (idv, radiusv, lengthv);
-  dGeomID id = dGeomID_val (idv);
-  dReal radius = Double_val (radiusv);
-  dReal length = Double_val (lengthv);
-  dGeomCylinderSetParams (id, radius, length);
-  CAMLreturn (Val_unit);
+  return ocamlode_dJointSetHingeAnchorDelta (argv[0], argv[1], argv[2],
+                                             argv[3], argv[4], argv[5], argv[6]);
 }
 
-
 CAMLprim value
-ocamlode_dCreateRay (value parentv, value lengthv)
+ocamlode_dJointSetHingeAxis (value joint, value x, value y, value z)
 {
-  CAMLparam2 (parentv, lengthv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-  dReal length = Double_val (lengthv);
-  dGeomID id = dCreateRay (parent, length);
-  CAMLreturn (Val_dGeomID (id));
+  dJointSetHingeAxis (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomRaySetLength (value idv, value lengthv)
+ocamlode_dJointAddHingeTorque (value joint, value torque)
 {
-  CAMLparam2 (idv, lengthv);
-  dGeomID id = dGeomID_val (idv);
-  dReal length = Double_val (lengthv);
-  dGeomRaySetLength (id, length);
-  CAMLreturn (Val_unit);
+  dJointAddHingeTorque (dJointID_val (joint), Double_val (torque));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomRayGetLength (value idv)
+ocamlode_dJointSetSliderAxisDelta (value joint, value x, value y, value z, value ax, value ay, value az)
 {
-  CAMLparam1 (idv);
-  dGeomID id = dGeomID_val (idv);
-  dReal length = dGeomRayGetLength (id);
-  CAMLreturn (caml_copy_double (length));
+  dJointSetSliderAxisDelta (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z),
+                            Double_val (ax), Double_val (ay), Double_val (az));
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dJointSetSliderAxisDelta_bytecode (value * argv, int argn)
+{
+  return ocamlode_dJointSetSliderAxisDelta (argv[0], argv[1], argv[2],
+                                            argv[3], argv[4], argv[5], argv[6]);
 }
 
 CAMLprim value
-ocamlode_dGeomRaySet_native (value ray, value px, value py, value pz, value dx, value dy, value dz)
+ocamlode_dJointAddSliderForce (value joint, value force)
 {
-  dGeomRaySet (dGeomID_val (ray), Double_val (px), Double_val (py), Double_val (pz),
-                                  Double_val (dx), Double_val (dy), Double_val (dz));
+  dJointAddSliderForce (dJointID_val (joint), Double_val (force));
   return Val_unit;
 }
+
 CAMLprim value
-ocamlode_dGeomRaySet_bytecode (value * argv, int argn)
+ocamlode_dJointSetHinge2Anchor (value joint, value x, value y, value z)
 {
-  return ocamlode_dGeomRaySet_native (argv[0], argv[1], argv[2],
-                                      argv[3], argv[4], argv[5], argv[6]);
+  dJointSetHinge2Anchor (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomRayGet (value ray)
+ocamlode_dJointAddHinge2Torques (value joint, value torque1, value torque2)
 {
-  CAMLparam1 (ray);
-  CAMLlocal1 (rv);
-  dVector3 start, dir;
-  dGeomRayGet (dGeomID_val (ray), start, dir);
-  rv = caml_alloc(2, 0);
-  Store_field (rv, 0, copy_dVector3 (start));
-  Store_field (rv, 1, copy_dVector3 (dir));
-  CAMLreturn (rv);
+  dJointAddHinge2Torques (dJointID_val (joint), Double_val (torque1), Double_val (torque2));
+  return Val_unit;
 }
 
+/* {{{ generated code needing to be tested */
+
 CAMLprim value
-ocamlode_dGeomRaySetClosestHit (value idv, value closestHit)
+ocamlode_dJointSetUniversalAnchor( value pv, value x, value y, value z )
 {
-  dGeomRaySetClosestHit (dGeomID_val (idv), Bool_val (closestHit));
+  dJointID p = dJointID_val (pv);
+  dJointSetUniversalAnchor( p, Double_val(x), Double_val(y), Double_val(z) );
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomRayGetClosestHit (value idv)
+ocamlode_dJointSetUniversalAxis1( value pv, value x, value y, value z )
 {
-  return Val_bool (dGeomRayGetClosestHit (dGeomID_val (idv)));
+  dJointID p = dJointID_val (pv);
+  dJointSetUniversalAxis1( p, Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
 }
 
-/* TriMesh */
-
 CAMLprim value
-ocamlode_dGeomTriMeshDataCreate (value unit)
+ocamlode_dJointSetUniversalAxis2( value pv, value x, value y, value z )
 {
-  CAMLparam0 ();
-  dTriMeshDataID id = dGeomTriMeshDataCreate();
-  /*
-  CAMLreturn (Val_dTriMeshDataID (id));
-  */
-  CAMLreturn (Val_dTriMeshDataID_2 (id, NULL));
+  dJointID p = dJointID_val (pv);
+  dJointSetUniversalAxis2( p, Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshDataDestroy (value idv)
+ocamlode_dJointAddUniversalTorques( value jointv, value torque1, value torque2 )
 {
-  dTriMeshDataID id = dTriMeshDataID_val(idv);
-  dGeomTriMeshDataDestroy (id);
+  dJointID joint = dJointID_val (jointv);
+  dJointAddUniversalTorques( joint, Double_val(torque1), Double_val(torque2) );
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshDataPreprocess (value idv)
+ocamlode_dJointSetPRAnchor( value pv, value x, value y, value z )
 {
-  dTriMeshDataID id = dTriMeshDataID_val(idv);
-  dGeomTriMeshDataPreprocess (id);
+  dJointID p = dJointID_val (pv);
+  dJointSetPRAnchor( p, Double_val(x), Double_val(y), Double_val(z) );
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshSetData (value geom, value data)
+ocamlode_dJointSetPRAxis1( value pv, value x, value y, value z )
 {
-  dGeomTriMeshSetData (dGeomID_val (geom), dTriMeshDataID_val (data));
+  dJointID p = dJointID_val (pv);
+  dJointSetPRAxis1( p, Double_val(x), Double_val(y), Double_val(z) );
   return Val_unit;
 }
 
-// TODO: what is the difference between 
-//       dGeomTriMeshGetData() and dGeomTriMeshGetTriMeshDataID() ?
-
 CAMLprim value
-ocamlode_dGeomTriMeshGetData (value geom)
+ocamlode_dJointSetPRAxis2( value pv, value x, value y, value z )
 {
-  CAMLparam1 (geom);
-  dTriMeshDataID id = dGeomTriMeshGetData (dGeomID_val (geom));
-  CAMLreturn (Val_dTriMeshDataID (id));
+  dJointID p = dJointID_val (pv);
+  dJointSetPRAxis2( p, Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshGetTriMeshDataID (value geom)
+ocamlode_dJointSetPRParam( value pv, value parameter, value value )
 {
-  CAMLparam1 (geom);
-  dTriMeshDataID id = dGeomTriMeshGetTriMeshDataID (dGeomID_val (geom));
-  CAMLreturn (Val_dTriMeshDataID (id));
+  dJointID p = dJointID_val (pv);
+  dJointSetPRParam( p, Int_val(parameter), Double_val(value) );
+  return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshDataUpdate (value idv)
+ocamlode_dJointAddPRTorque( value jv, value torque )
 {
-  dTriMeshDataID id = dTriMeshDataID_val(idv);
-  dGeomTriMeshDataUpdate (id);
+  dJointID j = dJointID_val (jv);
+  dJointAddPRTorque( j, Double_val(torque) );
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshDataBuildDouble (value idv, value vertices, value indicesv)
+ocamlode_dJointSetFixed( value pv )
 {
-  int *indices;
-  int i, lenv, leni;
-  dTriMeshDataID id = dTriMeshDataID_val(idv);
-
-  lenv = Wosize_val(vertices) / Double_wosize;
-  if ( (lenv % 3) != 0 )
-    caml_invalid_argument ("vertices array length not multiple of 3");
-
-  leni = Wosize_val (indicesv);
-  if ( (leni % 3) != 0 )
-    caml_invalid_argument ("indices array length not multiple of 3");
-
-  indices = malloc (leni * sizeof(int));
-  if (indices == NULL) caml_failwith("Out of memory");
-  for (i=0; i < leni; i++)
-  {
-    indices[i] = Long_val(Field(indicesv, i));
-  }
-
-  dGeomTriMeshDataBuildDouble (id,
-      (double *) vertices,
-      3 * sizeof(double), 
-      lenv / 3,
-      indices,
-      leni, 
-      3 * sizeof(int) );
-
-  // XXX ODE doesn't copy the datas but just keep a pointer to it,
-  // so, the memory pointed by 'indices' have to be freed at some point.
-  set_data2 (idv, indices);
-
+  dJointID p = dJointID_val (pv);
+  dJointSetFixed( p );
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dCreateTriMesh_native (value parentv, value idv, value tri_cb, value arr_cb, value ray_cb, value unit)
+ocamlode_dJointSetAMotorNumAxes( value pv, value num )
 {
-  CAMLparam5 (parentv, idv, tri_cb, arr_cb, ray_cb);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
+  dJointID p = dJointID_val (pv);
+  dJointSetAMotorNumAxes( p, Int_val(num) );
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetAMotorAxis( value pv, value anum, value rel, value x, value y, value z )
+{
+  dJointID p = dJointID_val (pv);
+  dJointSetAMotorAxis( p, Int_val(anum), Int_val(rel), Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dJointSetAMotorAxis_bc(value * argv, int argn)
+{
+  return ocamlode_dJointSetAMotorAxis(
+    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5] );
+}
+
+CAMLprim value
+ocamlode_dJointSetAMotorAngle( value pv, value anum, value angle )
+{
+  dJointID p = dJointID_val (pv);
+  dJointSetAMotorAngle( p, Int_val(anum), Double_val(angle) );
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetAMotorMode( value pv, value mode )
+{
+  dJointID p = dJointID_val (pv);
+  dJointSetAMotorMode( p, Int_val(mode) );
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointAddAMotorTorques( value pv, value torque1, value torque2, value torque3 )
+{
+  dJointID p = dJointID_val (pv);
+  dJointAddAMotorTorques( p, Double_val(torque1), Double_val(torque2), Double_val(torque3) );
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetLMotorNumAxes( value pv, value num )
+{
+  dJointID p = dJointID_val (pv);
+  dJointSetLMotorNumAxes( p, Int_val(num) );
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetLMotorAxis( value pv, value anum, value rel, value x, value y, value z )
+{
+  dJointID p = dJointID_val (pv);
+  dJointSetLMotorAxis( p, Int_val(anum), Int_val(rel), Double_val(x), Double_val(y), Double_val(z) );
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dJointSetLMotorAxis_bc(value * argv, int argn)
+{
+  return ocamlode_dJointSetLMotorAxis(
+    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5] );
+}
+
+/* }}} */
+
+CAMLprim value
+ocamlode_dJointSetPlane2DXParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetPlane2DXParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetPlane2DYParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetPlane2DYParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetPlane2DAngleParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetPlane2DAngleParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetBallAnchor (value joint)
+{
+  dVector3 result;
+  dJointGetBallAnchor (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetBallAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetBallAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHingeAnchor (value joint)
+{
+  dVector3 result;
+  dJointGetHingeAnchor (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHingeAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetHingeAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHingeAxis (value joint)
+{
+  dVector3 result;
+  dJointGetHingeAxis (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHingeAngle (value joint)
+{
+  return caml_copy_double (dJointGetHingeAngle (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetHingeAngleRate (value joint)
+{
+  return caml_copy_double (dJointGetHingeAngleRate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Anchor (value joint)
+{
+  dVector3 result;
+  dJointGetHinge2Anchor (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Anchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetHinge2Anchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Axis1 (value joint)
+{
+  dVector3 result;
+  dJointGetHinge2Axis1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Axis2 (value joint)
+{
+  dVector3 result;
+  dJointGetHinge2Axis2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Angle1 (value joint)
+{
+  return caml_copy_double (dJointGetHinge2Angle1 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Angle1Rate (value joint)
+{
+  return caml_copy_double (dJointGetHinge2Angle1Rate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetHinge2Angle2Rate (value joint)
+{
+  return caml_copy_double (dJointGetHinge2Angle2Rate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetUniversalAnchor (value joint)
+{
+  dVector3 result;
+  dJointGetUniversalAnchor (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetUniversalAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetUniversalAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetUniversalAxis1 (value joint)
+{
+  dVector3 result;
+  dJointGetUniversalAxis1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetUniversalAxis2 (value joint)
+{
+  dVector3 result;
+  dJointGetUniversalAxis2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+/*
+ void dJointGetUniversalAngles (dJointID, dReal *angle1, dReal *angle2);
+ dReal dJointGetUniversalAngle1 (dJointID);
+ dReal dJointGetUniversalAngle2 (dJointID);
+ dReal dJointGetUniversalAngle1Rate (dJointID);
+ dReal dJointGetUniversalAngle2Rate (dJointID);
+
+ void dJointGetPRAnchor (dJointID, dVector3 result);
+
+ dReal dJointGetPRPosition (dJointID);
+ dReal dJointGetPRPositionRate (dJointID);
+ void dJointGetPRAxis1 (dJointID, dVector3 result);
+ void dJointGetPRAxis2 (dJointID, dVector3 result);
+ dReal dJointGetPRParam (dJointID, int parameter);
+
+ int dJointGetAMotorNumAxes (dJointID);
+ void dJointGetAMotorAxis (dJointID, int anum, dVector3 result);
+ int dJointGetAMotorAxisRel (dJointID, int anum);
+ dReal dJointGetAMotorAngle (dJointID, int anum);
+ dReal dJointGetAMotorAngleRate (dJointID, int anum);
+ int dJointGetAMotorMode (dJointID);
+
+ int dJointGetLMotorNumAxes (dJointID);
+ void dJointGetLMotorAxis (dJointID, int anum, dVector3 result);
+*/
+
+/* {{{ Piston, PU, DBall, DHinge and Transmission joints */
+
+CAMLprim value
+ocamlode_dJointSetPUAnchor (value joint, value x, value y, value z)
+{
+  dJointSetPUAnchor (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetPUAxis1 (value joint, value x, value y, value z)
+{
+  dJointSetPUAxis1 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetPUAxis2 (value joint, value x, value y, value z)
+{
+  dJointSetPUAxis2 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetPUAxis3 (value joint, value x, value y, value z)
+{
+  dJointSetPUAxis3 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAnchor (value joint)
+{
+  dVector3 result;
+  dJointGetPUAnchor (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAxis1 (value joint)
+{
+  dVector3 result;
+  dJointGetPUAxis1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAxis2 (value joint)
+{
+  dVector3 result;
+  dJointGetPUAxis2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAxis3 (value joint)
+{
+  dVector3 result;
+  dJointGetPUAxis3 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPUPosition (value joint)
+{
+  return caml_copy_double (dJointGetPUPosition (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPUPositionRate (value joint)
+{
+  return caml_copy_double (dJointGetPUPositionRate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAngle1 (value joint)
+{
+  return caml_copy_double (dJointGetPUAngle1 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAngle1Rate (value joint)
+{
+  return caml_copy_double (dJointGetPUAngle1Rate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAngle2 (value joint)
+{
+  return caml_copy_double (dJointGetPUAngle2 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPUAngle2Rate (value joint)
+{
+  return caml_copy_double (dJointGetPUAngle2Rate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetPUParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetPUParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetPUParam (value joint, value paramv)
+{
+  int param = dJointParam_val (paramv);
+  return caml_copy_double (dJointGetPUParam (dJointID_val (joint), param));
+}
+
+CAMLprim value
+ocamlode_dJointSetPistonAnchor (value joint, value x, value y, value z)
+{
+  dJointSetPistonAnchor (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetPistonAxis (value joint, value x, value y, value z)
+{
+  dJointSetPistonAxis (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonAnchor (value joint)
+{
+  dVector3 result;
+  dJointGetPistonAnchor (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetPistonAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonAxis (value joint)
+{
+  dVector3 result;
+  dJointGetPistonAxis (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonPosition (value joint)
+{
+  return caml_copy_double (dJointGetPistonPosition (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonPositionRate (value joint)
+{
+  return caml_copy_double (dJointGetPistonPositionRate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonAngle (value joint)
+{
+  return caml_copy_double (dJointGetPistonAngle (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonAngleRate (value joint)
+{
+  return caml_copy_double (dJointGetPistonAngleRate (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetPistonParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetPistonParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetPistonParam (value joint, value paramv)
+{
+  int param = dJointParam_val (paramv);
+  return caml_copy_double (dJointGetPistonParam (dJointID_val (joint), param));
+}
+
+CAMLprim value
+ocamlode_dJointAddPistonForce (value joint, value force)
+{
+  dJointAddPistonForce (dJointID_val (joint), Double_val (force));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetDBallAnchor1 (value joint, value x, value y, value z)
+{
+  dJointSetDBallAnchor1 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetDBallAnchor2 (value joint, value x, value y, value z)
+{
+  dJointSetDBallAnchor2 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetDBallAnchor1 (value joint)
+{
+  dVector3 result;
+  dJointGetDBallAnchor1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetDBallAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetDBallAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetDBallDistance (value joint)
+{
+  return caml_copy_double (dJointGetDBallDistance (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetDBallDistance (value joint, value distance)
+{
+  dJointSetDBallDistance (dJointID_val (joint), Double_val (distance));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetDBallParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetDBallParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetDBallParam (value joint, value paramv)
+{
+  int param = dJointParam_val (paramv);
+  return caml_copy_double (dJointGetDBallParam (dJointID_val (joint), param));
+}
+
+CAMLprim value
+ocamlode_dJointSetDHingeAxis (value joint, value x, value y, value z)
+{
+  dJointSetDHingeAxis (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetDHingeAnchor1 (value joint, value x, value y, value z)
+{
+  dJointSetDHingeAnchor1 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointSetDHingeAnchor2 (value joint, value x, value y, value z)
+{
+  dJointSetDHingeAnchor2 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetDHingeAxis (value joint)
+{
+  dVector3 result;
+  dJointGetDHingeAxis (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetDHingeAnchor1 (value joint)
+{
+  dVector3 result;
+  dJointGetDHingeAnchor1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetDHingeAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetDHingeAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetDHingeDistance (value joint)
+{
+  return caml_copy_double (dJointGetDHingeDistance (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetDHingeParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetDHingeParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetDHingeParam (value joint, value paramv)
+{
+  int param = dJointParam_val (paramv);
+  return caml_copy_double (dJointGetDHingeParam (dJointID_val (joint), param));
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionMode (value joint, value mode)
+{
+  static const int transmission_mode_table[] = {
+    dTransmissionParallelAxes,
+    dTransmissionIntersectingAxes,
+    dTransmissionChainDrive,
+  };
+  dJointSetTransmissionMode (dJointID_val (joint), transmission_mode_table[Long_val (mode)]);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionMode (value joint)
+{
+  switch (dJointGetTransmissionMode (dJointID_val (joint)))
+  {
+    case dTransmissionParallelAxes:     return Val_int (0);
+    case dTransmissionIntersectingAxes: return Val_int (1);
+    case dTransmissionChainDrive:       return Val_int (2);
+    default: caml_failwith ("dJointGetTransmissionMode: unhandled mode");
+  }
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionAxis (value joint, value x, value y, value z)
+{
+  dJointSetTransmissionAxis (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAxis (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionAxis (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionAxis1 (value joint, value x, value y, value z)
+{
+  dJointSetTransmissionAxis1 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAxis1 (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionAxis1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionAxis2 (value joint, value x, value y, value z)
+{
+  dJointSetTransmissionAxis2 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAxis2 (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionAxis2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionAnchor1 (value joint, value x, value y, value z)
+{
+  dJointSetTransmissionAnchor1 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAnchor1 (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionAnchor1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionAnchor2 (value joint, value x, value y, value z)
+{
+  dJointSetTransmissionAnchor2 (dJointID_val (joint), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAnchor2 (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionAnchor2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionContactPoint1 (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionContactPoint1 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionContactPoint2 (value joint)
+{
+  dVector3 result;
+  dJointGetTransmissionContactPoint2 (dJointID_val (joint), result);
+  return copy_dVector3 (result);
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionRatio (value joint, value ratio)
+{
+  dJointSetTransmissionRatio (dJointID_val (joint), Double_val (ratio));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionRatio (value joint)
+{
+  return caml_copy_double (dJointGetTransmissionRatio (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionRadius1 (value joint, value radius)
+{
+  dJointSetTransmissionRadius1 (dJointID_val (joint), Double_val (radius));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionRadius1 (value joint)
+{
+  return caml_copy_double (dJointGetTransmissionRadius1 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionRadius2 (value joint, value radius)
+{
+  dJointSetTransmissionRadius2 (dJointID_val (joint), Double_val (radius));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionRadius2 (value joint)
+{
+  return caml_copy_double (dJointGetTransmissionRadius2 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionBacklash (value joint, value backlash)
+{
+  dJointSetTransmissionBacklash (dJointID_val (joint), Double_val (backlash));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionBacklash (value joint)
+{
+  return caml_copy_double (dJointGetTransmissionBacklash (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAngle1 (value joint)
+{
+  return caml_copy_double (dJointGetTransmissionAngle1 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionAngle2 (value joint)
+{
+  return caml_copy_double (dJointGetTransmissionAngle2 (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointSetTransmissionParam (value joint, value paramv, value val)
+{
+  int param = dJointParam_val (paramv);
+  dJointSetTransmissionParam (dJointID_val (joint), param, Double_val (val));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetTransmissionParam (value joint, value paramv)
+{
+  int param = dJointParam_val (paramv);
+  return caml_copy_double (dJointGetTransmissionParam (dJointID_val (joint), param));
+}
+
+/* }}} */
+
+CAMLprim value
+ocamlode_dBodyGetNumJoints (value body)
+{
+  return Val_int (dBodyGetNumJoints (dBodyID_val (body)));
+}
+
+CAMLprim value
+ocamlode_dBodyGetJoint (value body, value index)
+{
+  dJointID joint = dBodyGetJoint (dBodyID_val (body), Int_val (index));
+  return Val_dJointID (joint);
+}
+
+CAMLprim value
+ocamlode_dConnectingJoint (value b1, value b2)
+{
+  dJointID joint = dConnectingJoint (dBodyID_val (b1), dBodyID_val (b2));
+  return Val_dJointID (joint);
+}
+
+CAMLprim value
+ocamlode_dConnectingJointList (value b1, value b2)
+{
+  CAMLparam2 (b1, b2);
+  CAMLlocal1 (rv);
+
+  dJointID* jlist = NULL;
+  int i;
+  int n = dConnectingJointList (dBodyID_val (b1), dBodyID_val (b2), jlist);
+
+  rv = caml_alloc(n, 0);
+  for (i=0; i<n; ++i) {
+    Store_field (rv, i, Val_dJointID (jlist[i]) );
+  }
+  CAMLreturn (rv);
+}
+
+/* OCaml integers are unboxed,
+ * here it is set, and get back without convertions
+ */
+CAMLprim value
+ocamlode_dJointSetData (value joint, value data)
+{
+  dJointSetData (dJointID_val (joint), (void *) data);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetData (value joint)
+{
+  return ((value) dJointGetData (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetType (value joint)
+{
+  return Val_joint_type (dJointGetType (dJointID_val (joint)));
+}
+
+CAMLprim value
+ocamlode_dJointGetBody (value joint, value index)
+{
+  dBodyID b = dJointGetBody (dJointID_val (joint), Int_val (index));
+  if (!b) caml_failwith("dJointGetBody: connection with the static environment");
+  return Val_dBodyID (b);
+}
+
+static void
+serialize_dJointFeedback (value v, uintnat *bsize_32, uintnat *bsize_64)
+{
+  dJointFeedback *fb = (dJointFeedback *) Data_custom_val (v);
+  serialize_tag ();
+  serialize_reals (fb->f1, 4);
+  serialize_reals (fb->t1, 4);
+  serialize_reals (fb->f2, 4);
+  serialize_reals (fb->t2, 4);
+  *bsize_32 = *bsize_64 = sizeof(dJointFeedback);
+}
+
+static uintnat
+deserialize_dJointFeedback (void *dst)
+{
+  dJointFeedback *fb = (dJointFeedback *) dst;
+  struct serial_tag t = deserialize_tag ();
+  deserialize_reals (t, fb->f1, 4);
+  deserialize_reals (t, fb->t1, 4);
+  deserialize_reals (t, fb->f2, 4);
+  deserialize_reals (t, fb->t2, 4);
+  return sizeof(dJointFeedback);
+}
+
+static struct custom_operations dJointFeedback_custom_ops = {
+  identifier: "ocamlode_dJointFeedback",
+  finalize:    custom_finalize_default,
+  compare:     custom_compare_default,
+  hash:        custom_hash_default,
+  serialize:   serialize_dJointFeedback,
+  deserialize: deserialize_dJointFeedback
+};
+
+static inline value copy_dJointFeedback (dJointFeedback *some_obj)
+{
+  CAMLparam0 ();
+  CAMLlocal1 (v);
+  v = caml_alloc_custom (&dJointFeedback_custom_ops, sizeof(dJointFeedback), 0, 1);
+  memcpy (Data_custom_val(v), some_obj, sizeof(dJointFeedback));
+  CAMLreturn (v);
+}
+/*
+define value alloc_dJointFeedback \
+  caml_alloc_custom (&dJointFeedback_custom_ops, sizeof(dJointFeedback), 0, 1)
+*/
+CAMLprim value
+_ocamlode_dJointSetFeedback ( value joint )
+{
+  CAMLparam1 (joint);
+  CAMLlocal1 (ml_jfb);
+  ml_jfb = caml_alloc_custom (&dJointFeedback_custom_ops, sizeof(dJointFeedback), 0, 1);
+  dJointSetFeedback (dJointID_val (joint), (dJointFeedback *) Data_custom_val(ml_jfb));
+  CAMLreturn (ml_jfb);
+}
+
+CAMLprim value
+ocamlode_dJointSetFeedback ( value joint )
+{
+  CAMLparam1 (joint);
+  dJointID j = dJointID_val (joint);
+  dJointFeedback * jfb;
+  jfb = ocamlode_malloc (MEM_FEEDBACK, sizeof(dJointFeedback));
+  if (jfb==NULL) caml_failwith("Out of memory");
+  arena_feedback_forget (j);
+  dJointSetFeedback (j, jfb);
+  /* only the joints whose destruction is known can own an arena buffer */
+  if (joint_known (j))
+    arena_track (ARENA_FEEDBACK, jfb, j, Val_unit);
+  CAMLreturn ( (value) jfb );
+}
+
+CAMLprim value
+ocamlode_dJointFeedbackBufferDestroy (value b)
+{
+  dJointFeedback * f = (dJointFeedback *) b;
+  arena_forget (f);
+  ocamlode_free (f);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointGetFeedback (value joint)
+{
+  CAMLparam1 (joint);
+  CAMLlocal1 (rv);
+  dJointFeedback *f = dJointGetFeedback (dJointID_val (joint));
+  rv = caml_alloc (4, 0);
+  caml_modify (&Field (rv, 0), copy_dVector3 (f->f1));
+  caml_modify (&Field (rv, 1), copy_dVector3 (f->t1));
+  caml_modify (&Field (rv, 2), copy_dVector3 (f->f2));
+  caml_modify (&Field (rv, 3), copy_dVector3 (f->t2));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+_ocamlode_dJointFeedback_of_buffer (value b)
+{
+  CAMLparam1 (b);
+  CAMLlocal1 (rv);
+  dJointFeedback * f = (dJointFeedback *) Data_custom_val(b);
+  rv = caml_alloc (4, 0);
+  caml_modify (&Field (rv, 0), copy_dVector3 (f->f1));
+  caml_modify (&Field (rv, 1), copy_dVector3 (f->t1));
+  caml_modify (&Field (rv, 2), copy_dVector3 (f->f2));
+  caml_modify (&Field (rv, 3), copy_dVector3 (f->t2));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dJointFeedback_of_buffer (value b)
+{
+  CAMLparam1 (b);
+  CAMLlocal1 (rv);
+  dJointFeedback * f = (dJointFeedback *) b;
+  rv = caml_alloc (4, 0);
+  caml_modify (&Field (rv, 0), copy_dVector3 (f->f1));
+  caml_modify (&Field (rv, 1), copy_dVector3 (f->t1));
+  caml_modify (&Field (rv, 2), copy_dVector3 (f->f2));
+  caml_modify (&Field (rv, 3), copy_dVector3 (f->t2));
+  CAMLreturn (rv);
+}
+
+/* Feedback arena: one contiguous buffer of dJointFeedback for many joints,
+   read back all at once into a bigarray */
+
+struct feedback_arena {
+  int count;
+  dJointID *joints;  /* NULL once the joint is destroyed or gets another buffer */
+  dJointFeedback *feedbacks;
+  struct feedback_arena *next;
+};
+
+static struct feedback_arena *feedback_arenas = NULL;
+
+#define feedback_arena_val(v) Voidptr_val(struct feedback_arena *, (v))
+
+static struct feedback_arena *
+feedback_arena_get (value av, const char *msg)
+{
+  struct feedback_arena *a = feedback_arena_val(av);
+  if (a == NULL) caml_invalid_argument(msg);
+  return a;
+}
+
+/* called through arena_feedback_forget */
+static void
+feedback_arenas_forget (dJointID j, dJointFeedback *f)
+{
+  struct feedback_arena *a;
+  if (f == NULL) return;
+  for (a = feedback_arenas; a != NULL; a = a->next)
+    if (f >= a->feedbacks && f < a->feedbacks + a->count) {
+      if (a->joints[f - a->feedbacks] == j) a->joints[f - a->feedbacks] = NULL;
+      return;
+    }
+}
+
+/* the joints of a destroyed world, found through their bodies */
+static void
+feedback_arenas_world_destroyed (dWorldID w)
+{
+  struct feedback_arena *a;
+  int i, k;
+  for (a = feedback_arenas; a != NULL; a = a->next)
+    for (i = 0; i < a->count; i++) {
+      dJointID j = a->joints[i];
+      if (j == NULL) continue;
+      for (k = 0; k < 2; k++) {
+        dBodyID b = dJointGetBody(j, k);
+        if (b != NULL && dBodyGetWorld(b) == w) { a->joints[i] = NULL; break; }
+      }
+    }
+}
+
+CAMLprim value
+ocamlode_dJointFeedbackArenaCreate (value jointsv)
+{
+  CAMLparam1 (jointsv);
+  struct feedback_arena *a;
+  int i, n = Wosize_val (jointsv);
+
+  a = malloc (sizeof(struct feedback_arena));
+  if (a == NULL) caml_failwith("Out of memory");
+  a->count = n;
+  a->joints = ocamlode_malloc (MEM_FEEDBACK, (n + 1) * sizeof(dJointID));
+  a->feedbacks = ocamlode_calloc (MEM_FEEDBACK, n + 1, sizeof(dJointFeedback));
+  if (a->joints == NULL || a->feedbacks == NULL) {
+    ocamlode_free (a->joints); ocamlode_free (a->feedbacks); free (a);
+    caml_failwith("Out of memory");
+  }
+  for (i = 0; i < n; i++) {
+    a->joints[i] = dJointID_val (Field (jointsv, i));
+    arena_feedback_forget (a->joints[i]);
+    dJointSetFeedback (a->joints[i], &a->feedbacks[i]);
+  }
+  a->next = feedback_arenas;
+  feedback_arenas = a;
+  CAMLreturn (Val_voidptr (a));
+}
+
+CAMLprim value
+ocamlode_dJointFeedbackArenaSize (value av)
+{
+  return Val_int (feedback_arena_get (av, "dJointFeedbackArenaSize: the arena is destroyed")->count);
+}
+
+CAMLprim value
+ocamlode_dJointFeedbackArenaRead (value av, value ba)
+{
+  struct feedback_arena *a = feedback_arena_get (av, "dJointFeedbackArenaRead: the arena is destroyed");
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  double *dst = (double *) b->data;
+  int i, j;
+
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT64 ||
+      (b->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT ||
+      b->num_dims != 2 || b->dim[0] < a->count || b->dim[1] != 12)
+    caml_invalid_argument ("dJointFeedbackArenaRead: a float64 c_layout bigarray of dimensions [n; 12] is expected");
+
+  for (i = 0; i < a->count; i++, dst += 12) {
+    const dJointFeedback *f = &a->feedbacks[i];
+    for (j = 0; j < 3; j++) {
+      dst[j]     = f->f1[j];
+      dst[3 + j] = f->t1[j];
+      dst[6 + j] = f->f2[j];
+      dst[9 + j] = f->t2[j];
+    }
+  }
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dJointFeedbackArenaDestroy (value av)
+{
+  struct feedback_arena *a = feedback_arena_val (av);
+  struct feedback_arena **ap;
+  int i;
+  if (a == NULL) return Val_unit;
+  for (ap = &feedback_arenas; *ap != a; ap = &(*ap)->next);
+  *ap = a->next;
+  /* the joints still alive are detached */
+  for (i = 0; i < a->count; i++)
+    if (a->joints[i] != NULL)
+      dJointSetFeedback (a->joints[i], NULL);
+  ocamlode_free (a->joints);
+  ocamlode_free (a->feedbacks);
+  free (a);
+  destroy_voidptr (av);
+  return Val_unit;
+}
+
+/* }}} */
+/* {{{ Snapshots */
+
+/* A snapshot set is a fixed list of bodies and joints of a world, whose
+   state is saved into (and restored from) a contiguous buffer in one call.
+   The buffer holds the addresses of the bodies the joints are attached to,
+   so it is only valid in the process which saved it. */
+
+#define SNAPSHOT_MAGIC 0x4f444553  /* "ODES" */
+#define SNAPSHOT_VERSION 2
+
+enum {
+  SNAP_BODY_ENABLED      = 1,
+  SNAP_BODY_AUTO_DISABLE = 2,
+  SNAP_BODY_GRAVITY      = 4,
+  SNAP_BODY_KINEMATIC    = 8,
+  SNAP_BODY_GYROSCOPIC   = 16,
+  SNAP_JOINT_ENABLED     = 1,
+};
+
+struct snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t body_count;
+  uint32_t joint_count;
+  uint64_t size;
+};
+
+struct snapshot_world {
+  double gravity[3];
+  double erp, cfm, quickstep_w;
+  double contact_max_correcting_vel, contact_surface_layer;
+  double linear_damping, angular_damping;
+  double linear_damping_threshold, angular_damping_threshold;
+  double max_angular_speed;
+  int32_t quickstep_iterations;
+  int32_t pad;
+};
+
+struct snapshot_body {
+  double pos[3], q[4], lvel[3], avel[3], force[3], torque[3];
+  double adis_linear, adis_angular, adis_time;
+  double linear_damping, angular_damping;
+  double linear_damping_threshold, angular_damping_threshold;
+  double max_angular_speed;
+  int32_t adis_steps;
+  int32_t adis_samples;
+  uint32_t flags;
+  uint32_t pad;
+};
+
+struct snapshot_joint {
+  uint64_t body1, body2;
+  uint32_t flags;
+  uint32_t groups;  /* number of parameter groups following */
+};
+
+#define SNAPSHOT_PARAMS 12  /* per group in joint_param_table */
+
+struct snapshot_set {
+  dWorldID world;
+  int body_count;
+  int joint_count;
+  dBodyID *bodies;
+  dJointID *joints;
+  size_t size;
+};
+
+static int
+snapshot_param_groups (dJointID j)
+{
+  switch (dJointGetType (j))
+  {
+    case dJointTypeHinge:
+    case dJointTypeSlider:
+      return 1;
+    case dJointTypeHinge2:
+    case dJointTypeUniversal:
+    case dJointTypePR:
+    case dJointTypePiston:
+      return 2;
+    case dJointTypePU:
+    case dJointTypeAMotor:
+    case dJointTypeLMotor:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+static dReal
+snapshot_get_param (dJointID j, int param)
+{
+  switch (dJointGetType (j))
+  {
+    case dJointTypeHinge:     return dJointGetHingeParam (j, param);
+    case dJointTypeSlider:    return dJointGetSliderParam (j, param);
+    case dJointTypeHinge2:    return dJointGetHinge2Param (j, param);
+    case dJointTypeUniversal: return dJointGetUniversalParam (j, param);
+    case dJointTypePR:        return dJointGetPRParam (j, param);
+    case dJointTypePU:        return dJointGetPUParam (j, param);
+    case dJointTypePiston:    return dJointGetPistonParam (j, param);
+    case dJointTypeAMotor:    return dJointGetAMotorParam (j, param);
+    case dJointTypeLMotor:    return dJointGetLMotorParam (j, param);
+    default:                  return 0.0;
+  }
+}
+
+static void
+snapshot_set_param (dJointID j, int param, dReal v)
+{
+  switch (dJointGetType (j))
+  {
+    case dJointTypeHinge:     dJointSetHingeParam (j, param, v); break;
+    case dJointTypeSlider:    dJointSetSliderParam (j, param, v); break;
+    case dJointTypeHinge2:    dJointSetHinge2Param (j, param, v); break;
+    case dJointTypeUniversal: dJointSetUniversalParam (j, param, v); break;
+    case dJointTypePR:        dJointSetPRParam (j, param, v); break;
+    case dJointTypePU:        dJointSetPUParam (j, param, v); break;
+    case dJointTypePiston:    dJointSetPistonParam (j, param, v); break;
+    case dJointTypeAMotor:    dJointSetAMotorParam (j, param, v); break;
+    case dJointTypeLMotor:    dJointSetLMotorParam (j, param, v); break;
+    default: break;
+  }
+}
+
+static void
+snapshot_world_save (dWorldID world, struct snapshot_world *w)
+{
+  dVector3 g;
+  int k;
+  memset (w, 0, sizeof *w);
+  dWorldGetGravity (world, g);
+  for (k = 0; k < 3; k++) w->gravity[k] = g[k];
+  w->erp = dWorldGetERP (world);
+  w->cfm = dWorldGetCFM (world);
+  w->quickstep_w = dWorldGetQuickStepW (world);
+  w->quickstep_iterations = dWorldGetQuickStepNumIterations (world);
+  w->contact_max_correcting_vel = dWorldGetContactMaxCorrectingVel (world);
+  w->contact_surface_layer = dWorldGetContactSurfaceLayer (world);
+  w->linear_damping = dWorldGetLinearDamping (world);
+  w->angular_damping = dWorldGetAngularDamping (world);
+  w->linear_damping_threshold = dWorldGetLinearDampingThreshold (world);
+  w->angular_damping_threshold = dWorldGetAngularDampingThreshold (world);
+  w->max_angular_speed = dWorldGetMaxAngularSpeed (world);
+}
+
+static void
+snapshot_world_restore (dWorldID world, const struct snapshot_world *w)
+{
+  dWorldSetGravity (world, w->gravity[0], w->gravity[1], w->gravity[2]);
+  dWorldSetERP (world, w->erp);
+  dWorldSetCFM (world, w->cfm);
+  dWorldSetQuickStepW (world, w->quickstep_w);
+  dWorldSetQuickStepNumIterations (world, w->quickstep_iterations);
+  dWorldSetContactMaxCorrectingVel (world, w->contact_max_correcting_vel);
+  dWorldSetContactSurfaceLayer (world, w->contact_surface_layer);
+  dWorldSetLinearDamping (world, w->linear_damping);
+  dWorldSetAngularDamping (world, w->angular_damping);
+  dWorldSetLinearDampingThreshold (world, w->linear_damping_threshold);
+  dWorldSetAngularDampingThreshold (world, w->angular_damping_threshold);
+  dWorldSetMaxAngularSpeed (world, w->max_angular_speed);
+}
+
+static void
+snapshot_body_save (dBodyID b, struct snapshot_body *sb)
+{
+  const dReal *pos = dBodyGetPosition (b);
+  const dReal *q = dBodyGetQuaternion (b);
+  const dReal *lvel = dBodyGetLinearVel (b);
+  const dReal *avel = dBodyGetAngularVel (b);
+  const dReal *force = dBodyGetForce (b);
+  const dReal *torque = dBodyGetTorque (b);
+  int k;
+  for (k = 0; k < 3; k++) {
+    sb->pos[k] = pos[k];
+    sb->lvel[k] = lvel[k];
+    sb->avel[k] = avel[k];
+    sb->force[k] = force[k];
+    sb->torque[k] = torque[k];
+  }
+  for (k = 0; k < 4; k++) sb->q[k] = q[k];
+  sb->adis_linear = dBodyGetAutoDisableLinearThreshold (b);
+  sb->adis_angular = dBodyGetAutoDisableAngularThreshold (b);
+  sb->adis_time = dBodyGetAutoDisableTime (b);
+  sb->adis_steps = dBodyGetAutoDisableSteps (b);
+  sb->adis_samples = dBodyGetAutoDisableAverageSamplesCount (b);
+  sb->linear_damping = dBodyGetLinearDamping (b);
+  sb->angular_damping = dBodyGetAngularDamping (b);
+  sb->linear_damping_threshold = dBodyGetLinearDampingThreshold (b);
+  sb->angular_damping_threshold = dBodyGetAngularDampingThreshold (b);
+  sb->max_angular_speed = dBodyGetMaxAngularSpeed (b);
+  sb->flags = (dBodyIsEnabled (b) ? SNAP_BODY_ENABLED : 0)
+            | (dBodyGetAutoDisableFlag (b) ? SNAP_BODY_AUTO_DISABLE : 0)
+            | (dBodyGetGravityMode (b) ? SNAP_BODY_GRAVITY : 0)
+            | (dBodyIsKinematic (b) ? SNAP_BODY_KINEMATIC : 0)
+            | (dBodyGetGyroscopicMode (b) ? SNAP_BODY_GYROSCOPIC : 0);
+  sb->pad = 0;
+}
+
+static void
+snapshot_body_restore (dBodyID b, const struct snapshot_body *sb)
+{
+  dQuaternion q;
+  int k;
+  for (k = 0; k < 4; k++) q[k] = sb->q[k];
+  /* dBodySetDynamic sets the mass of the body again */
+  if (sb->flags & SNAP_BODY_KINEMATIC) {
+    if (!dBodyIsKinematic (b)) dBodySetKinematic (b);
+  } else if (dBodyIsKinematic (b)) dBodySetDynamic (b);
+  dBodySetPosition (b, sb->pos[0], sb->pos[1], sb->pos[2]);
+  dBodySetQuaternion (b, q);
+  dBodySetLinearVel (b, sb->lvel[0], sb->lvel[1], sb->lvel[2]);
+  dBodySetAngularVel (b, sb->avel[0], sb->avel[1], sb->avel[2]);
+  dBodySetForce (b, sb->force[0], sb->force[1], sb->force[2]);
+  dBodySetTorque (b, sb->torque[0], sb->torque[1], sb->torque[2]);
+  dBodySetAutoDisableLinearThreshold (b, sb->adis_linear);
+  dBodySetAutoDisableAngularThreshold (b, sb->adis_angular);
+  dBodySetAutoDisableTime (b, sb->adis_time);
+  dBodySetAutoDisableSteps (b, sb->adis_steps);
+  dBodySetAutoDisableAverageSamplesCount (b, sb->adis_samples);
+  dBodySetAutoDisableFlag (b, (sb->flags & SNAP_BODY_AUTO_DISABLE) != 0);
+  dBodySetGravityMode (b, (sb->flags & SNAP_BODY_GRAVITY) != 0);
+  dBodySetGyroscopicMode (b, (sb->flags & SNAP_BODY_GYROSCOPIC) != 0);
+  dBodySetLinearDamping (b, sb->linear_damping);
+  dBodySetAngularDamping (b, sb->angular_damping);
+  dBodySetLinearDampingThreshold (b, sb->linear_damping_threshold);
+  dBodySetAngularDampingThreshold (b, sb->angular_damping_threshold);
+  dBodySetMaxAngularSpeed (b, sb->max_angular_speed);
+  /* enabling a body also restarts its auto-disable counters */
+  if (sb->flags & SNAP_BODY_ENABLED) dBodyEnable (b);
+  else dBodyDisable (b);
+}
+
+#define snapshot_set_val(v) Voidptr_val(struct snapshot_set *, (v))
+
+CAMLprim value
+ocamlode_dSnapshotSetCreate (value worldv, value bodiesv, value jointsv)
+{
+  CAMLparam3 (worldv, bodiesv, jointsv);
+  struct snapshot_set *s;
+  int i;
+
+  s = malloc (sizeof (struct snapshot_set));
+  if (s == NULL) caml_failwith ("Out of memory");
+  s->world = dWorldID_val (worldv);
+  s->body_count = Wosize_val (bodiesv);
+  s->joint_count = Wosize_val (jointsv);
+  s->bodies = malloc ((s->body_count + 1) * sizeof (dBodyID));
+  s->joints = malloc ((s->joint_count + 1) * sizeof (dJointID));
+  if (s->bodies == NULL || s->joints == NULL) {
+    free (s->bodies); free (s->joints); free (s);
+    caml_failwith ("Out of memory");
+  }
+  s->size = sizeof (struct snapshot_header) + sizeof (struct snapshot_world)
+          + s->body_count * sizeof (struct snapshot_body)
+          + s->joint_count * sizeof (struct snapshot_joint);
+  for (i = 0; i < s->body_count; i++)
+    s->bodies[i] = dBodyID_val (Field (bodiesv, i));
+  for (i = 0; i < s->joint_count; i++) {
+    s->joints[i] = dJointID_val (Field (jointsv, i));
+    s->size += snapshot_param_groups (s->joints[i]) * SNAPSHOT_PARAMS * sizeof (double);
+  }
+  CAMLreturn (Val_voidptr (s));
+}
+
+CAMLprim value
+ocamlode_dSnapshotSetDestroy (value sv)
+{
+  struct snapshot_set *s = snapshot_set_val (sv);
+  if (s == NULL) return Val_unit;
+  free (s->bodies);
+  free (s->joints);
+  free (s);
+  destroy_voidptr (sv);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dSnapshotSize (value sv)
+{
+  return Val_long (snapshot_set_val (sv)->size);
+}
+
+CAMLprim value
+ocamlode_dSnapshotBodyCount (value sv)
+{
+  return Val_int (snapshot_set_val (sv)->body_count);
+}
+
+static unsigned char *
+snapshot_buffer (struct snapshot_set *s, value ba, const char *err)
+{
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_UINT8 ||
+      b->num_dims != 1 || b->dim[0] < (intnat) s->size)
+    caml_invalid_argument (err);
+  return (unsigned char *) b->data;
+}
+
+CAMLprim value
+ocamlode_dSnapshotSave (value sv, value ba)
+{
+  struct snapshot_set *s = snapshot_set_val (sv);
+  unsigned char *p = snapshot_buffer (s, ba,
+      "dSnapshotSave: an int8_unsigned bigarray of dSnapshotSize bytes is expected");
+  struct snapshot_header h;
+  struct snapshot_world w;
+  int i, k, n;
+
+  h.magic = SNAPSHOT_MAGIC;
+  h.version = SNAPSHOT_VERSION;
+  h.body_count = s->body_count;
+  h.joint_count = s->joint_count;
+  h.size = s->size;
+  memcpy (p, &h, sizeof h); p += sizeof h;
+
+  snapshot_world_save (s->world, &w);
+  memcpy (p, &w, sizeof w); p += sizeof w;
+
+  for (i = 0; i < s->body_count; i++, p += sizeof (struct snapshot_body)) {
+    struct snapshot_body sb;
+    snapshot_body_save (s->bodies[i], &sb);
+    memcpy (p, &sb, sizeof sb);
+  }
+
+  for (i = 0; i < s->joint_count; i++) {
+    dJointID j = s->joints[i];
+    struct snapshot_joint sj;
+    double params[3 * SNAPSHOT_PARAMS];
+    sj.body1 = (uint64_t) (uintptr_t) dJointGetBody (j, 0);
+    sj.body2 = (uint64_t) (uintptr_t) dJointGetBody (j, 1);
+    sj.flags = dJointIsEnabled (j) ? SNAP_JOINT_ENABLED : 0;
+    sj.groups = n = snapshot_param_groups (j);
+    memcpy (p, &sj, sizeof sj); p += sizeof sj;
+    for (k = 0; k < n * SNAPSHOT_PARAMS; k++)
+      params[k] = snapshot_get_param (j, joint_param_table[k]);
+    memcpy (p, params, n * SNAPSHOT_PARAMS * sizeof (double));
+    p += n * SNAPSHOT_PARAMS * sizeof (double);
+  }
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dSnapshotRestore (value sv, value ba)
+{
+  struct snapshot_set *s = snapshot_set_val (sv);
+  unsigned char *p = snapshot_buffer (s, ba,
+      "dSnapshotRestore: an int8_unsigned bigarray of dSnapshotSize bytes is expected");
+  struct snapshot_header h;
+  struct snapshot_world w;
+  int i, k;
+
+  memcpy (&h, p, sizeof h); p += sizeof h;
+  if (h.magic != SNAPSHOT_MAGIC || h.version != SNAPSHOT_VERSION ||
+      h.body_count != (uint32_t) s->body_count ||
+      h.joint_count != (uint32_t) s->joint_count || h.size != s->size)
+    caml_invalid_argument ("dSnapshotRestore: not a snapshot of this set");
+
+  memcpy (&w, p, sizeof w); p += sizeof w;
+  snapshot_world_restore (s->world, &w);
+
+  for (i = 0; i < s->body_count; i++, p += sizeof (struct snapshot_body)) {
+    struct snapshot_body sb;
+    memcpy (&sb, p, sizeof sb);
+    snapshot_body_restore (s->bodies[i], &sb);
+  }
+
+  for (i = 0; i < s->joint_count; i++) {
+    dJointID j = s->joints[i];
+    struct snapshot_joint sj;
+    double params[3 * SNAPSHOT_PARAMS];
+    dBodyID b1, b2;
+    memcpy (&sj, p, sizeof sj); p += sizeof sj;
+    memcpy (params, p, sj.groups * SNAPSHOT_PARAMS * sizeof (double));
+    p += sj.groups * SNAPSHOT_PARAMS * sizeof (double);
+    b1 = (dBodyID) (uintptr_t) sj.body1;
+    b2 = (dBodyID) (uintptr_t) sj.body2;
+    if (dJointGetBody (j, 0) != b1 || dJointGetBody (j, 1) != b2)
+      dJointAttach (j, b1, b2);
+    if (sj.flags & SNAP_JOINT_ENABLED) dJointEnable (j);
+    else dJointDisable (j);
+    for (k = 0; k < (int) sj.groups * SNAPSHOT_PARAMS; k++)
+      snapshot_set_param (j, joint_param_table[k], params[k]);
+  }
+  return Val_unit;
+}
+
+/* State hashes: a 64 bits hash of the bit patterns of the positions,
+   rotations and velocities of the bodies, and of the angles and rates of the
+   joints of a set, in the order of the set.  Two runs in lockstep have the
+   same hashes as long as they are bit exact. */
+
+#define STATE_HASH_SEED 0x9e3779b97f4a7c15ULL
+
+static inline uint64_t
+state_hash_mix (uint64_t h, uint64_t x)
+{
+  h ^= x * 0xc2b2ae3d27d4eb4fULL;
+  h = (h << 31) | (h >> 33);
+  return h * 0x9e3779b185ebca87ULL;
+}
+
+static inline uint64_t
+state_hash_reals (uint64_t h, const dReal *a, int n)
+{
+  int i;
+  for (i = 0; i < n; i++) {
+#if defined(dSINGLE)
+    uint32_t x;
+#else
+    uint64_t x;
+#endif
+    memcpy (&x, &a[i], sizeof x);
+    h = state_hash_mix (h, x);
+  }
+  return h;
+}
+
+static inline uint64_t
+state_hash_final (uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t
+state_hash_body (dBodyID b)
+{
+  uint64_t h = STATE_HASH_SEED;
+  h = state_hash_reals (h, dBodyGetPosition (b), 3);
+  h = state_hash_reals (h, dBodyGetQuaternion (b), 4);
+  h = state_hash_reals (h, dBodyGetLinearVel (b), 3);
+  h = state_hash_reals (h, dBodyGetAngularVel (b), 3);
+  h = state_hash_mix (h, dBodyIsEnabled (b));
+  return state_hash_final (h);
+}
+
+static uint64_t
+state_hash_joint (dJointID j)
+{
+  uint64_t h = STATE_HASH_SEED;
+  dReal v[6];
+  int i, n = 0, type = dJointGetType (j);
+  switch (type)
+  {
+    case dJointTypeHinge:
+      v[n++] = dJointGetHingeAngle (j);
+      v[n++] = dJointGetHingeAngleRate (j);
+      break;
+    case dJointTypeSlider:
+      v[n++] = dJointGetSliderPosition (j);
+      v[n++] = dJointGetSliderPositionRate (j);
+      break;
+    case dJointTypeUniversal:
+      v[n++] = dJointGetUniversalAngle1 (j);
+      v[n++] = dJointGetUniversalAngle2 (j);
+      v[n++] = dJointGetUniversalAngle1Rate (j);
+      v[n++] = dJointGetUniversalAngle2Rate (j);
+      break;
+    case dJointTypeHinge2:
+      v[n++] = dJointGetHinge2Angle1 (j);
+      v[n++] = dJointGetHinge2Angle1Rate (j);
+      v[n++] = dJointGetHinge2Angle2Rate (j);
+      break;
+    case dJointTypePR:
+      v[n++] = dJointGetPRPosition (j);
+      v[n++] = dJointGetPRPositionRate (j);
+      break;
+    case dJointTypePU:
+      v[n++] = dJointGetPUPosition (j);
+      v[n++] = dJointGetPUAngle1 (j);
+      v[n++] = dJointGetPUAngle2 (j);
+      v[n++] = dJointGetPUPositionRate (j);
+      v[n++] = dJointGetPUAngle1Rate (j);
+      v[n++] = dJointGetPUAngle2Rate (j);
+      break;
+    case dJointTypePiston:
+      v[n++] = dJointGetPistonPosition (j);
+      v[n++] = dJointGetPistonAngle (j);
+      v[n++] = dJointGetPistonPositionRate (j);
+      v[n++] = dJointGetPistonAngleRate (j);
+      break;
+    case dJointTypeAMotor:
+      for (i = 0; i < dJointGetAMotorNumAxes (j); i++)
+        v[n++] = dJointGetAMotorAngle (j, i);
+      break;
+    default:
+      break;
+  }
+  h = state_hash_mix (h, type);
+  h = state_hash_mix (h, dJointIsEnabled (j));
+  h = state_hash_reals (h, v, n);
+  return state_hash_final (h);
+}
+
+/* the hash of the set, and the hash of each body if body_hashes is not NULL */
+static uint64_t
+state_hash (struct snapshot_set *s, int64_t *body_hashes)
+{
+  uint64_t h = STATE_HASH_SEED;
+  int i;
+  for (i = 0; i < s->body_count; i++) {
+    uint64_t hb = state_hash_body (s->bodies[i]);
+    if (body_hashes != NULL) body_hashes[i] = (int64_t) hb;
+    h = state_hash_mix (h, hb);
+  }
+  for (i = 0; i < s->joint_count; i++)
+    h = state_hash_mix (h, state_hash_joint (s->joints[i]));
+  return state_hash_final (h);
+}
+
+CAMLprim value
+ocamlode_dSnapshotHash (value sv)
+{
+  CAMLparam1 (sv);
+  CAMLreturn (caml_copy_int64 ((int64_t) state_hash (snapshot_set_val (sv), NULL)));
+}
+
+CAMLprim value
+ocamlode_dSnapshotHashBodies (value sv, value ba)
+{
+  CAMLparam2 (sv, ba);
+  struct snapshot_set *s = snapshot_set_val (sv);
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_INT64 ||
+      b->num_dims != 1 || b->dim[0] < s->body_count)
+    caml_invalid_argument ("dSnapshotHashBodies: an int64 bigarray of one element per body is expected");
+  CAMLreturn (caml_copy_int64 ((int64_t) state_hash (s, (int64_t *) b->data)));
+}
+
+/* }}} */
+/* {{{ Sleep trackers */
+
+/* remembers the enabled state of a set of bodies, so that the bodies put to
+   sleep or woken up by a step are found without a call per body from OCaml */
+struct sleep_tracker {
+  int body_count;
+  dBodyID *bodies;
+  unsigned char *enabled;
+};
+
+#define sleep_tracker_val(v) Voidptr_val(struct sleep_tracker *, (v))
+
+static struct sleep_tracker *
+sleep_tracker_get (value tv, const char *msg)
+{
+  struct sleep_tracker *t = sleep_tracker_val (tv);
+  if (t == NULL) caml_invalid_argument (msg);
+  return t;
+}
+
+CAMLprim value
+ocamlode_dSleepTrackerCreate (value bodiesv)
+{
+  CAMLparam1 (bodiesv);
+  struct sleep_tracker *t;
+  int i;
+
+  t = malloc (sizeof (struct sleep_tracker));
+  if (t == NULL) caml_failwith ("Out of memory");
+  t->body_count = Wosize_val (bodiesv);
+  t->bodies = malloc ((t->body_count + 1) * sizeof (dBodyID));
+  t->enabled = malloc (t->body_count + 1);
+  if (t->bodies == NULL || t->enabled == NULL) {
+    free (t->bodies); free (t->enabled); free (t);
+    caml_failwith ("Out of memory");
+  }
+  for (i = 0; i < t->body_count; i++) {
+    t->bodies[i] = dBodyID_val (Field (bodiesv, i));
+    t->enabled[i] = dBodyIsEnabled (t->bodies[i]) != 0;
+  }
+  CAMLreturn (Val_voidptr (t));
+}
+
+CAMLprim value
+ocamlode_dSleepTrackerDestroy (value tv)
+{
+  struct sleep_tracker *t = sleep_tracker_val (tv);
+  if (t == NULL) return Val_unit;
+  free (t->bodies);
+  free (t->enabled);
+  free (t);
+  destroy_voidptr (tv);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dSleepTrackerBodyCount (value tv)
+{
+  return Val_int (sleep_tracker_get (tv, "dSleepTrackerBodyCount: the tracker is destroyed")->body_count);
+}
+
+CAMLprim value
+ocamlode_dSleepTrackerChanged (value tv, value ba)
+{
+  struct sleep_tracker *t = sleep_tracker_get (tv, "dSleepTrackerChanged: the tracker is destroyed");
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  int32_t *changed;
+  int i, n = 0;
+
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_INT32 ||
+      b->num_dims != 1 || b->dim[0] < t->body_count)
+    caml_invalid_argument ("dSleepTrackerChanged: an int32 bigarray of one element per body is expected");
+  changed = (int32_t *) b->data;
+  for (i = 0; i < t->body_count; i++) {
+    unsigned char e = dBodyIsEnabled (t->bodies[i]) != 0;
+    if (e != t->enabled[i]) {
+      t->enabled[i] = e;
+      changed[n++] = i;
+    }
+  }
+  return Val_int (n);
+}
+
+CAMLprim value
+ocamlode_dSleepTrackerIsEnabled (value tv, value iv)
+{
+  struct sleep_tracker *t = sleep_tracker_get (tv, "dSleepTrackerIsEnabled: the tracker is destroyed");
+  int i = Int_val (iv);
+  if (i < 0 || i >= t->body_count)
+    caml_invalid_argument ("dSleepTrackerIsEnabled: index out of bounds");
+  return Val_bool (t->enabled[i]);
+}
+
+/* }}} */
+/* {{{ Space */
+
+CAMLprim value
+ocamlode_dSimpleSpaceCreate (value parentv)
+{
+  CAMLparam1 (parentv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dSpaceID id = dSimpleSpaceCreate (parent);
+  CAMLreturn (Val_owned (ARENA_SPACE, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dHashSpaceCreate (value parentv)
+{
+  CAMLparam1 (parentv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dSpaceID id = dHashSpaceCreate (parent);
+  CAMLreturn (Val_owned (ARENA_SPACE, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dQuadTreeSpaceCreate (value parentv,
+                               value centerv, value extentsv, value depthv)
+{
+  CAMLparam4 (parentv, centerv, extentsv, depthv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dVector3 center, extents;
+  dVector3_val (centerv, center);
+  dVector3_val (extentsv, extents);
+  int depth = Int_val (depthv);
+  dSpaceID id = dQuadTreeSpaceCreate (parent, center, extents, depth);
+  CAMLreturn (Val_owned (ARENA_SPACE, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dSpaceDestroy (value idv)
+{
+  CAMLparam1 (idv);
+  dSpaceID id = dSpaceID_val (idv);
+  shared_space_destroyed (id);
+  arena_space_destroyed (id);
+  trackers_space_destroyed (id);
+  dSpaceDestroy (id);
+  destroy_voidptr (idv);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dHashSpaceSetLevels (value idv, value minlevelv, value maxlevelv)
+{
+  CAMLparam3 (idv, minlevelv, maxlevelv);
+  dSpaceID id = dSpaceID_val (idv);
+  int minlevel = Int_val (minlevelv);
+  int maxlevel = Int_val (maxlevelv);
+  dHashSpaceSetLevels (id, minlevel, maxlevel);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dHashSpaceGetLevels (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dSpaceID id = dSpaceID_val (idv);
+  int minlevel, maxlevel;
+  dHashSpaceGetLevels (id, &minlevel, &maxlevel);
+  rv = caml_alloc (2, 0);
+  caml_modify (&Field (rv, 0), Val_int (minlevel));
+  caml_modify (&Field (rv, 1), Val_int (maxlevel));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dSpaceAdd (value idv, value geomv)
+{
+  CAMLparam2 (idv, geomv);
+  dSpaceID id = dSpaceID_val (idv);
+  dGeomID geom = dGeomID_val (geomv);
+  dSpaceAdd (id, geom);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dSpaceRemove (value idv, value geomv)
+{
+  CAMLparam2 (idv, geomv);
+  dSpaceID id = dSpaceID_val (idv);
+  dGeomID geom = dGeomID_val (geomv);
+  dSpaceRemove (id, geom);
+  CAMLreturn (Val_unit);
+}
+
+static void
+dSpaceCollide_callback (void *fvpv, dGeomID geom1, dGeomID geom2)
+{
+  CAMLparam0 ();
+  CAMLlocal4 (fv, geom1v, geom2v, rv);
+  value *fvp = (value *) fvpv;
+  assert (geom1 != geom2);
+  geom1v = Val_dGeomID (geom1);
+  geom2v = Val_dGeomID (geom2);
+  rv = caml_callback2_exn (*fvp, geom1v, geom2v);
+  if (Is_exception_result (rv)) {
+    // XXX Can we do better than this?
+    fprintf (stderr, "dSpaceCollide: callback raised exception: %s\n",
+             caml_format_exception (Extract_exception (rv)));
+    fflush (stderr);
+  }
+  CAMLreturn0;
+}
+
+CAMLprim value
+ocamlode_dSpaceCollide (value idv, value fv)
+{
+  CAMLparam2 (idv, fv);
+  value *fvp = &fv;
+  dSpaceID id = dSpaceID_val (idv);
+  dSpaceCollide (id, fvp, dSpaceCollide_callback);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dSpaceCollide2 (value o1, value o2, value fv)
+{
+  CAMLparam3 (o1, o2, fv);
+  value *fvp = &fv;
+  dSpaceCollide2 (dGeomID_val (o1), dGeomID_val (o2), fvp, dSpaceCollide_callback);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dSpaceSetCleanup (value space, value mode)
+{
+  dSpaceSetCleanup (dSpaceID_val (space), Bool_val (mode));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dSpaceGetCleanup (value space)
+{
+  return Val_bool (dSpaceGetCleanup (dSpaceID_val (space)));
+}
+
+CAMLprim value
+ocamlode_dSpaceClean (value space)
+{
+  dSpaceClean (dSpaceID_val (space));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dSpaceQuery (value space, value geom)
+{
+  return Val_bool (dSpaceQuery (dSpaceID_val (space), dGeomID_val (geom)));
+}
+
+CAMLprim value
+ocamlode_dSpaceGetNumGeoms (value space)
+{
+  int num = dSpaceGetNumGeoms (dSpaceID_val (space));
+  return Val_int (num);
+}
+
+CAMLprim value
+ocamlode_dSpaceGetGeom (value space, value i)
+{
+  CAMLparam2 (space, i);
+  dGeomID id = dSpaceGetGeom (dSpaceID_val (space), Int_val (i));
+  CAMLreturn (Val_dGeomID (id));
+}
+
+CAMLprim value
+ocamlode_dSpaceGetGeomsArray (value spacev)
+{
+  CAMLparam1 (spacev);
+  CAMLlocal1 (ar);
+
+  dSpaceID space = dSpaceID_val (spacev);
+  int i;
+  int num = dSpaceGetNumGeoms (space);
+
+  ar = caml_alloc(num, 0);
+
+  for (i=0; i<num; ++i)
+  {
+    dGeomID id = dSpaceGetGeom (space, i);
+    Store_field (ar, i, Val_dGeomID (id));
+  }
+
+  CAMLreturn (ar);
+}
+
+/* }}} */
+/* {{{ Geometry */
+
+CAMLprim value
+ocamlode_dCollide (value geom1v, value geom2v, value maxv)
+{
+  CAMLparam3 (geom1v, geom2v, maxv);
+  CAMLlocal1 (contactsv);
+  dGeomID geom1 = dGeomID_val (geom1v);
+  dGeomID geom2 = dGeomID_val (geom2v);
+  int max = Int_val (maxv);
+  unsigned flags = ((unsigned) max) & 0xffff;
+  dContactGeom contacts[max];
+  int n = dCollide (geom1, geom2, flags, contacts, sizeof (dContactGeom));
+#if 0
+  if (n == 0)
+    caml_failwith("dCollide: no contacts");
+#endif
+  contactsv = caml_alloc (n, 0);
+  int i;
+  for (i = 0; i < n; ++i)
+    caml_modify (&Field (contactsv, i), copy_dContactGeom (&contacts[i]));
+  CAMLreturn (contactsv);
+}
+
+CAMLprim value
+ocamlode_dGeomDestroy (value idv)
+{
+  CAMLparam1 (idv);
+  dGeomID id = dGeomID_val (idv);
+  shared_geom_destroyed (id);
+  arena_geom_destroyed (id);
+  dGeomDestroy (id);
+  destroy_voidptr (idv);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomSetBody (value idv, value bodyv)
+{
+  CAMLparam2 (idv, bodyv);
+  dGeomID id = dGeomID_val (idv);
+  dBodyID body;
+  if (bodyv == Val_int (0))	/* None */
+    body = 0;
+  else
+    body = dBodyID_val (Field (bodyv, 0));
+  dGeomSetBody (id, body);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomGetBody (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (bodyv);
+  dGeomID id = dGeomID_val (idv);
+  dBodyID body = dGeomGetBody (id);
+  if (body) {			/* Some body */
+    bodyv = caml_alloc (1, 0);
+    caml_modify (&Field (bodyv, 0), Val_dBodyID (body));
+  } else
+    caml_modify (&bodyv, Val_int (0));	/* None */
+  CAMLreturn (bodyv);
+}
+
+CAMLprim value
+ocamlode_dGeomSetPosition (value idv, value xv, value yv, value zv)
+{
+  CAMLparam4 (idv, xv, yv, zv);
+  dGeomID id = dGeomID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dGeomSetPosition (id, x, y, z);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomSetRotation (value idv, value matrixv)
+{
+  CAMLparam2 (idv, matrixv);
+  dGeomID id = dGeomID_val (idv);
+#if defined(MEM_CPY) // dSINGLE
+  dMatrix3 m;
+  int i;
+  for (i=0; i<12; ++i)
+    m[i] = Double_field(matrixv,i);
+  dGeomSetRotation (id, m);
+#else // dDOUBLE
+  dGeomSetRotation (id, (double *) matrixv);
+#endif
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomSetQuaternion (value idv, value quaternionv)
+{
+  CAMLparam2 (idv, quaternionv);
+  dGeomID id = dGeomID_val (idv);
+#if defined(MEM_CPY) // dSINGLE
+  dQuaternion q;
+  int i;
+  for (i=0; i<4; ++i)
+    q[i] = Double_field(quaternionv,i);
+  dGeomSetQuaternion (id, q);
+#else // dDOUBLE
+  dGeomSetQuaternion (id, (double *) quaternionv);
+#endif
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomGetPosition (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  const dReal *r = dGeomGetPosition (id);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomGetRotation (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  const dReal *r = dGeomGetRotation (id);
+  rv = copy_dReal_array (r, 12);
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomGetQuaternion (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  dQuaternion r;
+  dGeomGetQuaternion (id, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomGetAABB (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (aabbv);
+  dGeomID id = dGeomID_val (idv);
+  dReal aabb[6];
+  dGeomGetAABB (id, aabb);
+  aabbv = copy_dReal_array (aabb, 6);
+  CAMLreturn (aabbv);
+}
+
+CAMLprim value
+ocamlode_dInfiniteAABB (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (aabbv);
+  dGeomID id = dGeomID_val (idv);
+  dReal aabb[6];
+  dInfiniteAABB (id, aabb);
+  aabbv = copy_dReal_array (aabb, 6);
+  CAMLreturn (aabbv);
+}
+
+/* Geometry Shapes */
+
+CAMLprim value
+ocamlode_dGeomGetClass (value geom)
+{
+  int geom_class = dGeomGetClass (dGeomID_val (geom));
+  value ret;
+  Val_dGeomClass(ret, geom_class);
+  return ret;
+}
+
+CAMLprim value
+ocamlode_dCreateSphere (value parentv, value radiusv)
+{
+  CAMLparam2 (parentv, radiusv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dReal radius = Double_val (radiusv);
+  dGeomID id = dCreateSphere (parent, radius);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomSphereGetRadius (value idv)
+{
+  CAMLparam1 (idv);
+  dGeomID id = dGeomID_val (idv);
+  dReal radius = dGeomSphereGetRadius (id);
+  CAMLreturn (caml_copy_double (radius));
+}
+
+CAMLprim value
+ocamlode_dGeomSphereSetRadius (value idv, value radiusv)
+{
+  CAMLparam2 (idv, radiusv);
+  dGeomID id = dGeomID_val (idv);
+  dReal radius = Double_val (radiusv);
+  dGeomSphereSetRadius (id, radius);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomSpherePointDepth (value idv, value xv, value yv, value zv)
+{
+  CAMLparam4 (idv, xv, yv, zv);
+  dGeomID id = dGeomID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dReal d =  dGeomSpherePointDepth (id, x, y, z);
+  CAMLreturn (caml_copy_double (d));
+}
+
+CAMLprim value
+ocamlode_dCreateBox (value parentv, value lxv, value lyv, value lzv)
+{
+  CAMLparam4 (parentv, lxv, lyv, lzv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dReal lx = Double_val (lxv);
+  dReal ly = Double_val (lyv);
+  dReal lz = Double_val (lzv);
+  dGeomID id = dCreateBox (parent, lx, ly, lz);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomBoxGetLengths (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  dVector3 r;
+  dGeomBoxGetLengths (id, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomBoxSetLengths (value idv, value lxv, value lyv, value lzv)
+{
+  CAMLparam4 (idv, lxv, lyv, lzv);
+  dGeomID id = dGeomID_val (idv);
+  dReal lx = Double_val (lxv);
+  dReal ly = Double_val (lyv);
+  dReal lz = Double_val (lzv);
+  dGeomBoxSetLengths (id, lx, ly, lz);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomBoxPointDepth (value idv, value xv, value yv, value zv)
+{
+  CAMLparam4 (idv, xv, yv, zv);
+  dGeomID id = dGeomID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dReal d = dGeomBoxPointDepth (id, x, y, z);
+  CAMLreturn (caml_copy_double (d));
+}
+
+CAMLprim value
+ocamlode_dCreatePlane (value parentv, value av, value bv, value cv, value dv)
+{
+  CAMLparam5 (parentv, av, bv, cv, dv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dReal a = Double_val (av);
+  dReal b = Double_val (bv);
+  dReal c = Double_val (cv);
+  dReal d = Double_val (dv);
+  dGeomID id = dCreatePlane (parent, a, b, c, d);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomPlaneGetParams (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  dVector4 r;
+  dGeomPlaneGetParams (id, r);
+  rv = copy_dReal_array (r, 4);
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomPlaneSetParams (value idv, value av, value bv, value cv, value dv)
+{
+  CAMLparam5 (idv, av, bv, cv, dv);
+  dGeomID id = dGeomID_val (idv);
+  dReal a = Double_val (av);
+  dReal b = Double_val (bv);
+  dReal c = Double_val (cv);
+  dReal d = Double_val (dv);
+  dGeomPlaneSetParams (id, a, b, c, d);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomPlanePointDepth (value idv, value xv, value yv, value zv)
+{
+  CAMLparam4 (idv, xv, yv, zv);
+  dGeomID id = dGeomID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dReal d = dGeomPlanePointDepth (id, x, y, z);
+  CAMLreturn (caml_copy_double (d));
+}
+
+CAMLprim value
+ocamlode_dCreateCapsule (value parentv, value radiusv, value lengthv)
+{
+  CAMLparam3 (parentv, radiusv, lengthv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dReal radius = Double_val (radiusv);
+  dReal length = Double_val (lengthv);
+  dGeomID id = dCreateCapsule (parent, radius, length);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomCapsuleGetParams (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  dReal radius, length;
+  dGeomCapsuleGetParams (id, &radius, &length);
+  rv = caml_alloc(2, 0);
+  Store_field (rv, 0, caml_copy_double (radius) );
+  Store_field (rv, 1, caml_copy_double (length) );
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomCapsuleSetParams (value idv, value radiusv, value lengthv)
+{
+  CAMLparam3 (idv, radiusv, lengthv);
+  dGeomID id = dGeomID_val (idv);
+  dReal radius = Double_val (radiusv);
+  dReal length = Double_val (lengthv);
+  dGeomCapsuleSetParams (id, radius, length);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomCapsulePointDepth (value idv, value xv, value yv, value zv)
+{
+  CAMLparam4 (idv, xv, yv, zv);
+  dGeomID id = dGeomID_val (idv);
+  dReal x = Double_val (xv);
+  dReal y = Double_val (yv);
+  dReal z = Double_val (zv);
+  dReal d = dGeomCapsulePointDepth (id, x, y, z);
+  CAMLreturn (caml_copy_double (d));
+}
+
+CAMLprim value
+ocamlode_dCreateCylinder (value parentv, value radiusv, value lengthv)
+{
+  CAMLparam3 (parentv, radiusv, lengthv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dReal radius = Double_val (radiusv);
+  dReal length = Double_val (lengthv);
+  dGeomID id = dCreateCylinder (parent, radius, length);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomCylinderGetParams (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal1 (rv);
+  dGeomID id = dGeomID_val (idv);
+  dReal radius, length;
+  dGeomCylinderGetParams (id, &radius, &length);
+  rv = caml_alloc(2, 0);
+  Store_field (rv, 0, caml_copy_double (radius) );
+  Store_field (rv, 1, caml_copy_double (length) );
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomCylinderSetParams (value idv, value radiusv, value lengthv)
+{
+  CAMLparam3 (idv, radiusv, lengthv);
+  dGeomID id = dGeomID_val (idv);
+  dReal radius = Double_val (radiusv);
+  dReal length = Double_val (lengthv);
+  dGeomCylinderSetParams (id, radius, length);
+  CAMLreturn (Val_unit);
+}
+
+
+CAMLprim value
+ocamlode_dCreateRay (value parentv, value lengthv)
+{
+  CAMLparam2 (parentv, lengthv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dReal length = Double_val (lengthv);
+  dGeomID id = dCreateRay (parent, length);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomRaySetLength (value idv, value lengthv)
+{
+  CAMLparam2 (idv, lengthv);
+  dGeomID id = dGeomID_val (idv);
+  dReal length = Double_val (lengthv);
+  dGeomRaySetLength (id, length);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomRayGetLength (value idv)
+{
+  CAMLparam1 (idv);
+  dGeomID id = dGeomID_val (idv);
+  dReal length = dGeomRayGetLength (id);
+  CAMLreturn (caml_copy_double (length));
+}
+
+CAMLprim value
+ocamlode_dGeomRaySet_native (value ray, value px, value py, value pz, value dx, value dy, value dz)
+{
+  dGeomRaySet (dGeomID_val (ray), Double_val (px), Double_val (py), Double_val (pz),
+                                  Double_val (dx), Double_val (dy), Double_val (dz));
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dGeomRaySet_bytecode (value * argv, int argn)
+{
+  return ocamlode_dGeomRaySet_native (argv[0], argv[1], argv[2],
+                                      argv[3], argv[4], argv[5], argv[6]);
+}
+
+CAMLprim value
+ocamlode_dGeomRayGet (value ray)
+{
+  CAMLparam1 (ray);
+  CAMLlocal1 (rv);
+  dVector3 start, dir;
+  dGeomRayGet (dGeomID_val (ray), start, dir);
+  rv = caml_alloc(2, 0);
+  Store_field (rv, 0, copy_dVector3 (start));
+  Store_field (rv, 1, copy_dVector3 (dir));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dGeomRaySetClosestHit (value idv, value closestHit)
+{
+  dGeomRaySetClosestHit (dGeomID_val (idv), Bool_val (closestHit));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomRayGetClosestHit (value idv)
+{
+  return Val_bool (dGeomRayGetClosestHit (dGeomID_val (idv)));
+}
+
+/* Geom Transform */
+
+CAMLprim value
+ocamlode_dCreateGeomTransform (value parentv)
+{
+  CAMLparam1 (parentv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+  dGeomID id = dCreateGeomTransform (parent);
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomTransformSetGeom (value idv, value geomv)
+{
+  dGeomID id, old, geom;
+  if (geomv == Val_int (0))	/* None */
+    geom = 0;
+  else				/* Some geom */
+    geom = dGeomID_val (Field (geomv, 0));
+  id = dGeomID_val (idv);
+  old = dGeomTransformGetGeom (id);
+  if (old == geom) return Val_unit;
+  /* with cleanup set, ODE destroys the previous geom */
+  if (old != NULL && dGeomTransformGetCleanup (id)) {
+    shared_geom_destroyed (old);
+    arena_geom_destroyed (old);
+  }
+  dGeomTransformSetGeom (id, geom);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTransformGetGeom (value idv)
+{
+  CAMLparam1 (idv);
+  CAMLlocal2 (some, geomv);
+  dGeomID geom = dGeomTransformGetGeom (dGeomID_val (idv));
+  if (geom == 0)
+    CAMLreturn (Val_int (0));	/* None */
+  geomv = Val_dGeomID (geom);
+  some = caml_alloc (1, 0);
+  Store_field (some, 0, geomv);
+  CAMLreturn (some);
+}
+
+CAMLprim value
+ocamlode_dGeomTransformSetCleanup (value idv, value mode)
+{
+  dGeomTransformSetCleanup (dGeomID_val (idv), Bool_val (mode));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTransformGetCleanup (value idv)
+{
+  return Val_bool (dGeomTransformGetCleanup (dGeomID_val (idv)));
+}
+
+CAMLprim value
+ocamlode_dGeomTransformSetInfo (value idv, value mode)
+{
+  dGeomTransformSetInfo (dGeomID_val (idv), Bool_val (mode));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTransformGetInfo (value idv)
+{
+  return Val_bool (dGeomTransformGetInfo (dGeomID_val (idv)));
+}
+
+/* TriMesh */
+
+CAMLprim value
+ocamlode_dGeomTriMeshDataCreate (value unit)
+{
+  CAMLparam0 ();
+  dTriMeshDataID id = dGeomTriMeshDataCreate();
+  /*
+  CAMLreturn (Val_dTriMeshDataID (id));
+  */
+  CAMLreturn (arena_track (ARENA_TRIMESH_DATA, id, NULL, Val_dTriMeshDataID_2 (id, NULL)));
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshDataDestroy (value idv)
+{
+  dTriMeshDataID id = dTriMeshDataID_val(idv);
+  arena_forget (id);
+  dGeomTriMeshDataDestroy (id);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshDataPreprocess (value idv)
+{
+  dTriMeshDataID id = dTriMeshDataID_val(idv);
+  dGeomTriMeshDataPreprocess (id);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshSetData (value geom, value data)
+{
+  dGeomTriMeshSetData (dGeomID_val (geom), dTriMeshDataID_val (data));
+  return Val_unit;
+}
+
+// TODO: what is the difference between 
+//       dGeomTriMeshGetData() and dGeomTriMeshGetTriMeshDataID() ?
+
+CAMLprim value
+ocamlode_dGeomTriMeshGetData (value geom)
+{
+  CAMLparam1 (geom);
+  dTriMeshDataID id = dGeomTriMeshGetData (dGeomID_val (geom));
+  CAMLreturn (Val_dTriMeshDataID (id));
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshGetTriMeshDataID (value geom)
+{
+  CAMLparam1 (geom);
+  dTriMeshDataID id = dGeomTriMeshGetTriMeshDataID (dGeomID_val (geom));
+  CAMLreturn (Val_dTriMeshDataID (id));
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshDataUpdate (value idv)
+{
+  dTriMeshDataID id = dTriMeshDataID_val(idv);
+  dGeomTriMeshDataUpdate (id);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshDataBuildDouble (value idv, value vertices, value indicesv)
+{
+  int *indices;
+  int i, lenv, leni;
+  dTriMeshDataID id = dTriMeshDataID_val(idv);
+
+  lenv = Wosize_val(vertices) / Double_wosize;
+  if ( (lenv % 3) != 0 )
+    caml_invalid_argument ("vertices array length not multiple of 3");
+
+  leni = Wosize_val (indicesv);
+  if ( (leni % 3) != 0 )
+    caml_invalid_argument ("indices array length not multiple of 3");
+
+  indices = ocamlode_malloc (MEM_TRIMESH, leni * sizeof(int));
+  if (indices == NULL) caml_failwith("Out of memory");
+  for (i=0; i < leni; i++)
+  {
+    indices[i] = Long_val(Field(indicesv, i));
+  }
+
+  dGeomTriMeshDataBuildDouble (id,
+      (double *) vertices,
+      3 * sizeof(double), 
+      lenv / 3,
+      indices,
+      leni, 
+      3 * sizeof(int) );
+
+  // XXX ODE doesn't copy the datas but just keep a pointer to it,
+  // so, the memory pointed by 'indices' have to be freed at some point.
+  set_data2 (idv, indices);
+
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dCreateTriMesh_native (value parentv, value idv, value tri_cb, value arr_cb, value ray_cb, value unit)
+{
+  CAMLparam5 (parentv, idv, tri_cb, arr_cb, ray_cb);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+
+  dTriMeshDataID data_id = dTriMeshDataID_val(idv);
+
+  if (Is_block(tri_cb) || Is_block(arr_cb) || Is_block(ray_cb))
+    caml_failwith("dCreateTriMesh: callbacks not yet implemented");
+
+  dGeomID id = dCreateTriMesh (parent, data_id,
+               0, 0, 0);
+  /* TODO:     dTriCallback * Callback,
+               dTriArrayCallback * ArrayCallback,
+               dTriRayCallback * RayCallback); */
+
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+CAMLprim value
+ocamlode_dCreateTriMesh_bytecode (value * argv, int argn)
+{
+    return ocamlode_dCreateTriMesh_native (argv[0], argv[1], argv[2],
+                                           argv[3], argv[4], argv[5]);
+}
+ 
+CAMLprim value
+ocamlode_dGeomTriMeshEnableTC (value geom, value geomclassv, value enable)
+{
+  int geomClass;
+  dGeomClass_val(geomClass, geomclassv);
+  dGeomTriMeshEnableTC (dGeomID_val (geom), geomClass, Bool_val (enable));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshIsTCEnabled (value geom, value geomclassv)
+{
+  int geomClass;
+  dGeomClass_val(geomClass, geomclassv);
+  int ret = dGeomTriMeshIsTCEnabled (dGeomID_val (geom), geomClass);
+  return Val_int (ret);
+}
+
+CAMLprim value
+ocamlode_dGeomTriMeshClearTCCache (value geom)
+{
+  dGeomTriMeshClearTCCache (dGeomID_val (geom));
+  return Val_unit;
+}
+
+
+/* Convex Geom */
+
+typedef struct _dConvexDataID {
+  unsigned int planecount;
+  unsigned int pointcount;
+  dReal *planes;
+  dReal *points;
+  unsigned int *polygons;
+} dConvexDataID;
+
+/*
+ * The memory management of convex datas needs to be more tested
+ * (until now no bugs found)
+ */
+
+void finalize_convexdata (value v)
+{
+  dReal *planes, *points;
+  unsigned int *polygs;
+  planes = ((dConvexDataID *) Data_custom_val (v))->planes;
+  points = ((dConvexDataID *) Data_custom_val (v))->points;
+  polygs = ((dConvexDataID *) Data_custom_val (v))->polygons;
+  if (planes != NULL) { ocamlode_free (planes); }
+  if (points != NULL) { ocamlode_free (points); }
+  if (polygs != NULL) { ocamlode_free (polygs); }
+  /* this is also called by dConvexDataDestroy, avoid a double free
+     when the block is finalised */
+  ((dConvexDataID *) Data_custom_val (v))->planes = NULL;
+  ((dConvexDataID *) Data_custom_val (v))->points = NULL;
+  ((dConvexDataID *) Data_custom_val (v))->polygons = NULL;
+}
+
+CAMLprim value
+ocamlode_free_dConvexDataID (value v)
+{
+  finalize_convexdata (v);
+  return Val_unit;
+}
+
+/* Checks that the polygons list is made of planecount polygons of the form
+   (n, i1, ..., in) with n >= 3 and the indices pointing inside the points. */
+static int
+check_convex_polygons (unsigned int *polygons, unsigned int polyscount,
+                       unsigned int planecount, unsigned int pointcount)
+{
+  unsigned int i, j, k = 0;
+  for (i = 0; i < planecount; i++)
+  {
+    unsigned int n;
+    if (k >= polyscount) return 0;
+    n = polygons[k++];
+    if (n < 3 || k + n > polyscount) return 0;
+    for (j = 0; j < n; j++)
+      if (polygons[k++] >= pointcount) return 0;
+  }
+  return (k == polyscount);
+}
+
+/* Checks that the triangles list is made of whole triangles whose indices
+   point inside the vertices. */
+static int
+check_trimesh_indices (const int *indices, int indexcount, int vertexcount)
+{
+  int i;
+  if (indexcount % 3 != 0) return 0;
+  for (i = 0; i < indexcount; i++)
+    if (indices[i] < 0 || indices[i] >= vertexcount) return 0;
+  return 1;
+}
+
+/* a destroyed convex data is serialized without planes and points */
+static void
+serialize_convexdata (value v, uintnat *bsize_32, uintnat *bsize_64)
+{
+  dConvexDataID *d = (dConvexDataID *) Data_custom_val (v);
+  unsigned int i, polyscount = 0;
+  if (d->planes != NULL)
+    for (i = 0; i < d->planecount; i++)
+      polyscount += 1 + d->polygons[polyscount];
+  serialize_tag ();
+  caml_serialize_int_1 (d->planes != NULL);
+  if (d->planes != NULL) {
+    caml_serialize_int_4 (d->planecount);
+    caml_serialize_int_4 (d->pointcount);
+    caml_serialize_int_4 (polyscount);
+    serialize_reals (d->planes, 4 * (uintnat) d->planecount);
+    serialize_reals (d->points, 3 * (uintnat) d->pointcount);
+    caml_serialize_block_4 (d->polygons, polyscount);
+  }
+  *bsize_32 = *bsize_64 = sizeof(dConvexDataID);
+}
+
+static uintnat
+deserialize_convexdata (void *dst)
+{
+  dConvexDataID *d = (dConvexDataID *) dst;
+  struct serial_tag t = deserialize_tag ();
+  unsigned int polyscount;
+  memset (d, 0, sizeof(dConvexDataID));
+  if (!caml_deserialize_uint_1 ())
+    return sizeof(dConvexDataID);
+  d->planecount = caml_deserialize_uint_4 ();
+  d->pointcount = caml_deserialize_uint_4 ();
+  polyscount = caml_deserialize_uint_4 ();
+  d->planes = ocamlode_malloc (MEM_CONVEX, (4 * (size_t) d->planecount + 1) * sizeof(dReal));
+  d->points = ocamlode_malloc (MEM_CONVEX, (3 * (size_t) d->pointcount + 1) * sizeof(dReal));
+  d->polygons = ocamlode_malloc (MEM_CONVEX, ((size_t) polyscount + 1) * sizeof(unsigned int));
+  if (d->planes == NULL || d->points == NULL || d->polygons == NULL) {
+    ocamlode_free (d->planes); ocamlode_free (d->points); ocamlode_free (d->polygons);
+    caml_deserialize_error ("ocamlode: out of memory");
+  }
+  deserialize_reals (t, d->planes, 4 * (uintnat) d->planecount);
+  deserialize_reals (t, d->points, 3 * (uintnat) d->pointcount);
+  caml_deserialize_block_4 (d->polygons, polyscount);
+  if (!check_convex_polygons (d->polygons, polyscount, d->planecount, d->pointcount)) {
+    ocamlode_free (d->planes); ocamlode_free (d->points); ocamlode_free (d->polygons);
+    caml_deserialize_error ("ocamlode: wrong convex polygons");
+  }
+  return sizeof(dConvexDataID);
+}
+
+static struct custom_operations convexdata_custom_ops = {
+  identifier: "ocamlode_dConvexDataID",
+  finalize:  finalize_convexdata,
+  compare:     custom_compare_default,
+  hash:        custom_hash_default,
+  serialize:   serialize_convexdata,
+  deserialize: deserialize_convexdata
+};
+
+/* needed to unmarshal these values in a process which didn't create any */
+CAMLprim value
+ocamlode_register_custom_ops (value unit)
+{
+  caml_register_custom_operations (&dMass_custom_ops);
+  caml_register_custom_operations (&dJointFeedback_custom_ops);
+  caml_register_custom_operations (&convexdata_custom_ops);
+  return Val_unit;
+}
+
+
+CAMLprim value
+ocamlode_get_dConvexDataID (value planesv, value pointsv, value polygonesv)
+{
+  CAMLparam3 (planesv, pointsv, polygonesv);
+  CAMLlocal1 (v);
+
+  int i;
+  unsigned int _planecount, _pointcount, polyscount;
+
+  _planecount = Wosize_val(planesv) / Double_wosize;
+  _pointcount = Wosize_val(pointsv) / Double_wosize;
+  polyscount = Wosize_val(polygonesv);
+
+  dReal *_planes;
+  dReal *_points;
+  unsigned int *_polygons;
+
+  _planes = ocamlode_malloc(MEM_CONVEX, _planecount * sizeof(dReal));
+  if (_planes == NULL) {
+    caml_failwith("Out of memory");
+  }
+
+  _points = ocamlode_malloc(MEM_CONVEX, _pointcount * sizeof(dReal));
+  if (_points == NULL) {
+    ocamlode_free (_planes);
+    caml_failwith("Out of memory");
+  }
+
+  _polygons = ocamlode_malloc(MEM_CONVEX, polyscount * sizeof(int));
+  if (_polygons == NULL) {
+    ocamlode_free (_planes);
+    ocamlode_free (_points);
+    caml_failwith("Out of memory");
+  }
+
+  if (!_planes || !_points || !_polygons)
+    caml_failwith("dCreateConvex: allocation error");
+
+  for (i=0; i<_planecount; ++i) {
+    _planes[i] = Double_field(planesv, i);
+  }
+  for (i=0; i<_pointcount; ++i) {
+    _points[i] = Double_field(pointsv, i);
+  }
+
+  for (i=0; i<polyscount; ++i) {
+    _polygons[i] = (unsigned int) (Long_val(Field(polygonesv, i)));
+  }
+
+  if (!check_convex_polygons(_polygons, polyscount, _planecount / 4, _pointcount / 3)) {
+    ocamlode_free (_planes);
+    ocamlode_free (_points);
+    ocamlode_free (_polygons);
+    caml_invalid_argument("dCreateConvex: wrong polygones");
+  }
+
+  dConvexDataID d;
+  d.planecount = _planecount / 4;
+  d.pointcount = _pointcount / 3;
+  d.planes = _planes;
+  d.points = _points;
+  d.polygons = _polygons;
+
+  v = caml_alloc_custom (&convexdata_custom_ops, sizeof(dConvexDataID), 0, 1);
+  memcpy (Data_custom_val(v), &d, sizeof(dConvexDataID));
+
+  CAMLreturn (v);
+}
+
+CAMLprim value
+ocamlode_dCreateConvex (value parentv, value convex_data)
+{
+  CAMLparam2 (parentv, convex_data);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+
+  dConvexDataID * d = ((dConvexDataID *) Data_custom_val (convex_data));
+
+  dGeomID id = dCreateConvex (parent,
+                          d->planes, d->planecount,
+                          d->points, d->pointcount,
+                          d->polygons);
+
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomSetConvex (value geom, value convex_data)
+{
+  CAMLparam2 (geom, convex_data);
+
+  dConvexDataID * d = ((dConvexDataID *) Data_custom_val (convex_data));
+
+  dGeomSetConvex (dGeomID_val (geom),
+                    d->planes, d->planecount,
+                    d->points, d->pointcount,
+                    d->polygons);
+
+  CAMLreturn (Val_unit);
+}
+
+
+/* Convex hull builder (quickhull), the coplanar triangles of the hull are
+   merged so that the faces are polygons of any size.
+   Each face keeps the list of the points outside of it (its conflict list)
+   and its neighbours across its edges, the furthest point of a face is
+   added by removing the faces it sees, found from this face through the
+   neighbours, and by joining the horizon of these faces to the point. */
+
+struct hull_face {
+  int v[3];
+  int adj[3];     /* the face across the edge (v[e], v[e+1]) */
+  double n[3], d;
+  int alive;      /* 2 while seen from the point being added */
+  int group;
+  int outside;    /* first point of the conflict list */
+  int far;        /* furthest point of the conflict list */
+  double far_dist;
+};
+
+struct hull {
+  const double *p;
+  int npoints;
+  double eps;
+  struct hull_face *faces;
+  int nfaces, maxfaces;
+  int *edges;     /* horizon edges, as (a, b, face beyond) triples */
+  int maxedges;
+  int *visible;   /* the faces seen from the point being added */
+  int maxvisible;
+  int *next;      /* next point of a conflict list */
+  int *horizon;   /* the new face whose first edge starts at a point */
+};
+
+static int
+hull_add_face (struct hull *h, int a, int b, int c)
+{
+  const double *pa = h->p + 3*a, *pb = h->p + 3*b, *pc = h->p + 3*c;
+  double u[3], w[3], *n, len;
+  struct hull_face *f;
+
+  if (h->nfaces == h->maxfaces) {
+    int maxfaces = h->maxfaces * 2;
+    struct hull_face *faces = realloc(h->faces, maxfaces * sizeof(struct hull_face));
+    if (faces == NULL) return -1;
+    h->faces = faces;
+    h->maxfaces = maxfaces;
+  }
+  f = &h->faces[h->nfaces];
+  f->v[0] = a; f->v[1] = b; f->v[2] = c;
+  f->adj[0] = f->adj[1] = f->adj[2] = -1;
+  f->alive = 1;
+  f->group = -1;
+  f->outside = -1;
+  f->far = -1;
+  f->far_dist = 0.0;
+  u[0] = pb[0] - pa[0]; u[1] = pb[1] - pa[1]; u[2] = pb[2] - pa[2];
+  w[0] = pc[0] - pa[0]; w[1] = pc[1] - pa[1]; w[2] = pc[2] - pa[2];
+  n = f->n;
+  n[0] = u[1]*w[2] - u[2]*w[1];
+  n[1] = u[2]*w[0] - u[0]*w[2];
+  n[2] = u[0]*w[1] - u[1]*w[0];
+  len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+  if (len > 0.0) { n[0] /= len; n[1] /= len; n[2] /= len; }
+  f->d = n[0]*pa[0] + n[1]*pa[1] + n[2]*pa[2];
+  return h->nfaces++;
+}
+
+static inline double
+hull_dist (struct hull *h, struct hull_face *f, int i)
+{
+  const double *p = h->p + 3*i;
+  return (f->n[0]*p[0] + f->n[1]*p[1] + f->n[2]*p[2] - f->d);
+}
+
+static inline double
+hull_dist2 (const double *a, const double *b)
+{
+  double x = b[0]-a[0], y = b[1]-a[1], z = b[2]-a[2];
+  return (x*x + y*y + z*z);
+}
+
+/* the index of the edge (a, b) of a face, or -1 */
+static inline int
+hull_edge (struct hull_face *f, int a, int b)
+{
+  int e;
+  for (e = 0; e < 3; e++)
+    if (f->v[e] == a && f->v[(e+1)%3] == b) return e;
+  return -1;
+}
+
+/* adds the point i to the conflict list of the first face of [first, last)
+   which sees it, the points seen by none are inside the hull */
+static void
+hull_assign (struct hull *h, int i, int first, int last)
+{
+  int j;
+  for (j = first; j < last; j++) {
+    struct hull_face *f = &h->faces[j];
+    double d = hull_dist(h, f, i);
+    if (d > h->eps) {
+      h->next[i] = f->outside;
+      f->outside = i;
+      if (d > f->far_dist) { f->far_dist = d; f->far = i; }
+      return;
+    }
+  }
+}
+
+static int
+hull_grow (int **a, int *max, int need)
+{
+  int m, *b;
+  if (need <= *max) return 1;
+  m = 2 * *max + 16;
+  if (m < need) m = need;
+  b = realloc(*a, m * sizeof(int));
+  if (b == NULL) return 0;
+  *a = b;
+  *max = m;
+  return 1;
+}
+
+/* adds the furthest point of the face fi to the hull,
+   returns 0 when out of memory, -2 when the horizon is not a simple loop */
+static int
+hull_add_point (struct hull *h, int fi)
+{
+  int eye = h->faces[fi].far;
+  int nvisible = 1, nedges = 0, first, i, j, e;
+
+  /* the visible faces, from fi through the neighbours, and their horizon */
+  if (!hull_grow(&h->visible, &h->maxvisible, 1)) return 0;
+  h->visible[0] = fi;
+  h->faces[fi].alive = 2;
+  for (i = 0; i < nvisible; i++) {
+    int f = h->visible[i];
+    for (e = 0; e < 3; e++) {
+      int g = h->faces[f].adj[e];
+      if (h->faces[g].alive == 2) continue;
+      if (hull_dist(h, &h->faces[g], eye) > h->eps) {
+        if (!hull_grow(&h->visible, &h->maxvisible, nvisible + 1)) return 0;
+        h->faces[g].alive = 2;
+        h->visible[nvisible++] = g;
+      } else {
+        if (!hull_grow(&h->edges, &h->maxedges, 3 * nedges + 3)) return 0;
+        h->edges[3*nedges+0] = h->faces[f].v[e];
+        h->edges[3*nedges+1] = h->faces[f].v[(e+1)%3];
+        h->edges[3*nedges+2] = g;
+        nedges++;
+      }
+    }
+  }
+
+  /* a new face on each edge of the horizon */
+  first = h->nfaces;
+  for (j = 0; j < nedges; j++) {
+    int a = h->edges[3*j], b = h->edges[3*j+1], g = h->edges[3*j+2];
+    int nf = hull_add_face(h, a, b, eye);
+    if (nf < 0) return 0;
+    if (h->horizon[a] != -1) return -2;
+    h->horizon[a] = nf;
+    h->faces[nf].adj[0] = g;
+    h->faces[g].adj[hull_edge(&h->faces[g], b, a)] = nf;
+  }
+  for (j = first; j < h->nfaces; j++) {
+    int g = h->horizon[h->faces[j].v[1]];
+    if (g == -1) return -2;
+    h->faces[j].adj[1] = g;
+    h->faces[g].adj[2] = j;
+  }
+  for (j = first; j < h->nfaces; j++)
+    h->horizon[h->faces[j].v[0]] = -1;
+
+  /* the points outside of the removed faces go to the new ones */
+  for (i = 0; i < nvisible; i++) {
+    struct hull_face *f = &h->faces[h->visible[i]];
+    int k, next;
+    f->alive = 0;
+    for (k = f->outside; k != -1; k = next) {
+      next = h->next[k];
+      if (k != eye) hull_assign(h, k, first, h->nfaces);
+    }
+    f->outside = -1;
+  }
+  return 1;
+}
+
+/* returns 0 when out of memory, -1 when the points are degenerated,
+   -2 when the hull could not be built */
+static int
+hull_build (struct hull *h)
+{
+  const double *p = h->p;
+  int n = h->npoints;
+  int i, j, e, i0 = 0, i1 = 0, i2 = -1, i3 = -1, ret = 1;
+  double best, ext = 0.0;
+
+  /* initial tetrahedron */
+  for (i = 1; i < n; i++) {
+    if (p[3*i] < p[3*i0]) i0 = i;
+  }
+  best = 0.0;
+  for (i = 0; i < n; i++) {
+    double d = hull_dist2(p + 3*i0, p + 3*i);
+    if (d > best) { best = d; i1 = i; }
+  }
+  ext = sqrt(best);
+  h->eps = ext * 1e-9;
+  if (ext == 0.0) return -1;
+
+  best = 0.0;
+  for (i = 0; i < n; i++) {
+    const double *a = p + 3*i0, *b = p + 3*i1, *c = p + 3*i;
+    double u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    double w[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+    double x = u[1]*w[2] - u[2]*w[1];
+    double y = u[2]*w[0] - u[0]*w[2];
+    double z = u[0]*w[1] - u[1]*w[0];
+    double d = x*x + y*y + z*z;
+    if (d > best) { best = d; i2 = i; }
+  }
+  if (i2 < 0 || sqrt(best) <= h->eps * ext) return -1;
+
+  if (hull_add_face(h, i0, i1, i2) < 0) return 0;
+  best = 0.0;
+  for (i = 0; i < n; i++) {
+    double d = fabs(hull_dist(h, &h->faces[0], i));
+    if (d > best) { best = d; i3 = i; }
+  }
+  if (i3 < 0 || best <= h->eps) return -1;
+
+  /* orient the faces outward */
+  if (hull_dist(h, &h->faces[0], i3) > 0.0) {
+    h->nfaces = 0;
+    if (hull_add_face(h, i0, i2, i1) < 0) return 0;
+    if (hull_add_face(h, i0, i1, i3) < 0) return 0;
+    if (hull_add_face(h, i1, i2, i3) < 0) return 0;
+    if (hull_add_face(h, i2, i0, i3) < 0) return 0;
+  } else {
+    if (hull_add_face(h, i0, i3, i1) < 0) return 0;
+    if (hull_add_face(h, i1, i3, i2) < 0) return 0;
+    if (hull_add_face(h, i2, i3, i0) < 0) return 0;
+  }
+  for (i = 0; i < 4; i++)
+    for (e = 0; e < 3; e++)
+      for (j = 0; j < 4; j++)
+        if (j != i && hull_edge(&h->faces[j], h->faces[i].v[(e+1)%3], h->faces[i].v[e]) >= 0)
+          h->faces[i].adj[e] = j;
+
+  h->next = malloc(n * sizeof(int));
+  h->horizon = malloc(n * sizeof(int));
+  if (h->next == NULL || h->horizon == NULL) { ret = 0; goto done; }
+  for (i = 0; i < n; i++) {
+    h->horizon[i] = -1;
+    if (i != i0 && i != i1 && i != i2 && i != i3) hull_assign(h, i, 0, 4);
+  }
+
+  /* the new faces are appended, so they are reached by this loop */
+  for (j = 0; j < h->nfaces && ret == 1; j++)
+    if (h->faces[j].alive && h->faces[j].outside != -1)
+      ret = hull_add_point(h, j);
+
+  /* compact the dead faces, the neighbours are renumbered (through the
+     field far, not needed anymore) for the merge of the coplanar faces */
+  if (ret == 1) {
+    for (j = 0, i = 0; j < h->nfaces; j++)
+      if (h->faces[j].alive) h->faces[j].far = i++;
+    for (j = 0; j < h->nfaces; j++)
+      if (h->faces[j].alive)
+        for (e = 0; e < 3; e++)
+          h->faces[j].adj[e] = h->faces[h->faces[j].adj[e]].far;
+    for (j = 0, i = 0; j < h->nfaces; j++)
+      if (h->faces[j].alive) h->faces[i++] = h->faces[j];
+    h->nfaces = i;
+  }
+
+done:
+  free(h->next); h->next = NULL;
+  free(h->horizon); h->horizon = NULL;
+  free(h->visible); h->visible = NULL;
+  return ret;
+}
+
+CAMLprim value
+ocamlode_dConvexDataBuildHull (value pointsv)
+{
+  CAMLparam1 (pointsv);
+  CAMLlocal1 (v);
+  struct caml_ba_array *b = Caml_ba_array_val(pointsv);
+  int kind = b->flags & CAML_BA_KIND_MASK;
+  struct hull h;
+  double *pts;
+  int *remap = NULL, *nextv = NULL, *order = NULL, *starts = NULL;
+  int i, j, k, m, ret, ngroups = 0, npoints = 0;
+  const char *err = NULL;
+  dConvexDataID d;
+
+  if (b->num_dims != 2 || b->dim[1] != 3 ||
+      (b->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT)
+    caml_invalid_argument("dConvexDataBuildHull: the points should be a [n; 3] c_layout array");
+  if (kind != CAML_BA_FLOAT32 && kind != CAML_BA_FLOAT64)
+    caml_invalid_argument("dConvexDataBuildHull: the points should be floats");
+  if (b->dim[0] < 4)
+    caml_invalid_argument("dConvexDataBuildHull: at least 4 points are needed");
+
+  memset(&h, 0, sizeof(struct hull));
+  h.npoints = b->dim[0];
+  pts = malloc(3 * h.npoints * sizeof(double));
+  h.maxfaces = 64;
+  h.faces = malloc(h.maxfaces * sizeof(struct hull_face));
+  if (pts == NULL || h.faces == NULL) {
+    free(pts); free(h.faces);
+    caml_failwith("Out of memory");
+  }
+  for (i = 0; i < 3 * h.npoints; i++)
+    pts[i] = (kind == CAML_BA_FLOAT32) ? ((float *) b->data)[i] : ((double *) b->data)[i];
+  h.p = pts;
+
+  ret = hull_build(&h);
+  if (ret == 1) {
+    remap = malloc(h.npoints * sizeof(int));
+    nextv = malloc(h.npoints * sizeof(int));
+    order = malloc(h.nfaces * sizeof(int));
+    starts = malloc((h.nfaces + 1) * sizeof(int));
+    if (remap == NULL || nextv == NULL || order == NULL || starts == NULL) ret = 0;
+  }
+  if (ret != 1) {
+    free(pts); free(h.faces); free(h.edges);
+    free(remap); free(nextv); free(order); free(starts);
+    if (ret == 0) caml_failwith("Out of memory");
+    if (ret == -2) caml_failwith("dConvexDataBuildHull: could not build the hull");
+    caml_invalid_argument("dConvexDataBuildHull: the points are coplanar");
+  }
+
+  /* merge the coplanar faces, on a convex hull the faces of a same plane
+     are always adjacent, so each group is flooded from its first face
+     through the neighbours, the faces of the group j are
+     order[starts[j] .. starts[j+1]-1] */
+  for (i = 0, k = 0; i < h.nfaces; i++) {
+    struct hull_face *f = &h.faces[i];
+    int m;
+    if (f->group != -1) continue;
+    f->group = ngroups;
+    starts[ngroups] = k;
+    order[k++] = i;
+    for (m = starts[ngroups]; m < k; m++) {
+      struct hull_face *c = &h.faces[order[m]];
+      int e;
+      for (e = 0; e < 3; e++) {
+        struct hull_face *g = &h.faces[c->adj[e]];
+        if (g->group == -1 &&
+            f->n[0]*g->n[0] + f->n[1]*g->n[1] + f->n[2]*g->n[2] > 1.0 - 1e-9 &&
+            fabs(f->d - g->d) <= 4.0 * h.eps) {
+          g->group = ngroups;
+          order[k++] = c->adj[e];
+        }
+      }
+    }
+    ngroups++;
+  }
+  starts[ngroups] = k;
+
+  /* keep only the points of the hull */
+  for (i = 0; i < h.npoints; i++) { remap[i] = -1; nextv[i] = -1; }
+  for (i = 0; i < h.nfaces; i++)
+    for (k = 0; k < 3; k++)
+      if (remap[h.faces[i].v[k]] == -1) remap[h.faces[i].v[k]] = npoints++;
+
+  d.planecount = ngroups;
+  d.pointcount = npoints;
+  d.planes = ocamlode_malloc(MEM_CONVEX, 4 * ngroups * sizeof(dReal));
+  d.points = ocamlode_malloc(MEM_CONVEX, 3 * npoints * sizeof(dReal));
+  /* a polygon has at most as much vertices as its triangles plus 2 */
+  d.polygons = ocamlode_malloc(MEM_CONVEX, (3 * ngroups + h.nfaces) * sizeof(unsigned int));
+  if (d.planes == NULL || d.points == NULL || d.polygons == NULL) {
+    err = "Out of memory";
+    goto fail;
+  }
+
+  for (i = 0; i < h.npoints; i++) {
+    if (remap[i] == -1) continue;
+    d.points[3*remap[i]+0] = pts[3*i+0];
+    d.points[3*remap[i]+1] = pts[3*i+1];
+    d.points[3*remap[i]+2] = pts[3*i+2];
+  }
+
+  k = 0;
+  for (j = 0; j < ngroups; j++)
+  {
+    double n[3] = { 0.0, 0.0, 0.0 }, len, dmax = -dInfinity;
+    int ntris = starts[j+1] - starts[j], start = -1, cur, count, count_pos;
+
+    /* the boundary of the group are the edges (a, b) whose neighbour face
+       is not in the group, they are linked by their first point */
+    for (m = starts[j]; m < starts[j+1]; m++) {
+      struct hull_face *f = &h.faces[order[m]];
+      int e;
+      n[0] += f->n[0]; n[1] += f->n[1]; n[2] += f->n[2];
+      for (e = 0; e < 3; e++) {
+        if (h.faces[f->adj[e]].group == j) continue;
+        if (nextv[f->v[e]] != -1) {
+          err = "dConvexDataBuildHull: a face of the hull is not a simple polygon";
+          goto fail;
+        }
+        nextv[f->v[e]] = f->v[(e+1)%3];
+        start = f->v[e];
+      }
+    }
+    len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    n[0] /= len; n[1] /= len; n[2] /= len;
+
+    count_pos = k++;
+    count = 0;
+    cur = start;
+    do {
+      if (cur == -1 || count >= ntris + 2) {
+        err = "dConvexDataBuildHull: the boundary of a face of the hull does not close";
+        goto fail;
+      }
+      d.polygons[k++] = remap[cur];
+      count++;
+      cur = nextv[cur];
+    } while (cur != start);
+
+    /* every boundary edge should have been walked */
+    for (m = starts[j]; m < starts[j+1]; m++) {
+      struct hull_face *f = &h.faces[order[m]];
+      int e;
+      for (e = 0; e < 3; e++) {
+        if (h.faces[f->adj[e]].group == j) continue;
+        if (count-- <= 0) {
+          err = "dConvexDataBuildHull: a face of the hull is not a simple polygon";
+          goto fail;
+        }
+        nextv[f->v[e]] = -1;
+      }
+    }
+    count = k - count_pos - 1;
+    d.polygons[count_pos] = count;
+
+    for (i = count_pos + 1; i < k; i++) {
+      const dReal *q = d.points + 3 * d.polygons[i];
+      double dist = n[0]*q[0] + n[1]*q[1] + n[2]*q[2];
+      if (dist > dmax) dmax = dist;
+    }
+    d.planes[4*j+0] = n[0];
+    d.planes[4*j+1] = n[1];
+    d.planes[4*j+2] = n[2];
+    d.planes[4*j+3] = dmax;
+  }
+
+  free(pts); free(h.faces); free(h.edges);
+  free(remap); free(nextv); free(order); free(starts);
+
+  if (!check_convex_polygons(d.polygons, k, d.planecount, d.pointcount)) {
+    ocamlode_free(d.planes); ocamlode_free(d.points); ocamlode_free(d.polygons);
+    caml_failwith("dConvexDataBuildHull: could not build the hull");
+  }
+
+  v = caml_alloc_custom (&convexdata_custom_ops, sizeof(dConvexDataID), 0, 1);
+  memcpy (Data_custom_val(v), &d, sizeof(dConvexDataID));
+
+  CAMLreturn (v);
+
+fail:
+  ocamlode_free(d.planes); ocamlode_free(d.points); ocamlode_free(d.polygons);
+  free(pts); free(h.faces); free(h.edges);
+  free(remap); free(nextv); free(order); free(starts);
+  caml_failwith(err);
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dConvexDataGet (value convex_data)
+{
+  CAMLparam1 (convex_data);
+  CAMLlocal4 (rv, planes, points, polygons);
+  dConvexDataID * d = ((dConvexDataID *) Data_custom_val (convex_data));
+  unsigned int i, polyscount = 0;
+
+  for (i = 0; i < d->planecount; i++)
+    polyscount += 1 + d->polygons[polyscount];
+
+  planes = caml_alloc(4 * d->planecount * Double_wosize, Double_array_tag);
+  for (i = 0; i < 4 * d->planecount; i++)
+    Store_double_field(planes, i, d->planes[i]);
+
+  points = caml_alloc(3 * d->pointcount * Double_wosize, Double_array_tag);
+  for (i = 0; i < 3 * d->pointcount; i++)
+    Store_double_field(points, i, d->points[i]);
+
+  polygons = caml_alloc(polyscount, 0);
+  for (i = 0; i < polyscount; i++)
+    Store_field(polygons, i, Val_int(d->polygons[i]));
+
+  rv = caml_alloc(3, 0);
+  Store_field (rv, 0, planes);
+  Store_field (rv, 1, points);
+  Store_field (rv, 2, polygons);
+  CAMLreturn (rv);
+}
+
+#if 0
+{{{ old version of dCreateConvex 
+
+CAMLprim value
+ocamlode_dCreateConvex (value parentv, value planesv, value pointsv, value polygonesv)
+{
+  CAMLparam4 (parentv, planesv, pointsv, polygonesv);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+
+  int i;
+  unsigned int planecount, pointcount, polyscount;
+
+  planecount = Wosize_val(planesv) / Double_wosize;
+  pointcount = Wosize_val(pointsv) / Double_wosize;
+  polyscount = Wosize_val(polygonesv);
+
+  if (polyscount != (planecount/4) * 5)
+    caml_invalid_argument("dCreateConvex: wrong polygones number");
+
+  dReal *_planes;
+  dReal *_points;
+  unsigned int *_polygons;
+
+  _planes = malloc(planecount * sizeof(dReal));
+  _points = malloc(pointcount * sizeof(dReal));
+  _polygons = malloc(polyscount * sizeof(int));
+
+  if (!_planes || !_points || !_polygons)
+    caml_failwith("dCreateConvex: allocation error");
+
+  for (i=0; i<planecount; ++i) {
+    _planes[i] = Double_field(planesv, i);
+  }
+  for (i=0; i<pointcount; ++i) {
+    _points[i] = Double_field(pointsv, i);
+  }
+
+  for (i=0; i<polyscount; ++i) {
+    _polygons[i] = (unsigned int) (Long_val(Field(polygonesv, i)));
+  }
+
+  dGeomID id = dCreateConvex (parent,
+                          _planes, (planecount/4),
+                          _points, (pointcount/3),
+                          _polygons);
+
+  CAMLreturn (Val_dGeomID (id));
+}
+}}}
+#endif
+
+/*
+ dGeomID dCreateConvex (dSpaceID space,
+          dReal *_planes, unsigned int _planecount,
+          dReal *_points, unsigned int _pointcount, unsigned int *_polygons);
+
+ void dGeomSetConvex (dGeomID g,
+        dReal *_planes, unsigned int _count,
+        dReal *_points, unsigned int _pointcount,unsigned int *_polygons);
+*/
+
+
+/* Heightfield */
+
+#define dHeightfieldDataID_val(v) ((dHeightfieldDataID)(v))
+#define Val_dHeightfieldDataID(d) ((value)(d))
+
+CAMLprim value
+ocamlode_dGeomHeightfieldDataCreate(value u)
+{
+  dHeightfieldDataID d = dGeomHeightfieldDataCreate();
+  return Val_dHeightfieldDataID(d);
+}
+
+CAMLprim value
+ocamlode_dGeomHeightfieldDataDestroy(value hf_data_id)
+{
+  dGeomHeightfieldDataDestroy( dHeightfieldDataID_val(hf_data_id) );
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dCreateHeightfield(value parentv, value data, value placeable)
+{
+  CAMLparam3 (parentv, data, placeable);
+  dSpaceID parent;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
+
+  dGeomID id = dCreateHeightfield(parent, dHeightfieldDataID_val(data), Int_val(placeable));
+  CAMLreturn (Val_owned (ARENA_GEOM, id, NULL));
+}
+
+CAMLprim value
+ocamlode_dGeomHeightfieldDataBuild(
+          value hf_data_id,
+          value pHeightDatav,
+          value width, value depth,
+          value widthSamples, value depthSamples,
+          value scale, value offset, value thickness,
+          value wrap )
+{
+  double* pHeightData;
+#if defined(MEM_CPY)
+  int i, len;
+  len = Wosize_val(pHeightDatav) / Double_wosize;
+  pHeightData = malloc( len * sizeof(double));
+  for (i=0; i < len; i++)
+    pHeightData[i] = Double_field(pHeightDatav, i);
+#else
+  pHeightData = (double *) pHeightDatav;
+#endif
+  dGeomHeightfieldDataBuildDouble(
+                  dHeightfieldDataID_val(hf_data_id),
+                  pHeightData,
+                  1, // bCopyHeightData
+                  Double_val(width), Double_val(depth),
+                  Int_val(widthSamples), Int_val(depthSamples),
+                  Double_val(scale), Double_val(offset), Double_val(thickness),
+                  Int_val(wrap) );
+#if defined(MEM_CPY)
+  free(pHeightData);
+#endif
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dGeomHeightfieldDataBuild_bytecode (value * argv, int argn)
+{
+  return ocamlode_dGeomHeightfieldDataBuild (argv[0], argv[1], argv[2],
+                                             argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9]);
+}
+
+CAMLprim value
+ocamlode_dGeomHeightfieldDataSetBounds(value hf_data_id, value min_height, value max_height)
+{
+  dGeomHeightfieldDataSetBounds( dHeightfieldDataID_val(hf_data_id),
+                                 Double_val(min_height), Double_val(max_height) );
+  return Val_unit;
+}
+
+
+/* Heightfield samplers: the heights are computed on demand by ODE
+   through dGeomHeightfieldDataBuildCallback(), so that unbounded or
+   procedural terrains can be collided without storing them. */
+
+enum hf_sampler_kind {
+  HF_SAMPLER_TILED,
+  HF_SAMPLER_NOISE,
+  HF_SAMPLER_CLOSURE,
+};
+
+struct hf_cache_entry {
+  int x, z;
+  unsigned int gen;
+  dReal h;
+};
+
+struct hf_sampler {
+  enum hf_sampler_kind kind;
+  value root;            /* the bigarray or the closure, registered as a root */
+
+  /* tiled lookup */
+  void *tile;
+  int tile_w, tile_d;
+  int tile_single;
+
+  /* value noise */
+  unsigned int seed;
+  dReal frequency, amplitude, persistence;
+  int octaves;
+
+  /* closure, with a direct mapped cache of the last queried heights */
+  struct hf_cache_entry *cache;
+  unsigned int cache_mask;
+  unsigned int gen;
+};
+
+#define hf_sampler_val(v) Voidptr_val(struct hf_sampler *, (v))
+
+static inline int
+hf_wrap (int i, int n)
+{
+  i %= n;
+  return (i < 0 ? i + n : i);
+}
+
+static dReal
+hf_tiled_get_height (void *p_user_data, int x, int z)
+{
+  struct hf_sampler *s = p_user_data;
+  int i = hf_wrap(z, s->tile_d) * s->tile_w + hf_wrap(x, s->tile_w);
+  if (s->tile_single)
+    return ((float *) s->tile)[i];
+  else
+    return ((double *) s->tile)[i];
+}
+
+static inline dReal
+hf_lattice (unsigned int seed, int x, int z)
+{
+  unsigned int h = seed;
+  h ^= (unsigned int) x * 0x8da6b343u;
+  h ^= (unsigned int) z * 0xd8163841u;
+  h = (h ^ (h >> 15)) * 0x2c1b3c6du;
+  h = (h ^ (h >> 12)) * 0x297a2d39u;
+  h ^= h >> 15;
+  return ((dReal) (h & 0xffffff) / (dReal) 0x7fffff) - 1.0;
+}
+
+static dReal
+hf_noise_get_height (void *p_user_data, int x, int z)
+{
+  struct hf_sampler *s = p_user_data;
+  dReal sum = 0.0, amp = 1.0, freq = s->frequency;
+  int o;
+  for (o = 0; o < s->octaves; o++)
+  {
+    dReal fx = x * freq, fz = z * freq;
+    dReal x0 = floor(fx), z0 = floor(fz);
+    dReal tx = fx - x0, tz = fz - z0;
+    int ix = (int) x0, iz = (int) z0;
+    unsigned int seed = s->seed + o * 0x9e3779b9u;
+    dReal h00 = hf_lattice(seed, ix,     iz);
+    dReal h10 = hf_lattice(seed, ix + 1, iz);
+    dReal h01 = hf_lattice(seed, ix,     iz + 1);
+    dReal h11 = hf_lattice(seed, ix + 1, iz + 1);
+    /* smoothstep interpolation */
+    tx = tx * tx * (3.0 - 2.0 * tx);
+    tz = tz * tz * (3.0 - 2.0 * tz);
+    sum += amp * ((h00 + (h10 - h00) * tx) * (1.0 - tz) +
+                  (h01 + (h11 - h01) * tx) * tz);
+    amp *= s->persistence;
+    freq *= 2.0;
+  }
+  return (s->amplitude * sum);
+}
+
+static dReal
+hf_closure_get_height (void *p_user_data, int x, int z)
+{
+  struct hf_sampler *s = p_user_data;
+  struct hf_cache_entry *e;
+  value rv;
+
+  e = &s->cache[((unsigned int) x * 73856093u ^ (unsigned int) z * 19349663u) & s->cache_mask];
+  if (e->gen == s->gen && e->x == x && e->z == z)
+    return e->h;
+
+  rv = caml_callback2_exn (s->root, Val_int(x), Val_int(z));
+  if (Is_exception_result (rv)) {
+    fprintf (stderr, "heightfield sampler: callback raised exception: %s\n",
+             caml_format_exception (Extract_exception (rv)));
+    fflush (stderr);
+    return 0.0;
+  }
+  e->x = x;
+  e->z = z;
+  e->gen = s->gen;
+  e->h = Double_val(rv);
+  return e->h;
+}
+
+static struct hf_sampler *
+hf_sampler_alloc (enum hf_sampler_kind kind)
+{
+  struct hf_sampler *s = calloc(1, sizeof(struct hf_sampler));
+  if (s == NULL) caml_failwith("Out of memory");
+  s->kind = kind;
+  s->root = Val_unit;
+  caml_register_generational_global_root(&s->root);
+  return s;
+}
+
+CAMLprim value
+ocamlode_dHeightfieldSamplerTiled (value ba)
+{
+  CAMLparam1 (ba);
+  struct hf_sampler *s;
+  struct caml_ba_array *b = Caml_ba_array_val(ba);
+  int kind = b->flags & CAML_BA_KIND_MASK;
+
+  if (b->num_dims != 2)
+    caml_invalid_argument("dHeightfieldSamplerTiled: the tile should have 2 dimensions");
+  if ((b->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT)
+    caml_invalid_argument("dHeightfieldSamplerTiled: the tile should have a c_layout");
+  if (kind != CAML_BA_FLOAT32 && kind != CAML_BA_FLOAT64)
+    caml_invalid_argument("dHeightfieldSamplerTiled: the tile should contain floats");
+  if (b->dim[0] <= 0 || b->dim[1] <= 0)
+    caml_invalid_argument("dHeightfieldSamplerTiled: empty tile");
+
+  s = hf_sampler_alloc(HF_SAMPLER_TILED);
+  caml_modify_generational_global_root(&s->root, ba);
+  s->tile = b->data;
+  s->tile_d = b->dim[0];
+  s->tile_w = b->dim[1];
+  s->tile_single = (kind == CAML_BA_FLOAT32);
+  CAMLreturn (Val_voidptr (s));
+}
+
+CAMLprim value
+ocamlode_dHeightfieldSamplerNoise (value seed, value frequency, value amplitude,
+                                   value persistence, value octaves)
+{
+  CAMLparam5 (seed, frequency, amplitude, persistence, octaves);
+  struct hf_sampler *s;
+  if (Int_val(octaves) < 1)
+    caml_invalid_argument("dHeightfieldSamplerNoise: octaves");
+  s = hf_sampler_alloc(HF_SAMPLER_NOISE);
+  s->seed = Int_val(seed);
+  s->frequency = Double_val(frequency);
+  s->amplitude = Double_val(amplitude);
+  s->persistence = Double_val(persistence);
+  s->octaves = Int_val(octaves);
+  CAMLreturn (Val_voidptr (s));
+}
+
+CAMLprim value
+ocamlode_dHeightfieldSamplerClosure (value cache_size, value f)
+{
+  CAMLparam2 (cache_size, f);
+  struct hf_sampler *s;
+  unsigned int n = 1;
+  /* round the cache size up to a power of 2 */
+  while (n < (unsigned int) Int_val(cache_size) && n < (1u << 24)) n <<= 1;
+
+  s = hf_sampler_alloc(HF_SAMPLER_CLOSURE);
+  s->cache = ocamlode_malloc(MEM_HEIGHTFIELD, n * sizeof(struct hf_cache_entry));
+  if (s->cache == NULL) {
+    caml_remove_generational_global_root(&s->root);
+    free(s);
+    caml_failwith("Out of memory");
+  }
+  s->cache_mask = n - 1;
+  s->gen = 1;
+  memset(s->cache, 0, n * sizeof(struct hf_cache_entry));
+  caml_modify_generational_global_root(&s->root, f);
+  CAMLreturn (Val_voidptr (s));
+}
+
+CAMLprim value
+ocamlode_dHeightfieldSamplerClearCache (value sv)
+{
+  struct hf_sampler *s = hf_sampler_val(sv);
+  if (s->cache != NULL && ++s->gen == 0) {
+    memset(s->cache, 0, (s->cache_mask + 1) * sizeof(struct hf_cache_entry));
+    s->gen = 1;
+  }
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dHeightfieldSamplerDestroy (value sv)
+{
+  struct hf_sampler *s = hf_sampler_val(sv);
+  if (s == NULL) return Val_unit;
+  caml_remove_generational_global_root(&s->root);
+  if (s->cache != NULL) ocamlode_free(s->cache);
+  free(s);
+  destroy_voidptr(sv);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomHeightfieldDataBuildCallback(
+          value hf_data_id,
+          value sv,
+          value width, value depth,
+          value widthSamples, value depthSamples,
+          value scale, value offset, value thickness,
+          value wrap )
+{
+  struct hf_sampler *s = hf_sampler_val(sv);
+  dHeightfieldGetHeight *get_height;
+  switch (s->kind)
+  {
+    case HF_SAMPLER_TILED:   get_height = hf_tiled_get_height;   break;
+    case HF_SAMPLER_NOISE:   get_height = hf_noise_get_height;   break;
+    case HF_SAMPLER_CLOSURE: get_height = hf_closure_get_height; break;
+    default: caml_failwith("dGeomHeightfieldDataBuildCallback");
+  }
+  dGeomHeightfieldDataBuildCallback(
+                  dHeightfieldDataID_val(hf_data_id),
+                  s, get_height,
+                  Double_val(width), Double_val(depth),
+                  Int_val(widthSamples), Int_val(depthSamples),
+                  Double_val(scale), Double_val(offset), Double_val(thickness),
+                  Int_val(wrap) );
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dGeomHeightfieldDataBuildCallback_bytecode (value * argv, int argn)
+{
+  return ocamlode_dGeomHeightfieldDataBuildCallback (argv[0], argv[1], argv[2],
+                                             argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9]);
+}
+
+
+/* Terrain paging: a ring of heightfield tiles is kept around some focus
+   points, the tiles are read from a memory mapped terrain file by a
+   background thread, and they are swapped into the space only from
+   ocamlode_dTerrainPagerUpdate(), which is meant to be called between
+   two steps.  The background thread never calls ODE, it only prepares
+   the height buffers. */
+
+enum tile_state {
+  TILE_PENDING,   /* queued for, or being read by, the loader thread */
+  TILE_READY,     /* heights read, waiting for the next update */
+  TILE_LOADED,    /* the heightfield geom is in the space */
+};
+
+struct terrain_tile {
+  int tx, tz;
+  enum tile_state state;
+  double *heights;
+  dHeightfieldDataID data;
+  dGeomID geom;
+  double t_request;
+  struct terrain_tile *next;    /* all the tiles of the pager */
+  struct terrain_tile *qnext;   /* the loader queue */
+};
+
+struct terrain_pager {
+  dSpaceID space;  /* NULL once destroyed */
+  const float *map;
+  size_t map_size;
+  int samples_x, samples_z;
+  int tiles_x, tiles_z;
+  int tile_cells;
+  dReal cell_size, height_scale, thickness;
+  int radius;
+
+  double *focus;
+  int focus_count;
+
+  struct terrain_tile *tiles;
+  struct terrain_tile **grid;   /* tiles_x * tiles_z, the tiles by position */
+  struct terrain_tile *queue_head, *queue_tail;
+
+  pthread_t loader;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int quit;
+
+  /* stats */
+  int tiles_loaded, tiles_pending;
+  long tiles_paged_in, tiles_paged_out;
+  double latency_last, latency_sum, latency_max;
+
+  struct terrain_pager *next;
+};
+
+static struct terrain_pager *terrain_pagers = NULL;
+
+#define terrain_pager_val(v) Voidptr_val(struct terrain_pager *, (v))
+
+static double
+terrain_clock (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+terrain_read_tile (struct terrain_pager *p, struct terrain_tile *t)
+{
+  int n = p->tile_cells + 1;
+  int x0 = t->tx * p->tile_cells;
+  int z0 = t->tz * p->tile_cells;
+  int i, j;
+  for (j = 0; j < n; j++)
+  {
+    const float *row = p->map + (size_t)(z0 + j) * p->samples_x + x0;
+    double *dst = t->heights + j * n;
+    for (i = 0; i < n; i++)
+      dst[i] = row[i];
+  }
+}
+
+static void *
+terrain_loader (void *arg)
+{
+  struct terrain_pager *p = arg;
+  struct terrain_tile *t;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;)
+  {
+    while (p->queue_head == NULL && !p->quit)
+      pthread_cond_wait(&p->cond, &p->lock);
+    if (p->quit) break;
+
+    t = p->queue_head;
+    p->queue_head = t->qnext;
+    if (p->queue_head == NULL) p->queue_tail = NULL;
+    pthread_mutex_unlock(&p->lock);
+
+    terrain_read_tile(p, t);
+
+    pthread_mutex_lock(&p->lock);
+    t->state = TILE_READY;
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+/* the tile of a focus coordinate, clamped before the conversion to int,
+   a focus further than the radius from the terrain doesn't want any tile */
+static int
+terrain_focus_tile (struct terrain_pager *p, double pos, int tiles)
+{
+  double f = floor(pos / (p->tile_cells * p->cell_size));
+  if (!(f >= -p->radius - 1)) return -p->radius - 1;  /* also NaN */
+  if (f > tiles + p->radius) return tiles + p->radius;
+  return (int) f;
+}
+
+static int
+terrain_tile_wanted (struct terrain_pager *p, int tx, int tz)
+{
+  int i;
+  for (i = 0; i < p->focus_count; i++)
+  {
+    int fx = terrain_focus_tile(p, p->focus[2*i],   p->tiles_x);
+    int fz = terrain_focus_tile(p, p->focus[2*i+1], p->tiles_z);
+    if (abs(tx - fx) <= p->radius && abs(tz - fz) <= p->radius)
+      return 1;
+  }
+  return 0;
+}
+
+/* the pager owns the geoms of its tiles, a space destroyed with its cleanup
+   mode set destroys them first, they are then forgotten */
+static void
+terrain_space_destroyed (dSpaceID s)
+{
+  struct terrain_pager *p;
+  struct terrain_tile *t;
+  int i, n, cleanup;
+  if (terrain_pagers == NULL) return;
+  cleanup = dSpaceGetCleanup(s);
+  for (p = terrain_pagers; p != NULL; p = p->next) {
+    if (p->space != s) continue;
+    p->space = NULL;
+    if (cleanup)
+      for (t = p->tiles; t != NULL; t = t->next) t->geom = NULL;
+  }
+  if (!cleanup) return;
+  n = dSpaceGetNumGeoms(s);
+  for (i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom(s, i);
+    if (dGeomIsSpace(g)) terrain_space_destroyed((dSpaceID) g);
+  }
+}
+
+static void
+terrain_free_tile (struct terrain_tile *t)
+{
+  if (t->geom != NULL) {
+    shared_geom_destroyed(t->geom);
+    arena_geom_destroyed(t->geom);
+    dGeomDestroy(t->geom);
+  }
+  if (t->data != NULL) dGeomHeightfieldDataDestroy(t->data);
+  ocamlode_free(t->heights);
+  free(t);
+}
+
+static void
+terrain_swap_in (struct terrain_pager *p, struct terrain_tile *t)
+{
+  int n = p->tile_cells;
+  dReal tile_size = n * p->cell_size;
+  double now = terrain_clock();
+
+  t->data = dGeomHeightfieldDataCreate();
+  dGeomHeightfieldDataBuildDouble(t->data, t->heights,
+                                  0, // bCopyHeightData, the tile keeps the buffer
+                                  tile_size, tile_size, n + 1, n + 1,
+                                  p->height_scale, 0.0, p->thickness, 0);
+  t->geom = dCreateHeightfield(p->space, t->data, 1);
+  dGeomSetPosition(t->geom,
+                   (t->tx + 0.5) * tile_size, 0.0,
+                   (t->tz + 0.5) * tile_size);
+  t->state = TILE_LOADED;
+
+  p->latency_last = now - t->t_request;
+  p->latency_sum += p->latency_last;
+  if (p->latency_last > p->latency_max) p->latency_max = p->latency_last;
+  p->tiles_paged_in++;
+}
+
+CAMLprim value
+ocamlode_dTerrainPagerCreate_native (value spacev, value filename,
+                                     value samples_x, value samples_z,
+                                     value tile_cells, value cell_size,
+                                     value height_scale, value thickness,
+                                     value radius)
+{
+  CAMLparam5 (spacev, filename, samples_x, samples_z, tile_cells);
+  CAMLxparam4 (cell_size, height_scale, thickness, radius);
+  struct terrain_pager *p;
+  struct stat st;
+  size_t size;
+  void *map;
+  int fd;
+
+  if (Int_val(tile_cells) < 1 ||
+      Int_val(samples_x) <= Int_val(tile_cells) ||
+      Int_val(samples_z) <= Int_val(tile_cells))
+    caml_invalid_argument("dTerrainPagerCreate: the terrain is smaller than a tile");
+  if (!(Double_val(cell_size) > 0.0) || !isfinite(Double_val(cell_size)))
+    caml_invalid_argument("dTerrainPagerCreate: cell_size should be positive");
+  if (Int_val(radius) < 0)
+    caml_invalid_argument("dTerrainPagerCreate: radius should not be negative");
+
+  size = (size_t) Int_val(samples_x) * Int_val(samples_z) * sizeof(float);
+  fd = open(String_val(filename), O_RDONLY);
+  if (fd == -1) caml_failwith("dTerrainPagerCreate: can not open the terrain file");
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < size) {
+    close(fd);
+    caml_failwith("dTerrainPagerCreate: the terrain file is too short");
+  }
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) caml_failwith("dTerrainPagerCreate: mmap failed");
+
+  p = calloc(1, sizeof(struct terrain_pager));
+  if (p == NULL) {
+    munmap(map, size);
+    caml_failwith("Out of memory");
+  }
+  p->space = dSpaceID_val(spacev);
+  p->map = map;
+  p->map_size = size;
+  p->samples_x = Int_val(samples_x);
+  p->samples_z = Int_val(samples_z);
+  p->tile_cells = Int_val(tile_cells);
+  p->tiles_x = (p->samples_x - 1) / p->tile_cells;
+  p->tiles_z = (p->samples_z - 1) / p->tile_cells;
+  p->cell_size = Double_val(cell_size);
+  p->height_scale = Double_val(height_scale);
+  p->thickness = Double_val(thickness);
+  /* a wider ring than the terrain wouldn't load more tiles */
+  p->radius = Int_val(radius);
+  if (p->radius > p->tiles_x && p->radius > p->tiles_z)
+    p->radius = (p->tiles_x > p->tiles_z) ? p->tiles_x : p->tiles_z;
+  p->grid = calloc((size_t) p->tiles_x * p->tiles_z, sizeof(struct terrain_tile *));
+  if (p->grid == NULL) {
+    munmap(map, size);
+    free(p);
+    caml_failwith("Out of memory");
+  }
+
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  if (pthread_create(&p->loader, NULL, terrain_loader, p) != 0) {
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    munmap(map, size);
+    free(p->grid);
+    free(p);
+    caml_failwith("dTerrainPagerCreate: can not create the loader thread");
+  }
+  p->next = terrain_pagers;
+  terrain_pagers = p;
+  CAMLreturn (Val_voidptr (p));
+}
+CAMLprim value
+ocamlode_dTerrainPagerCreate_bytecode (value * argv, int argn)
+{
+  return ocamlode_dTerrainPagerCreate_native (argv[0], argv[1], argv[2], argv[3],
+                                              argv[4], argv[5], argv[6], argv[7], argv[8]);
+}
+
+CAMLprim value
+ocamlode_dTerrainPagerSetFocus (value pv, value focusv)
+{
+  struct terrain_pager *p = terrain_pager_val(pv);
+  int i, len = Wosize_val(focusv) / Double_wosize;
+  double *focus;
+
+  if (len % 2 != 0)
+    caml_invalid_argument("dTerrainPagerSetFocus: the array should contain (x, z) pairs");
+  focus = malloc((len + 1) * sizeof(double));
+  if (focus == NULL) caml_failwith("Out of memory");
+  for (i = 0; i < len; i++)
+    focus[i] = Double_field(focusv, i);
+  free(p->focus);
+  p->focus = focus;
+  p->focus_count = len / 2;
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dTerrainPagerUpdate (value pv)
+{
+  struct terrain_pager *p = terrain_pager_val(pv);
+  struct terrain_tile *t, **tp;
+  double now = terrain_clock();
+  int i, tx, tz;
+
+  if (p->space == NULL)
+    caml_invalid_argument("dTerrainPagerUpdate: the space of the pager was destroyed");
+  pthread_mutex_lock(&p->lock);
+
+  /* swap in the ready tiles, and page out the tiles out of the ring */
+  tp = &p->tiles;
+  while ((t = *tp) != NULL)
+  {
+    int wanted = terrain_tile_wanted(p, t->tx, t->tz);
+    if (t->state == TILE_READY && wanted) {
+      terrain_swap_in(p, t);
+    }
+    if (t->state != TILE_PENDING && !wanted) {
+      if (t->state == TILE_LOADED) p->tiles_paged_out++;
+      *tp = t->next;
+      p->grid[(size_t) t->tz * p->tiles_x + t->tx] = NULL;
+      terrain_free_tile(t);
+      continue;
+    }
+    tp = &t->next;
+  }
+
+  /* queue the missing tiles of the ring */
+  for (i = 0; i < p->focus_count; i++)
+  {
+    int fx = terrain_focus_tile(p, p->focus[2*i],   p->tiles_x);
+    int fz = terrain_focus_tile(p, p->focus[2*i+1], p->tiles_z);
+    int x0 = (fx - p->radius < 0) ? 0 : fx - p->radius;
+    int z0 = (fz - p->radius < 0) ? 0 : fz - p->radius;
+    int x1 = (fx + p->radius >= p->tiles_x) ? p->tiles_x - 1 : fx + p->radius;
+    int z1 = (fz + p->radius >= p->tiles_z) ? p->tiles_z - 1 : fz + p->radius;
+    for (tz = z0; tz <= z1; tz++)
+    for (tx = x0; tx <= x1; tx++)
+    {
+      int n = p->tile_cells + 1;
+      struct terrain_tile **cell = &p->grid[(size_t) tz * p->tiles_x + tx];
+      if (*cell != NULL) continue;
+
+      t = calloc(1, sizeof(struct terrain_tile));
+      if (t == NULL) continue;
+      t->heights = ocamlode_malloc(MEM_HEIGHTFIELD, n * n * sizeof(double));
+      if (t->heights == NULL) { free(t); continue; }
+      t->tx = tx;
+      t->tz = tz;
+      t->state = TILE_PENDING;
+      t->t_request = now;
+      t->next = p->tiles;
+      p->tiles = t;
+      *cell = t;
+      if (p->queue_tail) p->queue_tail->qnext = t;
+      else p->queue_head = t;
+      p->queue_tail = t;
+    }
+  }
+
+  p->tiles_loaded = 0;
+  p->tiles_pending = 0;
+  for (t = p->tiles; t != NULL; t = t->next) {
+    if (t->state == TILE_LOADED) p->tiles_loaded++;
+    else p->tiles_pending++;
+  }
+
+  if (p->queue_head != NULL) pthread_cond_signal(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dTerrainPagerGetStats (value pv)
+{
+  CAMLparam1 (pv);
+  CAMLlocal1 (rv);
+  struct terrain_pager *p = terrain_pager_val(pv);
+
+  rv = caml_alloc(7, 0);
+  Store_field (rv, 0, Val_int (p->tiles_loaded));
+  Store_field (rv, 1, Val_int (p->tiles_pending));
+  Store_field (rv, 2, Val_long (p->tiles_paged_in));
+  Store_field (rv, 3, Val_long (p->tiles_paged_out));
+  Store_field (rv, 4, caml_copy_double (p->latency_last));
+  Store_field (rv, 5, caml_copy_double (
+        p->tiles_paged_in ? p->latency_sum / p->tiles_paged_in : 0.0));
+  Store_field (rv, 6, caml_copy_double (p->latency_max));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dTerrainPagerDestroy (value pv)
+{
+  struct terrain_pager *p = terrain_pager_val(pv);
+  struct terrain_pager **pp;
+  struct terrain_tile *t, *next;
+  if (p == NULL) return Val_unit;
+  for (pp = &terrain_pagers; *pp != p; pp = &(*pp)->next);
+  *pp = p->next;
+
+  pthread_mutex_lock(&p->lock);
+  p->quit = 1;
+  pthread_cond_signal(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->loader, NULL);
+
+  for (t = p->tiles; t != NULL; t = next) {
+    next = t->next;
+    terrain_free_tile(t);
+  }
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->cond);
+  munmap((void *) p->map, p->map_size);
+  free(p->grid);
+  free(p->focus);
+  free(p);
+  destroy_voidptr(pv);
+  return Val_unit;
+}
+
+
+/* Shared datas (see the "Shared collision datas" section) */
+
+CAMLprim value
+ocamlode_dSharedTriMeshCreate (value verticesv, value indicesv)
+{
+  CAMLparam2 (verticesv, indicesv);
+  struct shared_data *d;
+  int i, lenv, leni;
+
+  lenv = Wosize_val(verticesv) / Double_wosize;
+  if ( (lenv % 3) != 0 )
+    caml_invalid_argument ("vertices array length not multiple of 3");
+
+  leni = Wosize_val (indicesv);
+  if ( (leni % 3) != 0 )
+    caml_invalid_argument ("indices array length not multiple of 3");
+
+  d = shared_data_alloc(SHARED_TRIMESH);
+  d->vertices = ocamlode_malloc (MEM_TRIMESH, lenv * sizeof(dReal));
+  d->indices = ocamlode_malloc (MEM_TRIMESH, leni * sizeof(int));
+  if (d->vertices == NULL || d->indices == NULL) {
+    ocamlode_free(d->vertices); ocamlode_free(d->indices); free(d);
+    caml_failwith("Out of memory");
+  }
+  for (i=0; i < lenv; i++)
+    d->vertices[i] = Double_field(verticesv, i);
+  for (i=0; i < leni; i++)
+    d->indices[i] = Long_val(Field(indicesv, i));
+  d->bytes = lenv * sizeof(dReal) + leni * sizeof(int);
+  d->vertexcount = lenv / 3;
+  d->indexcount = leni;
+  if (!check_trimesh_indices (d->indices, leni, lenv / 3)) {
+    ocamlode_free(d->vertices); ocamlode_free(d->indices); free(d);
+    caml_invalid_argument ("dSharedTriMeshCreate: an index is out of the vertices");
+  }
+
+  shared_trimesh_build (d);
+  CAMLreturn (Val_shared_data (d));
+}
+
+CAMLprim value
+ocamlode_dSharedConvexCreate (value convex_data)
+{
+  CAMLparam1 (convex_data);
+  struct shared_data *d;
+  dConvexDataID *c = ((dConvexDataID *) Data_custom_val (convex_data));
+  unsigned int i, polyscount = 0;
+
+  if (c->planes == NULL)
+    caml_invalid_argument ("dSharedConvexCreate: destroyed convex data");
+  for (i = 0; i < c->planecount; i++)
+    polyscount += 1 + c->polygons[polyscount];
+
+  d = shared_data_alloc(SHARED_CONVEX);
+  d->planes = ocamlode_malloc (MEM_CONVEX, 4 * c->planecount * sizeof(dReal));
+  d->points = ocamlode_malloc (MEM_CONVEX, 3 * c->pointcount * sizeof(dReal));
+  d->polygons = ocamlode_malloc (MEM_CONVEX, polyscount * sizeof(unsigned int));
+  if (d->planes == NULL || d->points == NULL || d->polygons == NULL) {
+    ocamlode_free(d->planes); ocamlode_free(d->points); ocamlode_free(d->polygons); free(d);
+    caml_failwith("Out of memory");
+  }
+  memcpy (d->planes, c->planes, 4 * c->planecount * sizeof(dReal));
+  memcpy (d->points, c->points, 3 * c->pointcount * sizeof(dReal));
+  memcpy (d->polygons, c->polygons, polyscount * sizeof(unsigned int));
+  d->planecount = c->planecount;
+  d->pointcount = c->pointcount;
+  d->polyscount = polyscount;
+  d->bytes = (4 * c->planecount + 3 * c->pointcount) * sizeof(dReal)
+           + polyscount * sizeof(unsigned int);
+  CAMLreturn (Val_shared_data (d));
+}
+
+CAMLprim value
+ocamlode_dSharedHeightfieldCreate_native (
+          value pHeightDatav,
+          value width, value depth,
+          value widthSamples, value depthSamples,
+          value scale, value offset, value thickness,
+          value wrap )
+{
+  CAMLparam5 (pHeightDatav, width, depth, widthSamples, depthSamples);
+  CAMLxparam4 (scale, offset, thickness, wrap);
+  struct shared_data *d;
+  int i, len;
+
+  len = Wosize_val(pHeightDatav) / Double_wosize;
+  if (len < Int_val(widthSamples) * Int_val(depthSamples))
+    caml_invalid_argument ("dSharedHeightfieldCreate: not enough height samples");
+
+  d = shared_data_alloc(SHARED_HEIGHTFIELD);
+  d->vertices = ocamlode_malloc (MEM_HEIGHTFIELD, len * sizeof(dReal));
+  if (d->vertices == NULL) {
+    free(d);
+    caml_failwith("Out of memory");
+  }
+  for (i=0; i < len; i++)
+    d->vertices[i] = Double_field(pHeightDatav, i);
+  d->bytes = len * sizeof(dReal);
+  d->width = Double_val(width);
+  d->depth = Double_val(depth);
+  d->width_samples = Int_val(widthSamples);
+  d->depth_samples = Int_val(depthSamples);
+  d->scale = Double_val(scale);
+  d->offset = Double_val(offset);
+  d->thickness = Double_val(thickness);
+  d->wrap = Int_val(wrap);
+
+  shared_heightfield_build (d);
+  CAMLreturn (Val_shared_data (d));
+}
+CAMLprim value
+ocamlode_dSharedHeightfieldCreate_bytecode (value * argv, int argn)
+{
+  return ocamlode_dSharedHeightfieldCreate_native (argv[0], argv[1], argv[2],
+                                                   argv[3], argv[4], argv[5], argv[6], argv[7], argv[8]);
+}
+
+CAMLprim value
+ocamlode_dCreateSharedGeom (value parentv, value dv)
+{
+  CAMLparam2 (parentv, dv);
+  struct shared_data *d = shared_data_val(dv);
+  dSpaceID parent;
+  dGeomID g = 0;
+  if (parentv == Val_int (0))	/* None */
     parent = 0;
   else				/* Some parent */
     parent = dSpaceID_val (Field (parentv, 0));
 
-  dTriMeshDataID data_id = dTriMeshDataID_val(idv);
+  if (d == NULL)
+    caml_invalid_argument ("dCreateSharedGeom: released shared data");
 
-  if (Is_block(tri_cb) || Is_block(arr_cb) || Is_block(ray_cb))
-    caml_failwith("dCreateTriMesh: callbacks not yet implemented");
+  switch (d->kind)
+  {
+    case SHARED_TRIMESH:
+      g = dCreateTriMesh (parent, d->trimesh, NULL, NULL, NULL);
+      break;
+    case SHARED_CONVEX:
+      g = dCreateConvex (parent, d->planes, d->planecount,
+                                 d->points, d->pointcount, d->polygons);
+      break;
+    case SHARED_HEIGHTFIELD:
+      g = dCreateHeightfield (parent, d->heightfield, 1);
+      break;
+  }
+  if (!shared_ref_add(g, d)) {
+    dGeomDestroy(g);
+    caml_failwith("Out of memory");
+  }
+  d->refcount++;
+  d->instances++;
+  CAMLreturn (Val_owned (ARENA_GEOM, g, NULL));
+}
 
-  dGeomID id = dCreateTriMesh (parent, data_id,
-               0, 0, 0);
-  /* TODO:     dTriCallback * Callback,
-               dTriArrayCallback * ArrayCallback,
-               dTriRayCallback * RayCallback); */
+CAMLprim value
+ocamlode_dSharedDataRelease (value dv)
+{
+  struct shared_data *d = shared_data_val(dv);
+  if (d == NULL) return Val_unit;
+  destroy_voidptr (dv);
+  shared_data_unref (d);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dSharedDataGetInfo (value dv)
+{
+  CAMLparam1 (dv);
+  CAMLlocal1 (rv);
+  struct shared_data *d = shared_data_val(dv);
+  if (d == NULL)
+    caml_invalid_argument ("dSharedDataGetInfo: released shared data");
+  rv = caml_alloc (2, 0);
+  Store_field (rv, 0, Val_int (d->instances));
+  Store_field (rv, 1, Val_long (d->bytes));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dSharedDataGetTotal (value unit)
+{
+  CAMLparam1 (unit);
+  CAMLlocal1 (rv);
+  rv = caml_alloc (2, 0);
+  Store_field (rv, 0, Val_long (shared_datas_count));
+  Store_field (rv, 1, Val_long (shared_datas_bytes));
+  CAMLreturn (rv);
+}
+
+
+
+/* OCaml integers are unboxed,
+ * here it is set, and get back without convertions
+ */
+CAMLprim value
+ocamlode_dGeomSetData (value geom, value data)
+{
+  dGeomSetData (dGeomID_val (geom), (void*) data);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomGetData (value geom)
+{
+  return ((value) dGeomGetData (dGeomID_val (geom)));
+}
+
+CAMLprim value
+ocamlode_dGeomIsSpace (value geom)
+{
+  return Val_bool (dGeomIsSpace (dGeomID_val (geom)));
+}
+
+CAMLprim value
+ocamlode_dGeomGetSpace (value geom)
+{
+  dSpaceID id = dGeomGetSpace (dGeomID_val (geom));
+  return Val_dSpaceID (id);
+}
+
+CAMLprim value
+ocamlode_dGeomSetCategoryBits (value geom, value bits)
+{
+  dGeomSetCategoryBits (dGeomID_val (geom), Long_val (bits));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomSetCollideBits (value geom, value bits)
+{
+  dGeomSetCollideBits (dGeomID_val (geom), Long_val (bits));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomGetCategoryBits (value geom)
+{
+  return Val_long (dGeomGetCategoryBits (dGeomID_val (geom)));
+}
+
+CAMLprim value
+ocamlode_dGeomGetCollideBits (value geom)
+{
+  return Val_long (dGeomGetCollideBits (dGeomID_val (geom)));
+}
+
+CAMLprim value
+ocamlode_dGeomEnable (value geom)
+{
+  dGeomEnable (dGeomID_val (geom));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomDisable (value geom)
+{
+  dGeomDisable (dGeomID_val (geom));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomIsEnabled (value geom)
+{
+  return Val_bool (dGeomIsEnabled (dGeomID_val (geom)));
+}
+
+CAMLprim value
+ocamlode_dGeomSetOffsetPosition (value geom, value x, value y, value z)
+{
+  dGeomSetOffsetPosition (dGeomID_val (geom), Double_val (x), Double_val (y), Double_val (z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomSetOffsetRotation (value geom, value matrixv)
+{
+  CAMLparam2 (geom, matrixv);
+#if defined(MEM_CPY) // dSINGLE
+  dMatrix3 m;
+  int i;
+  for (i=0; i<12; ++i)
+    m[i] = Double_field(matrixv,i);
+  dGeomSetOffsetRotation (dGeomID_val (geom), m);
+#else // dDOUBLE
+  dGeomSetOffsetRotation (dGeomID_val (geom), (double *) matrixv);
+#endif
+  CAMLreturn (Val_unit);
+}
+
+CAMLprim value
+ocamlode_dGeomSetOffsetQuaternion (value geomv, value Qv)
+{
+  dGeomID geom = dGeomID_val (geomv);
+#if defined(MEM_CPY) // dSINGLE
+  dQuaternion Q;
+  int i;
+  for (i=0; i<4; ++i)
+    Q[i] = Double_field(Qv,i);
+#else // dDOUBLE
+  dReal * Q = (double *) Qv;
+#endif
+  dGeomSetOffsetQuaternion (geom, Q);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomGetOffsetQuaternion (value geom)
+{
+  dQuaternion result;
+  dGeomGetOffsetQuaternion (dGeomID_val (geom), result);
+  return copy_dQuaternion (result);
+}
+
+CAMLprim value
+ocamlode_dGeomSetOffsetWorldPosition (value geomv, value x, value y, value z)
+{
+  dGeomID geom = dGeomID_val (geomv);
+  dGeomSetOffsetWorldPosition (geom, Double_val(x), Double_val(y), Double_val(z));
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomSetOffsetWorldRotation (value geomv, value Rv)
+{
+  dGeomID geom = dGeomID_val (geomv);
+#if defined(MEM_CPY) // dSINGLE
+  dMatrix3 R;
+  int i;
+  for (i=0; i<12; ++i)
+    R[i] = Double_field(Rv,i);
+#else // dDOUBLE
+  dReal * R = (double *) Rv;
+#endif
+  dGeomSetOffsetWorldRotation (geom, R);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomSetOffsetWorldQuaternion (value geomv, value qv)
+{
+  dGeomID geom = dGeomID_val (geomv);
+#if defined(MEM_CPY) // dSINGLE
+  dQuaternion q;
+  int i;
+  for (i=0; i<4; ++i)
+    q[i] = Double_field(qv,i);
+#else // dDOUBLE
+  dReal * q = (double *) qv;
+#endif
+  dGeomSetOffsetWorldQuaternion (geom, q);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dGeomClearOffset (value geom)
+{
+  dGeomClearOffset (dGeomID_val (geom));
+  return Val_unit;
+}
 
-  CAMLreturn (Val_dGeomID (id));
+CAMLprim value
+ocamlode_dGeomIsOffset (value geom)
+{
+  int ret = dGeomIsOffset (dGeomID_val (geom));
+  return Val_bool (ret);
 }
+
 CAMLprim value
-ocamlode_dCreateTriMesh_bytecode (value * argv, int argn)
+ocamlode_dGeomCopyOffsetPosition (value geom)
 {
-    return ocamlode_dCreateTriMesh_native (argv[0], argv[1], argv[2],
-                                           argv[3], argv[4], argv[5]);
+  dVector3 pos;
+  dGeomCopyOffsetPosition (dGeomID_val (geom), pos);
+  return copy_dVector3 (pos);
 }
- 
+
 CAMLprim value
-ocamlode_dGeomTriMeshEnableTC (value geom, value geomclassv, value enable)
+ocamlode_dGeomCopyOffsetRotation (value geom)
 {
-  int geomClass;
-  dGeomClass_val(geomClass, geomclassv);
-  dGeomTriMeshEnableTC (dGeomID_val (geom), geomClass, Bool_val (enable));
-  return Val_unit;
+  CAMLparam1 (geom);
+  dMatrix3 R;
+  dGeomCopyOffsetRotation (dGeomID_val (geom), R);
+  CAMLreturn (copy_dMatrix3 (R));
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshIsTCEnabled (value geom, value geomclassv)
+ocamlode_dGeomGetOffsetPosition (value geom)
 {
-  int geomClass;
-  dGeomClass_val(geomClass, geomclassv);
-  int ret = dGeomTriMeshIsTCEnabled (dGeomID_val (geom), geomClass);
-  return Val_int (ret);
+  const dReal *pos = dGeomGetOffsetPosition (dGeomID_val (geom));
+  return copy_dVector3 (pos);
 }
 
 CAMLprim value
-ocamlode_dGeomTriMeshClearTCCache (value geom)
+ocamlode_dGeomGetOffsetRotation (value geom)
 {
-  dGeomTriMeshClearTCCache (dGeomID_val (geom));
-  return Val_unit;
+  const dReal *rot = dGeomGetOffsetRotation (dGeomID_val (geom));
+  return copy_dMatrix3 (rot);
 }
 
+/* Compound bodies: all the parts are created, their masses are accumulated,
+   and the body is recentered on the total center of mass in one call. */
 
-/* Convex Geom */
+CAMLprim value
+ocamlode_dCreateCompoundBody (value worldv, value parentv, value partsv)
+{
+  CAMLparam3 (worldv, parentv, partsv);
+  CAMLlocal4 (rv, bodyv, geomsv, geomv);
+  dSpaceID parent;
+  dBodyID body;
+  dGeomID *geoms;
+  dMass total, m;
+  dReal cx, cy, cz;
+  int i, n = Wosize_val (partsv);
 
-typedef struct _dConvexDataID {
-  unsigned int planecount;
-  unsigned int pointcount;
-  dReal *planes;
-  dReal *points;
-  unsigned int *polygons;
-} dConvexDataID;
+  if (parentv == Val_int (0))	/* None */
+    parent = 0;
+  else				/* Some parent */
+    parent = dSpaceID_val (Field (parentv, 0));
 
-/*
- * The memory management of convex datas needs to be more tested
- * (until now no bugs found)
- */
+  /* check the shapes before creating anything */
+  for (i = 0; i < n; i++) {
+    value part = Field (partsv, i);
+    value shape = Field (part, 0);
+    if (Double_val (Field (part, 3)) <= 0.0)
+      caml_invalid_argument ("dCreateCompoundBody: density");
+    if (Tag_val (shape) > 3)
+      caml_invalid_argument ("dCreateCompoundBody: shape");
+  }
+  if (n == 0)
+    caml_invalid_argument ("dCreateCompoundBody: no parts");
 
-void finalize_convexdata (value v)
-{
-  dReal *planes, *points;
-  unsigned int *polygs;
-  planes = ((dConvexDataID *) Data_custom_val (v))->planes;
-  points = ((dConvexDataID *) Data_custom_val (v))->points;
-  polygs = ((dConvexDataID *) Data_custom_val (v))->polygons;
-  if (planes != NULL) { free (planes); planes = NULL; }
-  if (points != NULL) { free (points); points = NULL; }
-  if (polygs != NULL) { free (polygs); polygs = NULL; }
-  fflush(stdout);
-}
+  geoms = malloc (n * sizeof (dGeomID));
+  if (geoms == NULL) caml_failwith ("Out of memory");
 
-CAMLprim value
-ocamlode_free_dConvexDataID (value v)
-{
-  finalize_convexdata (v);
-  return Val_unit;
+  body = dBodyCreate (dWorldID_val (worldv));
+  dMassSetZero (&total);
+
+  for (i = 0; i < n; i++)
+  {
+    value part = Field (partsv, i);
+    value shape = Field (part, 0);
+    value posv = Field (part, 1);
+    value rotv = Field (part, 2);
+    dReal density = Double_val (Field (part, 3));
+    dGeomID g = 0;
+
+    switch (Tag_val (shape))
+    {
+      case 0: /* Part_sphere */
+        g = dCreateSphere (parent, Double_val (Field (shape, 0)));
+        dMassSetSphere (&m, density, Double_val (Field (shape, 0)));
+        break;
+      case 1: /* Part_box */
+        g = dCreateBox (parent, Double_val (Field (shape, 0)),
+                                Double_val (Field (shape, 1)),
+                                Double_val (Field (shape, 2)));
+        dMassSetBox (&m, density, Double_val (Field (shape, 0)),
+                                  Double_val (Field (shape, 1)),
+                                  Double_val (Field (shape, 2)));
+        break;
+      case 2: /* Part_capsule, aligned along the z axis */
+        g = dCreateCapsule (parent, Double_val (Field (shape, 0)), Double_val (Field (shape, 1)));
+        dMassSetCapsule (&m, density, 3, Double_val (Field (shape, 0)), Double_val (Field (shape, 1)));
+        break;
+      case 3: /* Part_cylinder, aligned along the z axis */
+        g = dCreateCylinder (parent, Double_val (Field (shape, 0)), Double_val (Field (shape, 1)));
+        dMassSetCylinder (&m, density, 3, Double_val (Field (shape, 0)), Double_val (Field (shape, 1)));
+        break;
+    }
+
+    if (rotv != Val_int (0)) {	/* Some rot */
+#if defined(MEM_CPY) // dSINGLE
+      dMatrix3 R;
+      int j;
+      for (j=0; j<12; ++j)
+        R[j] = Double_field (Field (rotv, 0), j);
+#else // dDOUBLE
+      dReal *R = (double *) Field (rotv, 0);
+#endif
+      dMassRotate (&m, R);
+    }
+    dMassTranslate (&m, Double_field (posv, 0), Double_field (posv, 1), Double_field (posv, 2));
+    dMassAdd (&total, &m);
+
+    dGeomSetBody (g, body);
+    geoms[i] = g;
+  }
+
+  /* ODE needs the center of mass at the origin of the body */
+  cx = total.c[0];
+  cy = total.c[1];
+  cz = total.c[2];
+  dMassTranslate (&total, -cx, -cy, -cz);
+  dBodySetMass (body, &total);
+  dBodySetPosition (body, cx, cy, cz);
+
+  for (i = 0; i < n; i++)
+  {
+    value part = Field (partsv, i);
+    value posv = Field (part, 1);
+    value rotv = Field (part, 2);
+    dGeomSetOffsetPosition (geoms[i], Double_field (posv, 0) - cx,
+                                      Double_field (posv, 1) - cy,
+                                      Double_field (posv, 2) - cz);
+    if (rotv != Val_int (0)) {
+#if defined(MEM_CPY) // dSINGLE
+      dMatrix3 R;
+      int j;
+      for (j=0; j<12; ++j)
+        R[j] = Double_field (Field (rotv, 0), j);
+      dGeomSetOffsetRotation (geoms[i], R);
+#else // dDOUBLE
+      dGeomSetOffsetRotation (geoms[i], (double *) Field (rotv, 0));
+#endif
+    }
+  }
+
+  geomsv = caml_alloc (n, 0);
+  for (i = 0; i < n; i++) {
+    geomv = Val_owned (ARENA_GEOM, geoms[i], NULL);
+    Store_field (geomsv, i, geomv);
+  }
+  free (geoms);
+
+  bodyv = Val_owned (ARENA_BODY, body, dWorldID_val (worldv));
+  rv = caml_alloc (2, 0);
+  Store_field (rv, 0, bodyv);
+  Store_field (rv, 1, geomsv);
+  CAMLreturn (rv);
 }
 
-static struct custom_operations convexdata_custom_ops = {
-  identifier: "ocamlode_dConvexDataID",
-  finalize:  finalize_convexdata,
-  compare:     custom_compare_default,
-  hash:        custom_hash_default,
-  serialize:   custom_serialize_default,
-  deserialize: custom_deserialize_default
+/* }}} */
+/* {{{ Scenes */
+
+/* A scene file contains the parameters of a world, and its spaces, bodies
+   with their mass, geoms with their trimesh, convex and heightfield datas,
+   and joints.  dSceneSave writes the scene reachable from some spaces and
+   bodies, dSceneLoad creates all of it again in one call.
+   The datas are loaded as shared datas, freed with the last geom using them.
+   Only the shared convex and heightfield datas can be saved, ODE doesn't
+   give access to the others; a trimesh which is not shared is saved from
+   its triangles. */
+
+#define SCENE_MAGIC 0x4245444f  /* "ODEB" */
+#define SCENE_VERSION 3
+
+struct scene_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t space_count;
+  uint32_t body_count;
+  uint32_t data_count;
+  uint32_t geom_count;
+  uint32_t joint_count;
+  uint32_t pad;
 };
 
+struct scene_world {
+  struct snapshot_world w;
+  double adis_linear, adis_angular, adis_time;
+  int32_t adis_steps;
+  int32_t adis_flag;
+};
 
-CAMLprim value
-ocamlode_get_dConvexDataID (value planesv, value pointsv, value polygonesv)
-{
-  CAMLparam3 (planesv, pointsv, polygonesv);
-  CAMLlocal1 (v);
+enum { SCENE_SIMPLE_SPACE, SCENE_HASH_SPACE };
 
-  int i;
-  unsigned int _planecount, _pointcount, polyscount;
+struct scene_space {
+  int32_t type;
+  int32_t parent;
+  int32_t cleanup;
+  int32_t minlevel, maxlevel;
+  int32_t pad;
+};
 
-  _planecount = Wosize_val(planesv) / Double_wosize;
-  _pointcount = Wosize_val(pointsv) / Double_wosize;
-  polyscount = Wosize_val(polygonesv);
+struct scene_body {
+  struct snapshot_body state;
+  double mass, c[3], I[12];
+};
 
-  if (polyscount != (_planecount/4) * 5)
-    caml_invalid_argument("dCreateConvex: wrong polygones number");
+struct scene_data {
+  uint32_t kind;    /* enum shared_kind */
+  uint32_t n[3];    /* trimesh: vertices, indices; convex: planes, points, polygons;
+                       heightfield: width samples, depth samples, wrap */
+  double hf[5];     /* heightfield: width, depth, scale, offset, thickness */
+};
 
-  dReal *_planes;
-  dReal *_points;
-  unsigned int *_polygons;
+enum {
+  SCENE_GEOM_ENABLED = 1,
+  SCENE_GEOM_OFFSET  = 2,
+};
 
-  _planes = malloc(_planecount * sizeof(dReal));
-  if (_planes == NULL) {
-    caml_failwith("Out of memory");
+struct scene_geom {
+  int32_t class_;
+  int32_t space;
+  int32_t body;
+  int32_t data;
+  uint32_t flags;
+  uint32_t pad;
+  uint64_t category, collide;
+  double pos[3], R[12];
+  double params[4];
+};
+
+struct scene_joint {
+  int32_t type;
+  int32_t body1, body2;
+  uint32_t flags;
+  int32_t mode, num_axes, rel[3];
+  int32_t groups;
+  double anchor[3];
+  double axis[3][3];
+  double extra[4];  /* distance, or ratio, radiuses and backlash */
+};
+
+/* pointer -> index */
+struct scene_index {
+  void **keys;
+  int *values;
+  unsigned int size, count;
+};
+
+static int
+scene_index_get (struct scene_index *x, void *k)
+{
+  unsigned int h;
+  if (x->count == 0) return -1;
+  for (h = arena_hash(k, x->size); x->keys[h] != NULL; h = (h + 1) & (x->size - 1))
+    if (x->keys[h] == k) return x->values[h];
+  return -1;
+}
+
+static int
+scene_index_add (struct scene_index *x, void *k, int v)
+{
+  unsigned int h, i;
+  if (2 * (x->count + 1) > x->size) {
+    struct scene_index y;
+    y.size = x->size ? 2 * x->size : 256;
+    y.count = x->count;
+    y.keys = calloc(y.size, sizeof(void *));
+    y.values = malloc(y.size * sizeof(int));
+    if (y.keys == NULL || y.values == NULL) {
+      free(y.keys); free(y.values);
+      return 0;
+    }
+    for (i = 0; i < x->size; i++) {
+      if (x->keys[i] == NULL) continue;
+      for (h = arena_hash(x->keys[i], y.size); y.keys[h] != NULL; h = (h + 1) & (y.size - 1));
+      y.keys[h] = x->keys[i];
+      y.values[h] = x->values[i];
+    }
+    free(x->keys); free(x->values);
+    *x = y;
   }
+  for (h = arena_hash(k, x->size); x->keys[h] != NULL; h = (h + 1) & (x->size - 1));
+  x->keys[h] = k;
+  x->values[h] = v;
+  x->count++;
+  return 1;
+}
 
-  _points = malloc(_pointcount * sizeof(dReal));
-  if (_points == NULL) {
-    free (_planes);
-    caml_failwith("Out of memory");
+static int
+scene_grow (void **array, int *size, size_t elt)
+{
+  int n = *size ? 2 * *size : 64;
+  void *a = realloc(*array, n * elt);
+  if (a == NULL) return 0;
+  *array = a;
+  *size = n;
+  return 1;
+}
+
+#define SCENE_PUSH(array, count, size) \
+  ((count) < (size) || scene_grow((void **) &(array), &(size), sizeof *(array)))
+
+struct scene_data_src {
+  enum shared_kind kind;
+  struct shared_data *shared;
+  dGeomID geom;  /* a trimesh geom to take the triangles from */
+};
+
+struct scene {
+  dSpaceID *spaces; int *space_parents; int space_count, space_size, space_parents_size;
+  dBodyID *bodies; int body_count, body_size;
+  dGeomID *geoms; int *geom_spaces; int geom_count, geom_size, geom_spaces_size;
+  dJointID *joints; int joint_count, joint_size;
+  struct scene_data_src *datas; int data_count, data_size;
+  struct scene_index body_index, joint_index, data_index, space_index;
+};
+
+static void
+scene_free (struct scene *sc)
+{
+  free(sc->spaces); free(sc->space_parents);
+  free(sc->bodies);
+  free(sc->geoms); free(sc->geom_spaces);
+  free(sc->joints);
+  free(sc->datas);
+  free(sc->body_index.keys); free(sc->body_index.values);
+  free(sc->joint_index.keys); free(sc->joint_index.values);
+  free(sc->data_index.keys); free(sc->data_index.values);
+  free(sc->space_index.keys); free(sc->space_index.values);
+}
+
+static int
+scene_add_body (struct scene *sc, dBodyID b)
+{
+  if (b == NULL || scene_index_get(&sc->body_index, b) >= 0) return 1;
+  if (!SCENE_PUSH(sc->bodies, sc->body_count, sc->body_size)) return 0;
+  if (!scene_index_add(&sc->body_index, b, sc->body_count)) return 0;
+  sc->bodies[sc->body_count++] = b;
+  return 1;
+}
+
+static int
+scene_add_space (struct scene *sc, dSpaceID s, int parent)
+{
+  int i, n, index;
+  if (scene_index_get(&sc->space_index, s) >= 0) return 1;
+  if (!SCENE_PUSH(sc->spaces, sc->space_count, sc->space_size)) return 0;
+  if (!SCENE_PUSH(sc->space_parents, sc->space_count, sc->space_parents_size)) return 0;
+  if (!scene_index_add(&sc->space_index, s, sc->space_count)) return 0;
+  index = sc->space_count++;
+  sc->spaces[index] = s;
+  sc->space_parents[index] = parent;
+
+  n = dSpaceGetNumGeoms(s);
+  for (i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom(s, i);
+    if (dGeomIsSpace(g)) {
+      if (!scene_add_space(sc, (dSpaceID) g, index)) return 0;
+      continue;
+    }
+    if (!SCENE_PUSH(sc->geoms, sc->geom_count, sc->geom_size)) return 0;
+    if (!SCENE_PUSH(sc->geom_spaces, sc->geom_count, sc->geom_spaces_size)) return 0;
+    sc->geoms[sc->geom_count] = g;
+    sc->geom_spaces[sc->geom_count++] = index;
+    if (!scene_add_body(sc, dGeomGetBody(g))) return 0;
   }
+  return 1;
+}
 
-  _polygons = malloc(polyscount * sizeof(int));
-  if (_polygons == NULL) {
-    free (_planes);
-    free (_points);
-    caml_failwith("Out of memory");
+/* the joints of the bodies, and the bodies they are attached to */
+static int
+scene_add_joints (struct scene *sc)
+{
+  int i, k;
+  for (i = 0; i < sc->body_count; i++) {
+    dBodyID b = sc->bodies[i];
+    int n = dBodyGetNumJoints(b);
+    for (k = 0; k < n; k++) {
+      dJointID j = dBodyGetJoint(b, k);
+      int type = dJointGetType(j);
+      if (type == dJointTypeContact || type == dJointTypeNull ||
+          scene_index_get(&sc->joint_index, j) >= 0)
+        continue;
+      if (!SCENE_PUSH(sc->joints, sc->joint_count, sc->joint_size)) return 0;
+      if (!scene_index_add(&sc->joint_index, j, sc->joint_count)) return 0;
+      sc->joints[sc->joint_count++] = j;
+      if (!scene_add_body(sc, dJointGetBody(j, 0))) return 0;
+      if (!scene_add_body(sc, dJointGetBody(j, 1))) return 0;
+    }
   }
+  return 1;
+}
 
-  if (!_planes || !_points || !_polygons)
-    caml_failwith("dCreateConvex: allocation error");
+/* index of the data of a geom, -1 for the primitives,
+   -2 for the datas which can not be saved */
+static int
+scene_add_data (struct scene *sc, dGeomID g)
+{
+  struct shared_data *d;
+  void *key;
+  int index, klass = dGeomGetClass(g);
+  if (klass != dTriMeshClass && klass != dConvexClass && klass != dHeightfieldClass)
+    return -1;
+  d = shared_ref_find(g);
+  if (d == NULL && klass != dTriMeshClass) return -2;
+  key = (d != NULL) ? (void *) d : (void *) dGeomTriMeshGetTriMeshDataID(g);
+  index = scene_index_get(&sc->data_index, key);
+  if (index >= 0) return index;
+  if (!SCENE_PUSH(sc->datas, sc->data_count, sc->data_size)) return -3;
+  if (!scene_index_add(&sc->data_index, key, sc->data_count)) return -3;
+  sc->datas[sc->data_count].kind = (d != NULL) ? d->kind : SHARED_TRIMESH;
+  sc->datas[sc->data_count].shared = d;
+  sc->datas[sc->data_count].geom = g;
+  return sc->data_count++;
+}
 
-  for (i=0; i<_planecount; ++i) {
-    _planes[i] = Double_field(planesv, i);
-  }
-  for (i=0; i<_pointcount; ++i) {
-    _points[i] = Double_field(pointsv, i);
+static void
+scene_write_reals (FILE *f, const dReal *v, size_t n)
+{
+  double buf[256];
+  size_t i, k;
+  for (i = 0; i < n; i += k) {
+    for (k = 0; k < 256 && i + k < n; k++) buf[k] = v[i + k];
+    fwrite(buf, sizeof(double), k, f);
   }
+}
 
-  for (i=0; i<polyscount; ++i) {
-    _polygons[i] = (unsigned int) (Long_val(Field(polygonesv, i)));
+static void
+scene_write_data (FILE *f, struct scene_data_src *src)
+{
+  struct scene_data sd;
+  struct shared_data *d = src->shared;
+  memset(&sd, 0, sizeof sd);
+  sd.kind = src->kind;
+
+  if (d == NULL) {
+    /* the triangles of the geom, in its own frame */
+    dGeomID g = src->geom;
+    const dReal *p = dGeomGetPosition(g);
+    const dReal *R = dGeomGetRotation(g);
+    int i, k, n = dGeomTriMeshGetTriangleCount(g);
+    sd.n[0] = 3 * n;
+    sd.n[1] = 3 * n;
+    fwrite(&sd, sizeof sd, 1, f);
+    for (i = 0; i < n; i++) {
+      dVector3 v[3];
+      double local[9];
+      dGeomTriMeshGetTriangle(g, i, &v[0], &v[1], &v[2]);
+      for (k = 0; k < 3; k++) {
+        dReal dx = v[k][0] - p[0], dy = v[k][1] - p[1], dz = v[k][2] - p[2];
+        local[3*k]   = R[0] * dx + R[4] * dy + R[8] * dz;
+        local[3*k+1] = R[1] * dx + R[5] * dy + R[9] * dz;
+        local[3*k+2] = R[2] * dx + R[6] * dy + R[10] * dz;
+      }
+      fwrite(local, sizeof(double), 9, f);
+    }
+    for (i = 0; i < 3 * n; i++) {
+      int32_t index = i;
+      fwrite(&index, sizeof index, 1, f);
+    }
+    return;
   }
 
-  dConvexDataID d;
-  d.planecount = _planecount / 4;
-  d.pointcount = _pointcount / 3;
-  d.planes = _planes;
-  d.points = _points;
-  d.polygons = _polygons;
+  switch (d->kind)
+  {
+    case SHARED_TRIMESH:
+      sd.n[0] = d->vertexcount;
+      sd.n[1] = d->indexcount;
+      fwrite(&sd, sizeof sd, 1, f);
+      scene_write_reals(f, d->vertices, 3 * d->vertexcount);
+      fwrite(d->indices, sizeof(int32_t), d->indexcount, f);
+      break;
+    case SHARED_CONVEX:
+      sd.n[0] = d->planecount;
+      sd.n[1] = d->pointcount;
+      sd.n[2] = d->polyscount;
+      fwrite(&sd, sizeof sd, 1, f);
+      scene_write_reals(f, d->planes, 4 * d->planecount);
+      scene_write_reals(f, d->points, 3 * d->pointcount);
+      fwrite(d->polygons, sizeof(uint32_t), d->polyscount, f);
+      break;
+    case SHARED_HEIGHTFIELD:
+      sd.n[0] = d->width_samples;
+      sd.n[1] = d->depth_samples;
+      sd.n[2] = d->wrap;
+      sd.hf[0] = d->width;
+      sd.hf[1] = d->depth;
+      sd.hf[2] = d->scale;
+      sd.hf[3] = d->offset;
+      sd.hf[4] = d->thickness;
+      fwrite(&sd, sizeof sd, 1, f);
+      scene_write_reals(f, d->vertices, (size_t) d->width_samples * d->depth_samples);
+      break;
+  }
+}
 
-  v = caml_alloc_custom (&convexdata_custom_ops, sizeof(dConvexDataID), 0, 1);
-  memcpy (Data_custom_val(v), &d, sizeof(dConvexDataID));
+static void
+scene_save_joint (struct scene *sc, dJointID j, struct scene_joint *sj, double *params)
+{
+  dVector3 v;
+  int i, k;
+  dBodyID b1 = dJointGetBody(j, 0);
+  dBodyID b2 = dJointGetBody(j, 1);
+
+  memset(sj, 0, sizeof *sj);
+  sj->type = dJointGetType(j);
+  sj->body1 = b1 ? scene_index_get(&sc->body_index, b1) : -1;
+  sj->body2 = b2 ? scene_index_get(&sc->body_index, b2) : -1;
+  sj->flags = dJointIsEnabled(j) ? SNAP_JOINT_ENABLED : 0;
+  sj->groups = snapshot_param_groups(j);
+  for (k = 0; k < sj->groups * SNAPSHOT_PARAMS; k++)
+    params[k] = snapshot_get_param(j, joint_param_table[k]);
+
+#define SCENE_GET(getter, dst) \
+  do { getter(j, v); for (i = 0; i < 3; i++) (dst)[i] = v[i]; } while (0)
+
+  switch (sj->type)
+  {
+    case dJointTypeBall:
+      SCENE_GET(dJointGetBallAnchor, sj->anchor);
+      break;
+    case dJointTypeHinge:
+      SCENE_GET(dJointGetHingeAnchor, sj->anchor);
+      SCENE_GET(dJointGetHingeAxis, sj->axis[0]);
+      break;
+    case dJointTypeSlider:
+      SCENE_GET(dJointGetSliderAxis, sj->axis[0]);
+      break;
+    case dJointTypeUniversal:
+      SCENE_GET(dJointGetUniversalAnchor, sj->anchor);
+      SCENE_GET(dJointGetUniversalAxis1, sj->axis[0]);
+      SCENE_GET(dJointGetUniversalAxis2, sj->axis[1]);
+      break;
+    case dJointTypeHinge2:
+      SCENE_GET(dJointGetHinge2Anchor, sj->anchor);
+      SCENE_GET(dJointGetHinge2Axis1, sj->axis[0]);
+      SCENE_GET(dJointGetHinge2Axis2, sj->axis[1]);
+      break;
+    case dJointTypePR:
+      SCENE_GET(dJointGetPRAnchor, sj->anchor);
+      SCENE_GET(dJointGetPRAxis1, sj->axis[0]);
+      SCENE_GET(dJointGetPRAxis2, sj->axis[1]);
+      break;
+    case dJointTypePU:
+      SCENE_GET(dJointGetPUAnchor, sj->anchor);
+      SCENE_GET(dJointGetPUAxis1, sj->axis[0]);
+      SCENE_GET(dJointGetPUAxis2, sj->axis[1]);
+      SCENE_GET(dJointGetPUAxis3, sj->axis[2]);
+      break;
+    case dJointTypePiston:
+      SCENE_GET(dJointGetPistonAnchor, sj->anchor);
+      SCENE_GET(dJointGetPistonAxis, sj->axis[0]);
+      break;
+    case dJointTypeDBall:
+      SCENE_GET(dJointGetDBallAnchor1, sj->anchor);
+      SCENE_GET(dJointGetDBallAnchor2, sj->axis[1]);
+      sj->extra[0] = dJointGetDBallDistance(j);
+      break;
+    case dJointTypeDHinge:
+      SCENE_GET(dJointGetDHingeAnchor1, sj->anchor);
+      SCENE_GET(dJointGetDHingeAxis, sj->axis[0]);
+      SCENE_GET(dJointGetDHingeAnchor2, sj->axis[1]);
+      break;
+    case dJointTypeTransmission:
+      sj->mode = dJointGetTransmissionMode(j);
+      SCENE_GET(dJointGetTransmissionAnchor1, sj->anchor);
+      SCENE_GET(dJointGetTransmissionAxis1, sj->axis[0]);
+      SCENE_GET(dJointGetTransmissionAxis2, sj->axis[1]);
+      SCENE_GET(dJointGetTransmissionAnchor2, sj->axis[2]);
+      sj->extra[0] = dJointGetTransmissionRatio(j);
+      sj->extra[1] = dJointGetTransmissionRadius1(j);
+      sj->extra[2] = dJointGetTransmissionRadius2(j);
+      sj->extra[3] = dJointGetTransmissionBacklash(j);
+      break;
+    case dJointTypeAMotor:
+      sj->mode = dJointGetAMotorMode(j);
+      sj->num_axes = dJointGetAMotorNumAxes(j);
+      for (k = 0; k < sj->num_axes; k++) {
+        sj->rel[k] = dJointGetAMotorAxisRel(j, k);
+        dJointGetAMotorAxis(j, k, v);
+        for (i = 0; i < 3; i++) sj->axis[k][i] = v[i];
+      }
+      break;
+    case dJointTypeLMotor:
+      sj->num_axes = dJointGetLMotorNumAxes(j);
+      for (k = 0; k < sj->num_axes; k++) {
+        dJointGetLMotorAxis(j, k, v);
+        for (i = 0; i < 3; i++) sj->axis[k][i] = v[i];
+      }
+      break;
+    default:  /* fixed, plane2d */
+      break;
+  }
+#undef SCENE_GET
+}
 
-  CAMLreturn (v);
+/* dGeomGetOffsetPosition returns a null offset when there is none */
+static int
+scene_geom_has_offset (dGeomID g)
+{
+  const dReal *p = dGeomGetOffsetPosition(g);
+  const dReal *R = dGeomGetOffsetRotation(g);
+  return (p[0] != 0.0 || p[1] != 0.0 || p[2] != 0.0 ||
+          R[0] != 1.0 || R[5] != 1.0 || R[10] != 1.0 ||
+          R[1] != 0.0 || R[2] != 0.0 || R[4] != 0.0 ||
+          R[6] != 0.0 || R[8] != 0.0 || R[9] != 0.0);
 }
 
 CAMLprim value
-ocamlode_dCreateConvex (value parentv, value convex_data)
+ocamlode_dSceneSave (value filename, value worldv, value spacesv, value bodiesv)
 {
-  CAMLparam2 (parentv, convex_data);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
+  CAMLparam4 (filename, worldv, spacesv, bodiesv);
+  struct scene sc;
+  struct scene_header h;
+  struct scene_world sw;
+  dWorldID world = dWorldID_val(worldv);
+  int i, k, ok = 1, *geom_datas;
+  FILE *f;
 
-  dConvexDataID * d = ((dConvexDataID *) Data_custom_val (convex_data));
+  memset(&sc, 0, sizeof sc);
+  for (i = 0; ok && i < (int) Wosize_val(spacesv); i++)
+    ok = scene_add_space(&sc, dSpaceID_val(Field(spacesv, i)), -1);
+  for (i = 0; ok && i < (int) Wosize_val(bodiesv); i++)
+    ok = scene_add_body(&sc, dBodyID_val(Field(bodiesv, i)));
+  if (ok) ok = scene_add_joints(&sc);
+  geom_datas = ok ? malloc((sc.geom_count + 1) * sizeof(int)) : NULL;
+  if (geom_datas == NULL) {
+    scene_free(&sc);
+    caml_failwith("Out of memory");
+  }
+  for (i = 0; i < sc.geom_count; i++) {
+    int klass = dGeomGetClass(sc.geoms[i]);
+    geom_datas[i] = scene_add_data(&sc, sc.geoms[i]);
+    if (geom_datas[i] < -1 || klass == dGeomTransformClass || klass >= dFirstUserClass) {
+      int oom = (geom_datas[i] == -3);
+      free(geom_datas);
+      scene_free(&sc);
+      if (oom) caml_failwith("Out of memory");
+      caml_invalid_argument("dSceneSave: geom transforms, and convexes or heightfields "
+                            "without a shared data can not be saved");
+    }
+  }
 
-  dGeomID id = dCreateConvex (parent,
-                          d->planes, d->planecount,
-                          d->points, d->pointcount,
-                          d->polygons);
+  f = fopen(String_val(filename), "wb");
+  if (f == NULL) {
+    free(geom_datas);
+    scene_free(&sc);
+    caml_failwith("dSceneSave: can not open the file");
+  }
 
-  CAMLreturn (Val_dGeomID (id));
-}
+  h.magic = SCENE_MAGIC;
+  h.version = SCENE_VERSION;
+  h.space_count = sc.space_count;
+  h.body_count = sc.body_count;
+  h.data_count = sc.data_count;
+  h.geom_count = sc.geom_count;
+  h.joint_count = sc.joint_count;
+  h.pad = 0;
+  fwrite(&h, sizeof h, 1, f);
+
+  snapshot_world_save(world, &sw.w);
+  sw.adis_linear = dWorldGetAutoDisableLinearThreshold(world);
+  sw.adis_angular = dWorldGetAutoDisableAngularThreshold(world);
+  sw.adis_time = dWorldGetAutoDisableTime(world);
+  sw.adis_steps = dWorldGetAutoDisableSteps(world);
+  sw.adis_flag = dWorldGetAutoDisableFlag(world);
+  fwrite(&sw, sizeof sw, 1, f);
+
+  for (i = 0; i < sc.space_count; i++) {
+    struct scene_space ss;
+    int minlevel = 0, maxlevel = 0;
+    memset(&ss, 0, sizeof ss);
+    ss.type = (dGeomGetClass((dGeomID) sc.spaces[i]) == dSimpleSpaceClass)
+            ? SCENE_SIMPLE_SPACE : SCENE_HASH_SPACE;
+    if (dGeomGetClass((dGeomID) sc.spaces[i]) == dHashSpaceClass)
+      dHashSpaceGetLevels(sc.spaces[i], &minlevel, &maxlevel);
+    else {
+      minlevel = -3;
+      maxlevel = 10;
+    }
+    ss.parent = sc.space_parents[i];
+    ss.cleanup = dSpaceGetCleanup(sc.spaces[i]);
+    ss.minlevel = minlevel;
+    ss.maxlevel = maxlevel;
+    fwrite(&ss, sizeof ss, 1, f);
+  }
 
-CAMLprim value
-ocamlode_dGeomSetConvex (value geom, value convex_data)
-{
-  CAMLparam2 (geom, convex_data);
+  for (i = 0; i < sc.body_count; i++) {
+    struct scene_body sb;
+    dMass m;
+    snapshot_body_save(sc.bodies[i], &sb.state);
+    dBodyGetMass(sc.bodies[i], &m);
+    sb.mass = m.mass;
+    for (k = 0; k < 3; k++) sb.c[k] = m.c[k];
+    for (k = 0; k < 12; k++) sb.I[k] = m.I[k];
+    fwrite(&sb, sizeof sb, 1, f);
+  }
 
-  dConvexDataID * d = ((dConvexDataID *) Data_custom_val (convex_data));
+  for (i = 0; i < sc.data_count; i++)
+    scene_write_data(f, &sc.datas[i]);
+
+  for (i = 0; i < sc.geom_count; i++) {
+    dGeomID g = sc.geoms[i];
+    dBodyID b = dGeomGetBody(g);
+    struct scene_geom sg;
+    const dReal *pos = NULL, *R = NULL;
+    memset(&sg, 0, sizeof sg);
+    sg.class_ = dGeomGetClass(g);
+    sg.space = sc.geom_spaces[i];
+    sg.body = b ? scene_index_get(&sc.body_index, b) : -1;
+    sg.data = geom_datas[i];
+    sg.flags = dGeomIsEnabled(g) ? SCENE_GEOM_ENABLED : 0;
+    sg.category = dGeomGetCategoryBits(g);
+    sg.collide = dGeomGetCollideBits(g);
+    if (b != NULL) {
+      if (scene_geom_has_offset(g)) {
+        sg.flags |= SCENE_GEOM_OFFSET;
+        pos = dGeomGetOffsetPosition(g);
+        R = dGeomGetOffsetRotation(g);
+      }
+    } else if (b == NULL && sg.class_ != dPlaneClass) {
+      pos = dGeomGetPosition(g);
+      R = dGeomGetRotation(g);
+    }
+    if (pos != NULL) {
+      for (k = 0; k < 3; k++) sg.pos[k] = pos[k];
+      for (k = 0; k < 12; k++) sg.R[k] = R[k];
+    }
+    switch (sg.class_)
+    {
+      case dSphereClass:
+        sg.params[0] = dGeomSphereGetRadius(g);
+        break;
+      case dBoxClass:
+        {
+          dVector3 l;
+          dGeomBoxGetLengths(g, l);
+          for (k = 0; k < 3; k++) sg.params[k] = l[k];
+        }
+        break;
+      case dCapsuleClass:
+      case dCylinderClass:
+        {
+          dReal r, l;
+          if (sg.class_ == dCapsuleClass) dGeomCapsuleGetParams(g, &r, &l);
+          else dGeomCylinderGetParams(g, &r, &l);
+          sg.params[0] = r;
+          sg.params[1] = l;
+        }
+        break;
+      case dPlaneClass:
+        {
+          dVector4 p;
+          dGeomPlaneGetParams(g, p);
+          for (k = 0; k < 4; k++) sg.params[k] = p[k];
+        }
+        break;
+      case dRayClass:
+        sg.params[0] = dGeomRayGetLength(g);
+        break;
+      default:
+        break;
+    }
+    fwrite(&sg, sizeof sg, 1, f);
+  }
 
-  dGeomSetConvex (dGeomID_val (geom),
-                    d->planes, d->planecount,
-                    d->points, d->pointcount,
-                    d->polygons);
+  for (i = 0; i < sc.joint_count; i++) {
+    struct scene_joint sj;
+    double params[3 * SNAPSHOT_PARAMS];
+    scene_save_joint(&sc, sc.joints[i], &sj, params);
+    fwrite(&sj, sizeof sj, 1, f);
+    fwrite(params, sizeof(double), sj.groups * SNAPSHOT_PARAMS, f);
+  }
+
+  free(geom_datas);
+  scene_free(&sc);
+  ok = !ferror(f);
+  if (fclose(f) != 0) ok = 0;
+  if (!ok) caml_failwith("dSceneSave: write error");
+  CAMLreturn (Val_unit);
+}
+
+/* Loading */
+
+struct scene_reader {
+  const unsigned char *p, *end;
+  int error;
+};
 
-  CAMLreturn (Val_unit);
+static const void *
+scene_read (struct scene_reader *r, size_t size, size_t count)
+{
+  const void *p = r->p;
+  if (r->error || count > (size_t) (r->end - r->p) / size) {
+    r->error = 1;
+    return NULL;
+  }
+  r->p += size * count;
+  return p;
 }
 
-#if 0
-{{{ old version of dCreateConvex 
+static void
+scene_read_reals (dReal *dst, const void *src, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++) {
+    double d;
+    memcpy(&d, (const double *) src + i, sizeof d);
+    dst[i] = d;
+  }
+}
 
-CAMLprim value
-ocamlode_dCreateConvex (value parentv, value planesv, value pointsv, value polygonesv)
+static struct shared_data *
+scene_load_data (struct scene_reader *r)
 {
-  CAMLparam4 (parentv, planesv, pointsv, polygonesv);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
+  struct scene_data sd;
+  struct shared_data *d;
+  const void *a, *b, *c;
+  const void *p = scene_read(r, sizeof sd, 1);
+  if (p == NULL) return NULL;
+  memcpy(&sd, p, sizeof sd);
 
-  int i;
-  unsigned int planecount, pointcount, polyscount;
+  switch (sd.kind)
+  {
+    case SHARED_TRIMESH:
+      a = scene_read(r, 3 * sizeof(double), sd.n[0]);
+      b = scene_read(r, sizeof(int32_t), sd.n[1]);
+      if (r->error) return NULL;
+      d = calloc(1, sizeof(struct shared_data));
+      if (d == NULL) return NULL;
+      d->vertices = ocamlode_malloc(MEM_TRIMESH, (3 * (size_t) sd.n[0] + 1) * sizeof(dReal));
+      d->indices = ocamlode_malloc(MEM_TRIMESH, ((size_t) sd.n[1] + 1) * sizeof(int));
+      if (d->vertices == NULL || d->indices == NULL) break;
+      scene_read_reals(d->vertices, a, 3 * (size_t) sd.n[0]);
+      memcpy(d->indices, b, sd.n[1] * sizeof(int32_t));
+      d->vertexcount = sd.n[0];
+      d->indexcount = sd.n[1];
+      d->bytes = 3 * sd.n[0] * sizeof(dReal) + sd.n[1] * sizeof(int);
+      d->kind = SHARED_TRIMESH;
+      if (!check_trimesh_indices(d->indices, d->indexcount, d->vertexcount)) {
+        r->error = 1;
+        break;
+      }
+      shared_trimesh_build(d);
+      return d;
+    case SHARED_CONVEX:
+      a = scene_read(r, 4 * sizeof(double), sd.n[0]);
+      b = scene_read(r, 3 * sizeof(double), sd.n[1]);
+      c = scene_read(r, sizeof(uint32_t), sd.n[2]);
+      if (r->error) return NULL;
+      d = calloc(1, sizeof(struct shared_data));
+      if (d == NULL) return NULL;
+      d->planes = ocamlode_malloc(MEM_CONVEX, (4 * (size_t) sd.n[0] + 1) * sizeof(dReal));
+      d->points = ocamlode_malloc(MEM_CONVEX, (3 * (size_t) sd.n[1] + 1) * sizeof(dReal));
+      d->polygons = ocamlode_malloc(MEM_CONVEX, ((size_t) sd.n[2] + 1) * sizeof(unsigned int));
+      if (d->planes == NULL || d->points == NULL || d->polygons == NULL) break;
+      scene_read_reals(d->planes, a, 4 * (size_t) sd.n[0]);
+      scene_read_reals(d->points, b, 3 * (size_t) sd.n[1]);
+      memcpy(d->polygons, c, sd.n[2] * sizeof(uint32_t));
+      d->planecount = sd.n[0];
+      d->pointcount = sd.n[1];
+      d->polyscount = sd.n[2];
+      d->bytes = (4 * sd.n[0] + 3 * sd.n[1]) * sizeof(dReal) + sd.n[2] * sizeof(unsigned int);
+      d->kind = SHARED_CONVEX;
+      if (!check_convex_polygons(d->polygons, d->polyscount, d->planecount, d->pointcount)) {
+        r->error = 1;
+        break;
+      }
+      return d;
+    case SHARED_HEIGHTFIELD:
+      if (sd.n[0] < 2 || sd.n[1] < 2) { r->error = 1; return NULL; }
+      a = scene_read(r, sizeof(double) * sd.n[0], sd.n[1]);
+      if (r->error) return NULL;
+      d = calloc(1, sizeof(struct shared_data));
+      if (d == NULL) return NULL;
+      d->vertices = ocamlode_malloc(MEM_HEIGHTFIELD, (size_t) sd.n[0] * sd.n[1] * sizeof(dReal));
+      if (d->vertices == NULL) break;
+      scene_read_reals(d->vertices, a, (size_t) sd.n[0] * sd.n[1]);
+      d->width_samples = sd.n[0];
+      d->depth_samples = sd.n[1];
+      d->wrap = sd.n[2];
+      d->width = sd.hf[0];
+      d->depth = sd.hf[1];
+      d->scale = sd.hf[2];
+      d->offset = sd.hf[3];
+      d->thickness = sd.hf[4];
+      d->bytes = (size_t) sd.n[0] * sd.n[1] * sizeof(dReal);
+      d->kind = SHARED_HEIGHTFIELD;
+      shared_heightfield_build(d);
+      return d;
+    default:
+      r->error = 1;
+      return NULL;
+  }
+  /* allocation or format error */
+  ocamlode_free(d->vertices); ocamlode_free(d->indices);
+  ocamlode_free(d->planes); ocamlode_free(d->points); ocamlode_free(d->polygons);
+  free(d);
+  return NULL;
+}
 
-  planecount = Wosize_val(planesv) / Double_wosize;
-  pointcount = Wosize_val(pointsv) / Double_wosize;
-  polyscount = Wosize_val(polygonesv);
+static void
+scene_load_joint (dJointID j, const struct scene_joint *sj)
+{
+  int k;
+  const double *a = sj->anchor;
+  switch (sj->type)
+  {
+    case dJointTypeBall:
+      dJointSetBallAnchor(j, a[0], a[1], a[2]);
+      break;
+    case dJointTypeHinge:
+      dJointSetHingeAnchor(j, a[0], a[1], a[2]);
+      dJointSetHingeAxis(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      break;
+    case dJointTypeSlider:
+      dJointSetSliderAxis(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      break;
+    case dJointTypeUniversal:
+      dJointSetUniversalAnchor(j, a[0], a[1], a[2]);
+      dJointSetUniversalAxis1(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      dJointSetUniversalAxis2(j, sj->axis[1][0], sj->axis[1][1], sj->axis[1][2]);
+      break;
+    case dJointTypeHinge2:
+      {
+        dVector3 axis1, axis2;
+        for (k = 0; k < 3; k++) {
+          axis1[k] = sj->axis[0][k];
+          axis2[k] = sj->axis[1][k];
+        }
+        dJointSetHinge2Anchor(j, a[0], a[1], a[2]);
+        dJointSetHinge2Axes(j, axis1, axis2);
+      }
+      break;
+    case dJointTypePR:
+      dJointSetPRAnchor(j, a[0], a[1], a[2]);
+      dJointSetPRAxis1(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      dJointSetPRAxis2(j, sj->axis[1][0], sj->axis[1][1], sj->axis[1][2]);
+      break;
+    case dJointTypePU:
+      dJointSetPUAnchor(j, a[0], a[1], a[2]);
+      dJointSetPUAxis1(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      dJointSetPUAxis2(j, sj->axis[1][0], sj->axis[1][1], sj->axis[1][2]);
+      dJointSetPUAxis3(j, sj->axis[2][0], sj->axis[2][1], sj->axis[2][2]);
+      break;
+    case dJointTypePiston:
+      dJointSetPistonAnchor(j, a[0], a[1], a[2]);
+      dJointSetPistonAxis(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      break;
+    case dJointTypeDBall:
+      dJointSetDBallAnchor1(j, a[0], a[1], a[2]);
+      dJointSetDBallAnchor2(j, sj->axis[1][0], sj->axis[1][1], sj->axis[1][2]);
+      dJointSetDBallDistance(j, sj->extra[0]);
+      break;
+    case dJointTypeDHinge:
+      dJointSetDHingeAxis(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      dJointSetDHingeAnchor1(j, a[0], a[1], a[2]);
+      dJointSetDHingeAnchor2(j, sj->axis[1][0], sj->axis[1][1], sj->axis[1][2]);
+      break;
+    case dJointTypeTransmission:
+      dJointSetTransmissionMode(j, sj->mode);
+      if (sj->mode == dTransmissionIntersectingAxes) {
+        dJointSetTransmissionAxis1(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+        dJointSetTransmissionAxis2(j, sj->axis[1][0], sj->axis[1][1], sj->axis[1][2]);
+      }
+      else  /* the axes are parallel */
+        dJointSetTransmissionAxis(j, sj->axis[0][0], sj->axis[0][1], sj->axis[0][2]);
+      dJointSetTransmissionAnchor1(j, a[0], a[1], a[2]);
+      dJointSetTransmissionAnchor2(j, sj->axis[2][0], sj->axis[2][1], sj->axis[2][2]);
+      dJointSetTransmissionRatio(j, sj->extra[0]);
+      dJointSetTransmissionRadius1(j, sj->extra[1]);
+      dJointSetTransmissionRadius2(j, sj->extra[2]);
+      dJointSetTransmissionBacklash(j, sj->extra[3]);
+      break;
+    case dJointTypeFixed:
+      dJointSetFixed(j);
+      break;
+    case dJointTypeAMotor:
+      dJointSetAMotorMode(j, sj->mode);
+      dJointSetAMotorNumAxes(j, sj->num_axes);
+      for (k = 0; k < sj->num_axes && k < 3; k++)
+        dJointSetAMotorAxis(j, k, sj->rel[k], sj->axis[k][0], sj->axis[k][1], sj->axis[k][2]);
+      break;
+    case dJointTypeLMotor:
+      dJointSetLMotorNumAxes(j, sj->num_axes);
+      for (k = 0; k < sj->num_axes && k < 3; k++)
+        dJointSetLMotorAxis(j, k, 0, sj->axis[k][0], sj->axis[k][1], sj->axis[k][2]);
+      break;
+    default:
+      break;
+  }
+}
 
-  if (polyscount != (planecount/4) * 5)
-    caml_invalid_argument("dCreateConvex: wrong polygones number");
+static dJointID
+scene_create_joint (dWorldID world, int type)
+{
+  switch (type)
+  {
+    case dJointTypeBall:      return dJointCreateBall(world, 0);
+    case dJointTypeHinge:     return dJointCreateHinge(world, 0);
+    case dJointTypeSlider:    return dJointCreateSlider(world, 0);
+    case dJointTypeUniversal: return dJointCreateUniversal(world, 0);
+    case dJointTypeHinge2:    return dJointCreateHinge2(world, 0);
+    case dJointTypeFixed:     return dJointCreateFixed(world, 0);
+    case dJointTypeAMotor:    return dJointCreateAMotor(world, 0);
+    case dJointTypeLMotor:    return dJointCreateLMotor(world, 0);
+    case dJointTypePlane2D:   return dJointCreatePlane2D(world, 0);
+    case dJointTypePR:        return dJointCreatePR(world, 0);
+    case dJointTypePU:        return dJointCreatePU(world, 0);
+    case dJointTypePiston:    return dJointCreatePiston(world, 0);
+    case dJointTypeDBall:     return dJointCreateDBall(world, 0);
+    case dJointTypeDHinge:    return dJointCreateDHinge(world, 0);
+    case dJointTypeTransmission: return dJointCreateTransmission(world, 0);
+    default:                  return NULL;
+  }
+}
 
-  dReal *_planes;
-  dReal *_points;
-  unsigned int *_polygons;
+static dGeomID
+scene_create_geom (dSpaceID space, const struct scene_geom *sg, struct shared_data *d)
+{
+  const double *p = sg->params;
+  switch (sg->class_)
+  {
+    case dSphereClass:   return dCreateSphere(space, p[0]);
+    case dBoxClass:      return dCreateBox(space, p[0], p[1], p[2]);
+    case dCapsuleClass:  return dCreateCapsule(space, p[0], p[1]);
+    case dCylinderClass: return dCreateCylinder(space, p[0], p[1]);
+    case dPlaneClass:    return dCreatePlane(space, p[0], p[1], p[2], p[3]);
+    case dRayClass:      return dCreateRay(space, p[0]);
+    case dTriMeshClass:
+      if (d == NULL || d->kind != SHARED_TRIMESH) return NULL;
+      return dCreateTriMesh(space, d->trimesh, NULL, NULL, NULL);
+    case dConvexClass:
+      if (d == NULL || d->kind != SHARED_CONVEX) return NULL;
+      return dCreateConvex(space, d->planes, d->planecount,
+                                  d->points, d->pointcount, d->polygons);
+    case dHeightfieldClass:
+      if (d == NULL || d->kind != SHARED_HEIGHTFIELD) return NULL;
+      return dCreateHeightfield(space, d->heightfield, 1);
+    default:
+      return NULL;
+  }
+}
 
-  _planes = malloc(planecount * sizeof(dReal));
-  _points = malloc(pointcount * sizeof(dReal));
-  _polygons = malloc(polyscount * sizeof(int));
+CAMLprim value
+ocamlode_dSceneLoad (value filename)
+{
+  CAMLparam1 (filename);
+  CAMLlocal5 (rv, spacesv, bodiesv, geomsv, jointsv);
+  struct scene_reader r;
+  struct scene_header h;
+  struct scene_world sw;
+  struct stat st;
+  struct shared_data **datas = NULL;
+  dSpaceID *spaces = NULL;
+  dBodyID *bodies = NULL;
+  dGeomID *geoms = NULL;
+  dJointID *joints = NULL;
+  dWorldID world = NULL;
+  const void *p;
+  void *map;
+  int fd, i, k;
+
+  fd = open(String_val(filename), O_RDONLY);
+  if (fd == -1) caml_failwith("dSceneLoad: can not open the file");
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof h) {
+    close(fd);
+    caml_failwith("dSceneLoad: not a scene file");
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) caml_failwith("dSceneLoad: mmap failed");
+
+  r.p = map;
+  r.end = r.p + st.st_size;
+  r.error = 0;
+  memcpy(&h, scene_read(&r, sizeof h, 1), sizeof h);
+  if (h.magic != SCENE_MAGIC || h.version != SCENE_VERSION ||
+      (size_t) h.space_count + h.body_count + h.data_count + h.geom_count + h.joint_count
+        > (size_t) st.st_size) {
+    munmap(map, st.st_size);
+    caml_failwith("dSceneLoad: not a scene file");
+  }
+  spaces = calloc(h.space_count + 1, sizeof(dSpaceID));
+  bodies = calloc(h.body_count + 1, sizeof(dBodyID));
+  datas = calloc(h.data_count + 1, sizeof(struct shared_data *));
+  geoms = calloc(h.geom_count + 1, sizeof(dGeomID));
+  joints = calloc(h.joint_count + 1, sizeof(dJointID));
+  if (!spaces || !bodies || !datas || !geoms || !joints) {
+    r.error = 2;
+    goto fail;
+  }
 
-  if (!_planes || !_points || !_polygons)
-    caml_failwith("dCreateConvex: allocation error");
+  world = dWorldCreate();
+  if ((p = scene_read(&r, sizeof sw, 1)) == NULL) goto fail;
+  memcpy(&sw, p, sizeof sw);
+  snapshot_world_restore(world, &sw.w);
+  dWorldSetAutoDisableLinearThreshold(world, sw.adis_linear);
+  dWorldSetAutoDisableAngularThreshold(world, sw.adis_angular);
+  dWorldSetAutoDisableTime(world, sw.adis_time);
+  dWorldSetAutoDisableSteps(world, sw.adis_steps);
+  dWorldSetAutoDisableFlag(world, sw.adis_flag);
+
+  for (i = 0; i < (int) h.space_count; i++) {
+    struct scene_space ss;
+    dSpaceID parent;
+    if ((p = scene_read(&r, sizeof ss, 1)) == NULL) goto fail;
+    memcpy(&ss, p, sizeof ss);
+    if (ss.parent >= i) { r.error = 1; goto fail; }
+    parent = (ss.parent >= 0) ? spaces[ss.parent] : NULL;
+    if (ss.type == SCENE_SIMPLE_SPACE)
+      spaces[i] = dSimpleSpaceCreate(parent);
+    else {
+      spaces[i] = dHashSpaceCreate(parent);
+      dHashSpaceSetLevels(spaces[i], ss.minlevel, ss.maxlevel);
+    }
+    dSpaceSetCleanup(spaces[i], ss.cleanup);
+  }
 
-  for (i=0; i<planecount; ++i) {
-    _planes[i] = Double_field(planesv, i);
+  for (i = 0; i < (int) h.body_count; i++) {
+    struct scene_body sb;
+    dMass m;
+    if ((p = scene_read(&r, sizeof sb, 1)) == NULL) goto fail;
+    memcpy(&sb, p, sizeof sb);
+    bodies[i] = dBodyCreate(world);
+    dMassSetZero(&m);
+    m.mass = sb.mass;
+    for (k = 0; k < 3; k++) m.c[k] = sb.c[k];
+    for (k = 0; k < 12; k++) m.I[k] = sb.I[k];
+    if (m.mass > 0.0) dBodySetMass(bodies[i], &m);
+    snapshot_body_restore(bodies[i], &sb.state);
   }
-  for (i=0; i<pointcount; ++i) {
-    _points[i] = Double_field(pointsv, i);
+
+  for (i = 0; i < (int) h.data_count; i++) {
+    datas[i] = scene_load_data(&r);
+    if (datas[i] == NULL) {
+      if (!r.error) r.error = 2;
+      goto fail;
+    }
+    datas[i]->refcount = 1;  /* released at the end of the loading */
+    shared_data_register(datas[i]);
   }
 
-  for (i=0; i<polyscount; ++i) {
-    _polygons[i] = (unsigned int) (Long_val(Field(polygonesv, i)));
+  for (i = 0; i < (int) h.geom_count; i++) {
+    struct scene_geom sg;
+    struct shared_data *d = NULL;
+    dReal R[12];
+    if ((p = scene_read(&r, sizeof sg, 1)) == NULL) goto fail;
+    memcpy(&sg, p, sizeof sg);
+    if (sg.space >= (int) h.space_count || sg.body >= (int) h.body_count ||
+        sg.data >= (int) h.data_count) {
+      r.error = 1;
+      goto fail;
+    }
+    if (sg.data >= 0) d = datas[sg.data];
+    geoms[i] = scene_create_geom((sg.space >= 0) ? spaces[sg.space] : NULL, &sg, d);
+    if (geoms[i] == NULL) { r.error = 1; goto fail; }
+    if (d != NULL) {
+      if (!shared_ref_add(geoms[i], d)) { r.error = 2; goto fail; }
+      d->refcount++;
+      d->instances++;
+    }
+    for (k = 0; k < 12; k++) R[k] = sg.R[k];
+    if (sg.body >= 0) {
+      dGeomSetBody(geoms[i], bodies[sg.body]);
+      if (sg.flags & SCENE_GEOM_OFFSET) {
+        dGeomSetOffsetPosition(geoms[i], sg.pos[0], sg.pos[1], sg.pos[2]);
+        dGeomSetOffsetRotation(geoms[i], R);
+      }
+    } else if (sg.class_ != dPlaneClass) {
+      dGeomSetPosition(geoms[i], sg.pos[0], sg.pos[1], sg.pos[2]);
+      dGeomSetRotation(geoms[i], R);
+    }
+    dGeomSetCategoryBits(geoms[i], sg.category);
+    dGeomSetCollideBits(geoms[i], sg.collide);
+    if (sg.flags & SCENE_GEOM_ENABLED) dGeomEnable(geoms[i]);
+    else dGeomDisable(geoms[i]);
   }
 
-  dGeomID id = dCreateConvex (parent,
-                          _planes, (planecount/4),
-                          _points, (pointcount/3),
-                          _polygons);
+  for (i = 0; i < (int) h.joint_count; i++) {
+    struct scene_joint sj;
+    const double *params;
+    if ((p = scene_read(&r, sizeof sj, 1)) == NULL) goto fail;
+    memcpy(&sj, p, sizeof sj);
+    if (sj.groups < 0 || sj.groups > 3 ||
+        sj.body1 >= (int) h.body_count || sj.body2 >= (int) h.body_count ||
+        (params = scene_read(&r, sizeof(double), sj.groups * SNAPSHOT_PARAMS)) == NULL ||
+        (joints[i] = scene_create_joint(world, sj.type)) == NULL) {
+      r.error = 1;
+      goto fail;
+    }
+    dJointAttach(joints[i], (sj.body1 >= 0) ? bodies[sj.body1] : NULL,
+                            (sj.body2 >= 0) ? bodies[sj.body2] : NULL);
+    scene_load_joint(joints[i], &sj);
+    for (k = 0; k < sj.groups * SNAPSHOT_PARAMS; k++) {
+      double v;
+      memcpy(&v, params + k, sizeof v);
+      snapshot_set_param(joints[i], joint_param_table[k], v);
+    }
+    if (sj.flags & SNAP_JOINT_ENABLED) dJointEnable(joints[i]);
+    else dJointDisable(joints[i]);
+  }
 
-  CAMLreturn (Val_dGeomID (id));
-}
-}}}
-#endif
+  /* the geoms now hold the datas */
+  for (i = 0; i < (int) h.data_count; i++)
+    shared_data_unref(datas[i]);
+  munmap(map, st.st_size);
+
+  spacesv = caml_alloc(h.space_count, 0);
+  for (i = 0; i < (int) h.space_count; i++)
+    Store_field(spacesv, i, Val_owned(ARENA_SPACE, spaces[i], NULL));
+  bodiesv = caml_alloc(h.body_count, 0);
+  for (i = 0; i < (int) h.body_count; i++)
+    Store_field(bodiesv, i, Val_owned(ARENA_BODY, bodies[i], world));
+  geomsv = caml_alloc(h.geom_count, 0);
+  for (i = 0; i < (int) h.geom_count; i++)
+    Store_field(geomsv, i, Val_owned(ARENA_GEOM, geoms[i], NULL));
+  jointsv = caml_alloc(h.joint_count, 0);
+  for (i = 0; i < (int) h.joint_count; i++)
+    Store_field(jointsv, i, Val_joint(joints[i], world, 0));
+  free(spaces); free(bodies); free(datas); free(geoms); free(joints);
+
+  rv = caml_alloc(5, 0);
+  Store_field(rv, 0, Val_dWorldID(world));
+  Store_field(rv, 1, spacesv);
+  Store_field(rv, 2, bodiesv);
+  Store_field(rv, 3, geomsv);
+  Store_field(rv, 4, jointsv);
+  CAMLreturn (rv);
 
-/*
- dGeomID dCreateConvex (dSpaceID space,
-          dReal *_planes, unsigned int _planecount,
-          dReal *_points, unsigned int _pointcount, unsigned int *_polygons);
+fail:
+  /* destroys what was created, the world destroys the bodies and joints */
+  if (geoms != NULL)
+    for (i = 0; i < (int) h.geom_count && geoms[i] != NULL; i++) {
+      shared_geom_destroyed(geoms[i]);
+      dGeomDestroy(geoms[i]);
+    }
+  if (spaces != NULL)
+    for (i = h.space_count - 1; i >= 0; i--)
+      if (spaces[i] != NULL) {
+        dSpaceSetCleanup(spaces[i], 0);
+        dSpaceDestroy(spaces[i]);
+      }
+  if (datas != NULL)
+    for (i = 0; i < (int) h.data_count && datas[i] != NULL; i++)
+      shared_data_unref(datas[i]);
+  if (world != NULL) dWorldDestroy(world);
+  free(spaces); free(bodies); free(datas); free(geoms); free(joints);
+  munmap(map, st.st_size);
+  if (r.error == 2) caml_failwith("Out of memory");
+  caml_failwith("dSceneLoad: corrupted scene file");
+  CAMLreturn (Val_unit);
+}
 
- void dGeomSetConvex (dGeomID g,
-        dReal *_planes, unsigned int _count,
-        dReal *_points, unsigned int _pointcount,unsigned int *_polygons);
-*/
+/* }}} */
+/* {{{ Moved bodies */
+
+/* A moved tracker sets the moved callback of its bodies, ODE calls it for
+   each body moved by a step, the indexes of these bodies are appended once
+   to a buffer until they are read. */
+
+struct moved_tracker {
+  dWorldID world;  /* NULL once the world is destroyed */
+  int body_count;
+  dBodyID *bodies; /* NULL once destroyed */
+  struct scene_index index;  /* body -> index in bodies */
+  unsigned char *flags;      /* already in the buffer */
+  int32_t *moved;
+  int moved_count;
+  struct moved_tracker *next;
+};
 
+static struct moved_tracker *moved_trackers = NULL;
 
-/* Heightfield */
+#define moved_tracker_val(v) Voidptr_val(struct moved_tracker *, (v))
 
-#define dHeightfieldDataID_val(v) ((dHeightfieldDataID)(v))
-#define Val_dHeightfieldDataID(d) ((value)(d))
+static void
+moved_callback (dBodyID b)
+{
+  dWorldID w = dBodyGetWorld (b);
+  struct moved_tracker *t;
+  for (t = moved_trackers; t != NULL; t = t->next) {
+    int i;
+    if (t->world != w) continue;
+    i = scene_index_get (&t->index, b);
+    if (i >= 0 && !t->flags[i]) {
+      t->flags[i] = 1;
+      t->moved[t->moved_count++] = i;
+    }
+  }
+}
 
-CAMLprim value
-ocamlode_dGeomHeightfieldDataCreate(value u)
+static struct moved_tracker *
+moved_tracker_get (value tv, const char *msg)
 {
-  dHeightfieldDataID d = dGeomHeightfieldDataCreate();
-  return Val_dHeightfieldDataID(d);
+  struct moved_tracker *t = moved_tracker_val (tv);
+  if (t == NULL) caml_invalid_argument (msg);
+  return t;
 }
 
-CAMLprim value
-ocamlode_dGeomHeightfieldDataDestroy(value hf_data_id)
+/* a destroyed body is dropped from the trackers, its index stays unused */
+static void
+moved_trackers_body_destroyed (dBodyID b)
 {
-  dGeomHeightfieldDataDestroy( dHeightfieldDataID_val(hf_data_id) );
-  return Val_unit;
+  struct moved_tracker *t;
+  unsigned int h;
+  int i;
+  for (t = moved_trackers; t != NULL; t = t->next) {
+    if (t->index.count == 0) continue;
+    for (h = arena_hash (b, t->index.size); t->index.keys[h] != NULL;
+         h = (h + 1) & (t->index.size - 1)) {
+      if (t->index.keys[h] != b) continue;
+      t->index.values[h] = -1;
+      for (i = 0; i < t->body_count; i++)
+        if (t->bodies[i] == b) t->bodies[i] = NULL;
+      break;
+    }
+  }
 }
 
-CAMLprim value
-ocamlode_dCreateHeightfield(value parentv, value data, value placeable)
+/* the world destroys its bodies, its trackers are unlinked */
+static void
+moved_trackers_world_destroyed (dWorldID w)
 {
-  CAMLparam3 (parentv, data, placeable);
-  dSpaceID parent;
-  if (parentv == Val_int (0))	/* None */
-    parent = 0;
-  else				/* Some parent */
-    parent = dSpaceID_val (Field (parentv, 0));
-
-  dGeomID id = dCreateHeightfield(parent, dHeightfieldDataID_val(data), Int_val(placeable));
-  CAMLreturn (Val_dGeomID (id));
+  struct moved_tracker *t, **tp;
+  int i;
+  for (tp = &moved_trackers; (t = *tp) != NULL; ) {
+    if (t->world == w) {
+      *tp = t->next;
+      t->next = NULL;
+      t->world = NULL;
+      for (i = 0; i < t->body_count; i++) t->bodies[i] = NULL;
+    }
+    else tp = &t->next;
+  }
 }
 
-CAMLprim value
-ocamlode_dGeomHeightfieldDataBuild(
-          value hf_data_id,
-          value pHeightDatav,
-          value width, value depth,
-          value widthSamples, value depthSamples,
-          value scale, value offset, value thickness,
-          value wrap )
+static void
+moved_tracker_free (struct moved_tracker *t)
 {
-  double* pHeightData;
-#if defined(MEM_CPY)
-  int i, len;
-  len = Wosize_val(pHeightDatav) / Double_wosize;
-  pHeightData = malloc( len * sizeof(double));
-  for (i=0; i < len; i++)
-    pHeightData[i] = Double_field(pHeightDatav, i);
-#else
-  pHeightData = (double *) pHeightDatav;
-#endif
-  dGeomHeightfieldDataBuildDouble(
-                  dHeightfieldDataID_val(hf_data_id),
-                  pHeightData,
-                  1, // bCopyHeightData
-                  Double_val(width), Double_val(depth),
-                  Int_val(widthSamples), Int_val(depthSamples),
-                  Double_val(scale), Double_val(offset), Double_val(thickness),
-                  Int_val(wrap) );
-#if defined(MEM_CPY)
-  free(pHeightData);
-#endif
-  return Val_unit;
+  free (t->bodies); free (t->index.keys); free (t->index.values);
+  free (t->flags); free (t->moved); free (t);
 }
+
 CAMLprim value
-ocamlode_dGeomHeightfieldDataBuild_bytecode (value * argv, int argn)
+ocamlode_dMovedTrackerCreate (value worldv, value bodiesv)
 {
-  return ocamlode_dGeomHeightfieldDataBuild (argv[0], argv[1], argv[2],
-                                             argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9]);
-}
-
+  CAMLparam2 (worldv, bodiesv);
+  struct moved_tracker *t;
+  int i;
 
+  t = calloc (1, sizeof (struct moved_tracker));
+  if (t == NULL) caml_failwith ("Out of memory");
+  t->world = dWorldID_val (worldv);
+  t->body_count = Wosize_val (bodiesv);
+  t->bodies = malloc ((t->body_count + 1) * sizeof (dBodyID));
+  t->flags = calloc (t->body_count + 1, 1);
+  t->moved = malloc ((t->body_count + 1) * sizeof (int32_t));
+  if (t->bodies == NULL || t->flags == NULL || t->moved == NULL) {
+    moved_tracker_free (t);
+    caml_failwith ("Out of memory");
+  }
+  for (i = 0; i < t->body_count; i++) {
+    t->bodies[i] = dBodyID_val (Field (bodiesv, i));
+    if (dBodyGetWorld (t->bodies[i]) != t->world) {
+      moved_tracker_free (t);
+      caml_invalid_argument ("dMovedTrackerCreate: the bodies should be in the world");
+    }
+    if (scene_index_get (&t->index, t->bodies[i]) >= 0) continue;
+    if (!scene_index_add (&t->index, t->bodies[i], i)) {
+      moved_tracker_free (t);
+      caml_failwith ("Out of memory");
+    }
+  }
+  for (i = 0; i < t->body_count; i++)
+    dBodySetMovedCallback (t->bodies[i], moved_callback);
+  t->next = moved_trackers;
+  moved_trackers = t;
+  CAMLreturn (Val_voidptr (t));
+}
 
-/* OCaml integers are unboxed,
- * here it is set, and get back without convertions
- */
 CAMLprim value
-ocamlode_dGeomSetData (value geom, value data)
+ocamlode_dMovedTrackerDestroy (value tv)
 {
-  dGeomSetData (dGeomID_val (geom), (void*) data);
+  struct moved_tracker *t = moved_tracker_val (tv);
+  struct moved_tracker **tp, *u;
+  int i;
+  if (t == NULL) return Val_unit;
+  if (t->world != NULL) {
+    for (tp = &moved_trackers; *tp != t; tp = &(*tp)->next);
+    *tp = t->next;
+  }
+  /* the bodies tracked by another tracker keep the callback */
+  for (i = 0; i < t->body_count; i++) {
+    if (t->bodies[i] == NULL) continue;
+    for (u = moved_trackers; u != NULL; u = u->next)
+      if (u->world == t->world && scene_index_get (&u->index, t->bodies[i]) >= 0)
+        break;
+    if (u == NULL) dBodySetMovedCallback (t->bodies[i], NULL);
+  }
+  moved_tracker_free (t);
+  destroy_voidptr (tv);
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomGetData (value geom)
+ocamlode_dMovedTrackerRead (value tv, value ba)
 {
-  return ((value) dGeomGetData (dGeomID_val (geom)));
-}
+  struct moved_tracker *t =
+    moved_tracker_get (tv, "dMovedTrackerRead: the tracker is destroyed");
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  int i, n = t->moved_count;
 
-CAMLprim value
-ocamlode_dGeomIsSpace (value geom)
-{
-  return Val_bool (dGeomIsSpace (dGeomID_val (geom)));
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_INT32 ||
+      b->num_dims != 1 || b->dim[0] < t->body_count)
+    caml_invalid_argument ("dMovedTrackerRead: an int32 bigarray of one element per body is expected");
+  memcpy (b->data, t->moved, n * sizeof (int32_t));
+  for (i = 0; i < n; i++) t->flags[t->moved[i]] = 0;
+  t->moved_count = 0;
+  return Val_int (n);
 }
 
 CAMLprim value
-ocamlode_dGeomGetSpace (value geom)
+ocamlode_dMovedTrackerCount (value tv)
 {
-  dSpaceID id = dGeomGetSpace (dGeomID_val (geom));
-  return Val_dSpaceID (id);
+  return Val_int (moved_tracker_get (tv, "dMovedTrackerCount: the tracker is destroyed")->moved_count);
 }
 
-CAMLprim value
-ocamlode_dGeomSetCategoryBits (value geom, value bits)
-{
-  dGeomSetCategoryBits (dGeomID_val (geom), Long_val (bits));
-  return Val_unit;
-}
+/* }}} */
+/* {{{ Destroyed bodies and joints */
 
-CAMLprim value
-ocamlode_dGeomSetCollideBits (value geom, value bits)
+static void
+trackers_body_destroyed (dBodyID b)
 {
-  dGeomSetCollideBits (dGeomID_val (geom), Long_val (bits));
-  return Val_unit;
+  recorders_body_destroyed (b);
+  interpolators_body_destroyed (b);
+  moved_trackers_body_destroyed (b);
 }
 
-CAMLprim value
-ocamlode_dGeomGetCategoryBits (value geom)
+static void
+trackers_joint_destroyed (dJointID j)
 {
-  return Val_long (dGeomGetCategoryBits (dGeomID_val (geom)));
+  recorders_joint_destroyed (j);
 }
 
-CAMLprim value
-ocamlode_dGeomGetCollideBits (value geom)
+static void
+trackers_world_destroyed (dWorldID w)
 {
-  return Val_long (dGeomGetCollideBits (dGeomID_val (geom)));
+  recorders_world_destroyed (w);
+  interpolators_world_destroyed (w);
+  moved_trackers_world_destroyed (w);
+  feedback_arenas_world_destroyed (w);
 }
 
-CAMLprim value
-ocamlode_dGeomEnable (value geom)
+static void
+trackers_space_destroyed (dSpaceID s)
 {
-  dGeomEnable (dGeomID_val (geom));
-  return Val_unit;
+  terrain_space_destroyed (s);
 }
 
-CAMLprim value
-ocamlode_dGeomDisable (value geom)
+/* }}} */
+/* {{{ Substeps */
+
+/* dWorldSubstep runs the collide / step / empty cycle several times in one
+   call.  The contacts are created natively from a contact table, which
+   gives the surface parameters for each pair of geom materials, or by an
+   OCaml near callback. */
+
+struct contact_table {
+  int materials;
+  int max_contacts;
+  dSurfaceParameters *surfaces;  /* materials * materials */
+  dContact *contacts;            /* max_contacts */
+};
+
+#define contact_table_val(v) Voidptr_val(struct contact_table *, (v))
+
+/* the materials are bounded so that the surface indexes fit in an int */
+#define CONTACT_TABLE_MAX_MATERIALS 4096
+
+static struct contact_table *
+contact_table_get (value tv, const char *msg)
 {
-  dGeomDisable (dGeomID_val (geom));
-  return Val_unit;
+  struct contact_table *t = contact_table_val (tv);
+  if (t == NULL) caml_invalid_argument (msg);
+  return t;
 }
 
 CAMLprim value
-ocamlode_dGeomIsEnabled (value geom)
+ocamlode_dContactTableCreate (value materialsv, value max_contactsv, value surfacev)
 {
-  return Val_bool (dGeomIsEnabled (dGeomID_val (geom)));
+  CAMLparam3 (materialsv, max_contactsv, surfacev);
+  struct contact_table *t;
+  dSurfaceParameters surface;
+  int materials = Int_val (materialsv), max_contacts = Int_val (max_contactsv);
+  size_t i, n;
+
+  if (materials < 1 || materials > CONTACT_TABLE_MAX_MATERIALS ||
+      max_contacts < 1 || max_contacts > 0xffff)
+    caml_invalid_argument ("dContactTableCreate");
+  n = (size_t) materials * (size_t) materials;
+  if (n > SIZE_MAX / sizeof (dSurfaceParameters))
+    caml_failwith ("Out of memory");
+  dSurfaceParameters_val (surfacev, &surface);
+  t = malloc (sizeof (struct contact_table));
+  if (t == NULL) caml_failwith ("Out of memory");
+  t->materials = materials;
+  t->max_contacts = max_contacts;
+  t->surfaces = malloc (n * sizeof (dSurfaceParameters));
+  t->contacts = calloc (max_contacts, sizeof (dContact));
+  if (t->surfaces == NULL || t->contacts == NULL) {
+    free (t->surfaces); free (t->contacts); free (t);
+    caml_failwith ("Out of memory");
+  }
+  for (i = 0; i < n; i++)
+    t->surfaces[i] = surface;
+  CAMLreturn (Val_voidptr (t));
 }
 
 CAMLprim value
-ocamlode_dGeomSetOffsetPosition (value geom, value x, value y, value z)
+ocamlode_dContactTableDestroy (value tv)
 {
-  dGeomSetOffsetPosition (dGeomID_val (geom), Double_val (x), Double_val (y), Double_val (z));
+  struct contact_table *t = contact_table_val (tv);
+  if (t == NULL) return Val_unit;
+  free (t->surfaces);
+  free (t->contacts);
+  free (t);
+  destroy_voidptr (tv);
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomSetOffsetRotation (value geom, value matrixv)
+ocamlode_dContactTableSetSurface (value tv, value m1v, value m2v, value surfacev)
 {
-  CAMLparam2 (geom, matrixv);
-#if defined(MEM_CPY) // dSINGLE
-  dMatrix3 m;
-  int i;
-  for (i=0; i<12; ++i)
-    m[i] = Double_field(matrixv,i);
-  dGeomSetOffsetRotation (dGeomID_val (geom), m);
-#else // dDOUBLE
-  dGeomSetOffsetRotation (dGeomID_val (geom), (double *) matrixv);
-#endif
+  CAMLparam4 (tv, m1v, m2v, surfacev);
+  struct contact_table *t =
+    contact_table_get (tv, "dContactTableSetSurface: the table is destroyed");
+  int m1 = Int_val (m1v), m2 = Int_val (m2v);
+  if (m1 < 0 || m2 < 0 || m1 >= t->materials || m2 >= t->materials)
+    caml_invalid_argument ("dContactTableSetSurface: material out of the table");
+  dSurfaceParameters_val (surfacev, &t->surfaces[m1 * t->materials + m2]);
+  t->surfaces[m2 * t->materials + m1] = t->surfaces[m1 * t->materials + m2];
   CAMLreturn (Val_unit);
 }
 
-CAMLprim value
-ocamlode_dGeomSetOffsetQuaternion (value geomv, value Qv)
-{
-  dGeomID geom = dGeomID_val (geomv);
-#if defined(MEM_CPY) // dSINGLE
-  dQuaternion Q;
-  int i;
-  for (i=0; i<4; ++i)
-    Q[i] = Double_field(Qv,i);
-#else // dDOUBLE
-  dReal * Q = (double *) Qv;
-#endif
-  dGeomSetOffsetQuaternion (geom, Q);
-  return Val_unit;
+struct substep {
+  dWorldID world;
+  dJointGroupID group;
+  struct contact_table *table;
+  long pairs;
+  long contacts;
+  long max_contacts;  /* the most contacts created in a substep */
+  dReal max_depth;
+};
+
+static void
+substep_near (void *data, dGeomID g1, dGeomID g2)
+{
+  struct substep *s = (struct substep *) data;
+  struct contact_table *t = s->table;
+  const dSurfaceParameters *surface;
+  dBodyID b1, b2;
+  int i, n, m1, m2;
+
+  if (dGeomIsSpace (g1) || dGeomIsSpace (g2)) {
+    /* the geoms inside the spaces are collided by substep_collide */
+    dSpaceCollide2 (g1, g2, data, substep_near);
+    return;
+  }
+  b1 = dGeomGetBody (g1);
+  b2 = dGeomGetBody (g2);
+  if (b1 == NULL && b2 == NULL) return;
+  if (b1 != NULL && b2 != NULL && dAreConnectedExcluding (b1, b2, dJointTypeContact))
+    return;
+
+  s->pairs++;
+  n = dCollide (g1, g2, t->max_contacts, &t->contacts[0].geom, sizeof (dContact));
+  if (n == 0) return;
+  m1 = geom_material_get (g1);
+  m2 = geom_material_get (g2);
+  if (m1 >= t->materials) m1 = 0;
+  if (m2 >= t->materials) m2 = 0;
+  surface = &t->surfaces[m1 * t->materials + m2];
+  for (i = 0; i < n; i++) {
+    dJointID j;
+    if (t->contacts[i].geom.depth > s->max_depth)
+      s->max_depth = t->contacts[i].geom.depth;
+    t->contacts[i].surface = *surface;
+    j = dJointCreateContact (s->world, s->group, &t->contacts[i]);
+    dJointAttach (j, b1, b2);
+  }
+  s->contacts += n;
 }
 
-CAMLprim value
-ocamlode_dGeomGetOffsetQuaternion (value geom)
+/* the space, and the spaces it contains */
+static void
+substep_collide (dSpaceID space, struct substep *s)
 {
-  dQuaternion result;
-  dGeomGetOffsetQuaternion (dGeomID_val (geom), result);
-  return copy_dQuaternion (result);
+  int i, n = dSpaceGetNumGeoms (space);
+  dSpaceCollide (space, s, substep_near);
+  for (i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom (space, i);
+    if (dGeomIsSpace (g)) substep_collide ((dSpaceID) g, s);
+  }
 }
 
-CAMLprim value
-ocamlode_dGeomSetOffsetWorldPosition (value geomv, value x, value y, value z)
+/* one collide / step / empty cycle, with the OCaml near callback if near
+   is not NULL */
+static void
+substep_run (struct substep *s, dSpaceID space, value *near, dReal stepsize, int quick)
 {
-  dGeomID geom = dGeomID_val (geomv);
-  dGeomSetOffsetWorldPosition (geom, Double_val(x), Double_val(y), Double_val(z));
-  return Val_unit;
+  long contacts = s->contacts;
+  if (near == NULL)
+    substep_collide (space, s);
+  else
+    dSpaceCollide (space, near, dSpaceCollide_callback);
+  if (s->contacts - contacts > s->max_contacts)
+    s->max_contacts = s->contacts - contacts;
+  if (quick) dWorldQuickStep (s->world, stepsize);
+  else dWorldStep (s->world, stepsize);
+  recorders_step (s->world);
+  joint_group_emptied (s->group, 0);
+  dJointGroupEmpty (s->group);
 }
 
 CAMLprim value
-ocamlode_dGeomSetOffsetWorldRotation (value geomv, value Rv)
+ocamlode_dWorldSubstep_native (value worldv, value spacev, value groupv, value tablev,
+                               value nearv, value substepsv, value stepsizev, value quickv)
 {
-  dGeomID geom = dGeomID_val (geomv);
-#if defined(MEM_CPY) // dSINGLE
-  dMatrix3 R;
-  int i;
-  for (i=0; i<12; ++i)
-    R[i] = Double_field(Rv,i);
-#else // dDOUBLE
-  dReal * R = (double *) Rv;
-#endif
-  dGeomSetOffsetWorldRotation (geom, R);
-  return Val_unit;
+  CAMLparam5 (worldv, spacev, groupv, tablev, nearv);
+  CAMLxparam3 (substepsv, stepsizev, quickv);
+  CAMLlocal2 (near, rv);
+  struct substep s;
+  dSpaceID space = dSpaceID_val (spacev);
+  dReal stepsize = Double_val (stepsizev);
+  int i, substeps = Int_val (substepsv), quick = Bool_val (quickv);
+
+  s.world = dWorldID_val (worldv);
+  s.group = dJointGroupID_val (groupv);
+  s.table = contact_table_get (tablev, "dWorldSubstep: the contact table is destroyed");
+  s.pairs = s.contacts = s.max_contacts = 0;
+  s.max_depth = 0;
+  if (nearv != Val_int (0))	/* Some near callback */
+    near = Field (nearv, 0);
+
+  managed_collect ();
+  for (i = 0; i < substeps; i++)
+    substep_run (&s, space, (nearv == Val_int (0)) ? NULL : &near, stepsize, quick);
+  if (substeps > 0) interpolators_step (s.world);
+
+  rv = caml_alloc (4, 0);
+  Store_field (rv, 0, Val_int (substeps));
+  Store_field (rv, 1, Val_long (s.pairs));
+  Store_field (rv, 2, Val_long (s.contacts));
+  Store_field (rv, 3, Val_long (s.max_contacts));
+  CAMLreturn (rv);
+}
+CAMLprim value
+ocamlode_dWorldSubstep_bytecode (value * argv, int argn)
+{
+  return ocamlode_dWorldSubstep_native (argv[0], argv[1], argv[2], argv[3],
+                                        argv[4], argv[5], argv[6], argv[7]);
+}
+
+/* Adaptive steps.  After each substep the controller measures the deepest
+   contact, the largest travel of a body relative to the size of its geoms
+   (the distance covered during the step divided by the smallest half extent
+   of the geom, plus the angle covered), and the largest separation between
+   the two anchors of a joint.  The next step size is scaled so that the
+   largest of the three ratios to their limits gets close to 1, bounded by
+   a factor 2 per step and by [dt_min, dt_max]. */
+
+struct adaptive {
+  dReal dt_min, dt_max;
+  dReal max_depth, max_travel, max_error;
+  dReal dt;
+};
+
+#define adaptive_val(v) Voidptr_val(struct adaptive *, (v))
+
+static struct adaptive *
+adaptive_get (value av, const char *msg)
+{
+  struct adaptive *a = adaptive_val (av);
+  if (a == NULL) caml_invalid_argument (msg);
+  return a;
 }
 
 CAMLprim value
-ocamlode_dGeomSetOffsetWorldQuaternion (value geomv, value qv)
+ocamlode_dAdaptiveCreate (value dt_minv, value dt_maxv, value max_depthv,
+                          value max_travelv, value max_errorv)
 {
-  dGeomID geom = dGeomID_val (geomv);
-#if defined(MEM_CPY) // dSINGLE
-  dQuaternion q;
-  int i;
-  for (i=0; i<4; ++i)
-    q[i] = Double_field(qv,i);
-#else // dDOUBLE
-  dReal * q = (double *) qv;
-#endif
-  dGeomSetOffsetWorldQuaternion (geom, q);
-  return Val_unit;
+  struct adaptive *a;
+  if (Double_val (dt_minv) <= 0 || Double_val (dt_maxv) < Double_val (dt_minv) ||
+      Double_val (max_depthv) <= 0 || Double_val (max_travelv) <= 0 ||
+      Double_val (max_errorv) <= 0)
+    caml_invalid_argument ("dAdaptiveCreate");
+  a = malloc (sizeof (struct adaptive));
+  if (a == NULL) caml_failwith ("Out of memory");
+  a->dt_min = Double_val (dt_minv);
+  a->dt_max = Double_val (dt_maxv);
+  a->max_depth = Double_val (max_depthv);
+  a->max_travel = Double_val (max_travelv);
+  a->max_error = Double_val (max_errorv);
+  a->dt = a->dt_max;
+  return Val_voidptr (a);
 }
 
 CAMLprim value
-ocamlode_dGeomClearOffset (value geom)
+ocamlode_dAdaptiveDestroy (value av)
 {
-  dGeomClearOffset (dGeomID_val (geom));
+  struct adaptive *a = adaptive_val (av);
+  if (a == NULL) return Val_unit;
+  free (a);
+  destroy_voidptr (av);
   return Val_unit;
 }
 
 CAMLprim value
-ocamlode_dGeomIsOffset (value geom)
+ocamlode_dAdaptiveGetStep (value av)
 {
-  int ret = dGeomIsOffset (dGeomID_val (geom));
-  return Val_bool (ret);
+  return caml_copy_double (adaptive_get (av, "dAdaptiveGetStep: the controller is destroyed")->dt);
 }
 
-CAMLprim value
-ocamlode_dGeomCopyOffsetPosition (value geom)
+static dReal
+joint_anchor_error (dJointID j)
 {
-  dVector3 pos;
-  dGeomCopyOffsetPosition (dGeomID_val (geom), pos);
-  return copy_dVector3 (pos);
+  dVector3 a1, a2;
+  switch (dJointGetType (j))
+  {
+    case dJointTypeBall:
+      dJointGetBallAnchor (j, a1); dJointGetBallAnchor2 (j, a2); break;
+    case dJointTypeHinge:
+      dJointGetHingeAnchor (j, a1); dJointGetHingeAnchor2 (j, a2); break;
+    case dJointTypeUniversal:
+      dJointGetUniversalAnchor (j, a1); dJointGetUniversalAnchor2 (j, a2); break;
+    case dJointTypeHinge2:
+      dJointGetHinge2Anchor (j, a1); dJointGetHinge2Anchor2 (j, a2); break;
+    case dJointTypeDBall:
+      dJointGetDBallAnchor1 (j, a1); dJointGetDBallAnchor2 (j, a2);
+      return fabs (dCalcPointsDistance3 (a1, a2) - dJointGetDBallDistance (j));
+    default:
+      return 0;
+  }
+  return dCalcPointsDistance3 (a1, a2);
 }
 
-CAMLprim value
-ocamlode_dGeomCopyOffsetRotation (value geom)
+struct adaptive_metrics {
+  dReal travel;
+  dReal error;
+};
+
+static void
+adaptive_measure (dSpaceID space, dReal dt, struct adaptive_metrics *m)
+{
+  int i, k, n = dSpaceGetNumGeoms (space);
+  for (i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom (space, i);
+    dBodyID b;
+    dReal aabb[6], h, travel;
+    const dReal *v, *w;
+    if (dGeomIsSpace (g)) {
+      adaptive_measure ((dSpaceID) g, dt, m);
+      continue;
+    }
+    b = dGeomGetBody (g);
+    if (b == NULL || !dBodyIsEnabled (b)) continue;
+    dGeomGetAABB (g, aabb);
+    h = aabb[1] - aabb[0];
+    if (aabb[3] - aabb[2] < h) h = aabb[3] - aabb[2];
+    if (aabb[5] - aabb[4] < h) h = aabb[5] - aabb[4];
+    h *= 0.5;
+    v = dBodyGetLinearVel (b);
+    w = dBodyGetAngularVel (b);
+    travel = dSqrt (v[0]*v[0] + v[1]*v[1] + v[2]*v[2]) * dt;
+    travel = (h > 0) ? travel / h : 0;
+    travel += dSqrt (w[0]*w[0] + w[1]*w[1] + w[2]*w[2]) * dt;
+    if (travel > m->travel) m->travel = travel;
+    for (k = 0; k < dBodyGetNumJoints (b); k++) {
+      dReal e = joint_anchor_error (dBodyGetJoint (b, k));
+      if (e > m->error) m->error = e;
+    }
+  }
+}
+
+/* the step size following a step of size dt with these metrics */
+static dReal
+adaptive_next (struct adaptive *a, dReal dt, dReal depth, const struct adaptive_metrics *m)
 {
-  CAMLparam1 (geom);
-  dMatrix3 R;
-  dGeomCopyOffsetRotation (dGeomID_val (geom), R);
-  CAMLreturn (copy_dMatrix3 (R));
+  dReal r = depth / a->max_depth, scale;
+  if (m->travel / a->max_travel > r) r = m->travel / a->max_travel;
+  if (m->error / a->max_error > r) r = m->error / a->max_error;
+  scale = (r > 0) ? 0.9 / r : 2;
+  if (scale > 2) scale = 2;
+  if (scale < 0.5) scale = 0.5;
+  dt *= scale;
+  if (dt < a->dt_min) dt = a->dt_min;
+  if (dt > a->dt_max) dt = a->dt_max;
+  return dt;
 }
 
 CAMLprim value
-ocamlode_dGeomGetOffsetPosition (value geom)
+ocamlode_dWorldAdaptiveStep_native (value worldv, value spacev, value groupv, value tablev,
+                                    value adaptivev, value framev, value quickv)
 {
-  const dReal *pos = dGeomGetOffsetPosition (dGeomID_val (geom));
-  return copy_dVector3 (pos);
+  CAMLparam5 (worldv, spacev, groupv, tablev, adaptivev);
+  CAMLxparam2 (framev, quickv);
+  CAMLlocal1 (rv);
+  struct substep s;
+  struct adaptive *a = adaptive_get (adaptivev, "dWorldAdaptiveStep: the controller is destroyed");
+  dSpaceID space = dSpaceID_val (spacev);
+  dReal remaining = Double_val (framev);
+  dReal dt_used_min = 0, max_depth = 0, max_travel = 0, max_error = 0;
+  int steps = 0, quick = Bool_val (quickv);
+
+  if (!(remaining >= 0) || !isfinite (remaining))
+    caml_invalid_argument ("dWorldAdaptiveStep: the frame should be finite and non-negative");
+  s.world = dWorldID_val (worldv);
+  s.group = dJointGroupID_val (groupv);
+  s.table = contact_table_get (tablev, "dWorldAdaptiveStep: the contact table is destroyed");
+  s.pairs = s.contacts = s.max_contacts = 0;
+
+  managed_collect ();
+  while (remaining > 0) {
+    struct adaptive_metrics m = { 0, 0 }, n;
+    /* a last step shorter than dt_min is merged with the previous one */
+    dReal dt = (remaining < a->dt + a->dt_min) ? remaining : a->dt;
+    s.max_depth = 0;
+    substep_run (&s, space, NULL, dt, quick);
+    adaptive_measure (space, dt, &m);
+    /* the travel was measured over dt, the controller scales a->dt */
+    n = m;
+    n.travel = m.travel * (a->dt / dt);
+    a->dt = adaptive_next (a, a->dt, s.max_depth, &n);
+    remaining -= dt;
+    if (steps == 0 || dt < dt_used_min) dt_used_min = dt;
+    if (s.max_depth > max_depth) max_depth = s.max_depth;
+    if (m.travel > max_travel) max_travel = m.travel;
+    if (m.error > max_error) max_error = m.error;
+    steps++;
+  }
+  if (steps > 0) interpolators_step (s.world);
+
+  rv = caml_alloc (6, 0);
+  Store_field (rv, 0, Val_int (steps));
+  Store_field (rv, 1, caml_copy_double (dt_used_min));
+  Store_field (rv, 2, caml_copy_double (a->dt));
+  Store_field (rv, 3, caml_copy_double (max_depth));
+  Store_field (rv, 4, caml_copy_double (max_travel));
+  Store_field (rv, 5, caml_copy_double (max_error));
+  CAMLreturn (rv);
 }
-
 CAMLprim value
-ocamlode_dGeomGetOffsetRotation (value geom)
+ocamlode_dWorldAdaptiveStep_bytecode (value * argv, int argn)
 {
-  const dReal *rot = dGeomGetOffsetRotation (dGeomID_val (geom));
-  return copy_dMatrix3 (rot);
+  return ocamlode_dWorldAdaptiveStep_native (argv[0], argv[1], argv[2], argv[3],
+                                             argv[4], argv[5], argv[6]);
 }
 
 /* }}} */
@@ -4098,10 +11133,27 @@ ocamlode_dRFromEulerAngles (value phi, value theta, value psi)
   CAMLreturn (copy_dMatrix3 (m));
 }
 
-/*
- void dRFrom2Axes (dMatrix3 R, dReal ax, dReal ay, dReal az, dReal bx, dReal by, dReal bz);
- void dRFromZAxis (dMatrix3 R, dReal ax, dReal ay, dReal az);
-*/
+CAMLprim value
+ocamlode_dRFrom2Axes_native (value ax, value ay, value az, value bx, value by, value bz)
+{
+  dMatrix3 m;
+  dRFrom2Axes (m, Double_val (ax), Double_val (ay), Double_val (az),
+                  Double_val (bx), Double_val (by), Double_val (bz));
+  return copy_dMatrix3 (m);
+}
+CAMLprim value
+ocamlode_dRFrom2Axes_bytecode (value * argv, int argn)
+{
+  return ocamlode_dRFrom2Axes_native (argv[0], argv[1], argv[2], argv[3], argv[4], argv[5]);
+}
+
+CAMLprim value
+ocamlode_dRFromZAxis (value ax, value ay, value az)
+{
+  dMatrix3 m;
+  dRFromZAxis (m, Double_val (ax), Double_val (ay), Double_val (az));
+  return copy_dMatrix3 (m);
+}
 
 /* }}} */
 /* {{{ Quaternion */
@@ -4128,16 +11180,238 @@ ocamlode_dQFromAxisAndAngle (value ax, value ay, value az, value angle)
   CAMLreturn (rq);
 }
 
-/*
- void dQMultiply0 (dQuaternion qa, const dQuaternion qb, const dQuaternion qc);
- void dQMultiply1 (dQuaternion qa, const dQuaternion qb, const dQuaternion qc);
- void dQMultiply2 (dQuaternion qa, const dQuaternion qb, const dQuaternion qc);
- void dQMultiply3 (dQuaternion qa, const dQuaternion qb, const dQuaternion qc);
-
- void dRfromQ (dMatrix3 R, const dQuaternion q);
- void dQfromR (dQuaternion q, const dMatrix3 R);
- void dDQfromW (dReal dq[4], const dVector3 w, const dQuaternion q);
-*/
+CAMLprim value
+ocamlode_dQMultiply (value opv, value qbv, value qcv)
+{
+  dQuaternion qa, qb, qc;
+  dQuaternion_val (qbv, qb);
+  dQuaternion_val (qcv, qc);
+  switch (Int_val (opv))
+  {
+    case 0: dQMultiply0 (qa, qb, qc); break;
+    case 1: dQMultiply1 (qa, qb, qc); break;
+    case 2: dQMultiply2 (qa, qb, qc); break;
+    case 3: dQMultiply3 (qa, qb, qc); break;
+  }
+  return copy_dQuaternion (qa);
+}
+
+CAMLprim value
+ocamlode_dRfromQ (value qv)
+{
+  dQuaternion q;
+  dMatrix3 r;
+  dQuaternion_val (qv, q);
+  dRfromQ (r, q);
+  return copy_dMatrix3 (r);
+}
+
+CAMLprim value
+ocamlode_dQfromR (value rv)
+{
+  dMatrix3 r;
+  dQuaternion q;
+  dMatrix3_val (rv, r);
+  dQfromR (q, r);
+  return copy_dQuaternion (q);
+}
+
+CAMLprim value
+ocamlode_dDQfromW (value wv, value qv)
+{
+  dVector3 w;
+  dQuaternion q;
+  dReal dq[4];
+  dVector3_val (wv, w);
+  dQuaternion_val (qv, q);
+  dDQfromW (dq, w, q);
+  return copy_dQuaternion (dq);
+}
+
+/* Batched rotations.  The quaternions are stored in float64 bigarrays of
+   dimensions [n; 4], the matrices in [n; 12] (the dMatrix3 layout), and the
+   angular velocities in [n; 3].  The kernels are computed in double on the
+   bigarray data directly, whatever the precision of ODE, with the formulas
+   of ODE's rotation.cpp; no OCaml value is allocated. */
+
+static double *
+rotation_batch (value ba, intnat width, intnat *n, const char *err)
+{
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  if ((b->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT64 ||
+      (b->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT ||
+      b->num_dims != 2 || b->dim[1] != width ||
+      (*n >= 0 && b->dim[0] != *n))
+    caml_invalid_argument (err);
+  *n = b->dim[0];
+  return (double *) b->data;
+}
+
+static inline void
+batch_qmultiply (double *restrict qa, const double *restrict qb,
+                 const double *restrict qc, double sb, double sc)
+{
+  /* sb and sc are -1 to use the conjugate (the inverse) of qb or qc */
+  double b0 = qb[0], b1 = sb * qb[1], b2 = sb * qb[2], b3 = sb * qb[3];
+  double c0 = qc[0], c1 = sc * qc[1], c2 = sc * qc[2], c3 = sc * qc[3];
+  qa[0] = b0*c0 - b1*c1 - b2*c2 - b3*c3;
+  qa[1] = b0*c1 + b1*c0 + b2*c3 - b3*c2;
+  qa[2] = b0*c2 + b2*c0 + b3*c1 - b1*c3;
+  qa[3] = b0*c3 + b3*c0 + b1*c2 - b2*c1;
+}
+
+CAMLprim value
+ocamlode_dQMultiplyBatch (value opv, value qav, value qbv, value qcv)
+{
+  static const char err[] = "dQMultiplyBatch: float64 c_layout bigarrays of dimensions [n; 4] are expected";
+  intnat i, n = -1;
+  int op = Int_val (opv);
+  double *qa = rotation_batch (qav, 4, &n, err);
+  const double *qb = rotation_batch (qbv, 4, &n, err);
+  const double *qc = rotation_batch (qcv, 4, &n, err);
+  double sb = (op & 1) ? -1.0 : 1.0;
+  double sc = (op & 2) ? -1.0 : 1.0;
+  if (qa == qb || qa == qc) {
+    for (i = 0; i < n; i++) {
+      double t[4];
+      batch_qmultiply (t, qb + 4*i, qc + 4*i, sb, sc);
+      memcpy (qa + 4*i, t, sizeof t);
+    }
+  } else
+    for (i = 0; i < n; i++)
+      batch_qmultiply (qa + 4*i, qb + 4*i, qc + 4*i, sb, sc);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dRfromQBatch (value rv, value qv)
+{
+  static const char err[] = "dRfromQBatch: float64 c_layout bigarrays of dimensions [n; 12] and [n; 4] are expected";
+  intnat i, n = -1;
+  double *restrict R = rotation_batch (rv, 12, &n, err);
+  const double *restrict q = rotation_batch (qv, 4, &n, err);
+  for (i = 0; i < n; i++, R += 12, q += 4) {
+    double qq1 = 2*q[1]*q[1], qq2 = 2*q[2]*q[2], qq3 = 2*q[3]*q[3];
+    R[0]  = 1 - qq2 - qq3;
+    R[1]  = 2*(q[1]*q[2] - q[0]*q[3]);
+    R[2]  = 2*(q[1]*q[3] + q[0]*q[2]);
+    R[3]  = 0;
+    R[4]  = 2*(q[1]*q[2] + q[0]*q[3]);
+    R[5]  = 1 - qq1 - qq3;
+    R[6]  = 2*(q[2]*q[3] - q[0]*q[1]);
+    R[7]  = 0;
+    R[8]  = 2*(q[1]*q[3] - q[0]*q[2]);
+    R[9]  = 2*(q[2]*q[3] + q[0]*q[1]);
+    R[10] = 1 - qq1 - qq2;
+    R[11] = 0;
+  }
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dQfromRBatch (value qv, value rv)
+{
+  static const char err[] = "dQfromRBatch: float64 c_layout bigarrays of dimensions [n; 4] and [n; 12] are expected";
+  intnat i, n = -1;
+  double *restrict q = rotation_batch (qv, 4, &n, err);
+  const double *restrict R = rotation_batch (rv, 12, &n, err);
+#define _R(i,j) R[(i)*4+(j)]
+  for (i = 0; i < n; i++, q += 4, R += 12) {
+    double s, tr = _R(0,0) + _R(1,1) + _R(2,2);
+    if (tr >= 0) {
+      s = sqrt (tr + 1);
+      q[0] = 0.5 * s;
+      s = 0.5 / s;
+      q[1] = (_R(2,1) - _R(1,2)) * s;
+      q[2] = (_R(0,2) - _R(2,0)) * s;
+      q[3] = (_R(1,0) - _R(0,1)) * s;
+    }
+    else if (_R(0,0) >= _R(1,1) && _R(0,0) >= _R(2,2)) {
+      s = sqrt ((_R(0,0) - (_R(1,1) + _R(2,2))) + 1);
+      q[1] = 0.5 * s;
+      s = 0.5 / s;
+      q[2] = (_R(0,1) + _R(1,0)) * s;
+      q[3] = (_R(2,0) + _R(0,2)) * s;
+      q[0] = (_R(2,1) - _R(1,2)) * s;
+    }
+    else if (_R(1,1) >= _R(2,2)) {
+      s = sqrt ((_R(1,1) - (_R(2,2) + _R(0,0))) + 1);
+      q[2] = 0.5 * s;
+      s = 0.5 / s;
+      q[3] = (_R(1,2) + _R(2,1)) * s;
+      q[1] = (_R(0,1) + _R(1,0)) * s;
+      q[0] = (_R(0,2) - _R(2,0)) * s;
+    }
+    else {
+      s = sqrt ((_R(2,2) - (_R(0,0) + _R(1,1))) + 1);
+      q[3] = 0.5 * s;
+      s = 0.5 / s;
+      q[1] = (_R(2,0) + _R(0,2)) * s;
+      q[2] = (_R(1,2) + _R(2,1)) * s;
+      q[0] = (_R(1,0) - _R(0,1)) * s;
+    }
+  }
+#undef _R
+  return Val_unit;
+}
+
+/* in place, a null quaternion becomes the identity */
+CAMLprim value
+ocamlode_dQNormalizeBatch (value qv)
+{
+  intnat i, n = -1;
+  double *q = rotation_batch (qv, 4, &n,
+      "dQNormalizeBatch: a float64 c_layout bigarray of dimensions [n; 4] is expected");
+  for (i = 0; i < n; i++, q += 4) {
+    double l = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+    if (l > 0) {
+      l = 1 / sqrt (l);
+      q[0] *= l; q[1] *= l; q[2] *= l; q[3] *= l;
+    } else {
+      q[0] = 1; q[1] = 0; q[2] = 0; q[3] = 0;
+    }
+  }
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dDQfromWBatch (value dqv, value wv, value qv)
+{
+  static const char err[] = "dDQfromWBatch: float64 c_layout bigarrays of dimensions [n; 4], [n; 3] and [n; 4] are expected";
+  intnat i, n = -1;
+  double *dq = rotation_batch (dqv, 4, &n, err);
+  const double *w = rotation_batch (wv, 3, &n, err);
+  const double *q = rotation_batch (qv, 4, &n, err);
+  for (i = 0; i < n; i++, dq += 4, w += 3, q += 4) {
+    double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    dq[0] = 0.5 * (- w[0]*q1 - w[1]*q2 - w[2]*q3);
+    dq[1] = 0.5 * (  w[0]*q0 + w[1]*q3 - w[2]*q2);
+    dq[2] = 0.5 * (- w[0]*q3 + w[1]*q0 + w[2]*q1);
+    dq[3] = 0.5 * (  w[0]*q2 - w[1]*q1 + w[2]*q0);
+  }
+  return Val_unit;
+}
+
+/* q <- normalize (q + dt * dq/dt), the first order integration of ODE */
+CAMLprim value
+ocamlode_dQIntegrateBatch (value qv, value wv, value dtv)
+{
+  static const char err[] = "dQIntegrateBatch: float64 c_layout bigarrays of dimensions [n; 4] and [n; 3] are expected";
+  intnat i, n = -1;
+  double *q = rotation_batch (qv, 4, &n, err);
+  const double *w = rotation_batch (wv, 3, &n, err);
+  double h = 0.5 * Double_val (dtv);
+  for (i = 0; i < n; i++, q += 4, w += 3) {
+    double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], a0, a1, a2, a3, l;
+    a0 = q0 + h * (- w[0]*q1 - w[1]*q2 - w[2]*q3);
+    a1 = q1 + h * (  w[0]*q0 + w[1]*q3 - w[2]*q2);
+    a2 = q2 + h * (- w[0]*q3 + w[1]*q0 + w[2]*q1);
+    a3 = q3 + h * (  w[0]*q2 - w[1]*q1 + w[2]*q0);
+    l = 1 / sqrt (a0*a0 + a1*a1 + a2*a2 + a3*a3);
+    q[0] = a0 * l; q[1] = a1 * l; q[2] = a2 * l; q[3] = a3 * l;
+  }
+  return Val_unit;
+}
 
 /* }}} */
 /* {{{ Misc */
@@ -4200,14 +11474,11 @@ ocamlode_dPlaneSpace (value nv)
 #endif
 }
 
-#if 0
-#include <ode/export-dif.h>
-
 CAMLprim value
 ocamlode_dWorldExportDIF (value worldv, value filenamev, value world_name)
 {
   CAMLparam3 (worldv, filenamev, world_name);
-  char *filename = String_val (filenamev);
+  const char *filename = String_val (filenamev);
   FILE *f;
   int do_close;
 
@@ -4232,7 +11503,6 @@ ocamlode_dWorldExportDIF (value worldv, value filenamev, value world_name)
   }
   CAMLreturn (Val_unit);
 }
-#endif
 
 CAMLprim value
 ocamlode_dSafeNormalize3 (value vecv)
@@ -4274,45 +11544,152 @@ ocamlode_dMaxDifference (value Av, value Bv, value n, value m)
 #endif
 }
 
+/* The matrices have the layout of ODE: the rows of more than one element
+   are padded to a multiple of 4, as in a dMatrix3.  The products are
+   computed in double on the OCaml float arrays, without any copy:
+     0: A (p*r) = B (p*q)  . C (q*r)
+     1: A (p*r) = B' (q*p) . C (q*r)
+     2: A (p*r) = B (p*q)  . C' (r*q) */
+
+#define MULTIPLY_PAD(n) (((n) > 1) ? (((n) + 3) & ~3) : (n))
+
+static void
+multiply_check (int mode, int Alen, int Blen, int Clen, int p, int q, int r)
+{
+  int pskip = MULTIPLY_PAD(p), qskip = MULTIPLY_PAD(q), rskip = MULTIPLY_PAD(r);
+  int Bsize = (mode == 1) ? q * pskip : p * qskip;
+  int Csize = (mode == 2) ? r * qskip : q * rskip;
+  if (p <= 0 || q <= 0 || r <= 0)
+    caml_invalid_argument ("dMultiply: wrong dimensions");
+  if (Alen < p * rskip || Blen < Bsize || Clen < Csize)
+    caml_invalid_argument ("dMultiply: array too small for these dimensions");
+}
+
+static void
+multiply_kernel (int mode, double *A, const double *B, const double *C, int p, int q, int r)
+{
+  int pskip = MULTIPLY_PAD(p), qskip = MULTIPLY_PAD(q), rskip = MULTIPLY_PAD(r);
+  int i, j, k;
+  for (i = 0; i < p; i++) {
+    for (j = 0; j < r; j++) {
+      double s = 0;
+      switch (mode)
+      {
+        case 0: for (k = 0; k < q; k++) s += B[i*qskip + k] * C[k*rskip + j]; break;
+        case 1: for (k = 0; k < q; k++) s += B[k*pskip + i] * C[k*rskip + j]; break;
+        case 2: for (k = 0; k < q; k++) s += B[i*qskip + k] * C[j*qskip + k]; break;
+      }
+      A[i*rskip + j] = s;
+    }
+    for (; j < rskip; j++) A[i*rskip + j] = 0;
+  }
+}
+
 CAMLprim value
 ocamlode_dMultiply0 (value Bv, value Cv, value pv, value qv, value rv)
 {
-  CAMLparam5 (Bv, Cv, pv, qv, rv);
+  CAMLparam2 (Bv, Cv);
   CAMLlocal1 (fv);
-  int p = Int_val(pv); // 3
-  int q = Int_val(qv); // 3
-  int r = Int_val(rv); // 1
-  dReal *A;
-  A = malloc (p*r * sizeof(dReal));
-#if defined(MEM_CPY) // dSINGLE
-  int i, len;
-  dReal *B, *C;
+  int p = Int_val(pv);
+  int q = Int_val(qv);
+  int r = Int_val(rv);
+  multiply_check (0, p * MULTIPLY_PAD(r), Wosize_val(Bv) / Double_wosize,
+                  Wosize_val(Cv) / Double_wosize, p, q, r);
+  fv = caml_alloc (p * MULTIPLY_PAD(r) * Double_wosize, Double_array_tag);
+  multiply_kernel (0, (double *) fv, (double *) Bv, (double *) Cv, p, q, r);
+  CAMLreturn (fv);
+}
 
-  len = Wosize_val(Bv) / Double_wosize;
-  //assert (len == (p*q));
-  B = malloc (len * sizeof(dReal));
-  for (i=0; i < len; ++i)
-  {
-    B[i] = Double_field(Bv,i);
-  }
+/* A must not be B or C */
+CAMLprim value
+ocamlode_dMultiplyInto_native (value modev, value Av, value Bv, value Cv,
+                               value pv, value qv, value rv)
+{
+  int mode = Int_val(modev);
+  int p = Int_val(pv), q = Int_val(qv), r = Int_val(rv);
+  if (Av == Bv || Av == Cv)
+    caml_invalid_argument ("dMultiplyInto: the destination is an operand");
+  multiply_check (mode, Wosize_val(Av) / Double_wosize, Wosize_val(Bv) / Double_wosize,
+                  Wosize_val(Cv) / Double_wosize, p, q, r);
+  multiply_kernel (mode, (double *) Av, (double *) Bv, (double *) Cv, p, q, r);
+  return Val_unit;
+}
+CAMLprim value
+ocamlode_dMultiplyInto_bytecode (value * argv, int argn)
+{
+  return ocamlode_dMultiplyInto_native (argv[0], argv[1], argv[2], argv[3],
+                                        argv[4], argv[5], argv[6]);
+}
 
-  len = Wosize_val(Cv) / Double_wosize;
-  //assert (len == (q*r));
-  C = malloc (len * sizeof(dReal));
-  for (i=0; i < len; ++i)
-  {
-    C[i] = Double_field(Cv,i);
+/* Transforms of vectors stored in bigarrays of dimensions [n; 3], float32
+   or float64, the destination can be the source. */
+
+static void *
+vectors_batch (value ba, int kind, intnat n, const char *err)
+{
+  struct caml_ba_array *b = Caml_ba_array_val (ba);
+  if ((b->flags & CAML_BA_KIND_MASK) != kind ||
+      (b->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT ||
+      b->num_dims != 2 || b->dim[1] != 3 || (n >= 0 && b->dim[0] != n))
+    caml_invalid_argument (err);
+  return b->data;
+}
+
+#define TRANSFORM_LOOP(type) \
+  { \
+    type *d = dst; \
+    const type *s = src; \
+    for (i = 0; i < n; i++, d += 3, s += 3) { \
+      double x = s[0], y = s[1], z = s[2]; \
+      d[0] = R[0]*x + R[1]*y + R[2]*z  + t[0]; \
+      d[1] = R[4]*x + R[5]*y + R[6]*z  + t[1]; \
+      d[2] = R[8]*x + R[9]*y + R[10]*z + t[2]; \
+    } \
   }
 
-  dMultiply0 (A, B, C, p, q, r);
-  free (B);
-  free (C);
-#else // dDOUBLE
-  dMultiply0 (A, (double *)Bv, (double *)Cv, p, q, r);
-#endif
-  fv = copy_dReal_array (A, p*r);
-  free (A);
-  CAMLreturn (fv);
+static void
+transform_batch (value dstv, value srcv, const double *R, const double *t)
+{
+  static const char err[] = "dTransformBatch: float32 or float64 c_layout bigarrays of dimensions [n; 3] are expected";
+  struct caml_ba_array *b = Caml_ba_array_val (srcv);
+  int kind = b->flags & CAML_BA_KIND_MASK;
+  intnat i, n = b->dim[0];
+  void *src, *dst;
+  if (kind != CAML_BA_FLOAT32 && kind != CAML_BA_FLOAT64)
+    caml_invalid_argument (err);
+  src = vectors_batch (srcv, kind, -1, err);
+  dst = vectors_batch (dstv, kind, n, err);
+  if (kind == CAML_BA_FLOAT64)
+    TRANSFORM_LOOP(double)
+  else
+    TRANSFORM_LOOP(float)
+}
+
+/* dst = R . src + pos, with R a dMatrix3 */
+CAMLprim value
+ocamlode_dTransformBatch (value dstv, value Rv, value posv, value srcv)
+{
+  double R[12], t[4] = { 0, 0, 0, 0 };
+  memcpy (R, (double *) Rv, sizeof R);
+  if (posv != Val_int (0))	/* Some pos */
+    memcpy (t, (double *) Field (posv, 0), sizeof t);
+  transform_batch (dstv, srcv, R, t);
+  return Val_unit;
+}
+
+/* from the body frame to the world frame */
+CAMLprim value
+ocamlode_dBodyTransformBatch (value bodyv, value dstv, value srcv)
+{
+  dBodyID b = dBodyID_val (bodyv);
+  const dReal *p = dBodyGetPosition (b);
+  const dReal *r = dBodyGetRotation (b);
+  double R[12], t[3];
+  int i;
+  for (i = 0; i < 12; i++) R[i] = r[i];
+  for (i = 0; i < 3; i++) t[i] = p[i];
+  transform_batch (dstv, srcv, R, t);
+  return Val_unit;
 }
 
 CAMLprim value
@@ -4325,6 +11702,47 @@ ocamlode_memory_share (value unit)
 #endif
 }
 
+CAMLprim value
+ocamlode_dMemoryTrackingEnable (value unit)
+{
+  dSetAllocHandler (mem_ode_alloc);
+  dSetReallocHandler (mem_ode_realloc);
+  dSetFreeHandler (mem_ode_free);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dMemoryTrackingDisable (value unit)
+{
+  dSetAllocHandler (NULL);
+  dSetReallocHandler (NULL);
+  dSetFreeHandler (NULL);
+  return Val_unit;
+}
+
+CAMLprim value
+ocamlode_dMemoryGetStats (value category)
+{
+  CAMLparam1 (category);
+  CAMLlocal1 (rv);
+  struct mem_stats *s = &mem_stats[Int_val (category)];
+  rv = caml_alloc (4, 0);
+  Store_field (rv, 0, Val_long (s->live_bytes));
+  Store_field (rv, 1, Val_long (s->peak_bytes));
+  Store_field (rv, 2, Val_long (s->live_count));
+  Store_field (rv, 3, Val_long (s->total_count));
+  CAMLreturn (rv);
+}
+
+CAMLprim value
+ocamlode_dMemoryResetPeaks (value unit)
+{
+  int i;
+  for (i = 0; i < MEM_CATEGORIES; i++)
+    mem_stats[i].peak_bytes = mem_stats[i].live_bytes;
+  return Val_unit;
+}
+
 /* }}} */
 
 /* {{{ List of functions not wrapped yet 
@@ -4593,14 +12011,6 @@ typedef int dTriRayCallback(dGeomID TriMesh, dGeomID Ray, int TriangleIndex, dRe
 struct dxHeightfieldData;
 typedef struct dxHeightfieldData* dHeightfieldDataID;
 
-typedef dReal dHeightfieldGetHeight( void* p_user_data, int x, int z );
-
-
- void dGeomHeightfieldDataBuildCallback( dHeightfieldDataID d,
-    void* pUserData, dHeightfieldGetHeight* pCallback,
-    dReal width, dReal depth, int widthSamples, int depthSamples,
-    dReal scale, dReal offset, dReal thickness, int bWrap );
-
 
  void dGeomHeightfieldDataBuildByte( dHeightfieldDataID d,
     const unsigned char* pHeightData, int bCopyHeightData,
@@ -4623,9 +12033,6 @@ typedef dReal dHeightfieldGetHeight( void* p_user_data, int x, int z );
     dReal scale, dReal offset, dReal thickness, int bWrap );
 
 
- void dGeomHeightfieldDataSetBounds( dHeightfieldDataID d,
-    dReal minHeight, dReal maxHeight );
-
  void dGeomHeightfieldSetHeightfieldData( dGeomID g, dHeightfieldDataID d );
 
  dHeightfieldDataID dGeomHeightfieldGetHeightfieldData( dGeomID g );